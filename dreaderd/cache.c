@@ -20,6 +20,8 @@ Prototype void CreateCache(Connection *conn);
 Prototype void AbortCache(int fd, const char *msgid, int closefd);
 Prototype void CommitCache(Connection *conn, int closefd);
 Prototype void DumpArticleFromCache(Connection *conn, const char *map, int size, int grpIter, artno_t endNo);
+Prototype int SendArticleFromCache(Connection *conn, int cfd, const char *map, int size, int grpIter, artno_t endNo);
+Prototype int ZeroCopyOk(Connection *conn);
 
 Prototype void OpenCacheHits(void);
 
@@ -417,6 +419,79 @@ DumpArticleFromCache(Connection *conn, const char *map, int size, int grpIter, a
     }
 }
 
+/*
+ * ZEROCOPYOK() -	 return 1 if the article data for the current
+ *			 command can go to the client exactly as stored,
+ *			 i.e. ARTICLE or BODY with no virtual server
+ *			 header rewriting and no compression.
+ */
+
+int
+ZeroCopyOk(Connection *conn)
+{
+    Vserver *vs = conn->co_Auth.dr_VServerDef;
+
+    if (!USE_SENDFILE || !DOpts.ReaderZeroCopy || conn->co_ZStream != NULL)
+	return(0);
+    if (vs && vs->vs_ClusterName[0] &&
+			(!vs->vs_NoReadPath || !vs->vs_NoXrefHostUpdate))
+	return(0);
+    switch(conn->co_ArtMode) {
+    case COM_ARTICLE:
+    case COM_BODY:
+    case COM_BODYWVF:
+    case COM_BODYNOSTAT:
+	return(1);
+    }
+    return(0);
+}
+
+/*
+ * SENDARTICLEFROMCACHE() - zero-copy version of DumpArticleFromCache().
+ *			    Queues the article (or its body) as a file
+ *			    segment on the transmit buffer.  Returns 0
+ *			    if the article has to go through
+ *			    DumpArticleFromCache() instead.
+ */
+
+int
+SendArticleFromCache(Connection *conn, int cfd, const char *map, int size, int grpIter, artno_t endNo)
+{
+    int b = 0;
+    int fd;
+
+    if (!ZeroCopyOk(conn) || size <= 0 || map[size-1] != '\n')
+	return(0);
+
+    if (conn->co_ArtMode != COM_ARTICLE) {
+	/*
+	 * skip the headers, up to and including the blank line
+	 */
+	while (b < size) {
+	    int i;
+
+	    for (i = b; i < size && map[i] != '\n'; ++i)
+		;
+	    ++i;
+	    if (i == b + 2 && map[b] == '\r') {
+		b = i;
+		break;
+	    }
+	    b = i;
+	}
+    }
+    if (b < size) {
+	if ((fd = dup(cfd)) < 0)
+	    return(0);
+	MBSendFile(&conn->co_TMBuf, fd, b, size - b);
+    }
+
+    if (CacheHits) {
+	UpdateCacheHits(conn->co_GroupName, grpIter, endNo, 1); 
+    }
+    return(1);
+}
+
 struct CacheHitEntry*
 FindCacheHitEntry(struct CacheHash_t *ch) {
     uint32 *i=NULL;
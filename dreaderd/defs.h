@@ -9,6 +9,14 @@
 #define DRHSIZE		256
 #define DRHMASK		(DRHSIZE-1)
 
+/*
+ * dreaderd.status: the master has the first RT_MASTERSLOTS lines,
+ * connection counts and then the cache counters, the reader threads
+ * follow.
+ */
+
+#define RT_MASTERSLOTS	2
+
 /*
  * MSG_ flags that may not be implemented on a particular OS
  */
@@ -33,6 +41,7 @@ struct Timer;
 #define THREAD_SPOOL	7	/* spool connection		*/
 #define THREAD_POST	8	/* outgoing post		*/
 #define THREAD_FEEDER	9	/* feeder thread		*/
+#define THREAD_DFA	10	/* DFA io_uring completions	*/
 
 #define OVERVIEW_FMT	"Subject:\r\nFrom:\r\nDate:\r\nMessage-ID:\r\nReferences:\r\nBytes:\r\nLines:\r\nXref:full\r\n"
 #define DEFMAXARTSINGROUP		1024
@@ -57,6 +66,23 @@ struct Timer;
 typedef struct sockaddr sockaddr_storage;
 #endif
 
+/*
+ * FdSet - descriptor set for the thread select core (see thread.c).
+ *	   Unlike fd_set it grows on demand and is not limited to
+ *	   FD_SETSIZE.
+ */
+
+typedef struct FdSet {
+    unsigned long *fs_Bits;
+    int		fs_Size;	/* descriptors covered	*/
+} FdSet;
+
+#define FDS_NBITS		((int)sizeof(unsigned long) * 8)
+#define FDS_ISSET(fd, set)	((fd) < (set)->fs_Size && \
+	((set)->fs_Bits[(fd) / FDS_NBITS] & (1UL << ((fd) % FDS_NBITS))))
+#define FDS_SET(fd, set)	FdsSet(fd, set)
+#define FDS_CLR(fd, set)	FdsClr(fd, set)
+
 /*
  * ForkDesc - structure used to manage descriptors for select() threads
  */
@@ -329,6 +355,8 @@ typedef struct MBuf {
     int		mb_NLScan;	/* newline scan index 		*/
     int		mb_Size;
     int		mb_Max;
+    int		mb_FileFd;	/* file segment (mb_Buf NULL)	*/
+    off_t	mb_FileOff;	/* file offset of index 0	*/
 } MBuf;
 
 typedef struct MBufHead {
@@ -346,7 +374,7 @@ typedef struct MBufHead {
 } MBufHead;
 
 /*
- * Timer
+ * Timer (see the timing wheel in thread.c)
  */
 
 typedef struct Timer {
@@ -356,6 +384,8 @@ typedef struct Timer {
     struct timeval ti_To;	/* requested timeout		*/
     struct timeval ti_Tv;	/* absolute time of timeout	*/
     int		ti_Flags;
+    uint32	ti_Tick;	/* timeout in wheel ticks (ms)	*/
+    int		ti_Slot;	/* wheel slot			*/
 } Timer;
 
 #define TIF_READ	0x01
@@ -384,26 +414,22 @@ typedef struct TimeRestrict {
 #define BLOCK_ERROR	1
 #define BLOCK_END	2
 
-#ifdef __linux__
-#define USE_AIO		0
-#define USE_LINUX_KAIO	0
-#else
-#define USE_AIO		0
-#endif
+#define DFA_BUFSIZE	65536	/* one spool read per article, mostly */
 
 typedef struct DirectFileAccess {
-#if USE_AIO
-    struct aiocb *dfa_AIOcb;
-    int		lock;
-#else
     int		dfa_Fd;
+#if USE_IO_URING
+    off_t	dfa_Off;	/* file offset of the next block */
+    struct Connection *dfa_Conn; /* NULL once DelDFA()'d	*/
+    int		dfa_Busy;	/* read in progress on the ring	*/
 #endif
     int		dfa_Size;
-    char	dfa_Buffer[4096];
+    char	dfa_Buffer[DFA_BUFSIZE];
     char	dfa_Field[MAX_HDR_CC];
     char	dfa_InHdr;
     char	dfa_LF;
     char	dfa_Flag;
+    char	dfa_Wire;	/* stored CRLF and dot escaped	*/
     struct DirectFileAccess *dfa_Next;
 } DirectFileAccess;
 
@@ -454,6 +480,7 @@ typedef struct Connection {
     int		co_ListCacheMode;
     struct activeCacheEnt *co_ListCachePtr;
     struct GroupList *co_ListCacheGroups;
+    int		co_ListRender;	/* LC_* buffer for ACMODE_RENDER	*/
     int		co_ArtMode;	/* current article mode		*/
     artno_t	co_ArtNo;	/* current article number	*/
     artno_t	co_ArtBeg;
@@ -628,6 +655,7 @@ typedef struct OverData {
     int		od_HMapPos;
     int		od_HMapBytes;
     const char *od_HMapBase;
+    int		od_ColFd[OVERCOL_COUNT]; /* appending, -1 not open, -2 unusable */
 } OverData;
 
 typedef struct OverInfo {
@@ -644,8 +672,56 @@ typedef struct OverInfo {
     int		ov_endNo;
     int		ov_DataEntryMask;
     int		ov_LimitSecs;	/* don't show entries older than this	*/
+    int		ov_Shared;	/* OverCache slot or -1			*/
+    uint32	ov_LastUse;
+    int		ov_ColNo;	/* column block read (GetOverColumn())	*/
+    artno_t	ov_ColBase;
+    int		ov_ColFd;	/* -1 if the block has no column file	*/
+    OverColBuf	ov_ColBuf;
+    int		*ov_ColIdx;	/* entry offset by artno - ov_ColBase	*/
+    int		ov_ColScan;	/* ov_ColBuf indexed up to		*/
+    artno_t	ov_ColMax;	/* highest article number indexed	*/
 } OverInfo;
 
+/*
+ * What a fork found when it set up a group's OverInfo, shared with the
+ * other forks (overcache.c)
+ */
+
+typedef struct OverCacheEnt {
+    hash_t	oc_Hv;
+    time_t	oc_Time;	/* when entered				*/
+    artno_t	oc_EndNo;
+    dev_t	oc_Dev;		/* of the over.* file			*/
+    ino_t	oc_Ino;
+    int		oc_Iter;
+    int		oc_LimitSecs;
+    int		oc_HeadSize;
+    int		oc_DataEntries;
+    char	oc_Group[128];
+} OverCacheEnt;
+
+#define OC_HIT		0	/* found in the fork's own cache	*/
+#define OC_SHARED	1	/* set up from the shared table		*/
+#define OC_MISS		2	/* set up from scratch			*/
+#define OC_EVICT	3	/* dropped from a fork's cache		*/
+#define OC_REPLACED	4	/* shared entry replaced		*/
+#define OC_NSUMS	5	/* counters above are summed, below max	*/
+#define OC_NCOUNTS	5
+
+/*
+ * One header line of an overview record, folded continuation lines
+ * included (overscan.c)
+ */
+
+typedef struct OverLine {
+    const char	*ol_Line;
+    int		ol_Len;		/* including the \r\n			*/
+    int		ol_NameLen;	/* up to the colon, or ol_Len		*/
+} OverLine;
+
+#define OVER_MAXLINES	64	/* indexed on the stack, more allocated	*/
+
 typedef struct ArtNumAss {
     struct ArtNumAss *an_Next;
     const char	     *an_GroupName;	/* NOT TERMINATED	*/
@@ -668,6 +744,16 @@ typedef struct activeCacheEnt {
 #define	ACMODE_NONE	0
 #define	ACMODE_READ	1
 #define	ACMODE_WRITE	2
+#define	ACMODE_RENDER	3	/* sending a pre-rendered response	*/
+
+/*
+ * Pre-rendered LIST responses (listcache.c), one per article numbering
+ * mode for LIST ACTIVE
+ */
+
+#define	LC_ACTIVE	0	/* + co_Numbering			*/
+#define	LC_NEWSGROUPS	3
+#define	LC_NBUFS	4
 
 /*
  * This structure is to share info between the master process and
@@ -1,4 +1,3 @@
-
 /*
  * DFA.C      - Direct File Access to articles
  *
@@ -6,40 +5,56 @@
  *    the COPYRIGHT file in the base directory of this distribution 
  *    for specific rights granted.
  *
+ *	Where USE_IO_URING is set the spool reads are not done inline.
+ *	Each DFA queues its next block on a per-process io_uring, the
+ *	reader loop submits everything queued in one go before it
+ *	sleeps (DFARingFlush()) and the ring descriptor, a THREAD_DFA
+ *	thread, wakes it up when reads complete (DFARingReap()).  A
+ *	slow spool disk then only delays the articles that are on it.
+ *	If the ring cannot be set up the reads are done inline as
+ *	before.
  */
 
 #include "defs.h"
 
-#if USE_AIO
-    #if USE_LINUX_KAIO
-      #include <linux/aio.h>
-    #else
-      #include <aio.h>
-    #endif
-#include <signal.h>
+#if USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
 #endif
 
 Prototype DirectFileAccess* NewDFA(Connection *conn, int lf, int offset, int size);
 Prototype void DelDFA(Connection *conn);
 Prototype void NNSendLocalArticle(Connection *conn);
+Prototype int DFASendFile(Connection *conn, int lf, int offset, int size);
 
 int NNCopyLocalArticle(Connection *conn, int rs);
 void DFADataWrite(ServReq *sreq, const void *data, int len);
 void NNSLA_Loop(Connection *conn);
-
-#if USE_AIO
-Prototype void AIOBlockSignal(void);
-Prototype void AIOUnblockSignal(void);
-
-int AIOBlockedSignal = 0;
-
-void AIORDataRead(Connection *conn);
-void Sig_AIO(int signo, siginfo_t *info, void *context);
-
-struct sigaction* sig_aio = NULL;
-
-#define AIOSIG        SIGUSR1
-
+int NNSLA_Block(Connection *conn, int rs);
+
+#if USE_IO_URING
+Prototype void DFARingFlush(void);
+Prototype void DFARingReap(void);
+
+#define DFA_RING_ENTRIES	64
+
+int DFARingSetup(void);
+int DFARingQueue(DirectFileAccess *dfa);
+
+int RingFd = -1;		/* -1 not set up yet, -2 unavailable */
+unsigned int RingPending;	/* queued, not yet submitted	*/
+unsigned int RingInFlight;	/* submitted, not yet reaped	*/
+unsigned int RingCqEntries;
+unsigned int *SqHead;
+unsigned int *SqTail;
+unsigned int *SqMask;
+unsigned int *SqEntries;
+unsigned int *SqArray;
+unsigned int *CqHead;
+unsigned int *CqTail;
+unsigned int *CqMask;
+struct io_uring_sqe *Sqes;
+struct io_uring_cqe *Cqes;
 #endif
 
 /* We are using a fifo to store unused DFA structure */
@@ -51,35 +66,46 @@ NewDFA(Connection *conn, int lf, int offset, int size)
 {
     ServReq *sreq = conn->co_SReq;
     DirectFileAccess* el=NULL;
-
-#if USE_AIO
-    if (!sig_aio) {
-      sig_aio = (struct sigaction*) malloc(sizeof(struct sigaction)) ;
-      sigemptyset(&sig_aio->sa_mask);
-      sigaddset(&sig_aio->sa_mask, AIOSIG);
-      sig_aio->sa_flags = SA_SIGINFO;
-      sig_aio->sa_sigaction = Sig_AIO;
-      if (sigaction(AIOSIG, sig_aio, NULL)) {
-          logit(LOG_ERR, "NewDFA : cannot sigaction");
-          exit(1);
-      }
-      AIOBlockSignal();
-    }
-#endif
+    SpoolArtHdr ah;
+    int wire = 0;
 
     if (lf==-1) {
       logit(LOG_ERR, "NewDFA : fd is -1");
       return NULL;
     }
 
+    /*
+     * Skip the spool article header.  Wire format articles are stored
+     * CRLF terminated and dot escaped, with the final .CRLF.
+     */
+    if (size >= sizeof(ah) && pread(lf, &ah, sizeof(ah), offset) == sizeof(ah) &&
+        (uint8)ah.Magic1 == STORE_MAGIC1 && (uint8)ah.Magic2 == STORE_MAGIC2) {
+      if (ah.StoreType & STORETYPE_GZIP)
+          return NULL ;
+      offset += ah.HeadLen ;
+      size = ah.ArtLen ;
+      if (ah.StoreType & STORETYPE_WIRE) {
+          if (size < ah.ArtHdrLen + 2 + 3)
+              return NULL ;
+          size -= 3 ;
+          wire = 1 ;
+          switch(sreq->sr_CConn->co_ArtMode) {
+            case COM_BODY :
+            case COM_BODYWVF :
+            case COM_BODYNOSTAT :
+                /* JMPBDY only knows LF headers, skip them here */
+                offset += ah.ArtHdrLen + 2 ;
+                size -= ah.ArtHdrLen + 2 ;
+                wire = 2 ;
+          }
+      }
+    }
+
     if (dfa_Trash) {
       el = dfa_Trash ;
       dfa_Trash = el->dfa_Next ;
     } else {
       el = (DirectFileAccess*) malloc(sizeof(DirectFileAccess));
-#if USE_AIO
-      el->dfa_AIOcb = (struct aiocb*) malloc(sizeof(struct aiocb)) ;
-#endif
     }
 
     if (!el) return NULL ;
@@ -91,16 +117,6 @@ NewDFA(Connection *conn, int lf, int offset, int size)
       return NULL ;
     }
 
-#if USE_AIO
-    el->dfa_AIOcb->aio_fildes = lf ;
-    el->dfa_AIOcb->aio_offset = offset ;
-    el->dfa_AIOcb->aio_nbytes = 0 ;
-    el->dfa_AIOcb->aio_reqprio = 0 ;
-    el->dfa_AIOcb->aio_buf = el->dfa_Buffer ;
-    el->dfa_AIOcb->aio_sigevent.sigev_notify = SIGEV_SIGNAL ;
-    el->dfa_AIOcb->aio_sigevent.sigev_signo = AIOSIG;
-    el->dfa_AIOcb->aio_sigevent.sigev_value.sival_ptr = conn ;
-#else
     if (lseek(lf, offset, SEEK_SET)!=offset) { /* bring it back home */
       logit(LOG_ERR, "NewDFA : cannot seek to the beginning of article");
       el->dfa_Next = dfa_Trash;
@@ -108,12 +124,18 @@ NewDFA(Connection *conn, int lf, int offset, int size)
       return NULL ;
     }
     el->dfa_Fd     = lf ;
+#if USE_IO_URING
+    el->dfa_Off    = offset ;
+    el->dfa_Conn   = conn ;
+    el->dfa_Busy   = 0 ;
 #endif
 
     conn->co_DirectFA = el ;
 
     el->dfa_Size   = size ;
     el->dfa_LF     = 0 ;
+    el->dfa_Wire   = wire ;
+    el->dfa_Flag   = 0 ;
     el->dfa_Next   = NULL ;
 
     switch(conn->co_SReq->sr_CConn->co_ArtMode) {
@@ -121,6 +143,10 @@ NewDFA(Connection *conn, int lf, int offset, int size)
       case COM_BODYWVF :
       case COM_BODYNOSTAT :
           el->dfa_InHdr = JMPBDY ;
+          if (wire == 2) {
+              el->dfa_InHdr = INBODY ;
+              el->dfa_LF = CRLF ;
+          }
           if (sreq->sr_Cache) {
               AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0) ;
               fclose(sreq->sr_Cache) ;
@@ -140,85 +166,279 @@ NewDFA(Connection *conn, int lf, int offset, int size)
     return el;
 }
 
+/*
+ * DFASendFile() - zero-copy ARTICLE/BODY for wire format spool files.
+ *
+ *	The stored article is already CRLF terminated and dot escaped,
+ *	so when no header has to be rewritten the bytes can be queued
+ *	on the client as a file segment and sent with sendfile().  On
+ *	success the descriptor is taken over and the request finished.
+ *	Returns 0 if the article has to go through NewDFA() instead.
+ */
+
+int
+DFASendFile(Connection *conn, int lf, int offset, int size)
+{
+    ServReq *sreq = conn->co_SReq;
+    Connection *cconn = sreq->sr_CConn;
+    SpoolArtHdr ah;
+    char tail[3];
+    off_t b;
+    int len;
+
+    if (cconn == NULL || !ZeroCopyOk(cconn))
+	return(0);
+    if (cconn->co_ArtMode == COM_ARTICLE && sreq->sr_Cache)
+	return(0);
+    if (size < sizeof(ah) || pread(lf, &ah, sizeof(ah), offset) != sizeof(ah))
+	return(0);
+    if ((uint8)ah.Magic1 != STORE_MAGIC1 || (uint8)ah.Magic2 != STORE_MAGIC2)
+	return(0);
+    if ((ah.StoreType & (STORETYPE_WIRE|STORETYPE_GZIP)) != STORETYPE_WIRE)
+	return(0);
+    if (ah.HeadLen + ah.ArtLen > size || ah.ArtLen < ah.ArtHdrLen + 2 + 3)
+	return(0);
+
+    /*
+     * The terminating .CRLF is stored with the article, leave it to
+     * NNFinishSReq().
+     */
+    b = offset + ah.HeadLen;
+    len = ah.ArtLen - 3;
+    if (pread(lf, tail, 3, b + len) != 3 || bcmp(tail, ".\r\n", 3) != 0)
+	return(0);
+    if (cconn->co_ArtMode != COM_ARTICLE) {
+	b += ah.ArtHdrLen + 2;
+	len -= ah.ArtHdrLen + 2;
+	if (sreq->sr_Cache) {
+	    AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0);
+	    fclose(sreq->sr_Cache);
+	    sreq->sr_Cache = NULL;
+	}
+    }
+
+    if (len > 0)
+	MBSendFile(&cconn->co_ArtBuf, lf, b, len);
+    else
+	close(lf);
+    MBCopy(&cconn->co_ArtBuf, &cconn->co_TMBuf);
+    NNFinishSReq(conn, ".\r\n", 0);
+    return(1);
+}
+
 void
 DelDFA(Connection *conn)
 {
     DirectFileAccess* el=conn->co_DirectFA ;
     conn->co_DirectFA = NULL ;
-#if USE_AIO
-    if (el->dfa_AIOcb->aio_fildes!=-1) {
-      close(el->dfa_AIOcb->aio_fildes) ;
-      el->dfa_AIOcb->aio_fildes = -1 ;
-    }
-#else
+#if USE_IO_URING
+    /*
+     * The kernel still owns dfa_Buffer, DFARingReap() recycles the
+     * DFA when the read completes.
+     */
+    el->dfa_Conn = NULL ;
+    if (el->dfa_Busy)
+      return;
+#endif
     if (el->dfa_Fd!=-1) {
       close(el->dfa_Fd) ;
       el->dfa_Fd = -1 ;
     }
-#endif
     el->dfa_Next = dfa_Trash;
     dfa_Trash = el;
 }
 
-#if USE_AIO
-/* Get a signal, read data */
-void Sig_AIO(int signo, siginfo_t *info, void *context)
+#if USE_IO_URING
+
+/*
+ * DFARingSetup() - create the io_uring and map its queues.  Returns -1
+ *		    (and never tries again) if the kernel won't give us
+ *		    one, e.g. when io_uring is disabled or filtered.
+ */
+
+int
+DFARingSetup(void)
 {
-    Connection *conn = (Connection*) info->si_value.sival_ptr ;
-    DirectFileAccess *dfa = conn->co_DirectFA;
-    struct aiocb *aio=dfa->dfa_AIOcb;
-    const struct aiocb *aiolist[1];
-    int ret;
-
-    /* check IO */
-    aiolist[0] = aio;
-    if ((ret = aio_error(aio))) {
-      if (ret==EINPROGRESS) {
-          logit(LOG_ERR, "SigAIOPoll : EINPROGRESS", errno);
-          if (aio_suspend(aiolist,1,NULL)) {
-              logit(LOG_ERR, "SigAIOPoll : aio_suspend failed (errno=%i)", errno);
-              DelDFA(conn);
-              NNServerTerminate(conn);
-              return;
-          } else {
-              logit(LOG_NOTICE, "SigAIOPoll : aio_suspend on %i", aio->aio_fildes) ;
-          }
-      } else {
-          logit(LOG_ERR, "SigAIOPoll : IO error %i", ret);
-          DelDFA(conn);
-          NNServerTerminate(conn);
-      }
+    struct io_uring_params p;
+    size_t sqsz;
+    size_t cqsz;
+    char *sq;
+    char *cq;
+    int fd;
+
+    bzero(&p, sizeof(p));
+    if ((fd = syscall(__NR_io_uring_setup, DFA_RING_ENTRIES, &p)) < 0) {
+	logit(LOG_NOTICE, "DFA: io_uring unavailable (%s), using read()",
+							strerror(errno));
+	RingFd = -2;
+	return(-1);
     }
-    /* we can read the buffer */
-    NNSLA_Loop(conn);
-}
 
-void
-AIODataRead(Connection *conn)
-{
-    DirectFileAccess *dfa = conn->co_DirectFA;
+    sqsz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (cqsz > sqsz)
+	    sqsz = cqsz;
+	cqsz = sqsz;
+    }
+    sq = mmap(NULL, sqsz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+						fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+	logit(LOG_ERR, "DFA: unable to map io_uring sq ring (%s)", strerror(errno));
+	close(fd);
+	RingFd = -2;
+	return(-1);
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	cq = sq;
+    } else {
+	cq = mmap(NULL, cqsz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+						fd, IORING_OFF_CQ_RING);
+    }
+    Sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+			PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+			fd, IORING_OFF_SQES);
+    if (cq == MAP_FAILED || Sqes == MAP_FAILED) {
+	logit(LOG_ERR, "DFA: unable to map io_uring queues (%s)", strerror(errno));
+	if (Sqes != MAP_FAILED)
+	    munmap(Sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+	if (cq != MAP_FAILED && cq != sq)
+	    munmap(cq, cqsz);
+	munmap(sq, sqsz);
+	Sqes = NULL;
+	close(fd);
+	RingFd = -2;
+	return(-1);
+    }
 
-    dfa->dfa_AIOcb->aio_nbytes = (dfa->dfa_Size>sizeof(dfa->dfa_Buffer)) ? sizeof(dfa->dfa_Buffer) : dfa->dfa_Size ;
-    if (DebugOpt)
-      printf("AIODataRead : fd %i sz %i of %i", dfa->dfa_AIOcb->aio_fildes, dfa->dfa_AIOcb->aio_nbytes, (int)dfa->dfa_AIOcb->aio_offset);
+    SqHead = (unsigned int *)(sq + p.sq_off.head);
+    SqTail = (unsigned int *)(sq + p.sq_off.tail);
+    SqMask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    SqEntries = (unsigned int *)(sq + p.sq_off.ring_entries);
+    SqArray = (unsigned int *)(sq + p.sq_off.array);
+    CqHead = (unsigned int *)(cq + p.cq_off.head);
+    CqTail = (unsigned int *)(cq + p.cq_off.tail);
+    CqMask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    Cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    RingCqEntries = p.cq_entries;
+
+    RingFd = fd;
+    AddThread("dfaring", fd, -1, THREAD_DFA, -1, 0);
+    FDS_SET(fd, &RFds);
+    return(0);
+}
 
-    if (aio_read(dfa->dfa_AIOcb)) {
-      logit(LOG_ERR, "AIODataRead : error on reading (errno=%i)", errno);
-      DelDFA(conn);
-      NNServerTerminate(conn);
+/*
+ * DFARingQueue() - queue the next block read for a DFA.  Returns -1 if
+ *		    the ring is unavailable or full, the caller reads
+ *		    inline then.
+ */
+
+int
+DFARingQueue(DirectFileAccess *dfa)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail;
+    unsigned int idx;
+
+    if (RingFd == -2 || (RingFd == -1 && DFARingSetup() < 0))
+	return(-1);
+
+    tail = *SqTail;
+    if (tail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE) >= *SqEntries) {
+	DFARingFlush();
+	if (tail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE) >= *SqEntries)
+	    return(-1);
     }
+    if (RingInFlight + RingPending >= RingCqEntries)
+	return(-1);
+
+    idx = tail & *SqMask;
+    sqe = &Sqes[idx];
+    bzero(sqe, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = dfa->dfa_Fd;
+    sqe->addr = (unsigned long)dfa->dfa_Buffer;
+    sqe->len = (dfa->dfa_Size > sizeof(dfa->dfa_Buffer)) ?
+				sizeof(dfa->dfa_Buffer) : dfa->dfa_Size;
+    sqe->off = dfa->dfa_Off;
+    sqe->user_data = (unsigned long)dfa;
+    SqArray[idx] = idx;
+    __atomic_store_n(SqTail, tail + 1, __ATOMIC_RELEASE);
+
+    dfa->dfa_Busy = 1;
+    ++RingPending;
+    return(0);
 }
 
-void AIOBlockSignal(void)
+/*
+ * DFARingFlush() - submit all queued reads.  Called from the reader
+ *		    loop just before it waits.
+ */
+
+void
+DFARingFlush(void)
 {
-    if (sig_aio)
-      sigprocmask(SIG_BLOCK, &sig_aio->sa_mask, NULL) ;
+    while (RingPending) {
+	int r = syscall(__NR_io_uring_enter, RingFd, RingPending, 0, 0, NULL, 0);
+
+	if (r < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno != EAGAIN && errno != EBUSY)
+		logit(LOG_ERR, "DFA: io_uring_enter failed (%s)", strerror(errno));
+	    break;	/* retry on the next pass */
+	}
+	if (r == 0)
+	    break;
+	RingPending -= r;
+	RingInFlight += r;
+    }
 }
 
-void AIOUnblockSignal(void)
+/*
+ * DFARingReap() - run completed reads through NNCopyLocalArticle() and
+ *		   queue the next block of each article.
+ */
+
+void
+DFARingReap(void)
 {
-    if (sig_aio)
-      sigprocmask(SIG_UNBLOCK, &sig_aio->sa_mask, NULL) ;
+    unsigned int head;
+
+    while ((head = *CqHead) != __atomic_load_n(CqTail, __ATOMIC_ACQUIRE)) {
+	struct io_uring_cqe *cqe = &Cqes[head & *CqMask];
+	DirectFileAccess *dfa = (DirectFileAccess *)(unsigned long)cqe->user_data;
+	Connection *conn = dfa->dfa_Conn;
+	int rs = cqe->res;
+
+	__atomic_store_n(CqHead, head + 1, __ATOMIC_RELEASE);
+	--RingInFlight;
+	dfa->dfa_Busy = 0;
+
+	if (conn == NULL) {
+	    /*
+	     * DelDFA() was called while the read was in progress
+	     */
+	    if (dfa->dfa_Fd != -1) {
+		close(dfa->dfa_Fd);
+		dfa->dfa_Fd = -1;
+	    }
+	    dfa->dfa_Next = dfa_Trash;
+	    dfa_Trash = dfa;
+	    continue;
+	}
+	if (rs <= 0) {
+	    logit(LOG_ERR, "NNGetLocal2: spool read failed (%s)",
+				(rs < 0) ? strerror(-rs) : "short file");
+	    rs = -1;
+	}
+	if (NNSLA_Block(conn, rs) == 0) {
+	    dfa->dfa_Off += rs;
+	    if (DFARingQueue(dfa) < 0)
+		NNSLA_Loop(conn);
+	}
+    }
 }
 
 #endif
@@ -232,23 +452,81 @@ DFADataWrite(ServReq *sreq, const void *data, int len)
       fwrite(data, 1, len, sreq->sr_Cache);
 }
 
+/*
+ * NNSLA_Block() - handle one block of rs bytes (-1 on a read error)
+ *		   read into dfa_Buffer.  Returns 1 when the request
+ *		   has been finished or aborted and the DFA is gone.
+ */
+int
+NNSLA_Block(Connection *conn, int rs)
+{
+    ServReq *sreq = conn->co_SReq;
+    DirectFileAccess *dfa = conn->co_DirectFA;
+
+    switch ((rs < 0) ? BLOCK_ERROR : NNCopyLocalArticle(conn, rs)) {
+        case BLOCK_OK :
+            dfa->dfa_Size -= rs ;
+            if (!dfa->dfa_Size) {
+                if (sreq->sr_CConn)
+                        MBCopy(&sreq->sr_CConn->co_ArtBuf, &sreq->sr_CConn->co_TMBuf);
+                if (sreq->sr_Cache) {
+                    if (fflush(sreq->sr_Cache) || ferror(sreq->sr_Cache))
+                        AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0);
+                    else
+                        CommitCache(conn, 0);
+                    fclose(sreq->sr_Cache) ;
+                    sreq->sr_Cache = NULL ;
+                }
+                DelDFA(conn) ;
+                NNFinishSReq(conn, ".\r\n", 0) ;
+                return 1;
+            }
+            if (FastCopyOpt && sreq->sr_CConn) {
+                MBCopy(&sreq->sr_CConn->co_ArtBuf, &sreq->sr_CConn->co_TMBuf);
+            }
+            return 0;
+        case BLOCK_END :
+            if (sreq->sr_CConn)
+                    MBCopy(&sreq->sr_CConn->co_ArtBuf, &sreq->sr_CConn->co_TMBuf);
+            if (sreq->sr_Cache) {
+                AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0);
+                fclose(sreq->sr_Cache) ;
+                sreq->sr_Cache = NULL ;
+            }
+            DelDFA(conn) ;
+            NNFinishSReq(conn, ".\r\n", 0) ;
+            return 1;
+        case BLOCK_ERROR :
+        default :
+            DelDFA(conn);
+            if (sreq->sr_Cache) {
+                AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0);
+                fclose(sreq->sr_Cache) ;
+                sreq->sr_Cache = NULL ;
+            }
+            NNServerTerminate(conn);
+            return 1;
+    }
+}
+
 /* Reading buffer */
 void
 NNSLA_Loop(Connection *conn)
 {
-    ServReq *sreq = conn->co_SReq;
     DirectFileAccess *dfa = conn->co_DirectFA;
     int rs ;
 
     conn->co_Func = NNSendLocalArticle;
     conn->co_State = "getlclart";
 
-#if USE_AIO
-      rs = aio_return(dfa->dfa_AIOcb);        
-#else
     do {
       int sizofbuf = sizeof(dfa->dfa_Buffer) ;
+#if USE_IO_URING
+      /* the ring may have done the earlier blocks, it does not seek */
+      rs = pread(dfa->dfa_Fd, dfa->dfa_Buffer, (dfa->dfa_Size>sizofbuf) ? sizofbuf : dfa->dfa_Size, dfa->dfa_Off) ;
+#else
       rs = read(dfa->dfa_Fd, dfa->dfa_Buffer, (dfa->dfa_Size>sizofbuf) ? sizofbuf : dfa->dfa_Size) ;
+#endif
 
       if (rs<0) {
           if (errno == EAGAIN) { /* retry later */
@@ -262,71 +540,35 @@ NNSLA_Loop(Connection *conn)
               return;
           }
       }
-#endif
 
-      switch (NNCopyLocalArticle(conn, rs)) {
-          case BLOCK_OK :
-              dfa->dfa_Size -= rs ;
-              if (!dfa->dfa_Size) {
-                  if (sreq->sr_CConn)
-                          MBCopy(&sreq->sr_CConn->co_ArtBuf, &sreq->sr_CConn->co_TMBuf);
-                  if (sreq->sr_Cache) {
-                      if (fflush(sreq->sr_Cache) || ferror(sreq->sr_Cache))
-                          AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0);
-                      else
-                          CommitCache(conn, 0);
-                      fclose(sreq->sr_Cache) ;
-                      sreq->sr_Cache = NULL ;
-                  }
-                  DelDFA(conn) ;
-                  NNFinishSReq(conn, ".\r\n", 0) ;
-                  return;
-              }
-              if (FastCopyOpt && sreq->sr_CConn) {
-                  MBCopy(&sreq->sr_CConn->co_ArtBuf, &sreq->sr_CConn->co_TMBuf);
-              }
-              break ;
-          case BLOCK_END :
-              if (sreq->sr_CConn)
-                      MBCopy(&sreq->sr_CConn->co_ArtBuf, &sreq->sr_CConn->co_TMBuf);
-              if (sreq->sr_Cache) {
-                  AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0);
-                  fclose(sreq->sr_Cache) ;
-                  sreq->sr_Cache = NULL ;
-              }
-              DelDFA(conn) ;
-              NNFinishSReq(conn, ".\r\n", 0) ;
-              return;
-          case BLOCK_ERROR :
-          default :
-              DelDFA(conn);
-              if (sreq->sr_Cache) {
-                  AbortCache(fileno(sreq->sr_Cache), sreq->sr_MsgId, 0);
-                  fclose(sreq->sr_Cache) ;
-                  sreq->sr_Cache = NULL ;
-              }
-              NNServerTerminate(conn);
-              return;
-      }
-#if USE_AIO
-    dfa->dfa_AIOcb->aio_offset += rs;
-    AIODataRead(conn);
-#else
-    } while (rs) ;
+      if (NNSLA_Block(conn, rs))
+          return;
+#if USE_IO_URING
+      dfa->dfa_Off += rs;
 #endif
+    } while (rs) ;
 }
 
 /* Reading buffer */
 void
 NNSendLocalArticle(Connection *conn)
 {
-#if USE_AIO
-    /* let's start the pump */
-    AIODataRead(conn);
-#else
+#if USE_IO_URING
+    DirectFileAccess *dfa = conn->co_DirectFA;
+
+    /*
+     * We may be called again for the spool connection while a read
+     * is still in progress, the completion takes it from there.
+     */
+    conn->co_Func = NNSendLocalArticle;
+    conn->co_State = "getlclart";
+    if (dfa == NULL || dfa->dfa_Busy)
+	return;
+    if (DFARingQueue(dfa) == 0)
+	return;
+#endif
     /* blocking loop */
     NNSLA_Loop(conn);
-#endif
 }
 
 /* Copying article... Return 1 when an error occurred */
@@ -360,7 +602,7 @@ NNCopyLocalArticle(Connection *conn, int rs)
                       dfa->dfa_LF = CR ;
                       break ;
                   case '.' :
-                      if (dfa->dfa_LF == CRLF) { /* we have to dupplicate this '.' */
+                      if (dfa->dfa_LF == CRLF && !dfa->dfa_Wire) { /* we have to dupplicate this '.' */
                           DFADataWrite(sreq, dfa->dfa_Buffer+ptr, i-ptr+1) ;
                           ptr = i ;
                       }
@@ -445,7 +687,7 @@ NNCopyLocalArticle(Connection *conn, int rs)
                   case '\r' :
                       /* Check missing headers, end of last buffer or HEAD mode */
                       if ( ((dfa->dfa_Flag&FLAG_NEEDED)==FLAG_NEEDED) || (i+1 == sizofbuf)
-                           || (sreq->sr_CConn->co_ArtMode == COM_HEAD)) {
+                           || (sreq->sr_CConn->co_ArtMode == COM_HEAD) || dfa->dfa_Wire) {
                           /* we "simply" forget this '\r' for laziness reasons */
                           if (i-ptr) DFADataWrite(sreq, dfa->dfa_Buffer+ptr, i-ptr) ;
                           ptr = i+1 ;
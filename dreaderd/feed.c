@@ -277,7 +277,7 @@ NNAcceptArticle(Connection *conn)
 	 * more lines were pending, wake us up immediately, after we've
 	 * processed some other people.
 	 */
-	FD_SET(conn->co_Desc->d_Fd, &WFds);
+	FDS_SET(conn->co_Desc->d_Fd, &WFds);
     }
 }
 
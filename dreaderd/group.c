@@ -46,6 +46,7 @@ Prototype void FlushOverCache(void);
 Prototype OverInfo *GetOverInfo(const char *group);
 Prototype void PutOverInfo(OverInfo *ov);
 Prototype const char *GetOverRecord(OverInfo *ov, artno_t artno, int *plen, int *aleno, TimeRestrict *tr, int *TimeRcvd);
+Prototype int GetOverColumn(OverInfo *ov, int col, artno_t artno, const char **pres, int *plen, int *alen);
 Prototype OverInfo *FindCanceledMsg(const char *group, const char *msgid, artno_t *partNo, int *pvalidGroups);
 Prototype int CancelOverArt(OverInfo *ov, artno_t artNo);
 Prototype void OutputOverRange(OverInfo *ov, Connection *conn);
@@ -56,12 +57,15 @@ Prototype const char *NNRetrieveHead(Connection *conn, int *povlen, const char *
 const OverArt *GetOverArt(OverInfo *ov, artno_t artNo, off_t *ppos);
 void AssignArticleNo(Connection *conn, ArtNumAss **pan, const char *group, const char *xref, int approved, const char *art, int artLen, const char *msgid);
 int WriteOverview(Connection *conn, ArtNumAss *an, const char *group, const char *xref, const char *art, int artLen, const char *msgid);
+void WriteOverColumns(OverInfo *ov, OverData *od, artno_t artNo, hash_t hv, const char *art, int artLen);
+void FreeOverColumn(OverInfo *ov);
 OverData *MakeOverHFile(OverInfo *ov, artno_t artNo, int create);
 void FreeOverInfo(OverInfo *ov);
 void FreeOverData(OverData *od);
 
 OverInfo *OvHash[OVHSIZE];
 int	  NumOverInfo;
+uint32	  OvTick;
 
 void
 NNFeedOverview(Connection *conn)
@@ -669,6 +673,9 @@ WriteOverview(Connection *conn, ArtNumAss *an, const char *group, const char *xr
 	    OverArt ovart = { 0 };
 	    off_t ovpos = 0;
 
+	    if (DOpts.ReaderColumns && DOpts.ReaderXOverMode != 2)
+		WriteOverColumns(ov, ov->ov_HCache, artNo, hv, art, artLen);
+
 	    hflock(ov->ov_OFd, 0, XLOCK_EX);
 
 	    (void)GetOverArt(ov, artNo, &ovpos);
@@ -687,6 +694,8 @@ WriteOverview(Connection *conn, ArtNumAss *an, const char *group, const char *xr
 	    FilePreAllocSpace(ov->ov_OFd, ovpos, prealloc_ov, sizeof(ovart));
 	    write(ov->ov_OFd, &ovart, sizeof(ovart));
 	    hflock(ov->ov_OFd, 0, XLOCK_UN);
+	    if (DOpts.ReaderDirtyJournal)
+		DirtyGroupMark(group);
 	    LogCmd(conn, '+', logbuf);
 	    if (DRIncomingLogPat != NULL)
 		LogIncoming("%s + %s%s", conn->co_Auth.dr_Host, "", logbuf);
@@ -708,6 +717,56 @@ WriteOverview(Connection *conn, ArtNumAss *an, const char *group, const char *xr
     return(err);
 }
 
+/*
+ * WriteOverColumns() - append the article's column headers to the column
+ *			files of its data block (lib/overcol.c).  Called
+ *			with the data file locked.  The headers are taken
+ *			the way OutputOverview() finds them, first match
+ *			wins.  A column we can not write to is skipped
+ *			for the block, readers fall back to the data file.
+ */
+
+void
+WriteOverColumns(OverInfo *ov, OverData *od, artno_t artNo, hash_t hv, const char *art, int artLen)
+{
+    OverLine line[OVERCOL_COUNT];
+    OverLine ol;
+    int found = 0;
+    int b = 0;
+    int col;
+
+    bzero(line, sizeof(line));
+    while (found < OVERCOL_COUNT && (b = OverScanLine(art, artLen, b, &ol)) >= 0) {
+	if ((col = OverColFind(ol.ol_Line, ol.ol_NameLen)) >= 0 && line[col].ol_Line == NULL) {
+	    line[col] = ol;
+	    ++found;
+	}
+    }
+
+    for (col = 0; col < OVERCOL_COUNT; ++col) {
+	if (od->od_ColFd[col] == -1) {
+	    const char *gfname = GFName(ov->ov_Group, GRPFTYPE_COLUMN + col,
+				od->od_ArtBase, 1, ov->ov_Iter,
+				&DOpts.ReaderGroupHashMethod);
+	    int fd = xopen(O_RDWR|O_CREAT|O_APPEND, 0644, "%s/%s", MyGroupHome, gfname);
+
+	    if (fd >= 0 && OverColOpen(fd, col) < 0) {
+		close(fd);
+		fd = -1;
+	    }
+	    od->od_ColFd[col] = (fd >= 0) ? fd : -2;
+	}
+	if (od->od_ColFd[col] < 0)
+	    continue;
+	if (OverColAppend(od->od_ColFd[col], artNo, hv, line[col].ol_Line, line[col].ol_Len) < 0) {
+	    logit(LOG_ERR, "error writing overview column %s for %s",
+				OverColHeader(col), ov->ov_Group);
+	    close(od->od_ColFd[col]);
+	    od->od_ColFd[col] = -2;
+	}
+    }
+}
+
 void FlushOverCache(void)
 {
     OverInfo **pov;
@@ -743,52 +802,74 @@ GetOverInfo(const char *group)
 	    break;
 	pov = &ov->ov_Next;
     }
-    if (ov == NULL) {
+    if (ov != NULL) {
+	OverCacheCount(OC_HIT);
+    } else {
 	OverExpire save;
+	OverCacheEnt oce;
 	struct stat st;
 	char *path;
 	int iter = 0;
 	artno_t endNo = 0;
+	int oslot;
+	int shared;
 
 	bzero(&st, sizeof(st));
 
 	/*
-	 * If our cache has grown too large, attempt to free up
-	 * a bunch of overview structures.  Depending on the load,
-	 * we may not be able to.
+	 * If our cache is full, free up the least recently used
+	 * overview structure.  Depending on the load, we may not
+	 * be able to.
 	 */
 
 	if (NumOverInfo >= OV_CACHE_MAX) {
+	    OverInfo **plru = NULL;
 	    int i;
-	    int freeup = OV_CACHE_MAX / 2;
-	    static int OI = 0;
-
-	    for (i = 0; i < OVHSIZE && freeup; ++i) {
-		int ai = OI;
-		OI = (ai + 1) & OVHMASK;
-
-		pov = &OvHash[ai];
-		while ((ov = *pov) != NULL) {
-		    if (ov->ov_Refs == 0) {
-			*pov = ov->ov_Next;
-			FreeOverInfo(ov);
-			--NumOverInfo;
-			--freeup;
-		    } else {
-			pov = &ov->ov_Next;
+
+	    for (i = 0; i < OVHSIZE; ++i) {
+		for (pov = &OvHash[i]; (ov = *pov) != NULL; pov = &ov->ov_Next) {
+		    if (ov->ov_Refs == 0 && (plru == NULL ||
+			(int32)(ov->ov_LastUse - (*plru)->ov_LastUse) < 0)
+		    ) {
+			plru = pov;
 		    }
 		}
 	    }
+	    if (plru) {
+		ov = *plru;
+		*plru = ov->ov_Next;
+		FreeOverInfo(ov);
+		--NumOverInfo;
+		OverCacheCount(OC_EVICT);
+	    }
 	}
 	ov = zalloc(&SysMemPool, sizeof(OverInfo));
 	ov->ov_Group = zallocStr(&SysMemPool, group);
-	GetOverExpire(group, &save);
-	ov->ov_LimitSecs = save.oe_LimitDays * 24.0 * 60.0 * 60.0;
+	ov->ov_OFd = -1;
+	ov->ov_Shared = -1;
+	ov->ov_ColNo = -1;
+	ov->ov_ColFd = -1;
 
-	{
+	/*
+	 * If another fork has set this group up recently we can take
+	 * what it found instead of looking it up again.
+	 */
+	oslot = OverCacheFind(group, &oce);
+	shared = (oslot >= 0);
+lookup:
+	if (shared) {
+	    ov->ov_LimitSecs = oce.oc_LimitSecs;
+	    iter = oce.oc_Iter;
+	    endNo = oce.oc_EndNo;
+	} else {
 	    const char *rec;
 	    int recLen;
+
+	    GetOverExpire(group, &save);
+	    ov->ov_LimitSecs = save.oe_LimitDays * 24.0 * 60.0 * 60.0;
+
 	    if ((rec = KPDBReadRecord(KDBActive, group, KP_LOCK, &recLen)) == NULL) {
+		FreeOverInfo(ov);
 		return(NULL);
 	    }
 	    iter = strtol(KPDBGetField(rec, recLen, "ITER", NULL, "0"), NULL, 10);
@@ -804,13 +885,17 @@ again:
 
 	    sprintf(path, "%s/%s", MyGroupHome, gfname);
 	    ov->ov_OFd = -1;
-	    if (MakeGroupDirectory(path) == -1)
+	    if (!shared && MakeGroupDirectory(path) == -1)
 		logit(LOG_ERR, "Error on overview dir open/create: %s (%s)",
 						path, strerror(errno));
 	    else
 		ov->ov_OFd = xopen(O_RDWR|O_CREAT, 0644, "%s", path);
 	}
-	if (ov->ov_OFd < 0) {
+	if (ov->ov_OFd < 0 && shared) {
+	    shared = 0;
+	    zfree(&SysMemPool, path, strlen(MyGroupHome) + 48);
+	    goto lookup;
+	} else if (ov->ov_OFd < 0) {
 	    logit(LOG_ERR, "Error on overview open/create for group %s: %s (%s)",
 						group, path, strerror(errno));
 	    FreeOverInfo(ov);
@@ -834,6 +919,23 @@ again:
 		goto again;
 	    }
 
+	    /*
+	     * A shared entry is only good for the file it was made from
+	     */
+	    if (shared) {
+		if (st.st_dev != oce.oc_Dev || st.st_ino != oce.oc_Ino) {
+		    hflock(ov->ov_OFd, 4, XLOCK_UN);
+		    close(ov->ov_OFd);
+		    ov->ov_OFd = -1;
+		    shared = 0;
+		    zfree(&SysMemPool, path, strlen(MyGroupHome) + 48);
+		    goto lookup;
+		}
+		oh.oh_HeadSize = oce.oc_HeadSize;
+		oh.oh_DataEntries = oce.oc_DataEntries;
+		goto mapit;
+	    }
+
 	    /*
 	     * check if new overview file or illegal overview file and size 
 	     * accordingly
@@ -903,6 +1005,7 @@ again:
 		sprintf(tsBuf,"%06d", iter);
 		KPDBWrite(KDBActive, group, "ITER", tsBuf, 0);   
 	    }
+mapit:
 	    ov->ov_Iter = iter;
 	    ov->ov_endNo = endNo;
 	    ov->ov_Size = st.st_size;
@@ -916,6 +1019,24 @@ again:
 		ov = NULL;
 	    } else {
 		xadvise(ov->ov_Head, ov->ov_Size, XADV_SEQUENTIAL);
+		if (shared) {
+		    ov->ov_Shared = oslot;
+		    OverCacheCount(OC_SHARED);
+		} else {
+		    bzero(&oce, sizeof(oce));
+		    oce.oc_Time = CurTime.tv_sec;
+		    oce.oc_EndNo = endNo;
+		    oce.oc_Dev = st.st_dev;
+		    oce.oc_Ino = st.st_ino;
+		    oce.oc_Iter = iter;
+		    oce.oc_LimitSecs = ov->ov_LimitSecs;
+		    oce.oc_HeadSize = oh.oh_HeadSize;
+		    oce.oc_DataEntries = oh.oh_DataEntries;
+		    StrnCpyNull(oce.oc_Group, group, sizeof(oce.oc_Group));
+		    ov->ov_Shared = OverCacheEnter(&oce);
+		    OverCacheCount(OC_MISS);
+		}
+		OverCacheRef(ov->ov_Shared, group, 1);
 		++NumOverInfo;
 		pov = &OvHash[shash(group) & OVHMASK];
 		ov->ov_Next = *pov;
@@ -924,8 +1045,10 @@ again:
 	}
 	zfree(&SysMemPool, path, strlen(MyGroupHome) + 48);
     }
-    if (ov)
+    if (ov) {
 	++ov->ov_Refs;
+	ov->ov_LastUse = ++OvTick;
+    }
     return(ov);
 }
 
@@ -951,6 +1074,99 @@ GetOverArt(OverInfo *ov, artno_t artno, off_t *ppos)
     return(oa);
 }
 
+/*
+ * GetOverColumn() - look up the column col header line of an article
+ *		     (lib/overcol.c).  Returns 1 and the line in *pres,
+ *		     *plen (0 if the article does not have the header), 0
+ *		     if GetOverRecord() would not return the article
+ *		     either, or -1 if the column can not answer and the
+ *		     caller has to use GetOverRecord().  The column block
+ *		     last used is kept, the file is only read again for
+ *		     article numbers beyond what it held.
+ */
+
+int
+GetOverColumn(OverInfo *ov, int col, artno_t artno, const char **pres, int *plen, int *alen)
+{
+    const OverArt *oa;
+    artno_t artBase = artno & ~ov->ov_DataEntryMask;
+    int entries = ov->ov_DataEntryMask + 1;
+    OverColEnt ce;
+    const char *line;
+    int off;
+
+    oa = GetOverArt(ov, artno, NULL);
+
+    if (oa == NULL || ! OA_ARTNOEQ(artno, oa->oa_ArtNo) || oa->oa_Bytes > OVER_HMAPSIZE / 2)
+	return(0);
+    if (ov->ov_LimitSecs > 0 && (int)(CurTime.tv_sec - oa->oa_TimeRcvd) > ov->ov_LimitSecs)
+	return(0);
+    if (oa->oa_SeekPos == -1)
+	return(0);
+
+    if (ov->ov_ColIdx == NULL || ov->ov_ColNo != col || ov->ov_ColBase != artBase) {
+	const char *gfname = GFName(ov->ov_Group, GRPFTYPE_COLUMN + col,
+				artBase, 1, ov->ov_Iter,
+				&DOpts.ReaderGroupHashMethod);
+	int i;
+
+	FreeOverColumn(ov);
+	ov->ov_ColIdx = zalloc(&SysMemPool, entries * sizeof(int));
+	for (i = 0; i < entries; ++i)
+	    ov->ov_ColIdx[i] = -1;
+	ov->ov_ColNo = col;
+	ov->ov_ColBase = artBase;
+	ov->ov_ColMax = artBase - 1;
+	ov->ov_ColFd = xopen(O_RDONLY, 0644, "%s/%s", MyGroupHome, gfname);
+    }
+    if (ov->ov_ColFd < 0)
+	return(-1);
+
+    if (artno > ov->ov_ColMax) {
+	if (OverColRead(ov->ov_ColFd, &ov->ov_ColBuf) < 0) {
+	    close(ov->ov_ColFd);
+	    ov->ov_ColFd = -1;
+	    return(-1);
+	}
+	while ((off = OverColNext(&ov->ov_ColBuf, ov->ov_ColScan, &ce, &line)) >= 0) {
+	    if (ce.ce_ArtNo >= artBase && ce.ce_ArtNo < artBase + entries) {
+		ov->ov_ColIdx[ce.ce_ArtNo - artBase] = ov->ov_ColScan;
+		if (ce.ce_ArtNo > ov->ov_ColMax)
+		    ov->ov_ColMax = ce.ce_ArtNo;
+	    }
+	    ov->ov_ColScan = off;
+	}
+    }
+
+    if ((off = ov->ov_ColIdx[artno - artBase]) < 0 ||
+	OverColNext(&ov->ov_ColBuf, off, &ce, &line) < 0 ||
+	ce.ce_ArtNo != artno ||
+	ce.ce_MsgHash.h1 != oa->oa_MsgHash.h1 ||
+	ce.ce_MsgHash.h2 != oa->oa_MsgHash.h2
+    ) {
+	return(-1);
+    }
+    *pres = line;
+    *plen = ce.ce_Len;
+    if (alen)
+	*alen = oa->oa_ArtSize;
+    return(1);
+}
+
+void
+FreeOverColumn(OverInfo *ov)
+{
+    if (ov->ov_ColIdx)
+	zfree(&SysMemPool, ov->ov_ColIdx, (ov->ov_DataEntryMask + 1) * sizeof(int));
+    if (ov->ov_ColFd >= 0)
+	close(ov->ov_ColFd);
+    OverColFree(&ov->ov_ColBuf);
+    ov->ov_ColIdx = NULL;
+    ov->ov_ColFd = -1;
+    ov->ov_ColNo = -1;
+    ov->ov_ColScan = 0;
+}
+
 const char *
 GetOverRecord(OverInfo *ov, artno_t artno, int *plen, int *alen, TimeRestrict *tr, int *TimeRcvd)
 {
@@ -1367,6 +1583,7 @@ MakeOverHFile(OverInfo *ov, artno_t artNo, int create)
     unsigned long zlen;
     z_stream z;
     int code;
+    int col;
 
     if (create)
 	create = O_CREAT;
@@ -1383,6 +1600,8 @@ MakeOverHFile(OverInfo *ov, artno_t artNo, int create)
 				ov->ov_Iter, &DOpts.ReaderGroupHashMethod);
 
 	*pod = od = zalloc(&SysMemPool, sizeof(OverData));
+	for (col = 0; col < OVERCOL_COUNT; ++col)
+	    od->od_ColFd[col] = -1;
         errno = 0;
 	hfd = xopen(O_RDWR|create, 0644, "%s/%s", MyGroupHome, gfname);
 	if (hfd < 0 && ! create) {
@@ -1574,6 +1793,8 @@ FreeOverInfo(OverInfo *ov)
 	ov->ov_HData = od->od_Next;
 	FreeOverData(od);
     }
+    FreeOverColumn(ov);
+    OverCacheRef(ov->ov_Shared, ov->ov_Group, -1);
     if (ov->ov_Head)
 	xunmap((void *)ov->ov_Head, ov->ov_Size);
     if (ov->ov_OFd >= 0) {
@@ -1592,6 +1813,12 @@ FreeOverInfo(OverInfo *ov)
 void
 FreeOverData(OverData *od)
 {
+    int col;
+
+    for (col = 0; col < OVERCOL_COUNT; ++col) {
+	if (od->od_ColFd[col] >= 0)
+	    close(od->od_ColFd[col]);
+    }
     if (od->od_HMapBase) {
 	xunmap((void *)od->od_HMapBase, od->od_HMapBytes);
 	od->od_HMapBase = NULL;
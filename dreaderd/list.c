@@ -184,6 +184,20 @@ NNStartListActiveScan(Connection *conn, const char *wc, TimeRestrict *tr, int mo
 	}
     }
 
+    /*
+     * Wildcard LIST ACTIVE and LIST NEWSGROUPS are sent from the
+     * pre-rendered responses if we can (listcache.c)
+     */
+
+    if ((mode == COM_ACTIVE || mode == COM_GROUPDESC) &&
+	(wc == NULL || strchr(wc, '*') || strchr(wc, '?')) &&
+	ListCacheStart(conn, mode) == 0
+    ) {
+	conn->co_ArtMode = mode;
+	NNListActiveScan(conn);
+	return;
+    }
+
     /*
      * Initiate active file scan, but optimize if specific group requested
      */
@@ -209,6 +223,18 @@ NNListActiveScan(Connection *conn)
     conn->co_Func = NNListActiveScan;
     conn->co_State = "listac";
 
+    if (conn->co_ListCacheMode == ACMODE_RENDER) {
+	if (ListCacheSend(conn)) {
+	    ListCacheDone(conn);
+	    MBPrintf(&conn->co_TMBuf, ".\r\n");
+	    NNCommand(conn);
+	    zfreeStr(&conn->co_MemPool, &conn->co_ListPat);
+	    if (DebugOpt)
+		printf("done\n");
+	}
+	return;
+    }
+
     while ((conn->co_TMBuf.mh_Bytes < MBUF_HIWAT) &&
 	   (((conn->co_ListCacheMode != ACMODE_READ) &&
 	     conn->co_ListRec) || 
@@ -537,7 +563,11 @@ NNListGroup(Connection *conn)
 	int resLen;
         int artSize;
 
-        if (GetOverRecord(ov, conn->co_ListBegNo, &resLen, &artSize, NULL, NULL) != NULL) {
+	/*
+	 * With readercolumns on the overview index is taken as is,
+	 * rather than mapping every article's header record
+	 */
+        if (GetOverRecord(ov, conn->co_ListBegNo, (DOpts.ReaderColumns ? NULL : &resLen), &artSize, NULL, NULL) != NULL) {
 	    MBPrintf(&conn->co_TMBuf, "%d\r\n", conn->co_ListBegNo);
 	}
 	++conn->co_ListBegNo;
@@ -0,0 +1,499 @@
+/*
+ * DREADERD/LISTCACHE.C
+ *
+ *	Pre-rendered LIST ACTIVE and LIST NEWSGROUPS responses.  Formatting
+ *	every group line for every client is what pins the reader forks
+ *	when hundreds of clients reconnect and LIST at the same time, so
+ *	each fork keeps the response text ready, one buffer per article
+ *	numbering mode for LIST ACTIVE and one for LIST NEWSGROUPS (and
+ *	XGTITLE), and its connections copy lines straight out of it.
+ *	Buffers are rendered the first time they are asked for.
+ *
+ *	The groups are taken from a scan of dactive.kp, which is redone
+ *	when the append sequence of the file changes (groups added or
+ *	records rewritten).  Otherwise, at most once a second, the NB and
+ *	NE fields of every group are compared with the rendered ones and
+ *	changed article numbers are written over the old ones in place,
+ *	which works because they are always rendered ten digits wide.  A
+ *	deleted record, changed flags or description, or a number that
+ *	does not fit makes the next request rescan and render again.
+ *
+ *	A rescan frees the buffers, so it is put off while a connection
+ *	is still sending from them.  LIST requests meanwhile use the
+ *	active file scan in list.c, as do requests for a single group.
+ *
+ *	The buffers are private to the fork.  Sharing one rendered copy
+ *	between the forks would need it in a file or segment of unknown
+ *	and changing size and a way to patch it under the readers of
+ *	every fork; a fork renders in a few milliseconds, once.
+ *
+ *	The generation, bumped by every rescan and every pass that
+ *	changed a number, and the time the last rescan and render took
+ *	are kept per fork in a small shared memory segment created
+ *	before the forks (InitListCache()), for the master's status
+ *	line (ListCacheStats()).
+ *
+ * Refer to the COPYRIGHT file in the base directory of this distribution
+ * for specific rights granted.
+ */
+
+#include "defs.h"
+
+Prototype void InitListCache(void);
+Prototype int ListCacheStart(Connection *conn, int mode);
+Prototype int ListCacheSend(Connection *conn);
+Prototype void ListCacheDone(Connection *conn);
+Prototype void ListCacheStats(uint32 *pgen, uint32 *pms);
+
+#define LC_CHUNK	8192	/* unrestricted lists are sent in chunks */
+#define LC_NUMLEN	23	/* " %010lld %010lld "			 */
+
+typedef struct ListCacheEnt {
+    int		le_RecOff;	/* dactive.kp record			*/
+    int		le_NameLen;
+    artno_t	le_NB;
+    artno_t	le_NE;
+    uint32	le_FlagHash;	/* of the S field			*/
+    uint32	le_DescHash;	/* of the GD field, as stored		*/
+} ListCacheEnt;
+
+/*
+ * one line of counters per fork, so the forks do not share cache lines
+ */
+typedef struct ListCacheCounts {
+    uint32	lc_Gen;		/* generation of the rendered lists	*/
+    uint32	lc_Ms;		/* last rescan and render, ms		*/
+    char	lc_Pad[64 - 2 * sizeof(uint32)];
+} ListCacheCounts;
+
+typedef struct ListCacheBuf {
+    char	*lb_Buf;	/* NULL if not rendered			*/
+    int		lb_Len;
+    int		lb_Max;
+    int		*lb_Line;	/* offset of each group's line, + end	*/
+} ListCacheBuf;
+
+ListCacheEnt	*LCEnt;
+int		LCCount;
+int		LCMax;
+ListCacheBuf	LCBuf[LC_NBUFS];
+int		LCDirty = 1;
+int		LCAppendSeq;
+int		LCReaders;
+time_t		LCPatchTime;
+uint32		LCGen;
+ListCacheCounts	*LCCounts = NULL;
+int		LCNumCounts;
+
+/*
+ * InitListCache() - master: create the counter segment before forking
+ */
+
+void
+InitListCache(void)
+{
+#if USE_LISTCACHE_SHM
+    size_t bytes;
+    int sid;
+    struct shmid_ds ds;
+    char *base;
+
+    LCNumCounts = DOpts.ReaderForks + DOpts.ReaderFeedForks;
+    bytes = LCNumCounts * sizeof(ListCacheCounts);
+    if (bytes == 0)
+	return;
+    if ((sid = shmget(IPC_PRIVATE, bytes, SHM_R|SHM_W)) < 0) {
+	logit(LOG_WARNING, "InitListCache cannot allocate sysv shared memory");
+	return;
+    }
+    base = (char *)shmat(sid, NULL, SHM_R|SHM_W);
+    if (shmctl(sid, IPC_STAT, &ds) < 0 || shmctl(sid, IPC_RMID, &ds) < 0) {
+	logit(LOG_CRIT, "sysv shmctl stat/rmid failed");
+	exit(1);
+    }
+    if (base == (char *)-1) {
+	logit(LOG_CRIT, "sysv shared memory map failed");
+	exit(1);
+    }
+    bzero(base, bytes);
+    LCCounts = (ListCacheCounts *)base;
+#endif
+}
+
+static ListCacheCounts *
+lccounts(void)
+{
+    if (LCCounts && ThisReaderFork >= 0 && ThisReaderFork < LCNumCounts)
+	return(&LCCounts[ThisReaderFork]);
+    return(NULL);
+}
+
+/*
+ * ListCacheStats() - master: the highest generation and rebuild time
+ *		      of all forks
+ */
+
+void
+ListCacheStats(uint32 *pgen, uint32 *pms)
+{
+    int i;
+
+    *pgen = 0;
+    *pms = 0;
+    for (i = 0; LCCounts && i < LCNumCounts; ++i) {
+	if (*pgen < LCCounts[i].lc_Gen)
+	    *pgen = LCCounts[i].lc_Gen;
+	if (*pms < LCCounts[i].lc_Ms)
+	    *pms = LCCounts[i].lc_Ms;
+    }
+}
+
+static uint32
+lchash(const char *p, int l)
+{
+    uint32 h = 0x811C9DC5;
+
+    while (l-- > 0) {
+	h ^= (uint8)*p++;
+	h *= 0x01000193;
+    }
+    return(h);
+}
+
+static void
+lcfields(const char *rec, int recLen, ListCacheEnt *le)
+{
+    const char *p;
+    int l;
+
+    le->le_NE = strtoll(KPDBGetField(rec, recLen, "NE", NULL, "0"), NULL, 10);
+    le->le_NB = strtoll(KPDBGetField(rec, recLen, "NB", NULL, "0"), NULL, 10);
+    p = KPDBGetField(rec, recLen, "S", &l, "n");
+    le->le_FlagHash = lchash(p, l);
+    p = KPDBGetField(rec, recLen, "GD", &l, "?");
+    le->le_DescHash = lchash(p, l);
+}
+
+static void
+lcfree(void)
+{
+    int i;
+
+    for (i = 0; i < LC_NBUFS; ++i) {
+	ListCacheBuf *lb = &LCBuf[i];
+
+	if (lb->lb_Buf)
+	    free(lb->lb_Buf);
+	if (lb->lb_Line)
+	    free(lb->lb_Line);
+	bzero(lb, sizeof(ListCacheBuf));
+    }
+}
+
+/*
+ * lcscan() - (re)read the groups from the active file
+ */
+
+static int
+lcscan(void)
+{
+    int recLen;
+    int off;
+
+    lcfree();
+    LCCount = 0;
+
+    /*
+     * Take the append sequence before remapping so an append racing
+     * with us is caught by the next request.
+     */
+    LCAppendSeq = KPDBAppendCount(KDBActive);
+    KPDBReSize(KDBActive);
+
+    for (off = KPDBScanFirst(KDBActive, 0, &recLen);
+	 off;
+	 off = KPDBScanNext(KDBActive, off, 0, &recLen)
+    ) {
+	const char *rec = KPDBReadRecordAt(KDBActive, off, 0, NULL);
+	const char *group;
+	int glen;
+
+	if (rec == NULL || rec[0] != '+')
+	    continue;
+	group = KPDBGetField(rec, recLen, NULL, &glen, NULL);
+	if (group == NULL || glen <= 0 || glen >= MAXGNAME)
+	    continue;
+	if (LCCount == LCMax) {
+	    int max = LCMax ? LCMax * 2 : 1024;
+	    ListCacheEnt *ent;
+
+	    if ((ent = realloc(LCEnt, max * sizeof(ListCacheEnt))) == NULL)
+		return(-1);
+	    LCEnt = ent;
+	    LCMax = max;
+	}
+	LCEnt[LCCount].le_RecOff = off;
+	LCEnt[LCCount].le_NameLen = glen;
+	lcfields(rec, recLen, &LCEnt[LCCount]);
+	++LCCount;
+    }
+    LCDirty = 0;
+    LCPatchTime = CurTime.tv_sec;
+    ++LCGen;
+    if (lccounts())
+	lccounts()->lc_Gen = LCGen;
+    return(0);
+}
+
+/*
+ * lcrender() - render buffer which from the scanned groups
+ */
+
+static int
+lcrender(int which)
+{
+    ListCacheBuf *lb = &LCBuf[which];
+    int i;
+
+    if ((lb->lb_Line = malloc((LCCount + 1) * sizeof(int))) == NULL)
+	return(-1);
+    lb->lb_Max = LCCount * 64 + 1024;
+    if ((lb->lb_Buf = malloc(lb->lb_Max)) == NULL) {
+	free(lb->lb_Line);
+	lb->lb_Line = NULL;
+	return(-1);
+    }
+    lb->lb_Len = 0;
+
+    for (i = 0; i < LCCount; ++i) {
+	ListCacheEnt *le = &LCEnt[i];
+	const char *rec;
+	const char *group;
+	const char *data;
+	char nums[64];
+	int recLen;
+	int dlen;
+	int nlen;
+
+	rec = KPDBReadRecordAt(KDBActive, le->le_RecOff, 0, &recLen);
+	group = KPDBGetField(rec, recLen, NULL, NULL, NULL);
+
+	if (which == LC_NEWSGROUPS) {
+	    data = KPDBGetFieldDecode(rec, recLen, "GD", &dlen, "?");
+	    nums[0] = '\t';
+	    nlen = 1;
+	} else {
+	    int mode = which - LC_ACTIVE;
+
+	    data = KPDBGetField(rec, recLen, "S", &dlen, "n");
+	    nlen = snprintf(nums, sizeof(nums), " %010lld %010lld ",
+		artno_ne(le->le_NB, le->le_NE, mode),
+		artno_nb(le->le_NB, le->le_NE, mode)
+	    );
+	}
+
+	if (lb->lb_Len + le->le_NameLen + nlen + dlen + 2 > lb->lb_Max) {
+	    int max = lb->lb_Max * 2 + le->le_NameLen + nlen + dlen + 2;
+	    char *buf;
+
+	    if ((buf = realloc(lb->lb_Buf, max)) == NULL) {
+		free(lb->lb_Buf);
+		free(lb->lb_Line);
+		bzero(lb, sizeof(ListCacheBuf));
+		return(-1);
+	    }
+	    lb->lb_Buf = buf;
+	    lb->lb_Max = max;
+	}
+	lb->lb_Line[i] = lb->lb_Len;
+	bcopy(group, lb->lb_Buf + lb->lb_Len, le->le_NameLen);
+	lb->lb_Len += le->le_NameLen;
+	bcopy(nums, lb->lb_Buf + lb->lb_Len, nlen);
+	lb->lb_Len += nlen;
+	bcopy(data, lb->lb_Buf + lb->lb_Len, dlen);
+	lb->lb_Len += dlen;
+	bcopy("\r\n", lb->lb_Buf + lb->lb_Len, 2);
+	lb->lb_Len += 2;
+    }
+    lb->lb_Line[i] = lb->lb_Len;
+    return(0);
+}
+
+/*
+ * lcpatch() - write changed article numbers into the rendered buffers,
+ *	       or mark everything for a rescan
+ */
+
+static void
+lcpatch(void)
+{
+    int changed = 0;
+    int i;
+
+    for (i = 0; i < LCCount && LCDirty == 0; ++i) {
+	ListCacheEnt *le = &LCEnt[i];
+	ListCacheEnt ne;
+	const char *rec;
+	int recLen;
+	int m;
+
+	rec = KPDBReadRecordAt(KDBActive, le->le_RecOff, 0, &recLen);
+	if (rec == NULL || rec[0] != '+') {
+	    LCDirty = 1;
+	    break;
+	}
+	lcfields(rec, recLen, &ne);
+	if (ne.le_FlagHash != le->le_FlagHash ||
+	    ne.le_DescHash != le->le_DescHash
+	) {
+	    LCDirty = 1;
+	    break;
+	}
+	if (ne.le_NB == le->le_NB && ne.le_NE == le->le_NE)
+	    continue;
+	le->le_NB = ne.le_NB;
+	le->le_NE = ne.le_NE;
+	changed = 1;
+
+	for (m = 0; m < LC_NEWSGROUPS - LC_ACTIVE; ++m) {
+	    ListCacheBuf *lb = &LCBuf[LC_ACTIVE + m];
+	    char nums[64];
+	    char *p;
+
+	    if (lb->lb_Buf == NULL)
+		continue;
+	    p = lb->lb_Buf + lb->lb_Line[i] + le->le_NameLen;
+	    if (snprintf(nums, sizeof(nums), " %010lld %010lld ",
+		    artno_ne(le->le_NB, le->le_NE, m),
+		    artno_nb(le->le_NB, le->le_NE, m)) != LC_NUMLEN ||
+		p[0] != ' ' || p[11] != ' ' || p[22] != ' '
+	    ) {
+		LCDirty = 1;
+		break;
+	    }
+	    bcopy(nums, p, LC_NUMLEN);
+	}
+    }
+    if (changed) {
+	++LCGen;
+	if (lccounts())
+	    lccounts()->lc_Gen = LCGen;
+    }
+}
+
+/*
+ * ListCacheStart() - set conn up to send the rendered response for mode
+ *		      (COM_ACTIVE or COM_GROUPDESC), filtered by
+ *		      conn->co_ListPat.  Returns -1 if there is none, the
+ *		      caller then scans the active file itself.
+ */
+
+int
+ListCacheStart(Connection *conn, int mode)
+{
+    struct timeval tv;
+    int which;
+    int built = 0;
+
+    if (DOpts.ReaderListCache == 0 || KDBActive == NULL)
+	return(-1);
+    if (mode == COM_ACTIVE)
+	which = LC_ACTIVE + conn->co_Numbering;
+    else if (mode == COM_GROUPDESC)
+	which = LC_NEWSGROUPS;
+    else
+	return(-1);
+    if (which < 0 || which >= LC_NBUFS)
+	return(-1);
+
+    gettimeofday(&tv, NULL);
+    if (LCDirty == 0 && LCAppendSeq != KPDBAppendCount(KDBActive))
+	LCDirty = 1;
+    if (LCDirty == 0 && LCPatchTime != CurTime.tv_sec) {
+	LCPatchTime = CurTime.tv_sec;
+	lcpatch();
+    }
+    if (LCDirty) {
+	if (LCReaders)
+	    return(-1);
+	if (lcscan() < 0) {
+	    LCDirty = 1;
+	    return(-1);
+	}
+	built = 1;
+    }
+    if (LCBuf[which].lb_Buf == NULL) {
+	if (lcrender(which) < 0)
+	    return(-1);
+	built = 1;
+    }
+    if (built) {
+	struct timeval t2;
+
+	gettimeofday(&t2, NULL);
+	if (lccounts())
+	    lccounts()->lc_Ms = (t2.tv_sec - tv.tv_sec) * 1000 +
+				(t2.tv_usec - tv.tv_usec) / 1000;
+	if (DebugOpt)
+	    printf("list cache %d: %d groups, generation %u\n", which, LCCount, LCGen);
+    }
+
+    ++LCReaders;
+    conn->co_ListCacheMode = ACMODE_RENDER;
+    conn->co_ListRender = which;
+    conn->co_ListRec = 0;
+    return(0);
+}
+
+/*
+ * ListCacheSend() - queue more of the response, up to MBUF_HIWAT.
+ *		     Returns 1 when all of it has been queued.
+ */
+
+int
+ListCacheSend(Connection *conn)
+{
+    ListCacheBuf *lb = &LCBuf[conn->co_ListRender];
+    struct GroupList *groups = conn->co_Auth.dr_ListGroupDef->gr_Groups;
+    const char *pat = conn->co_ListPat;
+    int i = conn->co_ListRec;
+
+    if (pat && strcmp(pat, "*") == 0)
+	pat = NULL;
+
+    while (conn->co_TMBuf.mh_Bytes < MBUF_HIWAT && i < LCCount) {
+	const char *line = lb->lb_Buf + lb->lb_Line[i];
+
+	if (pat == NULL && groups == NULL) {
+	    int j = i + 1;
+
+	    while (j < LCCount && lb->lb_Line[j] - lb->lb_Line[i] < LC_CHUNK)
+		++j;
+	    MBWrite(&conn->co_TMBuf, line, lb->lb_Line[j] - lb->lb_Line[i]);
+	    i = j;
+	} else {
+	    char grpbuf[MAXGNAME];
+
+	    bcopy(line, grpbuf, LCEnt[i].le_NameLen);
+	    grpbuf[LCEnt[i].le_NameLen] = 0;
+	    if ((pat == NULL || WildCmp(pat, grpbuf) == 0) &&
+		(groups == NULL || GroupFindWild(grpbuf, groups))
+	    ) {
+		MBWrite(&conn->co_TMBuf, line, lb->lb_Line[i + 1] - lb->lb_Line[i]);
+	    }
+	    ++i;
+	}
+    }
+    conn->co_ListRec = i;
+    return(i >= LCCount);
+}
+
+void
+ListCacheDone(Connection *conn)
+{
+    if (conn->co_ListCacheMode == ACMODE_RENDER) {
+	--LCReaders;
+	conn->co_ListCacheMode = ACMODE_NONE;
+	conn->co_ListRec = 0;
+    }
+}
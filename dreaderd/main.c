@@ -650,6 +650,22 @@ main(int ac, char **av)
     }
 #endif
 
+#if USE_EPOLL
+    /*
+     * The epoll select core is not bound by FD_SETSIZE, allow the
+     * reader forks as many descriptors as the hard limit permits.
+     */
+    {
+	struct rlimit rlp;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlp) == 0 && rlp.rlim_cur < rlp.rlim_max) {
+	    rlp.rlim_cur = rlp.rlim_max;
+	    if (setrlimit(RLIMIT_NOFILE, &rlp) < 0)
+		perror("setrlimit(RLIMIT_NOFILE)");
+	}
+    }
+#endif
+
     if (DOpts.ReaderHostName == NULL)
 	SetMyHostName(&DOpts.ReaderHostName);
     if (*DOpts.ReaderHostName == 0) {
@@ -684,7 +700,7 @@ main(int ac, char **av)
      * RTStatus file initial open
      */
 
-    RTStatusOpen(RTStatus, 0, 1);
+    RTStatusOpen(RTStatus, 0, RT_MASTERSLOTS);
 
     /*
      * open syslog
@@ -720,10 +736,13 @@ main(int ac, char **av)
 #endif
 
     /*
-     * Cancel cache (inherited by children)
+     * Cancel and overview caches (inherited by children)
      */
 
     InitCancelCache();
+    InitOverCache();
+    InitListCache();
+    InitZeroCopy();
 
     InstallAccessCache();
 
@@ -924,7 +943,7 @@ main(int ac, char **av)
 	 */
 	{
 	    struct timeval tv;
-	    fd_set rfds = SFds;
+	    static FdSet rfds;
 	    int i;
 
 	    if (Exiting)
@@ -937,17 +956,32 @@ main(int ac, char **av)
 		NumPending, DOpts.ReaderDns, 
 		NumActive, MaxConnects
 	    );
-	    RTStatusUpdate(0, "Connect=%d Failed=%d Dns=%d/%d Act=%d/%d", 
-		ConnectCount, FailCount,
-		NumPending, DOpts.ReaderDns, 
-		NumActive, MaxConnects
-	    );
+	    {
+		uint32 oc[OC_NCOUNTS];
+		uint32 lgen;
+		uint32 lms;
+
+		OverCacheStats(oc);
+		ListCacheStats(&lgen, &lms);
+		RTStatusUpdate(0, "Connect=%d Failed=%d Dns=%d/%d Act=%d/%d ZeroCopy=%s", 
+		    ConnectCount, FailCount,
+		    NumPending, DOpts.ReaderDns, 
+		    NumActive, MaxConnects,
+		    ftos(ZeroCopyTotal())
+		);
+		RTStatusUpdate(1, "Over=%u/%u/%u/%u/%u List=%u/%ums",
+		    oc[OC_HIT], oc[OC_SHARED], oc[OC_MISS],
+		    oc[OC_EVICT], oc[OC_REPLACED],
+		    lgen, lms
+		);
+	    }
 
-	    select(MaxFds, &rfds, NULL, NULL, &tv);
+	    FdsCopy(&rfds, &SFds);
+	    ThreadSelect(MaxFds, &rfds, NULL, &tv);
 	    gettimeofday(&CurTime, NULL);
 
 	    for (i = 0; i < MaxFds; ++i) {
-		if (FD_ISSET(i, &rfds)) {
+		if (FDS_ISSET(i, &rfds)) {
 		    ForkDesc *desc;
 
 		    if ((desc = FindThread(i, -1)) != NULL) {
@@ -1051,7 +1085,7 @@ main(int ac, char **av)
 			desc->d_Fd >= 0 &&
 			desc->d_Type == THREAD_LISTEN
 		    ) {
-			FD_SET(desc->d_Fd, &SFds);
+			FDS_SET(desc->d_Fd, &SFds);
 		    }
 		}
 	    }
@@ -1067,7 +1101,7 @@ main(int ac, char **av)
 			desc->d_Fd >= 0 &&
 			desc->d_Type == THREAD_LISTEN
 		    ) {
-			FD_CLR(desc->d_Fd, &SFds);
+			FDS_CLR(desc->d_Fd, &SFds);
 		    }
 		}
 	    }
@@ -1163,7 +1197,7 @@ DoListen(ForkDesc *desc, time_t t)
 	    return;
 	}
 
-	if (fd >= MAXFDS) {
+	if (!ThreadFdOk(fd)) {
 	    logit(LOG_CRIT, "fd beyond MAXFDS: %d, closing", fd);
 	    snprintf(errbuf, sizeof(errbuf), "400 %s: Too many open descriptors, please try later%s%s\r\n",
 					DOpts.ReaderHostName,
@@ -1496,7 +1530,7 @@ ForkPipe(int *pfd, void (*task)(int fd, const char *id), const char *description
 	logit(LOG_ERR, "socketpair() call failed");
 	return((pid_t)-1);
     }
-    if (fds[0] > MAXFDS || fds[1] > MAXFDS) {
+    if (!ThreadFdOk(fds[0]) || !ThreadFdOk(fds[1])) {
 	logit(LOG_ERR, "pipe desc > MAXFDS: %d/%d/%d", fds[0], fds[1], MAXFDS);
 	close(fds[0]);
 	close(fds[1]);
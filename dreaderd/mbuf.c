@@ -18,6 +18,7 @@ Prototype void MBFree(MBufHead *mh);
 Prototype void MBPoll(MBufHead *mh);
 Prototype void MBInit(MBufHead *mh, int fd, MemPool **mpool, MemPool **bpool);
 Prototype void MBWrite(MBufHead *mh, const void *data, int len);
+Prototype void MBSendFile(MBufHead *mh, int fd, off_t off, int len);
 Prototype int MZInit(Connection *conn, MBufHead *mh, int level);
 Prototype void MZWrite(Connection *conn, const void *data, int len);
 Prototype void MZPrintf(Connection *conn, const char *ctl, ...);
@@ -30,7 +31,78 @@ Prototype int MBRead(MBufHead *mh, void *data, int len);
 Prototype int MBReadLine(MBufHead *mh, char **pptr);
 Prototype char *MBNormalize(MBufHead *mh, int *plen);
 
+Prototype double ZeroCopyBytes;
+Prototype void InitZeroCopy(void);
+Prototype double ZeroCopyTotal(void);
+
 void DebugData(const char *h, const void *buf, int n);
+void MBFreeOne(MBufHead *mh, MBuf *mbuf);
+int MBSendFileSeg(MBufHead *mh, MBuf *mbuf, int n);
+
+double ZeroCopyBytes;		/* bytes sent with sendfile() */
+
+/*
+ * The bytes each fork sent with sendfile() are also kept in a shared
+ * memory segment, one cache line per fork, so the master can show
+ * the total in dreaderd.status.
+ */
+typedef struct ZeroCopyCount {
+    double	zc_Bytes;
+    char	zc_Pad[64 - sizeof(double)];
+} ZeroCopyCount;
+
+ZeroCopyCount	*ZCCounts = NULL;
+int		ZCNumCounts;
+
+/*
+ * InitZeroCopy() - master: create the counter segment before forking
+ */
+
+void
+InitZeroCopy(void)
+{
+#if USE_SENDFILE
+    size_t bytes;
+    int sid;
+    struct shmid_ds ds;
+    char *base;
+
+    ZCNumCounts = DOpts.ReaderForks + DOpts.ReaderFeedForks;
+    bytes = ZCNumCounts * sizeof(ZeroCopyCount);
+    if (bytes == 0)
+	return;
+    if ((sid = shmget(IPC_PRIVATE, bytes, SHM_R|SHM_W)) < 0) {
+	logit(LOG_WARNING, "InitZeroCopy cannot allocate sysv shared memory");
+	return;
+    }
+    base = (char *)shmat(sid, NULL, SHM_R|SHM_W);
+    if (shmctl(sid, IPC_STAT, &ds) < 0 || shmctl(sid, IPC_RMID, &ds) < 0) {
+	logit(LOG_CRIT, "sysv shmctl stat/rmid failed");
+	exit(1);
+    }
+    if (base == (char *)-1) {
+	logit(LOG_CRIT, "sysv shared memory map failed");
+	exit(1);
+    }
+    bzero(base, bytes);
+    ZCCounts = (ZeroCopyCount *)base;
+#endif
+}
+
+/*
+ * ZeroCopyTotal() - master: bytes sent with sendfile() by all forks
+ */
+
+double
+ZeroCopyTotal(void)
+{
+    double total = 0.0;
+    int i;
+
+    for (i = 0; ZCCounts && i < ZCNumCounts; ++i)
+	total += ZCCounts[i].zc_Bytes;
+    return(total);
+}
 
 /*
  * MBFlush() - attempt to write output to descriptor, set select bits
@@ -107,7 +179,11 @@ MBFlush(Connection *conn, MBufHead *mh)
 	     */
 
 	    errno = 0;
-	    n = write(mh->mh_Fd, mbuf->mb_Buf + mbuf->mb_Index, n);
+	    if (mbuf->mb_Buf == NULL) {
+		n = MBSendFileSeg(mh, mbuf, n);
+	    } else {
+		n = write(mh->mh_Fd, mbuf->mb_Buf + mbuf->mb_Index, n);
+	    }
 
 	    if (n < 0) {
 		if (errno == EINTR)
@@ -149,7 +225,7 @@ MBFlush(Connection *conn, MBufHead *mh)
 	if (mh->mh_WError)
 	    n = mbuf->mb_Size - mbuf->mb_Index;
 
-	if (DebugOpt > 1) {
+	if (DebugOpt > 1 && mbuf->mb_Buf != NULL) {
 	    DebugData(">>", mbuf->mb_Buf + mbuf->mb_Index, n);
 	}
 
@@ -157,17 +233,15 @@ MBFlush(Connection *conn, MBufHead *mh)
 	mh->mh_Bytes -= n;
 	if (mbuf->mb_Index == mbuf->mb_Size) {
 	    mh->mh_MBuf = mbuf->mb_Next;
-	    if (mbuf->mb_Buf)
-		zfree(mh->mh_BufPool, mbuf->mb_Buf, mbuf->mb_Max);
-	    zfree(mh->mh_MemPool, mbuf, sizeof(MBuf));
+	    MBFreeOne(mh, mbuf);
 	}
     }
 
     if (mh->mh_Fd >= 0) {
 	if (mh->mh_WError || mh->mh_MBuf == NULL || (desc && desc->d_Timer))
-	    FD_CLR(mh->mh_Fd, &WFds); 
+	    FDS_CLR(mh->mh_Fd, &WFds); 
 	else
-	    FD_SET(mh->mh_Fd, &WFds); 
+	    FDS_SET(mh->mh_Fd, &WFds); 
     }
 }
 
@@ -178,9 +252,7 @@ MBFree(MBufHead *mh)
 
     while ((mbuf = mh->mh_MBuf) != NULL) {
 	mh->mh_MBuf = mbuf->mb_Next;
-	if (mbuf->mb_Buf)
-	    zfree(mh->mh_BufPool, mbuf->mb_Buf, mbuf->mb_Max);
-	zfree(mh->mh_MemPool, mbuf, sizeof(MBuf));
+	MBFreeOne(mh, mbuf);
     }
     mh->mh_Bytes = 0;
     mh->mh_TotalBytes = 0.0;
@@ -191,6 +263,21 @@ MBFree(MBufHead *mh)
     mh->mh_WError = 0;
 }
 
+/*
+ * MBFreeOne() - release a single mbuf, closing the descriptor of a
+ *		 file segment.
+ */
+
+void
+MBFreeOne(MBufHead *mh, MBuf *mbuf)
+{
+    if (mbuf->mb_Buf)
+	zfree(mh->mh_BufPool, mbuf->mb_Buf, mbuf->mb_Max);
+    else
+	close(mbuf->mb_FileFd);
+    zfree(mh->mh_MemPool, mbuf, sizeof(MBuf));
+}
+
 /*
  * MBInit() initialize an MBuf header.  MBuf's are allocated on the
  * fly as needed.
@@ -214,7 +301,7 @@ MBWrite(MBufHead *mh, const void *data, int len)
      */
 
     if (mh->mh_Fd >= 0)
-	FD_CLR(mh->mh_Fd, &WFds); 
+	FDS_CLR(mh->mh_Fd, &WFds); 
 
     /*
      * Queue the remainder and set WFds for the descriptor
@@ -246,7 +333,88 @@ MBWrite(MBufHead *mh, const void *data, int len)
 	data = (char *)data + n;
     }
     if (mh->mh_Fd >= 0)
-	FD_SET(mh->mh_Fd, &WFds); 
+	FDS_SET(mh->mh_Fd, &WFds); 
+}
+
+/*
+ * MBSendFile() - queue len bytes of a file starting at off.  The data
+ *		  is not copied, MBFlush() hands it to sendfile() when
+ *		  it gets to it.  The descriptor belongs to the mbuf from
+ *		  here on and is closed once the segment has been sent.
+ *
+ *		  Without sendfile() the data is read and queued with
+ *		  MBWrite().
+ */
+
+void
+MBSendFile(MBufHead *mh, int fd, off_t off, int len)
+{
+#if USE_SENDFILE
+    MBuf **pmbuf = &mh->mh_MBuf;
+    MBuf *mbuf;
+
+    while ((mbuf = *pmbuf) != NULL)
+	pmbuf = &mbuf->mb_Next;
+    *pmbuf = mbuf = zalloc(mh->mh_MemPool, sizeof(MBuf));
+    mbuf->mb_Buf = NULL;
+    mbuf->mb_FileFd = fd;
+    mbuf->mb_FileOff = off;
+    mbuf->mb_Size = len;
+    mbuf->mb_Max = len;		/* full, MBWrite() appends a new mbuf */
+    mh->mh_Bytes += len;
+    mh->mh_TotalBytes += len;
+    if (mh->mh_Fd >= 0)
+	FDS_SET(mh->mh_Fd, &WFds); 
+#else
+    char buf[MBUF_SIZE];
+
+    while (len > 0) {
+	int n = pread(fd, buf, (len > sizeof(buf)) ? sizeof(buf) : len, off);
+
+	if (n <= 0)
+	    break;
+	MBWrite(mh, buf, n);
+	off += n;
+	len -= n;
+    }
+    close(fd);
+#endif
+}
+
+/*
+ * MBSendFileSeg() - MBFlush() helper, push up to n bytes of a file
+ *		     segment to the descriptor.  Returns the number of
+ *		     bytes sent or -1 with errno set, like write().
+ */
+
+int
+MBSendFileSeg(MBufHead *mh, MBuf *mbuf, int n)
+{
+#if USE_SENDFILE
+    off_t off = mbuf->mb_FileOff + mbuf->mb_Index;
+    int r;
+
+    if (n == 0)
+	return(0);
+    r = sendfile(mh->mh_Fd, mbuf->mb_FileFd, &off, n);
+    if (r == 0) {
+	/*
+	 * The file got shorter underneath us, there is no way to
+	 * make up the rest of the promised data.
+	 */
+	errno = EIO;
+	r = -1;
+    }
+    if (r > 0) {
+	ZeroCopyBytes += r;
+	if (ZCCounts && ThisReaderFork >= 0 && ThisReaderFork < ZCNumCounts)
+	    ZCCounts[ThisReaderFork].zc_Bytes += r;
+    }
+    return(r);
+#else
+    errno = EIO;
+    return(-1);
+#endif
 }
 
 int
@@ -361,7 +529,7 @@ MBWriteDecode(MBufHead *mh, const char *data, int len)
      */
 
     if (mh->mh_Fd >= 0)
-	FD_CLR(mh->mh_Fd, &WFds); 
+	FDS_CLR(mh->mh_Fd, &WFds); 
 
     /*
      * Queue the remainder and set WFds for the descriptor
@@ -401,7 +569,7 @@ MBWriteDecode(MBufHead *mh, const char *data, int len)
 	}
     }
     if (mh->mh_Fd >= 0)
-	FD_SET(mh->mh_Fd, &WFds); 
+	FDS_SET(mh->mh_Fd, &WFds); 
 }
 
 void 
@@ -431,7 +599,7 @@ MBCopy(MBufHead *m1, MBufHead *m2)
     m1->mh_Bytes = 0;
     m1->mh_TotalBytes = 0.0;
     if (m2->mh_Fd >= 0)
-	FD_SET(m2->mh_Fd, &WFds); 
+	FDS_SET(m2->mh_Fd, &WFds); 
 }
 
 void
@@ -480,7 +648,7 @@ MBRead(MBufHead *mh, void *data, int len)
     int r = 0;
 
     if (mh->mh_Fd >= 0)
-	FD_CLR(mh->mh_Fd, &RFds);
+	FDS_CLR(mh->mh_Fd, &RFds);
 
     while (len) {
 	MBuf *mbuf;
@@ -518,11 +686,11 @@ MBRead(MBufHead *mh, void *data, int len)
 		    errno == EINPROGRESS || 
 		    errno == EAGAIN
 		) {
-		    FD_SET(mh->mh_Fd, &RFds);
+		    FDS_SET(mh->mh_Fd, &RFds);
 		    break;	/* break while */
 		}
 		if (errno == ENOTCONN) {
-		    FD_SET(mh->mh_Fd, &RFds);
+		    FDS_SET(mh->mh_Fd, &RFds);
 		    break;	/* break while */
 		}
 	    }
@@ -568,7 +736,7 @@ MBReadLine(MBufHead *mh, char **pptr)
     MBuf *mbuf = NULL;
 
     if (mh->mh_Fd >= 0)
-	FD_CLR(mh->mh_Fd, &RFds);
+	FDS_CLR(mh->mh_Fd, &RFds);
 
     while (haveit == 0) {
 	MBuf **pmbuf = &mh->mh_MBuf;
@@ -654,11 +822,11 @@ MBReadLine(MBufHead *mh, char **pptr)
 			errno == EINPROGRESS ||
 			errno == EAGAIN
 		    ) {
-			FD_SET(mh->mh_Fd, &RFds);
+			FDS_SET(mh->mh_Fd, &RFds);
 			break;	/* break while */
 		    }
 		    if (errno == ENOTCONN) {
-			FD_SET(mh->mh_Fd, &RFds);
+			FDS_SET(mh->mh_Fd, &RFds);
 			break;	/* break while */
 		    }
 		    n = 0;
@@ -0,0 +1,258 @@
+/*
+ * DREADERD/OVERCACHE.C
+ *
+ *	Shared table of overview open parameters.  Every reader fork keeps
+ *	its own OverInfo cache (see GetOverInfo()), and setting one up for a
+ *	group means a locked read of the group's dactive.kp record, an
+ *	expire.ctl lookup, a walk of the group directories and a read and
+ *	check of the over.* header.  The mappings themselves can not be
+ *	shared between forks, but all of that can: once one fork has set up
+ *	a group it enters what it found here, and the other forks only have
+ *	to open, lock and map the over.* file, checking that it is still the
+ *	file that was entered (same device and inode).
+ *
+ *	The table lives in a SysV shared memory segment created before the
+ *	forks, like the cancel cache.  Entries are written lock-free under a
+ *	per-entry sequence count (odd while being written) and replaced
+ *	oldest first within their probe window, preferring entries no fork
+ *	has open.  They are only trusted for OC_MAXAGE seconds, which also
+ *	bounds how stale the NE value and the expire limit can get.
+ *
+ *	The table also carries per-fork counters for the overview cache,
+ *	summed up by the master for the status file.
+ *
+ * Refer to the COPYRIGHT file in the base directory of this distribution
+ * for specific rights granted.
+ */
+
+#include "defs.h"
+
+Prototype void InitOverCache(void);
+Prototype int OverCacheFind(const char *group, OverCacheEnt *oce);
+Prototype int OverCacheEnter(const OverCacheEnt *oce);
+Prototype void OverCacheRef(int slot, const char *group, int n);
+Prototype void OverCacheCount(int which);
+Prototype void OverCacheSet(int which, uint32 value);
+Prototype void OverCacheStats(uint32 *counts);
+
+#define OC_HSIZE	4096
+#define OC_HMASK	(OC_HSIZE-1)
+#define OC_PROBE	8
+#define OC_MAXAGE	300
+
+#if defined(__GNUC__)
+#define OCCAS(p, o, n)	__sync_bool_compare_and_swap(p, o, n)
+#define OCADD(p, n)	__sync_fetch_and_add(p, n)
+#define OCBARRIER()	__sync_synchronize()
+#define OC_ATOMIC	1
+#else
+#define OC_ATOMIC	0
+#endif
+
+typedef struct OverCacheSlot {
+    volatile uint32	os_Seq;
+    volatile int32	os_Refs;	/* forks with the group open	*/
+    OverCacheEnt	os_Ent;
+} OverCacheSlot;
+
+/*
+ * one line of counters per fork, so the forks do not share cache lines
+ */
+typedef struct OverCacheCounts {
+    uint32	oc_Count[OC_NCOUNTS];
+    char	oc_Pad[64 - OC_NCOUNTS * sizeof(uint32)];
+} OverCacheCounts;
+
+OverCacheSlot	*OCSlots = NULL;
+OverCacheCounts	*OCCounts = NULL;
+int		OCNumCounts;
+
+void
+InitOverCache(void)
+{
+#if USE_OVERCACHE_SHM && OC_ATOMIC
+    size_t bytes;
+    int sid;
+    struct shmid_ds ds;
+    char *base;
+
+    OCNumCounts = DOpts.ReaderForks + DOpts.ReaderFeedForks;
+    bytes = OC_HSIZE * sizeof(OverCacheSlot) +
+			OCNumCounts * sizeof(OverCacheCounts);
+    sid = shmget(IPC_PRIVATE, bytes, SHM_R|SHM_W);
+
+    if (sid < 0) {
+	logit(LOG_WARNING, "InitOverCache cannot allocate sysv shared memory");
+	return;
+    }
+    base = (char *)shmat(sid, NULL, SHM_R|SHM_W);
+    if (shmctl(sid, IPC_STAT, &ds) < 0 || shmctl(sid, IPC_RMID, &ds) < 0) {
+	logit(LOG_CRIT, "sysv shmctl stat/rmid failed");
+	exit(1);
+    }
+    if (base == (char *)-1) {
+	logit(LOG_CRIT, "sysv shared memory map failed");
+	exit(1);
+    }
+    bzero(base, bytes);
+    OCSlots = (OverCacheSlot *)base;
+    OCCounts = (OverCacheCounts *)(base + OC_HSIZE * sizeof(OverCacheSlot));
+#endif
+}
+
+static int
+ocmatch(const OverCacheSlot *os, hash_t hv, const char *group)
+{
+    return(os->os_Ent.oc_Hv.h1 == hv.h1 && os->os_Ent.oc_Hv.h2 == hv.h2 &&
+	strcmp(os->os_Ent.oc_Group, group) == 0);
+}
+
+/*
+ * OverCacheFind() - copy out the entry for group.  Returns its slot
+ *		     number, or -1 if there is no usable entry.
+ */
+
+int
+OverCacheFind(const char *group, OverCacheEnt *oce)
+{
+#if OC_ATOMIC
+    hash_t hv;
+    int i;
+
+    if (OCSlots == NULL || strlen(group) >= sizeof(oce->oc_Group))
+	return(-1);
+    hv = hhash(group);
+    for (i = 0; i < OC_PROBE; ++i) {
+	int slot = ((hv.h1 ^ hv.h2) + i) & OC_HMASK;
+	OverCacheSlot *os = &OCSlots[slot];
+	uint32 seq = os->os_Seq;
+
+	if (seq & 1)
+	    continue;
+	OCBARRIER();
+	if (!ocmatch(os, hv, group))
+	    continue;
+	*oce = os->os_Ent;
+	OCBARRIER();
+	if (os->os_Seq != seq || strcmp(oce->oc_Group, group) != 0)
+	    return(-1);
+	if (CurTime.tv_sec - oce->oc_Time > OC_MAXAGE)
+	    return(-1);
+	return(slot);
+    }
+#endif
+    return(-1);
+}
+
+/*
+ * OverCacheEnter() - enter or refresh the entry for oce->oc_Group.
+ *		      Returns the slot used or -1.  Gives up rather than
+ *		      wait if another fork is writing the slot.
+ */
+
+int
+OverCacheEnter(const OverCacheEnt *oce)
+{
+#if OC_ATOMIC
+    OverCacheSlot *os = NULL;
+    hash_t hv;
+    uint32 seq;
+    int slot = -1;
+    int i;
+
+    if (OCSlots == NULL || strlen(oce->oc_Group) >= sizeof(oce->oc_Group))
+	return(-1);
+    hv = hhash(oce->oc_Group);
+
+    for (i = 0; i < OC_PROBE; ++i) {
+	int s = ((hv.h1 ^ hv.h2) + i) & OC_HMASK;
+	OverCacheSlot *scan = &OCSlots[s];
+
+	if (ocmatch(scan, hv, oce->oc_Group)) {
+	    slot = s;
+	    break;
+	}
+	if (slot < 0 ||
+	    (scan->os_Refs <= 0 && os->os_Refs > 0) ||
+	    ((scan->os_Refs <= 0) == (os->os_Refs <= 0) &&
+	     scan->os_Ent.oc_Time < os->os_Ent.oc_Time)
+	) {
+	    slot = s;
+	    os = scan;
+	}
+    }
+    os = &OCSlots[slot];
+
+    seq = os->os_Seq;
+    if ((seq & 1) || !OCCAS(&os->os_Seq, seq, seq + 1))
+	return(-1);
+    OCBARRIER();
+    if (!ocmatch(os, hv, oce->oc_Group)) {
+	if (os->os_Ent.oc_Group[0])
+	    OverCacheCount(OC_REPLACED);
+	os->os_Refs = 0;
+    }
+    os->os_Ent = *oce;
+    os->os_Ent.oc_Hv = hv;
+    OCBARRIER();
+    os->os_Seq = seq + 2;
+    return(slot);
+#else
+    return(-1);
+#endif
+}
+
+/*
+ * OverCacheRef() - count a fork opening (n = 1) or closing (n = -1) the
+ *		    group held in slot
+ */
+
+void
+OverCacheRef(int slot, const char *group, int n)
+{
+#if OC_ATOMIC
+    OverCacheSlot *os;
+
+    if (OCSlots == NULL || slot < 0)
+	return;
+    os = &OCSlots[slot & OC_HMASK];
+    if (strcmp(os->os_Ent.oc_Group, group) == 0 && (n > 0 || os->os_Refs > 0))
+	OCADD(&os->os_Refs, n);
+#endif
+}
+
+void
+OverCacheCount(int which)
+{
+    if (OCCounts && ThisReaderFork >= 0 && ThisReaderFork < OCNumCounts)
+	++OCCounts[ThisReaderFork].oc_Count[which];
+}
+
+void
+OverCacheSet(int which, uint32 value)
+{
+    if (OCCounts && ThisReaderFork >= 0 && ThisReaderFork < OCNumCounts)
+	OCCounts[ThisReaderFork].oc_Count[which] = value;
+}
+
+/*
+ * OverCacheStats() - master: sum the counters of all forks, take the
+ *		      highest value of the others
+ */
+
+void
+OverCacheStats(uint32 *counts)
+{
+    int i;
+    int j;
+
+    bzero(counts, OC_NCOUNTS * sizeof(uint32));
+    for (i = 0; OCCounts && i < OCNumCounts; ++i) {
+	for (j = 0; j < OC_NSUMS; ++j)
+	    counts[j] += OCCounts[i].oc_Count[j];
+	for (j = OC_NSUMS; j < OC_NCOUNTS; ++j) {
+	    if (counts[j] < OCCounts[i].oc_Count[j])
+		counts[j] = OCCounts[i].oc_Count[j];
+	}
+    }
+}
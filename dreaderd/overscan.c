@@ -0,0 +1,199 @@
+/*
+ * DREADERD/OVERSCAN.C
+ *
+ *	Byte scanners for overview records.  A record holds the article's
+ *	headers as received, one \r\n terminated line each (folded lines
+ *	continue with a space or a tab), and is \0 terminated as a whole.
+ *	OutputOverview() indexes the lines of a record with OverScanLine(),
+ *	as far as the headers asked for need it and only once, and splits
+ *	the headers it outputs at their line breaks with OverScanSep(),
+ *	rather than walking the record a byte at a time for every header.
+ *
+ *	Both look for one of a few bytes.  With SSE2 (any x86-64) or AVX2
+ *	(-mavx2) 16 or 32 bytes are compared at a time and the first
+ *	match is taken from the movemask.  Other machines, and the tail
+ *	of a short run, go through a byte class table.  OverScanScalar
+ *	forces the table, for doverbench.
+ *
+ * Refer to the COPYRIGHT file in the base directory of this distribution
+ * for specific rights granted.
+ */
+
+#include "defs.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define OS_SSE2		1
+#else
+#define OS_SSE2		0
+#endif
+
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define OS_AVX2		1
+#else
+#define OS_AVX2		0
+#endif
+
+Prototype int OverScanLine(const char *rec, int len, int b, OverLine *ol);
+Prototype int OverScanSep(const char *p, int len, int tabs);
+Prototype const char *OverScanType(void);
+Prototype int OverScanScalar;
+
+#define OSC_EOL		0x01	/* \n \0	*/
+#define OSC_SEP		0x02	/* \r \n	*/
+#define OSC_TAB		0x04	/* \t		*/
+
+static const unsigned char OSClass[256] = {
+    [0] = OSC_EOL,
+    ['\t'] = OSC_TAB,
+    ['\n'] = OSC_EOL | OSC_SEP,
+    ['\r'] = OSC_SEP
+};
+
+int OverScanScalar = 0;
+
+static int
+osscalar(const char *p, int len, int mask)
+{
+    int i;
+
+    for (i = 0; i < len; ++i) {
+	if (OSClass[(unsigned char)p[i]] & mask)
+	    break;
+    }
+    return(i);
+}
+
+/*
+ * osscan() - offset of the first byte of class mask in p[0..len), or len
+ */
+
+static int
+osscan(const char *p, int len, int mask)
+{
+    int i = 0;
+#if OS_SSE2
+    char a;
+    char b;
+    char c;
+
+    if (OverScanScalar)
+	return(osscalar(p, len, mask));
+
+    if (mask & OSC_EOL) {
+	a = '\n';
+	b = c = 0;
+    } else {
+	a = '\r';
+	b = '\n';
+	c = (mask & OSC_TAB) ? '\t' : '\n';
+    }
+#if OS_AVX2
+    if (len >= 32) {
+	__m256i va = _mm256_set1_epi8(a);
+	__m256i vb = _mm256_set1_epi8(b);
+	__m256i vc = _mm256_set1_epi8(c);
+
+	for (; i + 32 <= len; i += 32) {
+	    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+	    uint32 m = _mm256_movemask_epi8(
+		_mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+		    _mm256_cmpeq_epi8(v, vc)
+		)
+	    );
+	    if (m)
+		return(i + __builtin_ctz(m));
+	}
+    }
+#endif
+    if (len >= 16) {
+	__m128i va = _mm_set1_epi8(a);
+	__m128i vb = _mm_set1_epi8(b);
+	__m128i vc = _mm_set1_epi8(c);
+
+	for (;;) {
+	    __m128i v;
+	    uint32 m;
+	    int skip = 0;
+
+	    /*
+	     * The last 16 bytes overlap what was already looked at
+	     * rather than going through the table
+	     */
+	    if (i + 16 > len) {
+		if (i == len)
+		    break;
+		skip = i - (len - 16);
+		i = len - 16;
+	    }
+	    v = _mm_loadu_si128((const __m128i *)(p + i));
+	    m = _mm_movemask_epi8(
+		_mm_or_si128(
+		    _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+		    _mm_cmpeq_epi8(v, vc)
+		)
+	    );
+	    m = (m >> skip) << skip;
+	    if (m)
+		return(i + __builtin_ctz(m));
+	    i += 16;
+	}
+	return(len);
+    }
+#endif
+    return(i + osscalar(p + i, len - i, mask));
+}
+
+/*
+ * OverScanLine() - index the header line of an overview record starting
+ *		    at offset b.  Returns the offset of the next line, or
+ *		    -1 if there is no line at b (the \r\n ending the
+ *		    headers, a \0 or len).
+ */
+
+int
+OverScanLine(const char *rec, int len, int b, OverLine *ol)
+{
+    const char *colon;
+    int e = b;
+
+    for (;;) {
+	e += osscan(rec + e, len - e, OSC_EOL);
+	if (e == len || rec[e] == 0)
+	    break;
+	if (++e == len || (rec[e] != ' ' && rec[e] != '\t'))
+	    break;
+    }
+    if (e == b)
+	return(-1);
+    if (e - b == 2 && rec[b] == '\r' && rec[b+1] == '\n')
+	return(-1);
+    ol->ol_Line = rec + b;
+    ol->ol_Len = e - b;
+    if ((colon = memchr(rec + b, ':', e - b)) != NULL)
+	ol->ol_NameLen = colon - (rec + b);
+    else
+	ol->ol_NameLen = e - b;
+    return(e);
+}
+
+/*
+ * OverScanSep() - offset of the first \r or \n (or \t if tabs) in
+ *		   p[0..len), or len
+ */
+
+int
+OverScanSep(const char *p, int len, int tabs)
+{
+    return(osscan(p, len, OSC_SEP | (tabs ? OSC_TAB : 0)));
+}
+
+const char *
+OverScanType(void)
+{
+    if (OverScanScalar || !OS_SSE2)
+	return("scalar");
+    return(OS_AVX2 ? "avx2" : "sse2");
+}
@@ -100,7 +100,10 @@ ReaderTask(int fd, const char *id)
     /*
      * [re]open RTStatus
      */
-    RTStatusOpen(RTStatus, ThisReaderFork * DOpts.ReaderThreads + 1, DOpts.ReaderThreads);
+    RTStatusOpen(RTStatus,
+	ThisReaderFork * DOpts.ReaderThreads + RT_MASTERSLOTS,
+	DOpts.ReaderThreads
+    );
 
     /*
      * Since we setuid(), we won't core.  This is for debugging
@@ -122,7 +125,7 @@ ReaderTask(int fd, const char *id)
     ResetThreads();
     AddThread("reader", fd, -1, THREAD_READER, -1, 0);
 
-    FD_SET(fd, &RFds);
+    FDS_SET(fd, &RFds);
 
     /*
      * Open KPDB database for active file
@@ -151,11 +154,14 @@ ReaderTask(int fd, const char *id)
 	 *  select core
 	 */
 	struct timeval tv;
-	fd_set rfds = RFds;
-	fd_set wfds = WFds;
-	fd_set read_only_to_find_eof_fds;
+	static FdSet rfds;
+	static FdSet wfds;
+	static FdSet read_only_to_find_eof_fds;
 	int i, sel_r;
 
+	FdsCopy(&rfds, &RFds);
+	FdsCopy(&wfds, &WFds);
+
 	if (TerminatePending) {
 	    if (TerminateTime == 0)
 		TerminateTime = time(NULL) + 2;
@@ -178,41 +184,38 @@ ReaderTask(int fd, const char *id)
 	else
 	    NextTimeout(&tv, 2 * 1000);
 
-	stprintf("%s readers=%02d spoolsrv=%d/%d postsrv=%d/%d",
+	stprintf("%s readers=%02d spoolsrv=%d/%d postsrv=%d/%d zerocopy=%.0f",
 	    id,
 	    NumReaders,
 	    NReadServAct, NReadServers, 
-	    NWriteServAct, NWriteServers
+	    NWriteServAct, NWriteServers,
+	    ZeroCopyBytes
 	);
 
 	/* Check for disconnected clients every 50 times through the loop */
-	FD_ZERO(&read_only_to_find_eof_fds);
+	FdsZero(&read_only_to_find_eof_fds);
 	if (++check_disconn_counter == 50) {
 	    for (i = 0; i < MaxFds; ++i) {
-		if (FD_ISSET(i, &wfds) && (!(FD_ISSET(i, &rfds)))) {
-		    FD_SET(i, &rfds);
-		    FD_SET(i, &read_only_to_find_eof_fds);
+		if (FDS_ISSET(i, &wfds) && (!(FDS_ISSET(i, &rfds)))) {
+		    FDS_SET(i, &rfds);
+		    FDS_SET(i, &read_only_to_find_eof_fds);
 		}
 	    }
 	    check_disconn_counter = 0;
 	}
 
-#if USE_AIO
-	AIOUnblockSignal();
-#endif
-	sel_r = select(MaxFds, &rfds, &wfds, NULL, &tv);
-#if USE_AIO
-	AIOBlockSignal();
+#if USE_IO_URING
+	DFARingFlush();
 #endif
+	sel_r = ThreadSelect(MaxFds, &rfds, &wfds, &tv);
 
 	gettimeofday(&CurTime, NULL);
 
 	if(sel_r < 0 && errno != EINTR)
 	    logit(LOG_CRIT,
-		  "select error: %s (rfds=0x%x, wfds=0x%x)",
+		  "select error: %s (maxfds=%d)",
 		  strerror(errno),
-		  rfds,
-		  wfds);
+		  MaxFds);
 
 	/*
 	 * select is critical, don't make unnecessary system calls.  Only
@@ -261,7 +264,7 @@ ReaderTask(int fd, const char *id)
 		 * connections. XXX
 		 */
 		if (itime < -5 || itime >= 300) {
-		    rfds = RFds;
+		    FdsCopy(&rfds, &RFds);
 		    itime = 0;
 		}
 
@@ -301,7 +304,7 @@ ReaderTask(int fd, const char *id)
 	}
 
 	for (i = 0; i < MaxFds; ++i) {
-	    if (FD_ISSET(i, &rfds) && FD_ISSET(i, &read_only_to_find_eof_fds)) {
+	    if (FDS_ISSET(i, &rfds) && FDS_ISSET(i, &read_only_to_find_eof_fds)) {
 		char junk_byte;
 		int ret_val;
 		/*
@@ -310,7 +313,7 @@ ReaderTask(int fd, const char *id)
 		 * from it, but we do want to close it if the associated
 		 * connection is dead.
 		 */
-		FD_CLR(i, &rfds);
+		FDS_CLR(i, &rfds);
 
 		/* Use recv() with MSG_PEEK to see if it's closed.
 		 * We shouldn't block because we're O_NONBLOCK.
@@ -337,7 +340,7 @@ ReaderTask(int fd, const char *id)
 
 	for (i = 0; i < MaxFds; ++i) {
 	    if (forceallcheck || TerminatePending ||
-		FD_ISSET(i, &rfds) || FD_ISSET(i, &wfds)) {
+		FDS_ISSET(i, &rfds) || FDS_ISSET(i, &wfds)) {
 		ForkDesc *desc;
 
 		if ((desc = FindThread(i, -1)) != NULL) {
@@ -358,7 +361,7 @@ ReaderTask(int fd, const char *id)
 
 		    switch(desc->d_Type) {
 		    case THREAD_READER:
-			if (FD_ISSET(i, &rfds) || FD_ISSET(i, &wfds))
+			if (FDS_ISSET(i, &rfds) || FDS_ISSET(i, &wfds))
 			    HandleReaderMsg(desc);
 			break;
 		    case THREAD_NNTP:		/* client	  */
@@ -374,6 +377,12 @@ ReaderTask(int fd, const char *id)
 			conn->co_Func(conn);
 			LogServerInfo(conn, TFd);
 			break;
+#if USE_IO_URING
+		    case THREAD_DFA:		/* spool reads	  */
+			if (FDS_ISSET(i, &rfds))
+			    DFARingReap();
+			break;
+#endif
 		    default:
 			/* panic */
 			break;
@@ -454,7 +463,7 @@ HandleReaderMsg(ForkDesc *desc)
     DnsRes  dres;
 
     if ((r = RecvMsg(desc->d_Fd, &recv_fd, &dres)) == sizeof(DnsRes)) {
-	if (recv_fd >= MAXFDS) {
+	if (recv_fd >= 0 && !ThreadFdOk(recv_fd)) {
 	    logit(LOG_WARNING, "fd too large %d/%d, increase MAXFDS for select. Closing fd", recv_fd, MAXFDS);
 	    /*
 	     * Tell the main server that we are done with the connection
@@ -483,7 +492,7 @@ HandleReaderMsg(ForkDesc *desc)
 	    if (DebugOpt)
 		printf("add thread fd=%d\n", recv_fd);
 
-	    FD_SET(ndesc->d_Fd, &WFds);	/* will cause immediate effect */
+	    FDS_SET(ndesc->d_Fd, &WFds);	/* will cause immediate effect */
 	    conn = InitConnection(ndesc, &dres);
 	    if (conn->co_Auth.dr_Flags & DF_FEED)
 		conn->co_Flags |= COF_SERVER;
@@ -580,6 +589,8 @@ DeleteConnection(Connection *conn)
     if (conn->co_Desc->d_Type == THREAD_SPOOL) {
 	conn->co_LastServerLog = 1;
 	LogServerInfo(conn, TFd);
+	if (conn->co_DirectFA)
+	    DelDFA(conn);
     } else if (conn->co_Desc->d_Type == THREAD_NNTP) {
 	char statbuf[1024];
 	char vsbuf[11];
@@ -658,8 +669,10 @@ NNTerminate(Connection *conn)
 	ActiveCacheFreeMain();
 	ActiveCacheWriteUnlock();
     }
+    if (conn->co_ListCacheMode == ACMODE_RENDER)
+	ListCacheDone(conn);
     MBFlush(conn, &conn->co_TMBuf);
-    FD_SET(conn->co_Desc->d_Fd, &WFds);
+    FDS_SET(conn->co_Desc->d_Fd, &WFds);
 }
 
 void
@@ -1092,13 +1105,13 @@ NNCommand2(Connection *conn)
      */
 
     if (conn->co_FCounter) {
-	FD_SET(conn->co_Desc->d_Fd, &WFds);
+	FDS_SET(conn->co_Desc->d_Fd, &WFds);
 	/*
 	 * if the other side closed the connection, select() is
 	 * not going to wake up for write(!) so set RFds too.
 	 */
 	if (conn->co_TMBuf.mh_WError)
-	    FD_SET(conn->co_Desc->d_Fd, &RFds);
+	    FDS_SET(conn->co_Desc->d_Fd, &RFds);
 	return;
     }
     ++conn->co_FCounter;
@@ -1253,8 +1266,8 @@ NNWaitThread(Connection *conn)
 {
     conn->co_Func = NNWaitThread;
     conn->co_State = "waitrt";
-    FD_CLR(conn->co_Desc->d_Fd, &RFds);
-    /*FD_CLR(conn->co_Desc->d_Fd, &WFds);*/
+    FDS_CLR(conn->co_Desc->d_Fd, &RFds);
+    /*FDS_CLR(conn->co_Desc->d_Fd, &WFds);*/
 }
 
 void
@@ -1359,7 +1372,7 @@ sigSegVReader(int sigNo)
     if (TFd >= 0)
 	close(TFd);
     for (i = 0; i < MaxFds; ++i)
-	if (FD_ISSET(i, &RFds) || FD_ISSET(i, &WFds))
+	if (FDS_ISSET(i, &RFds) || FDS_ISSET(i, &WFds))
 	    close(i);
 
     nice(20);
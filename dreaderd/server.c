@@ -62,7 +62,7 @@ setServerMaybeCloseFlag(ForkDesc *desc)
     Connection *conn = desc->d_Data;
     conn->co_Flags |= COF_MAYCLOSESRV;
     if (conn->co_Func == NNServerIdle)		/* wakeup idle server */
-	FD_SET(desc->d_Fd, &RFds);
+	FDS_SET(desc->d_Fd, &RFds);
 }
 
 void
@@ -471,7 +471,7 @@ AddServer(char *bindinfo, int txbufsize, int rxbufsize, const char *host, int ty
      */
 
     desc = AddThread(host, fd, -1, type, -1, pri);
-    FD_SET(desc->d_Fd, &RFds);
+    FDS_SET(desc->d_Fd, &RFds);
     conn = InitConnection(desc, NULL);
     if (flags & COF_LOGIN) {
 	if (password) {
@@ -751,7 +751,7 @@ NNServerRequest(Connection *conn, const char *grp, const char *msgid, const int
 
     conn->co_SReq = sreq;	/* client has active sreq		*/
 
-    FD_CLR(conn->co_Desc->d_Fd, &RFds);
+    FDS_CLR(conn->co_Desc->d_Fd, &RFds);
 
     if (req == SREQ_RETRIEVE) {
 	*PSRead = sreq;
@@ -1238,7 +1238,8 @@ NNArticleRetrieveByMessageId(Connection *conn, const char *msgid, const char *ms
 		    );
 		}
 		if (conn->co_ArtMode != COM_STAT) {
-		    DumpArticleFromCache(conn, map, size, grpIter, endNo);
+		    if (!SendArticleFromCache(conn, cfd, map, size, grpIter, endNo))
+			DumpArticleFromCache(conn, map, size, grpIter, endNo);
 		    MBPrintf(&conn->co_TMBuf, ".\r\n");
 		}
 		xunmap((void *)map, size);
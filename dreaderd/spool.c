@@ -158,7 +158,9 @@ NNGetLocal1(Connection *conn)
 		    snprintf(filepath, sizeof(filepath), "%s/%s",
 					conn->co_Desc->d_LocalSpool, filename);
 		lf = open(filepath, O_RDONLY);
-		if (lf >= 0 && NewDFA(conn, lf, offset, size)) {
+		if (lf >= 0 && DFASendFile(conn, lf, offset, size)) {
+		    ;
+		} else if (lf >= 0 && NewDFA(conn, lf, offset, size)) {
 		    NNSendLocalArticle(conn);
 		} else {
 		    if (lf == -1) {
@@ -5,6 +5,14 @@
  *	Thread module used to support non-blocking multi-threaded I/O
  *	(see also mbuf.c)
  *
+ *	Descriptor sets are FdSet's rather than fd_set's so a process is
+ *	not limited to FD_SETSIZE descriptors.  ThreadSelect() has select()
+ *	semantics; where USE_EPOLL is set it keeps an epoll set in sync
+ *	with the interest sets passed in, so the kernel does not have to
+ *	walk every idle connection on each pass.  The epoll set is level
+ *	triggered:  the MBuf code relies on re-setting RFds/WFds bits to
+ *	get another pass over a descriptor that still has buffered data.
+ *
  * (c)Copyright 1998, Matthew Dillon, All Rights Reserved.  Refer to
  *    the COPYRIGHT file in the base directory of this distribution
  *    for specific rights granted.
@@ -24,32 +32,137 @@ Prototype void AddTimer(ForkDesc *desc, int ms, int flags);
 Prototype void DelTimer(Timer *t);
 Prototype void NextTimeout(struct timeval *tv, int maxMs);
 Prototype int ScanTimers(int doRun, int maxMs);
-
-Prototype fd_set SFds;
-Prototype fd_set RFds;
-Prototype fd_set WFds;
+Prototype int ThreadSelect(int nfds, FdSet *rfds, FdSet *wfds, struct timeval *tv);
+Prototype int ThreadFdOk(int fd);
+Prototype void FdsSet(int fd, FdSet *set);
+Prototype void FdsClr(int fd, FdSet *set);
+Prototype void FdsZero(FdSet *set);
+Prototype void FdsCopy(FdSet *dst, const FdSet *src);
+
+Prototype FdSet SFds;
+Prototype FdSet RFds;
+Prototype FdSet WFds;
 Prototype int MaxFds;
 Prototype struct timeval CurTime;
 
-fd_set SFds;
-fd_set RFds;
-fd_set WFds;
+FdSet SFds;
+FdSet RFds;
+FdSet WFds;
 int MaxFds = 0;
 struct timeval CurTime;
-Timer  TimerBase = { &TimerBase, &TimerBase };
 
-ForkDesc *FDes[MAXFDS] = { NULL };
+#define TW_BITS		8
+#define TW_SIZE		(1 << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	4		/* 4 x 8 bits of ms ticks	*/
+
+static Timer TimerWheel[TW_LEVELS][TW_SIZE];	/* slot list heads	*/
+static uint32 TimerMap[TW_LEVELS][TW_SIZE / 32];	/* occupied slots	*/
+static uint32 TimerTick;
+static int TimerCount;
+static Timer *TimerFree;			/* recycled, zfree() is O(n)	*/
+
+ForkDesc **FDes = NULL;
+int	 FDesSize = 0;
 MemPool	 *TMemPool = NULL;
 
+#if USE_EPOLL
+static int EvFd = -1;			/* per-process epoll descriptor	*/
+static FdSet EvRFds;			/* registered for EPOLLIN	*/
+static FdSet EvWFds;			/* registered for EPOLLOUT	*/
+static struct epoll_event *EvList = NULL;
+static int EvMax = 0;
+
+static void threadEvCtl(int fd, int r, int w);
+#endif
+static void timerInit(void);
+
+static void
+fdsGrow(FdSet *set, int fd)
+{
+    int words = set->fs_Size / FDS_NBITS;
+    int nwords = (words) ? words : 4;
+
+    while (nwords * FDS_NBITS <= fd)
+	nwords *= 2;
+    set->fs_Bits = realloc(set->fs_Bits, nwords * sizeof(unsigned long));
+    if (set->fs_Bits == NULL) {
+	logit(LOG_CRIT, "FdSet: unable to grow to %d descriptors", fd + 1);
+	exit(1);
+    }
+    bzero(set->fs_Bits + words, (nwords - words) * sizeof(unsigned long));
+    set->fs_Size = nwords * FDS_NBITS;
+}
+
+void
+FdsSet(int fd, FdSet *set)
+{
+    if (fd >= set->fs_Size)
+	fdsGrow(set, fd);
+    set->fs_Bits[fd / FDS_NBITS] |= 1UL << (fd % FDS_NBITS);
+}
+
+void
+FdsClr(int fd, FdSet *set)
+{
+    if (fd < set->fs_Size)
+	set->fs_Bits[fd / FDS_NBITS] &= ~(1UL << (fd % FDS_NBITS));
+}
+
+void
+FdsZero(FdSet *set)
+{
+    if (set->fs_Size)
+	bzero(set->fs_Bits, set->fs_Size / FDS_NBITS * sizeof(unsigned long));
+}
+
+void
+FdsCopy(FdSet *dst, const FdSet *src)
+{
+    int n = src->fs_Size / FDS_NBITS;
+
+    if (dst->fs_Size < src->fs_Size)
+	fdsGrow(dst, src->fs_Size - 1);
+    if (n)
+	bcopy(src->fs_Bits, dst->fs_Bits, n * sizeof(unsigned long));
+    bzero(dst->fs_Bits + n, (dst->fs_Size / FDS_NBITS - n) * sizeof(unsigned long));
+}
+
+/*
+ * ThreadFdOk() - can the select core handle this descriptor?
+ */
+
+int
+ThreadFdOk(int fd)
+{
+#if USE_EPOLL
+    return(fd >= 0);
+#else
+    return(fd >= 0 && fd < MAXFDS);
+#endif
+}
+
 ForkDesc *
 AddThread(const char *id, int fd, pid_t pid, int type, int slot, int pri)
 {
     ForkDesc *desc;
 
-    if (fd < 0 || fd >= MAXFDS || (desc = FDes[fd]) != NULL) {
+    if (!ThreadFdOk(fd) || (fd < FDesSize && FDes[fd] != NULL)) {
 	logit(LOG_CRIT, "AddThread: descriptor %d already in use", fd);
 	exit(1);
     }
+    if (fd >= FDesSize) {
+	int n = (FDesSize) ? FDesSize : 256;
+
+	while (n <= fd)
+	    n *= 2;
+	if ((FDes = realloc(FDes, n * sizeof(ForkDesc *))) == NULL) {
+	    logit(LOG_CRIT, "AddThread: unable to track %d descriptors", n);
+	    exit(1);
+	}
+	bzero(FDes + FDesSize, (n - FDesSize) * sizeof(ForkDesc *));
+	FDesSize = n;
+    }
     desc = FDes[fd] = zalloc(&TMemPool, sizeof(ForkDesc));
 
 #if NONBLK_ACCEPT_BROKEN
@@ -71,7 +184,7 @@ AddThread(const char *id, int fd, pid_t pid, int type, int slot, int pri)
     desc->d_utime = 0;
     desc->d_stime = 0;
 #endif
-    FD_SET(fd, &SFds);
+    FDS_SET(fd, &SFds);
     if (MaxFds <= fd)
 	MaxFds = fd + 1;
     return(desc);
@@ -83,7 +196,7 @@ FindThread(int fd, pid_t pid)
     int i;
 
     if (fd >= 0)
-	return(FDes[fd]);
+	return((fd < FDesSize) ? FDes[fd] : NULL);
     for (i = 0; i < MaxFds; ++i) {
 	if (FDes[i] && FDes[i]->d_Pid == pid)
 	    return(FDes[i]);
@@ -198,7 +311,7 @@ DumpThreads(void)
     printf("**** DUMP THREADS %d ****\n", (int)getpid());
     sleep(1);
 
-    for (i = 0; i < MAXFDS; ++i) {
+    for (i = 0; i < FDesSize; ++i) {
 	ForkDesc *desc;
 
 	if ((desc = FDes[i]) != NULL) {
@@ -234,12 +347,20 @@ DelThread(ForkDesc *desc)
 
     if (fd >= 0) {
 	FDes[fd] = NULL;
+#if USE_EPOLL
+	/*
+	 * Deregister before the close, the registration would otherwise
+	 * survive in any other process sharing the file
+	 */
+	if (EvFd >= 0)
+	    threadEvCtl(fd, 0, 0);
+#endif
 	close(fd);
 	desc->d_Fd = -1;
 
-	FD_CLR(fd, &SFds);
-	FD_CLR(fd, &RFds);
-	FD_CLR(fd, &WFds);
+	FDS_CLR(fd, &SFds);
+	FDS_CLR(fd, &RFds);
+	FDS_CLR(fd, &WFds);
 
 	if (fd + 1 == MaxFds) {
 	    while (fd >= 0) {
@@ -276,23 +397,163 @@ ResetThreads(void)
 	    }
 	}
     }
-    FD_ZERO(&SFds);
-    FD_ZERO(&RFds);
-    FD_ZERO(&WFds);
-    bzero(FDes, sizeof(FDes));
+    FdsZero(&SFds);
+    FdsZero(&RFds);
+    FdsZero(&WFds);
+    if (FDesSize)
+	bzero(FDes, FDesSize * sizeof(ForkDesc *));
     freePool(&TMemPool);
     MaxFds = 0;
+    timerInit();
+#if USE_EPOLL
+    /*
+     * An epoll descriptor inherited over fork() still refers to the
+     * parent's set, just drop our reference and start a new one.
+     */
+    if (EvFd >= 0) {
+	close(EvFd);
+	EvFd = -1;
+    }
+    FdsZero(&EvRFds);
+    FdsZero(&EvWFds);
+#endif
+}
+
+/*
+ * Timers live on a hierarchical timing wheel:  TW_LEVELS wheels of
+ * TW_SIZE slots, one millisecond per level 0 slot and TW_SIZE times
+ * coarser per level above that.  Insert and cancel are O(1).  Each
+ * time level 0 turns over the next slot of level 1 is redistributed
+ * (cascaded) into level 0, and so on up.  TimerTick is the next tick
+ * to be run, ticks are CurTime in milliseconds modulo 2^32.
+ */
+
+static __inline uint32
+timerNow(void)
+{
+    return((uint32)CurTime.tv_sec * 1000U + (uint32)(CurTime.tv_usec / 1000));
+}
+
+static void
+timerInit(void)
+{
+    int i;
+
+    for (i = 0; i < TW_LEVELS * TW_SIZE; ++i) {
+	Timer *head = &TimerWheel[0][0] + i;
+
+	head->ti_Next = head;
+	head->ti_Prev = head;
+    }
+    bzero(TimerMap, sizeof(TimerMap));
+    TimerCount = 0;
+    TimerFree = NULL;
+    TimerTick = timerNow();
+}
+
+static void
+timerLink(Timer *ti)
+{
+    uint32 delta = ti->ti_Tick - TimerTick;
+    int level;
+    int idx;
+    Timer *head;
+
+    if ((int32)delta < TW_SIZE) {
+	level = 0;
+	idx = (((int32)delta < 0) ? TimerTick : ti->ti_Tick) & TW_MASK;
+    } else {
+	for (level = 1; level < TW_LEVELS - 1; ++level) {
+	    if (delta < 1U << ((level + 1) * TW_BITS))
+		break;
+	}
+	idx = (ti->ti_Tick >> (level * TW_BITS)) & TW_MASK;
+    }
+    head = &TimerWheel[level][idx];
+    ti->ti_Slot = level * TW_SIZE + idx;
+    ti->ti_Next = head;
+    ti->ti_Prev = head->ti_Prev;
+    ti->ti_Prev->ti_Next = ti;
+    head->ti_Prev = ti;
+    TimerMap[level][idx / 32] |= 1U << (idx % 32);
+    ++TimerCount;
+}
+
+static void
+timerUnlink(Timer *ti)
+{
+    Timer *head = &TimerWheel[0][0] + ti->ti_Slot;
+
+    ti->ti_Next->ti_Prev = ti->ti_Prev;
+    ti->ti_Prev->ti_Next = ti->ti_Next;
+    if (head->ti_Next == head) {
+	int idx = ti->ti_Slot % TW_SIZE;
+
+	TimerMap[ti->ti_Slot / TW_SIZE][idx / 32] &= ~(1U << (idx % 32));
+    }
+    --TimerCount;
+}
+
+/*
+ * timerNextSlot() - first occupied level 0 slot at or after idx,
+ *		     TW_SIZE if there is none.
+ */
+
+static int
+timerNextSlot(int idx)
+{
+    while (idx < TW_SIZE) {
+	uint32 m = TimerMap[0][idx / 32] >> (idx % 32);
+
+	if (m)
+	    return(idx + ffs((int)m) - 1);
+	idx = (idx | 31) + 1;
+    }
+    return(TW_SIZE);
+}
+
+/*
+ * timerCascade() - level 0 is turning over at TimerTick, move the
+ *		    timers of the next slot in each coarser level down.
+ */
+
+static void
+timerCascade(void)
+{
+    int level;
+
+    for (level = 1; level < TW_LEVELS; ++level) {
+	int idx = (TimerTick >> (level * TW_BITS)) & TW_MASK;
+	Timer *head = &TimerWheel[level][idx];
+	Timer *ti;
+
+	while ((ti = head->ti_Next) != head) {
+	    timerUnlink(ti);
+	    timerLink(ti);
+	}
+	if (idx != 0)
+	    break;
+    }
 }
 
 void
 AddTimer(ForkDesc *desc, int ms, int flags)
 {
-    Timer *ti = zalloc(&TMemPool, sizeof(Timer));
-    Timer *scan;
+    Timer *ti;
 
     if (desc->d_Timer) {
 	DelTimer(desc->d_Timer);
     }
+    if (TimerWheel[0][0].ti_Next == NULL)
+	timerInit();
+    if ((ti = TimerFree) != NULL) {
+	TimerFree = ti->ti_Next;
+	bzero(ti, sizeof(Timer));
+    } else {
+	ti = zalloc(&TMemPool, sizeof(Timer));
+    }
+    if (TimerCount == 0)
+	TimerTick = timerNow();
 
     ti->ti_To.tv_sec = ms / 1000;
     ti->ti_To.tv_usec = (ms - (ti->ti_To.tv_sec * 1000)) * 1000;
@@ -302,6 +563,7 @@ AddTimer(ForkDesc *desc, int ms, int flags)
 	ti->ti_Tv.tv_usec -= 1000000;
 	++ti->ti_Tv.tv_sec;
     }
+    ti->ti_Tick = timerNow() + (uint32)ms;
 
     /*
      * Attach to descriptor, clear select bits
@@ -314,38 +576,24 @@ AddTimer(ForkDesc *desc, int ms, int flags)
 
     if (desc->d_Fd >= 0) {
 	if (flags & TIF_READ)
-	    FD_CLR(desc->d_Fd, &RFds);
+	    FDS_CLR(desc->d_Fd, &RFds);
 	if (flags & TIF_WRITE)
-	    FD_CLR(desc->d_Fd, &WFds);
+	    FDS_CLR(desc->d_Fd, &WFds);
     }
 
-    /*
-     * find insert-before point
-     */
-    for (scan = TimerBase.ti_Next; scan != &TimerBase; scan = scan->ti_Next) {
-	if (ti->ti_Tv.tv_sec < scan->ti_Tv.tv_sec ||
-	    (ti->ti_Tv.tv_sec == scan->ti_Tv.tv_sec &&
-	    ti->ti_Tv.tv_usec < scan->ti_Tv.tv_usec)
-	) {
-	    break;
-	}
-    }
-    ti->ti_Next = scan;
-    ti->ti_Prev = scan->ti_Prev;
-    ti->ti_Prev->ti_Next = ti;
-    ti->ti_Next->ti_Prev = ti;
+    timerLink(ti);
 }
 
 void
 DelTimer(Timer *t)
 {
-    t->ti_Next->ti_Prev = t->ti_Prev;
-    t->ti_Prev->ti_Next = t->ti_Next;
+    timerUnlink(t);
     if (t->ti_Desc != NULL) {
 	t->ti_Desc->d_Timer = NULL;
 	t->ti_Desc = NULL;
     }
-    zfree(&TMemPool, t, sizeof(Timer));
+    t->ti_Next = TimerFree;
+    TimerFree = t;
 }
 
 void
@@ -361,36 +609,240 @@ NextTimeout(struct timeval *tv, int maxMs)
     tv->tv_usec = (nms - (tv->tv_sec * 1000)) * 1000;
 }
 
+/*
+ * ScanTimers() - run expired timers if doRun, return the number of
+ *		  ms until the wheel next needs attention (0 if a timer
+ *		  is due), at most maxMs.  While only coarse timers are
+ *		  pending that is the next level 0 turnover.
+ */
+
 int
 ScanTimers(int doRun, int maxMs)
 {
-    int dt = maxMs;
-    Timer *scan;
-
-    while ((scan = TimerBase.ti_Next) != &TimerBase) {
-	if (scan->ti_Tv.tv_sec < CurTime.tv_sec ||
-	    (scan->ti_Tv.tv_sec == CurTime.tv_sec &&
-	    scan->ti_Tv.tv_usec <= CurTime.tv_usec)
-	) {
-	    if (doRun) {
-		int fd;
-
-		if ((fd = scan->ti_Desc->d_Fd) >= 0) {
-		    if (scan->ti_Flags & TIF_READ)
-			FD_SET(fd, &RFds);
-		    if (scan->ti_Flags & TIF_WRITE)
-			FD_SET(fd, &WFds);
-		}
-		DelTimer(scan);
-		continue;
+    uint32 now;
+    uint32 next;
+    int idx;
+    int dt;
+
+    if (TimerCount == 0)
+	return(maxMs);
+    now = timerNow();
+
+    while (doRun && TimerCount && (int32)(now - TimerTick) >= 0) {
+	Timer *head;
+	Timer *scan;
+	int nidx;
+
+	idx = TimerTick & TW_MASK;
+	if (idx == 0)
+	    timerCascade();
+	head = &TimerWheel[0][idx];
+	while ((scan = head->ti_Next) != head) {
+	    int fd;
+
+	    if ((fd = scan->ti_Desc->d_Fd) >= 0) {
+		if (scan->ti_Flags & TIF_READ)
+		    FDS_SET(fd, &RFds);
+		if (scan->ti_Flags & TIF_WRITE)
+		    FDS_SET(fd, &WFds);
 	    }
-	    dt = 0;
-	} else {
-	    dt = (scan->ti_Tv.tv_sec - 1 - CurTime.tv_sec) * 1000 +
-		(scan->ti_Tv.tv_usec + 1000000 - CurTime.tv_usec) / 1000;
+	    DelTimer(scan);
+	}
+
+	/*
+	 * skip empty slots, but stop at the turnover to cascade
+	 */
+	nidx = timerNextSlot(idx + 1);
+	if ((uint32)(nidx - idx) > now - TimerTick) {
+	    TimerTick = now + 1;
+	    break;
 	}
-	break;
+	TimerTick += nidx - idx;
     }
+    if (TimerCount == 0)
+	return(maxMs);
+
+    idx = TimerTick & TW_MASK;
+    if (idx == 0)
+	next = TimerTick;
+    else
+	next = TimerTick + (timerNextSlot(idx) - idx);
+    dt = (int32)(next - now);
+    if (dt < 0)
+	dt = 0;
+    if (dt > maxMs)
+	dt = maxMs;
     return(dt);
 }
 
+
+/*
+ * ThreadSelect() - wait for descriptors in rfds/wfds (either may be NULL)
+ *		    to become ready, select() style.  On return the sets
+ *		    hold the ready descriptors.
+ */
+
+#if USE_EPOLL
+
+static __inline unsigned long
+fdsWord(const FdSet *set, int i)
+{
+    return((set != NULL && i < set->fs_Size / FDS_NBITS) ? set->fs_Bits[i] : 0);
+}
+
+static void
+threadEvCtl(int fd, int r, int w)
+{
+    struct epoll_event ev;
+    int reg = FDS_ISSET(fd, &EvRFds) || FDS_ISSET(fd, &EvWFds);
+    int rc = 0;
+
+    bzero(&ev, sizeof(ev));
+    ev.events = ((r) ? EPOLLIN : 0) | ((w) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+
+    if (r == 0 && w == 0) {
+	if (reg)
+	    epoll_ctl(EvFd, EPOLL_CTL_DEL, fd, &ev);
+    } else if (reg) {
+	if ((rc = epoll_ctl(EvFd, EPOLL_CTL_MOD, fd, &ev)) < 0 && errno == ENOENT)
+	    rc = epoll_ctl(EvFd, EPOLL_CTL_ADD, fd, &ev);
+    } else {
+	if ((rc = epoll_ctl(EvFd, EPOLL_CTL_ADD, fd, &ev)) < 0 && errno == EEXIST)
+	    rc = epoll_ctl(EvFd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    if (rc < 0)
+	logit(LOG_ERR, "epoll_ctl fd %d: %s", fd, strerror(errno));
+
+    if (r)
+	FdsSet(fd, &EvRFds);
+    else
+	FdsClr(fd, &EvRFds);
+    if (w)
+	FdsSet(fd, &EvWFds);
+    else
+	FdsClr(fd, &EvWFds);
+}
+
+int
+ThreadSelect(int nfds, FdSet *rfds, FdSet *wfds, struct timeval *tv)
+{
+    int i;
+    int n;
+    int nw;
+    int ms = -1;
+    int ready = 0;
+
+    if (EvFd < 0) {
+	if ((EvFd = epoll_create(1024)) < 0) {
+	    logit(LOG_CRIT, "epoll_create failed: %s", strerror(errno));
+	    exit(1);
+	}
+    }
+
+    /*
+     * Bring the kernel's interest list in line with the sets, only
+     * words that changed since the last call are looked at bit by bit.
+     */
+    nw = (nfds + FDS_NBITS - 1) / FDS_NBITS;
+    if (nw < EvRFds.fs_Size / FDS_NBITS)
+	nw = EvRFds.fs_Size / FDS_NBITS;
+    if (nw < EvWFds.fs_Size / FDS_NBITS)
+	nw = EvWFds.fs_Size / FDS_NBITS;
+
+    for (i = 0; i < nw; ++i) {
+	unsigned long r = fdsWord(rfds, i);
+	unsigned long w = fdsWord(wfds, i);
+	unsigned long diff;
+	int b = nfds - i * FDS_NBITS;
+
+	if (b < FDS_NBITS) {
+	    unsigned long m = (b <= 0) ? 0 : (1UL << b) - 1;
+	    r &= m;
+	    w &= m;
+	}
+	diff = (r ^ fdsWord(&EvRFds, i)) | (w ^ fdsWord(&EvWFds, i));
+	for (b = 0; diff; ++b, diff >>= 1) {
+	    if (diff & 1)
+		threadEvCtl(i * FDS_NBITS + b, (r >> b) & 1, (w >> b) & 1);
+	}
+    }
+
+    if (EvMax < nfds || EvList == NULL) {
+	EvMax = (nfds > 64) ? nfds : 64;
+	if ((EvList = realloc(EvList, EvMax * sizeof(struct epoll_event))) == NULL) {
+	    logit(LOG_CRIT, "ThreadSelect: out of memory");
+	    exit(1);
+	}
+    }
+    if (tv != NULL)
+	ms = tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+
+    n = epoll_wait(EvFd, EvList, EvMax, ms);
+
+    if (rfds != NULL)
+	FdsZero(rfds);
+    if (wfds != NULL)
+	FdsZero(wfds);
+
+    /*
+     * Like select(), an error or hangup makes a descriptor ready for
+     * whatever it was being waited on for.
+     */
+    for (i = 0; i < n; ++i) {
+	int fd = EvList[i].data.fd;
+	unsigned int ev = EvList[i].events;
+
+	if ((ev & (EPOLLIN|EPOLLHUP|EPOLLERR)) && rfds != NULL &&
+	    FDS_ISSET(fd, &EvRFds)
+	) {
+	    FdsSet(fd, rfds);
+	    ++ready;
+	}
+	if ((ev & (EPOLLOUT|EPOLLHUP|EPOLLERR)) && wfds != NULL &&
+	    FDS_ISSET(fd, &EvWFds)
+	) {
+	    FdsSet(fd, wfds);
+	    ++ready;
+	}
+    }
+    return((n < 0) ? n : ready);
+}
+
+#else
+
+int
+ThreadSelect(int nfds, FdSet *rfds, FdSet *wfds, struct timeval *tv)
+{
+    fd_set r;
+    fd_set w;
+    int i;
+    int n;
+
+    if (nfds > FD_SETSIZE)
+	nfds = FD_SETSIZE;
+    FD_ZERO(&r);
+    FD_ZERO(&w);
+    for (i = 0; i < nfds; ++i) {
+	if (rfds != NULL && FDS_ISSET(i, rfds))
+	    FD_SET(i, &r);
+	if (wfds != NULL && FDS_ISSET(i, wfds))
+	    FD_SET(i, &w);
+    }
+
+    n = select(nfds, &r, &w, NULL, tv);
+
+    if (rfds != NULL)
+	FdsZero(rfds);
+    if (wfds != NULL)
+	FdsZero(wfds);
+    for (i = 0; n > 0 && i < nfds; ++i) {
+	if (FD_ISSET(i, &r))
+	    FdsSet(i, rfds);
+	if (FD_ISSET(i, &w))
+	    FdsSet(i, wfds);
+    }
+    return(n);
+}
+
+#endif
@@ -24,6 +24,7 @@ void NNStartListOverview(Connection *conn, const char *hdr, const char *ran, con
 void NNStartListOverviewRange(Connection *conn);
 void NNStartListOverviewMsgId(Connection *conn, const char *msgid);
 void NNListOverviewRange(Connection *conn);
+int OverColumnFor(Connection *conn);
 
 Prototype char *OverViewFmt;
 
@@ -307,6 +308,9 @@ NNListOverviewRange(Connection *conn)
 {
     OverInfo *ov;
     int xpat_count = 0;
+#ifndef USE_OVER_MADVISE
+    int col = OverColumnFor(conn);
+#endif
 
     conn->co_Func = NNListOverviewRange;
     conn->co_State = "listover";
@@ -334,7 +338,7 @@ NNListOverviewRange(Connection *conn)
 #endif
 
 	if (conn->co_ArtMode == COM_XPAT && ++xpat_count > 50) {
-	    FD_SET(conn->co_Desc->d_Fd, &WFds);
+	    FDS_SET(conn->co_Desc->d_Fd, &WFds);
 	    break;
 	}
 #ifdef USE_OVER_MADVISE
@@ -342,6 +346,23 @@ NNListOverviewRange(Connection *conn)
 #else
 	if (conn->co_ArtMode == COM_NEWNEWS)
 	    tr = &conn->co_TimeRestrict;
+	if (col >= 0) {
+	    /*
+	     * The column holds just the header line, which is all
+	     * OutputOverview() looks at for XHDR and XPAT
+	     */
+	    int r = GetOverColumn(ov, col, conn->co_ListBegNo, &res, &resLen, &artSize);
+
+	    if (r > 0) {
+		OutputOverview(conn, res, resLen, artSize);
+		++conn->co_ListBegNo;
+		continue;
+	    }
+	    if (r == 0) {
+		++conn->co_ListBegNo;
+		continue;
+	    }
+	}
 	if ((res = GetOverRecord(ov, conn->co_ListBegNo, &resLen, &artSize, tr, NULL)) != NULL) {
 	    OutputOverview(conn, res, resLen, artSize);
 	}
@@ -359,6 +380,25 @@ NNListOverviewRange(Connection *conn)
     }
 }
 
+/*
+ * OverColumnFor() - the overview column (lib/overcol.c) holding the
+ *		     header of an XHDR or XPAT, or -1
+ */
+
+int
+OverColumnFor(Connection *conn)
+{
+    const char *hdr = conn->co_ListHdrs;
+
+    if (DOpts.ReaderColumns == 0 ||
+	(conn->co_ArtMode != COM_XHDR && conn->co_ArtMode != COM_XPAT) ||
+	strpbrk(hdr, ":\r\n") != NULL
+    ) {
+	return(-1);
+    }
+    return(OverColFind(hdr, strlen(hdr)));
+}
+
 void
 NNStartListOverviewMsgId(Connection *conn, const char *msgid)
 {
@@ -367,20 +407,39 @@ NNStartListOverviewMsgId(Connection *conn, const char *msgid)
     NNCommand(conn);
 }
 
+/*
+ * OverWrite() - queue output for the overview command in progress
+ */
+
+static void
+OverWrite(Connection *conn, const char *buf, int len)
+{
+    if (conn->co_ArtMode == COM_XZVER)
+	MZWrite(conn, buf, len);
+    else
+	MBWrite(&conn->co_TMBuf, buf, len);
+}
+
 int
 OutputOverview(Connection *conn, const char *res, int resLen, int artSize)
 {
     const char *hdr = conn->co_ListHdrs;
+    OverLine lineBuf[OVER_MAXLINES];
+    OverLine *lines = lineBuf;
+    int maxLines = OVER_MAXLINES;
+    int nlines = 0;
+    int scanPos = 0;
     int didIndex = 0;
 
     while (*hdr) {
 	int hlen;
 	int hhlen;
-	int rleft;
+	int rlen = 0;
+	int rrlen = 0;
 	int printHdr = 0;
-	const char *rline;
+	const char *rline = NULL;
 	char hch;
-	char ch;
+	int l;
 
 	/*
 	 * locate next header
@@ -407,199 +466,145 @@ OutputOverview(Connection *conn, const char *res, int resLen, int artSize)
 	    ;
 
 	/*
-	 * scan overview info for header
+	 * look the header up in the lines indexed so far, indexing more
+	 * of the record only as far as needed.  scanPos is -1 once the
+	 * whole record has been indexed.
 	 */
-	rline = res;
-	rleft = resLen;
 
 	hch = tolower(*hdr);
 
-	while (rleft) {
-	    int rlen;
-	    int rrlen;
+	for (l = 0; ; ++l) {
+	    if (l == nlines) {
+		if (scanPos < 0)
+		    break;
+		if (nlines == maxLines) {
+		    OverLine *nl = zalloc(&conn->co_MemPool, maxLines * 2 * sizeof(OverLine));
+
+		    bcopy(lines, nl, nlines * sizeof(OverLine));
+		    if (lines != lineBuf)
+			zfree(&conn->co_MemPool, lines, maxLines * sizeof(OverLine));
+		    lines = nl;
+		    maxLines *= 2;
+		}
+		scanPos = OverScanLine(res, resLen, scanPos, &lines[nlines]);
+		if (scanPos < 0)
+		    break;
+		++nlines;
+	    }
+	    if (lines[l].ol_NameLen == hhlen &&
+		tolower(*lines[l].ol_Line) == hch &&
+		strncasecmp(lines[l].ol_Line, hdr, hhlen) == 0
+	    ) {
+		rline = lines[l].ol_Line;
+		rlen = lines[l].ol_Len;
+		rrlen = lines[l].ol_NameLen;
+		break;
+	    }
+	}
 
-	    /*
-	     * get entire header
-	     */
+	if (rline) {
+	    switch(conn->co_ArtMode) {
+	    case COM_XPAT:
+		{
+		    char hdr[128];
+		    char *p = hdr;
+		    int glen = rrlen;
+
+		    if (glen < rlen && rline[glen] == ':')
+			++glen;
+		    while (glen < rlen && 
+			(rline[glen] == ' ' || rline[glen] == '\t')
+		    ) {
+			++glen;
+		    }
 
-	    for (rlen = 0; rline[rlen]; ++rlen) {
-		if (rline[rlen] != '\n')
-		    continue;
-		if (rline[rlen+1] == ' ' || rline[rlen+1] == '\t')/* multiln */
-		    continue;
-		++rlen;
+		    if (rlen >= sizeof(hdr))
+			p = zalloc(&conn->co_MemPool, rlen + 1);
+		    memcpy(p, rline, rlen);
+		    /* Handle CR/LF in overview data */
+		    if (rlen > 2 && p[rlen - 2] == '\r' && p[rlen - 1] == '\n') {
+			p[rlen - 2] = 0;
+		    }
+		    p[rlen] = 0;
+		    if (wildmat(p + glen, conn->co_ListPat))
+			printHdr = ' ';
+		    if (p != hdr)
+			zfree(&conn->co_MemPool, p, rlen + 1);
+		}
+		break;
+	    case COM_XHDR:
+		printHdr =  ' ';
+		break;
+	    case COM_NEWNEWS:
+		printHdr = ' ';
+		didIndex = 1;
+		break;
+	    case COM_XOVER:
+		printHdr = '\t';
+		break;
+	    case COM_XZVER:
+		printHdr = '\t';
 		break;
 	    }
+	}
+	if (printHdr) {
+	    int tabs = (conn->co_ArtMode == COM_XOVER ||
+			conn->co_ArtMode == COM_XZVER);
+	    int doSpace = 0;
+	    int b;
 
-	    /*
-	     * no more headers, don't scan article (if article data passed)
-	     */
-	    if (rlen == 2 && rline[0] == '\r' && rline[1] == '\n')
-		break;
+	    if (didIndex == 0) {
+		if (conn->co_ArtMode == COM_XZVER) {
+		    MZPrintf(conn, "%lld", 
+			artno_art(conn->co_ArtBeg, conn->co_ArtEnd, conn->co_ListBegNo, conn->co_Numbering));
+		} else {
+		    MBPrintf(&conn->co_TMBuf, "%lld",
+			artno_art(conn->co_ArtBeg, conn->co_ArtEnd, conn->co_ListBegNo, conn->co_Numbering));
+		}
+		didIndex = 1;
+	    }
+	    if (conn->co_ArtMode != COM_NEWNEWS) {
+		char ch = printHdr;
+
+		OverWrite(conn, &ch, 1);
+	    }
 
 	    /*
-	     * This occurs if the map file containing the headers is boshed
+	     * hack for overview format options, only deal with
+	     * 'full' at the moment.
 	     */
 
-	    if (rlen == 0)
-		break;
+	    if (hhlen < hlen && strncmp(hdr + hhlen + 1, "full", 4) == 0) {
+		OverWrite(conn, hdr, hhlen + 1);
+		OverWrite(conn, " ", 1);
+	    }
 
 	    /*
-	     * get just header portion, non inclusive of colon
+	     * Compress whitespace if necessary. Mainly applies to
+	     * folded lines.  Whitespace after the colon and after a
+	     * line break is skipped, line breaks (and tabs if doing
+	     * XOVER) become a single space.  Spaces within a line are
+	     * not compressed, we will do that for OVER when it gets
+	     * implemented.
 	     */
+	    for (b = rrlen + 1; b < rlen; ) {
+		int e;
 
-	    for (rrlen = 0; rrlen < rlen && rline[rrlen] != ':'; ++rrlen)
-		;
-
-	    ch = tolower(*rline);
-	    if (rrlen == hhlen &&
-			ch == hch && strncasecmp(rline, hdr, hhlen) == 0) {
-		switch(conn->co_ArtMode) {
-		case COM_XPAT:
-		    {
-			char hdr[128];
-			char *p = hdr;
-			int glen = rrlen;
-
-			if (glen < rlen && rline[glen] == ':')
-			    ++glen;
-			while (glen < rlen && 
-			    (rline[glen] == ' ' || rline[glen] == '\t')
-			) {
-			    ++glen;
-			}
-
-			if (rlen >= sizeof(hdr))
-			    p = zalloc(&conn->co_MemPool, rlen + 1);
-			memcpy(p, rline, rlen);
-			/* Handle CR/LF in overview data */
-			if (rlen > 2 && p[rlen - 2] == '\r' && p[rlen - 1] == '\n') {
-			    p[rlen - 2] = 0;
-			}
-			p[rlen] = 0;
-			if (wildmat(p + glen, conn->co_ListPat))
-			    printHdr = ' ';
-			if (p != hdr)
-			    zfree(&conn->co_MemPool, p, rlen + 1);
-		    }
-		    break;
-		case COM_XHDR:
-		    printHdr =  ' ';
-		    break;
-		case COM_NEWNEWS:
-		    printHdr = ' ';
-		    didIndex = 1;
-		    break;
-		case COM_XOVER:
-		    printHdr = '\t';
-		    break;
-		case COM_XZVER:
-		    printHdr = '\t';
-		    break;
-		}
-		if (printHdr) {
-		    int b;
-		    int i;
-		    int doSpace = 0;
-
-		    if (didIndex == 0) {
-			if (conn->co_ArtMode == COM_XZVER) {
-			    MZPrintf(conn, "%lld", 
-				artno_art(conn->co_ArtBeg, conn->co_ArtEnd, conn->co_ListBegNo, conn->co_Numbering));
-			} else {
-			    MBPrintf(&conn->co_TMBuf, "%lld",
-				artno_art(conn->co_ArtBeg, conn->co_ArtEnd, conn->co_ListBegNo, conn->co_Numbering));
-			}
-			didIndex = 1;
-		    }
-		    if (conn->co_ArtMode != COM_NEWNEWS) {
-			if (conn->co_ArtMode == COM_XZVER) {
-			    MZPrintf(conn, "%c", printHdr);
-			} else {
-			    MBPrintf(&conn->co_TMBuf, "%c", printHdr);
-			}
-		    }
-
-		    /*
-		     * hack for overview format options, only deal with
-		     * 'full' at the moment.
-		     */
-
-		    if (hhlen < hlen && strncmp(hdr + hhlen + 1, "full", 4) == 0) {
-			if (conn->co_ArtMode == COM_XZVER) {
-			    MZWrite(conn, hdr, hhlen + 1);
-			    MZWrite(conn, " ", 1);
-			} else {
-			    MBWrite(&conn->co_TMBuf, hdr, hhlen + 1);
-			    MBWrite(&conn->co_TMBuf, " ", 1);
-			}
-		    }
-
-		    /*
-		     * Compress whitespace if necessary. Mainly applies
-		     * to folded lines.
-		     */
-		    for (b = i = rrlen + 1; i < rlen; ++i) {
-			if (rline[i] == '\r' || rline[i] == '\n' ||
-			    rline[i] == ' ' || rline[i] == '\t'
-			) {
-			    /*
-			     * Skip first whitespace
-			     */
-			    if (b == i) {
-				++b;
-			    } else {
-				/*
-				 * Don't compress spaces
-				 * We will compress space for OVER when it
-				 * gets implemented
-				 */
-				if (rline[i] == ' ')
-				    continue;
-				/*
-				 * Only compress tabs if doing XOVER
-				 */
-				if (conn->co_ArtMode != COM_XOVER &&
-				    conn->co_ArtMode != COM_XZVER &&
-							rline[i] == '\t')
-				    continue;
-				if (doSpace) {
-				    if (conn->co_ArtMode == COM_XZVER) {
-				        MZWrite(conn, " ", 1);
-				    } else {
-				        MBWrite(&conn->co_TMBuf, " ", 1);
-				    }
-				}
-				if (conn->co_ArtMode == COM_XZVER) {
-				    MZWrite(conn, rline + b, i - b);
-				} else {
-				    MBWrite(&conn->co_TMBuf, rline + b, i - b);
-				}
-				b = i + 1;
-				doSpace = 1;
-			    }
-			}
-		    }
-		    if (b != i) {
-			if (doSpace) {
-			    if (conn->co_ArtMode == COM_XZVER) {
-			        MZWrite(conn, " ", 1);
-			    } else {
-			        MBWrite(&conn->co_TMBuf, " ", 1);
-			    }
-			}
-			if (conn->co_ArtMode == COM_XZVER) {
-			    MZWrite(conn, rline + b, i - b);
-			} else {
-			    MBWrite(&conn->co_TMBuf, rline + b, i - b);
-			}
-		    }
+		while (b < rlen && (rline[b] == '\r' || rline[b] == '\n' ||
+				    rline[b] == ' ' || rline[b] == '\t')
+		) {
+		    ++b;
 		}
-		break;
+		if (b == rlen)
+		    break;
+		e = b + OverScanSep(rline + b, rlen - b, tabs);
+		if (doSpace)
+		    OverWrite(conn, " ", 1);
+		OverWrite(conn, rline + b, e - b);
+		doSpace = 1;
+		b = e + 1;
 	    }
-	    rleft -= rlen;
-	    rline += rlen;
-	} /* while */
+	}
 	if (printHdr == 0 && (conn->co_ArtMode == COM_XOVER ||
 			      conn->co_ArtMode == COM_XZVER)) {
 	    if (didIndex == 0) {
@@ -619,17 +624,16 @@ OutputOverview(Connection *conn, const char *res, int resLen, int artSize)
 		    MBPrintf(&conn->co_TMBuf, "\t%d", artSize + 1);
 		}
 	    } else {
-		if (conn->co_ArtMode == COM_XZVER) {
-		    MZPrintf(conn, "\t");
-		} else {
-		    MBPrintf(&conn->co_TMBuf, "\t");
-		}
+		OverWrite(conn, "\t", 1);
 	    }
 	}
 
 	hdr += hlen;
 	conn->co_LastActiveTime = CurTime.tv_sec;
     }
+    if (lines != lineBuf)
+	zfree(&conn->co_MemPool, lines, maxLines * sizeof(OverLine));
+
     if (didIndex == 0 && 
 	(/* conn->co_ArtMode == COM_XPAT || */ conn->co_ArtMode == COM_XHDR)
     ) {
@@ -643,11 +647,7 @@ OutputOverview(Connection *conn, const char *res, int resLen, int artSize)
 	didIndex = 1;
     }
     if (didIndex) {
-	if (conn->co_ArtMode == COM_XZVER) {
-	    MZPrintf(conn, "\r\n");
-	} else {
-	    MBPrintf(&conn->co_TMBuf, "\r\n");
-	}
+	OverWrite(conn, "\r\n", 2);
 	return(0);
     }
     return(-1);
@@ -38,6 +38,11 @@
  *
  *  Once we have found a binary, we stop scanning the article - save CPU
  *
+ *  ArticleTypeBody() takes a block of body lines at once and gives the
+ *  same result as passing them to ArticleType() one at a time, without
+ *  the per line call and without looking at the block at all once a
+ *  binary has been found.
+ *
  */
 
 #include "defs.h"
@@ -46,9 +51,12 @@ Prototype void InitArticleType(void);
 Prototype int ArtTypeConv(char *t);
 Prototype int ArtTypeMatch(int articletype, ArtTypeList *acctypes);
 Prototype int ArticleType(char *line, int len, int inheader);
+Prototype int ArticleTypeBody(char *buf, int len, int wire);
 
 int isBinHexLine(char *line, int len, int firstline);
 int isUuencodedLine(char *buf, int len);
+static void articleTypeAny(char *ptr);
+static int articleTypeBodyLine(char *ptr, int len);
 
 /*
  * Global state variables required for multi-line checking
@@ -364,26 +372,24 @@ int classifyLineAsTypes(char *buf, int len)
 	if (ptr[len - 1] == '\r')
 	    len--;
 
+	/*
+	 * No type allows a line outside 60-77 characters, and that is
+	 * all BASE64 data is checked for: BASE64 data isn't
+	 * well-behaved.  I can't actually find anything that specifies
+	 * what the line length of base64 data is supposed to be.
+	 * RFC1113 says 64, but isn't actually base64.  RFC1341 says "no
+	 * more than 76 characters".  Typical.  Examination of actual
+	 * base64 content shows lines to always be 74, for a relatively
+	 * large sample size.  But better safe than sorry...  allow 60-76.
+	 */
+	if (len < 60 || len > 77)
+		return(0);
+
 	/* UUENCODE-specific checks:  UUENCODE data is well-behaved */
 	if (*ptr != 'M' || len != 61) {
 		isnttype &= ~UUE;
 	}
 
-	/* BASE64-specific checks: BASE64 data isn't well-behaved */
-	if (len < 60 || len > 77) {
-		/*
-		 * I can't actually find anything that specifies what the
-		 * line length of base64 data is supposed to be.  RFC1113
-		 * says 64, but isn't actually base64.  RFC1341 says "no
-		 * more than 76 characters".  Typical.  Examination of
-		 * actual base64 content shows lines to always be 74, for
-		 * a relatively large sample size.  But better safe than
-		 * sorry...  allow 60-76.
-		 */
-
-		isnttype &= ~B64;
-	}
-
 	/* BinHex-specific checks: BinHex just gives me shivers */
 	if (len < 64 || len > 65) {
 		isnttype &= ~BHX;
@@ -511,8 +517,7 @@ ArtTypeMatch(int articletype, ArtTypeList *acctypes)
 int
 ArticleType(char *line, int len, int inheader)
 {
-    static char *ptr;
-    static char first;
+    char *ptr = line;
 
     if (Type != ARTTYPE_DEFAULT)
 	Type = Type & ~ARTTYPE_DEFAULT;
@@ -522,44 +527,15 @@ ArticleType(char *line, int len, int inheader)
     if (Type & ARTTYPE_BINARY)
 	return(Type);
 
-    ptr = line;
-
     /*
      * Do some checks that could apply to headers and or body
      */
-    first = tolower(*ptr);
-    if (first == 'c' && tolower(*(ptr + 1) == 'o')) {
-	if (! strncasecmp(ptr, "Content-Type: text/html", 23))
-	    Type |= ARTTYPE_HTML;
-	if (! strncasecmp(ptr, "Content-Type: ", 14))
-	    Type |= ARTTYPE_MIME;
-	if (! strncasecmp(ptr, "Content-Type: multipart", 23))
-	    Type |= ARTTYPE_MULTIPART;
-	if (! strncasecmp(ptr, "Content-transfer-encoding: base64", 33))
-	    Type |= ARTTYPE_BASE64 | ARTTYPE_BINARY;
-	if (! strncasecmp(ptr, "Content-transfer-encoding: X-Bommanews", 38))
-	    Type |= ARTTYPE_BOMMANEWS | ARTTYPE_BINARY;
-	if (! strncasecmp(ptr, "Content-transfer-encoding: X-UnidataEncoding", 44))
-	    Type |= ARTTYPE_UNIDATA | ARTTYPE_BINARY;
-	if (! strncasecmp(ptr, "Content-Type: application/postscript", 36))
-	    Type |= ARTTYPE_PS;
-	if (! strncasecmp(ptr, "Content-Type: application/mac-binhex40", 38))
-	    BinHex = 1;
-	if (! strncasecmp(ptr, "Content-Type: application/octet-stream", 38))
-	    Type |= ARTTYPE_BINARY;
-	if (! strncasecmp(ptr, "Content-Type: message/partial", 29))
-	    Type |= ARTTYPE_PARTIAL;
-    }
-    if (first == '(' && strncasecmp(ptr, "(This file must be converted with BinHex 4.0)", 33) == 0)
-	BinHex = 1;
-
-    if (first == '=' && strncasecmp(ptr, "=ybegin part=", 13) == 0)
-	Type |= ARTTYPE_BINARY|ARTTYPE_PARTIAL|ARTTYPE_YENC;
-    if (first == '=' && strncasecmp(ptr, "=ybegin line=", 13) == 0)
-	Type |= ARTTYPE_BINARY|ARTTYPE_YENC;
+    articleTypeAny(ptr);
 
     if (inheader) {
-	if (first == 'c' && tolower(*(ptr + 1) == 'o')) {
+	char first = tolower(*ptr);
+
+	if (first == 'c' && ptr[1] == 'o') {
 	    if (! strncasecmp(ptr, "Control: ", 9))
 		Type |= ARTTYPE_CONTROL;
 	    if (! strncasecmp(ptr, "Control: cancel ", 16))
@@ -567,64 +543,181 @@ ArticleType(char *line, int len, int inheader)
 	}
 	if (first == 'm' && strncasecmp(ptr, "Mime-Version: ", 14) == 0)
 		Type |= ARTTYPE_MIME;
-    } else {
-	int linetype;
+    } else if (articleTypeBodyLine(ptr, len)) {
+	return(Type);
+    }
+    if (Type != ARTTYPE_DEFAULT)
+	Type = Type & ~ARTTYPE_DEFAULT;
+    return(Type);
+}
 
-	/* Get quoted UUencode, etc. */
-	if (*ptr == '>') {
-	    ptr++;
-	    len--;
-	    if (*ptr == ' ') {
-		ptr++;
-		len--;
+/*
+ * ArticleTypeBody() - classify a block of complete body lines, as read
+ *		       from the wire (CRLF terminated and dot stuffed).
+ *		       With wire 0 each line is passed on the way diablo
+ *		       does without wireformat, dot unstuffed and without
+ *		       the CRLF, with wire 1 it is passed as is less the
+ *		       last two characters.  Returns what ArticleType()
+ *		       would have returned for the last line.
+ */
+
+int
+ArticleTypeBody(char *buf, int len, int wire)
+{
+    char *end = buf + len;
+    int r = Type;
+
+    while (buf < end) {
+	char *nl;
+	char *ptr = buf;
+	int bytes;
+
+	if (Type != ARTTYPE_DEFAULT)
+	    Type = Type & ~ARTTYPE_DEFAULT;
+	if (Type & ARTTYPE_BINARY)
+	    return(Type);
+
+	if ((nl = memchr(buf, '\n', end - buf)) != NULL)
+	    bytes = nl + 1 - buf;
+	else
+	    bytes = end - buf;
+	buf += bytes;
+
+	if (wire == 0) {
+	    if (bytes > 1 && ptr[bytes - 1] == '\n' && ptr[bytes - 2] == '\r')
+		--bytes;
+	    if (*ptr == '.') {
+		++ptr;
+		--bytes;
 	    }
+	    --bytes;
+	} else {
+	    bytes -= 2;
 	}
 
-	/*
-	 * We look for binary formats first, since these eat 
-	 * up CPU like there is no tomorrow.  We may miss 
-	 * some flags if we detect a binary file, the 
-	 * alternative is to remove the return(Type)'s and 
-	 * eat CPU for the entire binary.
-	 */
+	articleTypeAny(ptr);
+	if (articleTypeBodyLine(ptr, bytes)) {
+	    r = Type;
+	    continue;
+	}
+	if (Type != ARTTYPE_DEFAULT)
+	    Type = Type & ~ARTTYPE_DEFAULT;
+	r = Type;
+    }
+    return(r);
+}
 
-	linetype = classifyLineAsTypes(ptr, len);
+/*
+ * articleTypeAny() - the checks made on header and body lines.  All the
+ *		      Content- checks share the prefix, which is compared
+ *		      once.
+ */
 
-	if (linetype & UUE) {
-	    Base64 = 0;
-	    BinHex = 0;
-	    UUencode++;
-	    if (UUencode > 8) {
-		Type |= ARTTYPE_UUENCODE | ARTTYPE_BINARY;
-		return(Type);
-	    }
-	} else if (linetype & BHX) {
-	    UUencode = 0;
-	    Base64 = 0;
-	    BinHex++;
-	    if (BinHex > 8) {
-		Type |= ARTTYPE_BINHEX | ARTTYPE_BINARY;
-		return(Type);
-	    }
-	} else if (linetype & B64) {
-	    UUencode = 0;
-	    BinHex = 0;
-	    Base64++;
-	    if (Base64 > 8) {
+static void
+articleTypeAny(char *ptr)
+{
+    char first = tolower(*ptr);
+
+    if (first == 'c' && ptr[1] == 'o' && strncasecmp(ptr, "Content-", 8) == 0) {
+	char *p = ptr + 8;
+
+	if (! strncasecmp(p, "Type: ", 6)) {
+	    p += 6;
+	    Type |= ARTTYPE_MIME;
+	    if (! strncasecmp(p, "text/html", 9))
+		Type |= ARTTYPE_HTML;
+	    if (! strncasecmp(p, "multipart", 9))
+		Type |= ARTTYPE_MULTIPART;
+	    if (! strncasecmp(p, "application/postscript", 22))
+		Type |= ARTTYPE_PS;
+	    if (! strncasecmp(p, "application/mac-binhex40", 24))
+		BinHex = 1;
+	    if (! strncasecmp(p, "application/octet-stream", 24))
+		Type |= ARTTYPE_BINARY;
+	    if (! strncasecmp(p, "message/partial", 15))
+		Type |= ARTTYPE_PARTIAL;
+	} else if (! strncasecmp(p, "transfer-encoding: ", 19)) {
+	    p += 19;
+	    if (! strncasecmp(p, "base64", 6))
 		Type |= ARTTYPE_BASE64 | ARTTYPE_BINARY;
-		return(Type);
-	    }
-	} else {
-	    if (*ptr == '-' &&
-			strncmp(ptr, "-----BEGIN PGP MESSAGE-----", 27) == 0)
-		Type |= ARTTYPE_PGPMESSAGE;
-	    UUencode = 0;
-	    Base64 = 0;
-	    BinHex = 0;
+	    if (! strncasecmp(p, "X-Bommanews", 11))
+		Type |= ARTTYPE_BOMMANEWS | ARTTYPE_BINARY;
+	    if (! strncasecmp(p, "X-UnidataEncoding", 17))
+		Type |= ARTTYPE_UNIDATA | ARTTYPE_BINARY;
 	}
     }
-    if (Type != ARTTYPE_DEFAULT)
-	Type = Type & ~ARTTYPE_DEFAULT;
-    return(Type);
+    if (first == '(' && strncasecmp(ptr, "(This file must be converted with BinHex 4.0)", 33) == 0)
+	BinHex = 1;
+
+    if (first == '=' && strncasecmp(ptr, "=ybegin ", 8) == 0) {
+	if (strncasecmp(ptr + 8, "part=", 5) == 0)
+	    Type |= ARTTYPE_BINARY|ARTTYPE_PARTIAL|ARTTYPE_YENC;
+	if (strncasecmp(ptr + 8, "line=", 5) == 0)
+	    Type |= ARTTYPE_BINARY|ARTTYPE_YENC;
+    }
 }
 
+/*
+ * articleTypeBodyLine() - the checks made on body lines.  Returns 1 if
+ *			   the line made the article a binary.
+ */
+
+static int
+articleTypeBodyLine(char *ptr, int len)
+{
+    int linetype;
+
+    /* Get quoted UUencode, etc. */
+    if (*ptr == '>') {
+	ptr++;
+	len--;
+	if (*ptr == ' ') {
+	    ptr++;
+	    len--;
+	}
+    }
+
+    /*
+     * We look for binary formats first, since these eat 
+     * up CPU like there is no tomorrow.  We may miss 
+     * some flags if we detect a binary file, the 
+     * alternative is to remove the return(Type)'s and 
+     * eat CPU for the entire binary.
+     */
+
+    linetype = classifyLineAsTypes(ptr, len);
+
+    if (linetype & UUE) {
+	Base64 = 0;
+	BinHex = 0;
+	UUencode++;
+	if (UUencode > 8) {
+	    Type |= ARTTYPE_UUENCODE | ARTTYPE_BINARY;
+	    return(1);
+	}
+    } else if (linetype & BHX) {
+	UUencode = 0;
+	Base64 = 0;
+	BinHex++;
+	if (BinHex > 8) {
+	    Type |= ARTTYPE_BINHEX | ARTTYPE_BINARY;
+	    return(1);
+	}
+    } else if (linetype & B64) {
+	UUencode = 0;
+	BinHex = 0;
+	Base64++;
+	if (Base64 > 8) {
+	    Type |= ARTTYPE_BASE64 | ARTTYPE_BINARY;
+	    return(1);
+	}
+    } else {
+	if (*ptr == '-' &&
+		    strncmp(ptr, "-----BEGIN PGP MESSAGE-----", 27) == 0)
+	    Type |= ARTTYPE_PGPMESSAGE;
+	UUencode = 0;
+	Base64 = 0;
+	BinHex = 0;
+    }
+    return(0);
+}
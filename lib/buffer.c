@@ -24,6 +24,7 @@ Prototype char *bstart(Buffer *b);
 Prototype void bclose(Buffer *b, int closeFd);
 Prototype void efree(char **pcopy, int *pcopymax);
 Prototype char *bgets(Buffer *b, int *pbytes);
+Prototype char *bgetlines(Buffer *b, int *pbytes);
 Prototype char *egets(Buffer *b, int *pbytes);
 Prototype void bwrite(Buffer *b, const void *data, int bytes);
 Prototype void bflush(Buffer *b);
@@ -136,6 +137,7 @@ bclose(Buffer *b, int closeFd)
 char *
 bgets(Buffer *b, int *pbytes)
 {
+    char *nl;
     int i;
 
     if (b->bu_Beg == b->bu_End) {
@@ -151,29 +153,31 @@ bgets(Buffer *b, int *pbytes)
 	 * buffer that we have already checked.
 	 */
 
-	for (i = b->bu_NLScan; i < b->bu_End; ++i) {
-	    if (b->bu_Data[i] == '\n') {
-		char *p = b->bu_Data + b->bu_Beg;
+	if (b->bu_NLScan < b->bu_End &&
+	    (nl = memchr(b->bu_Data + b->bu_NLScan, '\n', b->bu_End - b->bu_NLScan)) != NULL
+	) {
+	    char *p = b->bu_Data + b->bu_Beg;
 
-		/*
-		 * terminate buffer, removing newline, or return
-		 * exact size of buffer with nothing removed or terminated.
-		 */
+	    i = nl - b->bu_Data;
 
-		if (pbytes) {
-		    *pbytes = i + 1 - b->bu_Beg;
-		} else {
-		    b->bu_Data[i] = 0;
-		}
-		/*
-		 * note: cannot reset to 0/0 or bunget will not work.
-		 */
-		b->bu_Beg = i + 1;
-		b->bu_NLScan = b->bu_Beg;
-		return(p);
+	    /*
+	     * terminate buffer, removing newline, or return
+	     * exact size of buffer with nothing removed or terminated.
+	     */
+
+	    if (pbytes) {
+		*pbytes = i + 1 - b->bu_Beg;
+	    } else {
+		b->bu_Data[i] = 0;
 	    }
+	    /*
+	     * note: cannot reset to 0/0 or bunget will not work.
+	     */
+	    b->bu_Beg = i + 1;
+	    b->bu_NLScan = b->bu_Beg;
+	    return(p);
 	}
-	b->bu_NLScan = i;
+	b->bu_NLScan = b->bu_End;
 
 	/*
 	 * If there is no room to append new data, attempt to
@@ -364,6 +368,32 @@ err_or_eof:
     return((void *)-1);
 }
 
+/*
+ * bgetlines() - same as bgets, but returns every complete line in the
+ *		 buffer at once.  If ptr[bytes-1] != '\n' it is a partial
+ *		 line, as with bgets.
+ */
+
+char *
+bgetlines(Buffer *b, int *pbytes)
+{
+    char *p = bgets(b, pbytes);
+
+    if (p != NULL && p != (char *)-1 && p[*pbytes - 1] == '\n') {
+	int i;
+
+	for (i = b->bu_End - 1; i >= b->bu_Beg; --i) {
+	    if (b->bu_Data[i] == '\n') {
+		*pbytes += i + 1 - b->bu_Beg;
+		b->bu_Beg = i + 1;
+		b->bu_NLScan = b->bu_Beg;
+		break;
+	    }
+	}
+    }
+    return(p);
+}
+
 /*
  * egets() - same as bgets, but will allocate an extended buffer to
  *	     fit the line if necessary.
@@ -410,6 +440,7 @@ bunget(Buffer *b, int n)
 
     if (n <= b->bu_Beg) {
 	b->bu_Beg -= n;
+	b->bu_NLScan = b->bu_Beg;
 	r = 0;
     }
     return(r);
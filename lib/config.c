@@ -102,7 +102,9 @@ initDOpts(void)
     DOpts.ReaderGroupHashMethod.gh_dirlvl = 1;
     DOpts.ReaderGroupHashMethod.gh_dirinfo[0] = 2;
     DOpts.HashSize = 16 * 1024 * 1024;
+    DOpts.HistoryVersion = 2;
     DOpts.FeederBufferSize = 1;
+    DOpts.FeederPreforkSessions = 100;
     DOpts.FeederMaxArtSize = 10000000;
     DOpts.FeederArtTypes = 1;
     DOpts.FeederPreloadArt = 1;
@@ -116,9 +118,13 @@ initDOpts(void)
     DOpts.ReaderCacheMode = 1;
     DOpts.ReaderCacheHashSize = 4096;
     DOpts.ReaderXOverMode = 1;
+    DOpts.ReaderColumns = 0;
+    DOpts.ReaderListCache = 1;
+    DOpts.ReaderDirtyJournal = 0;
     DOpts.ReaderAutoAddToActive = 0;
     DOpts.FeederAutoAddToActive = 0;
     DOpts.ReaderDetailLog = 1;
+    DOpts.ReaderZeroCopy = 1;
     DOpts.ReaderIdentTimeout = 10;
     DOpts.RememberSecs = 14 * 24 * 60 * 60;
     DOpts.FeederMaxAcceptAge = DOpts.RememberSecs;
@@ -126,6 +132,7 @@ initDOpts(void)
     DOpts.DisplayAdminVersion = 1;
     DOpts.FeederRTStats = RTSTATS_NONE;
     DOpts.SpamFilterOpt = NULL;
+    DOpts.SpamHashMethod = SPAMHASH_MD5;
     DOpts.FeederXRefHost = NULL;
     DOpts.ReaderXRefHost = NULL;
     DOpts.ReaderXRefSlaveHost = NULL;
@@ -250,6 +257,40 @@ LoadDiabloConfig(int ac, char **av)
 			if (optErr == 0)
 			    DOpts.HashSize = n;
 		    }
+		} else if (strcasecmp(cmd, "historyversion") == 0) {
+		    if (opt) {
+			int n = strtol(opt, NULL, 0);
+
+			if (n == 2 || n == HVERSION) {
+			    DOpts.HistoryVersion = n;
+			    optErr = 0;
+			} else {
+			    fprintf(stderr, "Illegal history version: %d\n", n);
+			    logit(LOG_CRIT, "Illegal history version: %d", n);
+			}
+		    }
+		} else if (strcasecmp(cmd, "historymmap") == 0) {
+		    if (opt) {
+			DOpts.HistoryMMap = enabled(opt);
+			optErr = 0;
+		    }
+		} else if (strcasecmp(cmd, "historycommit") == 0) {
+		    if (opt) {
+			DOpts.HistoryCommit = enabled(opt);
+			optErr = 0;
+		    }
+		} else if (strcasecmp(cmd, "historyfilter") == 0) {
+		    if (opt) {
+			uint32 n = bsizetol(opt);
+
+			if (n == 0 || n >= 64 * 1024) {
+			    DOpts.HistoryFilterSize = n;
+			    optErr = 0;
+			} else {
+			    fprintf(stderr, "Illegal history filter size: %d\n", n);
+			    logit(LOG_CRIT, "Illegal history filter size: %d", n);
+			}
+		    }
 		} else if (strcasecmp(cmd, "active") == 0) {
 		    if (opt) {
 			if (strcasecmp(opt, "on") == 0) {
@@ -363,6 +404,8 @@ LoadDiabloConfig(int ac, char **av)
 			pptr = &PCommitCachePat;
 		    else if (strcasecmp(cmd + 5, "dexpover_list") == 0)
 			pptr = &DExpireOverListPat;
+		    else if (strcasecmp(cmd + 5, "dexpover_dirty") == 0)
+			pptr = &DExpireOverDirtyPat;
 		    else if (strcasecmp(cmd + 5, "dhosts_cache") == 0)
 			pptr = &DHostsCachePat;
 		    else if (strcasecmp(cmd + 5, "dnewsfeeds") == 0) 
@@ -592,6 +635,11 @@ SetCommand(FILE *fo, char *cmd, char *opt, int *cmdErr)
 		DOpts.ReaderDetailLog = enabled(opt);
 		optErr = 0;
 	    }
+	} else if (strcasecmp(cmd, "readerzerocopy") == 0) {
+	    if (opt) {
+		DOpts.ReaderZeroCopy = enabled(opt);
+		optErr = 0;
+	    }
 	} else if (strcasecmp(cmd, "readeridenttimeout") == 0) {
 	    if (opt) {
 		DOpts.ReaderIdentTimeout = strtol(opt, NULL, 0);
@@ -630,6 +678,21 @@ SetCommand(FILE *fo, char *cmd, char *opt, int *cmdErr)
 		    optErr = 0;
 		}
 	    }
+	} else if (strcasecmp(cmd, "readercolumns") == 0) {
+	    if (opt) {
+		DOpts.ReaderColumns = enabled(opt);
+		optErr = 0;
+	    }
+	} else if (strcasecmp(cmd, "readerlistcache") == 0) {
+	    if (opt) {
+		DOpts.ReaderListCache = enabled(opt);
+		optErr = 0;
+	    }
+	} else if (strcasecmp(cmd, "readerdirtyjournal") == 0) {
+	    if (opt) {
+		DOpts.ReaderDirtyJournal = enabled(opt);
+		optErr = 0;
+	    }
 	} else if (strcasecmp(cmd, "feederrtstats") == 0) {
 	    if (opt) {
 		if (strcasecmp(opt, "none") == 0)
@@ -651,6 +714,25 @@ SetCommand(FILE *fo, char *cmd, char *opt, int *cmdErr)
 		SetSpamFilterOpt();
 		optErr = 0;
 	    }
+	} else if (strcasecmp(cmd, "spamhash") == 0) {
+	    if (opt) {
+		int method = -1;
+
+		if (strcasecmp(opt, "md5") == 0)
+		    method = SPAMHASH_MD5;
+		else if (strcasecmp(opt, "murmur3") == 0)
+		    method = SPAMHASH_MURMUR3;
+		if (method >= 0) {
+		    /*
+		     * The cache files are rebuilt when reopened
+		     */
+		    if (method != DOpts.SpamHashMethod) {
+			TermSpamFilter();
+			DOpts.SpamHashMethod = method;
+		    }
+		    optErr = 0;
+		}
+	    }
 	} else if (strcasecmp(cmd, "rejectartswithnul") == 0) {
 	    if (opt) {
 		DOpts.RejectArtsWithNul = strtol(opt, NULL, 0);
@@ -749,6 +831,21 @@ SetCommand(FILE *fo, char *cmd, char *opt, int *cmdErr)
 		if (optErr == 0)
 		    DOpts.FeederBufferSize = n;
 	    }
+	} else if (strcasecmp(cmd, "feederprefork") == 0) {
+	    if (opt) {
+		DOpts.FeederPrefork = strtol(opt, NULL, 0);
+		optErr = 0;
+	    }
+	} else if (strcasecmp(cmd, "feederpreforksessions") == 0) {
+	    if (opt) {
+		DOpts.FeederPreforkSessions = strtol(opt, NULL, 0);
+		optErr = 0;
+	    }
+	} else if (strcasecmp(cmd, "feederqueue") == 0) {
+	    if (opt) {
+		DOpts.FeederQueue = strtol(opt, NULL, 0);
+		optErr = 0;
+	    }
 	} else if (strcasecmp(cmd, "feedermaxartsize") == 0) {
 	    if (opt) {
 		DOpts.FeederMaxArtSize = bsizetol(opt);
@@ -822,6 +919,14 @@ dumpConfigFeeder(FILE *fo, char *cmd)
     }
     if (cmd == NULL || strcasecmp(cmd, "hsize") == 0)
 	fprintf(fo, "*hsize: %d\n", DOpts.HashSize);
+    if (cmd == NULL || strcasecmp(cmd, "historyversion") == 0)
+	fprintf(fo, "*historyversion: %d\n", DOpts.HistoryVersion);
+    if (cmd == NULL || strcasecmp(cmd, "historymmap") == 0)
+	fprintf(fo, "*historymmap: %d\n", DOpts.HistoryMMap);
+    if (cmd == NULL || strcasecmp(cmd, "historycommit") == 0)
+	fprintf(fo, "*historycommit: %d\n", DOpts.HistoryCommit);
+    if (cmd == NULL || strcasecmp(cmd, "historyfilter") == 0)
+	fprintf(fo, "*historyfilter: %u\n", DOpts.HistoryFilterSize);
     if (cmd == NULL || strcasecmp(cmd, "feederactive") == 0)
 	fprintf(fo, "*feederactive: %d\n", DOpts.FeederActiveEnabled);
     if (cmd == NULL || strcasecmp(cmd, "hiscachesize") == 0)
@@ -849,6 +954,9 @@ dumpConfigFeeder(FILE *fo, char *cmd)
     if (cmd == NULL || strcasecmp(cmd, "internalfilter") == 0)
 	fprintf(fo, "*internalfilter: %s\n",
 					safestr(DOpts.SpamFilterOpt, NULL));
+    if (cmd == NULL || strcasecmp(cmd, "spamhash") == 0)
+	fprintf(fo, "spamhash: %s\n",
+		(DOpts.SpamHashMethod == SPAMHASH_MURMUR3) ? "murmur3" : "md5");
     if (cmd == NULL || strcasecmp(cmd, "feederfilter") == 0)
 	fprintf(fo, "feederfilter: %s\n", safestr(DOpts.FeederFilter, NULL));
     if (cmd == NULL || strcasecmp(cmd, "rejectartswithnul") == 0)
@@ -889,6 +997,12 @@ dumpConfigFeeder(FILE *fo, char *cmd)
     }
     if (cmd == NULL || strcasecmp(cmd, "feederbuffersize") == 0)
 	fprintf(fo, "feederbuffersize: %d\n", DOpts.FeederBufferSize);
+    if (cmd == NULL || strcasecmp(cmd, "feederprefork") == 0)
+	fprintf(fo, "feederprefork: %d\n", DOpts.FeederPrefork);
+    if (cmd == NULL || strcasecmp(cmd, "feederpreforksessions") == 0)
+	fprintf(fo, "feederpreforksessions: %d\n", DOpts.FeederPreforkSessions);
+    if (cmd == NULL || strcasecmp(cmd, "feederqueue") == 0)
+	fprintf(fo, "feederqueue: %d\n", DOpts.FeederQueue);
     if (cmd == NULL || strcasecmp(cmd, "feedermaxartsize") == 0)
 	fprintf(fo, "feedermaxartsize: %d\n", DOpts.FeederMaxArtSize);
     if (cmd == NULL || strcasecmp(cmd, "feederarttypes") == 0)
@@ -936,6 +1050,8 @@ dumpConfigReader(FILE *fo, char *cmd)
 	fprintf(fo, "readerautoaddtoactive: %d\n", DOpts.ReaderAutoAddToActive);
     if (cmd == NULL || strcasecmp(cmd, "readerdetaillog") == 0)
 	fprintf(fo, "readerdetaillog: %d\n", DOpts.ReaderDetailLog);
+    if (cmd == NULL || strcasecmp(cmd, "readerzerocopy") == 0)
+	fprintf(fo, "readerzerocopy: %d\n", DOpts.ReaderZeroCopy);
     if (cmd == NULL || strcasecmp(cmd, "readerthreads") == 0)
 	fprintf(fo, "readerthreads: %d\n", DOpts.ReaderThreads);
     if (cmd == NULL || strcasecmp(cmd, "readercache") == 0)
@@ -953,6 +1069,12 @@ dumpConfigReader(FILE *fo, char *cmd)
 		    break;
 	}
     }
+    if (cmd == NULL || strcasecmp(cmd, "readercolumns") == 0)
+	fprintf(fo, "readercolumns: %d\n", DOpts.ReaderColumns);
+    if (cmd == NULL || strcasecmp(cmd, "readerlistcache") == 0)
+	fprintf(fo, "readerlistcache: %d\n", DOpts.ReaderListCache);
+    if (cmd == NULL || strcasecmp(cmd, "readerdirtyjournal") == 0)
+	fprintf(fo, "readerdirtyjournal: %d\n", DOpts.ReaderDirtyJournal);
     if (cmd == NULL || strcasecmp(cmd, "readercrash") == 0)
 	fprintf(fo, "readercrash: %s\n",
 				safestr(DOpts.ReaderCrashHandler, NULL));
@@ -53,6 +53,14 @@
  *				to cache cancels that occur prior to article
  *				reception.
  *
+ *	USE_OVERCACHE_SHM	Diablo reader forks will share what they found
+ *				opening a group's overview in a shared memory
+ *				segment, see dreaderd/overcache.c.
+ *
+ *	USE_LISTCACHE_SHM	Diablo reader forks will report the state of
+ *				their pre-rendered LIST responses to the
+ *				master in a shared memory segment.
+ *
  *	DO_PCOMMIT_POSTCACHE	use the precommit cache as a recent-history
  *				cache.  Suggested only if USE_PCOMMIT_RW_MAP
  *				or USE_PCOMMIT_SHM are set.
@@ -242,6 +250,13 @@
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,4,0)
 #define USE_MADVISE           1       /* new (test) - premap article pte's */
 #endif  /* _KERNEL_VERSION >= 2.4.0 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,0)
+#define USE_EPOLL		1	/* epoll() dreaderd select core	 */
+#define USE_SENDFILE		1	/* sendfile() articles to readers */
+#endif  /* _KERNEL_VERSION >= 2.6.0 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+#define USE_IO_URING		1	/* io_uring dreaderd spool reads */
+#endif  /* _KERNEL_VERSION >= 5.6.0 */
 
 #else
 #warning "linux/versionh was not found, perhaps you will have to set options"
@@ -423,6 +438,12 @@ uint64_t		i;
 #ifndef USE_CANCEL_SHM
 #define USE_CANCEL_SHM		1	/* default enabled	  */
 #endif
+#ifndef USE_OVERCACHE_SHM
+#define USE_OVERCACHE_SHM	1	/* default enabled	  */
+#endif
+#ifndef USE_LISTCACHE_SHM
+#define USE_LISTCACHE_SHM	1	/* default enabled	  */
+#endif
 #ifndef DO_PCOMMIT_POSTCACHE
 #define DO_PCOMMIT_POSTCACHE	0
 #endif
@@ -476,6 +497,15 @@ uint64_t		i;
 #ifndef USE_POLL
 #define USE_POLL		0
 #endif
+#ifndef USE_EPOLL
+#define USE_EPOLL		0
+#endif
+#ifndef USE_SENDFILE
+#define USE_SENDFILE		0
+#endif
+#ifndef USE_IO_URING
+#define USE_IO_URING		0
+#endif
 #ifndef DIABLO_FILTER
 #define DIABLO_FILTER		0
 #endif
@@ -43,10 +43,12 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/resource.h>	/* getrlimit()		*/
 #include <sys/ioctl.h>
 #include <sys/socket.h>		/* internet sockets	*/
 #include <sys/un.h>		/* unix domain sockets	*/
 #include <sys/mman.h>		/* mmap()		*/
+#include <sys/uio.h>		/* writev()		*/
 #ifdef _AIX
 #include <sys/select.h>
 #endif
@@ -78,6 +80,13 @@ typedef struct direct den_t;
 #include <poll.h>		/* poll()		*/
 #endif
 
+#if USE_EPOLL
+#include <sys/epoll.h>		/* epoll()		*/
+#endif
+#if USE_SENDFILE
+#include <sys/sendfile.h>	/* sendfile()		*/
+#endif
+
 #if USE_PCOMMIT_SHM || USE_SPAM_SHM || USE_CANCEL_SHM
 #include <sys/ipc.h>		/* SYSV shared memory	*/
 #include <sys/shm.h>		/* SYSV shared memory	*/
@@ -158,6 +167,9 @@ typedef	long long	artno_t;
 #define HASH_CRC	1
 #define HASH_OCRC	2
 
+#define SPAMHASH_MD5	 0
+#define SPAMHASH_MURMUR3 1
+
 #define	CONF_FEEDER	0x01
 #define	CONF_READER	0x02
 
@@ -173,9 +185,12 @@ typedef	long long	artno_t;
 
 #define HASHGRPTYPE_OVER	0x1000
 #define HASHGRPTYPE_DATA	0x2000
+#define HASHGRPTYPE_COLUMN	0x4000	/* column number in bits 4-7 */
+#define HASHGRPCOLUMN(type)	(((type) >> 4) & 0x0F)
 
 #define	GRPFTYPE_OVER	0
 #define	GRPFTYPE_DATA	1
+#define	GRPFTYPE_COLUMN	2	/* + column number (lib/overcol.c) */
 
 #define	HASHGRP_DIR_NUM	1	/* Dirs per level specified as a number */
 #define	HASHGRP_DIR_BIT	2	/* Dirs per level specified as bytes of hash */
@@ -211,6 +226,10 @@ typedef struct BindList {
 struct DiabloOpts {
     int HashMethod;
     uint32 HashSize;
+    int HistoryMMap;
+    int HistoryVersion;
+    uint32 HistoryFilterSize;
+    int HistoryCommit;
     int CompatHashMethod;
     int FeederXRefSlave;
     int FeederXRefSync;
@@ -225,8 +244,12 @@ struct DiabloOpts {
     int ReaderCacheMode;
     int ReaderCacheHashSize;
     int ReaderXOverMode;
+    int ReaderColumns;
+    int ReaderListCache;
+    int ReaderDirtyJournal;
     int ReaderAutoAddToActive;
     int ReaderDetailLog;
+    int ReaderZeroCopy;
     int RememberSecs;
     int FeederMaxAcceptAge;
     int MaxPerRemote;
@@ -235,6 +258,9 @@ struct DiabloOpts {
     int RejectArtsWithNul;
     int RejectArtsWithBareCR;
     int FeederBufferSize;
+    int FeederPrefork;
+    int FeederPreforkSessions;
+    int FeederQueue;
     int FeederMaxArtSize;
     int ReaderMaxArtSize;
     int WireFormat;
@@ -244,6 +270,7 @@ struct DiabloOpts {
     int FeederMaxHeaderSize;
     int ReaderIdentTimeout;
     char *SpamFilterOpt;
+    int SpamHashMethod;
     char *FeederPathHost;
     char *FeederXRefHost;
     char *FeederHostName;
@@ -281,6 +308,75 @@ typedef struct {
     uint64_t    h2;
 } md5hash_t;
 
+/*
+ * Streaming MurmurHash3 x64_128 context (see lib/hash.c)
+ */
+
+typedef struct {
+    uint64_t	h1;
+    uint64_t	h2;
+    uint64_t	len;
+    int		tlen;
+    unsigned char tail[16];
+} mmhash_ctx;
+
+/*
+ * Overview column files (see lib/overcol.c)
+ */
+
+#define OVERCOL_COUNT	7	/* Subject From Date Message-ID References Bytes Lines */
+
+typedef struct OverColHead {
+    int32	ch_Magic;	/* OCMAGIC				*/
+    int32	ch_Version;
+    int32	ch_Column;
+    int32	ch_Flags;
+    int32	ch_RawBytes;	/* entries inflated, if compressed	*/
+    int32	ch_Reserved[3];
+} OverColHead;
+
+#define OCMAGIC		((int32)0xC01D5EED)
+#define OCVERSION	1
+#define OCF_COMPRESSED	0x0001
+
+typedef struct OverColEnt {
+    artno_t	ce_ArtNo;
+    hash_t	ce_MsgHash;
+    int32	ce_Len;		/* header line that follows, \r\n incl.	*/
+    int32	ce_Unused;
+} OverColEnt;
+
+/*
+ * Dirty group journal (see lib/dirtygrp.c)
+ */
+
+typedef struct DirtyGroupHead {
+    int32	dh_Magic;	/* DGMAGIC				*/
+    int32	dh_Version;
+    uint32	dh_Gen;		/* bumped each time dexpireover uses it	*/
+    int32	dh_Reserved;
+} DirtyGroupHead;
+
+#define DGMAGIC		((int32)0xD1E7C0DE)
+#define DGVERSION	1
+
+typedef struct DirtyGroupSet {
+    int		ds_Fd;
+    uint32	ds_Gen;		/* generation read			*/
+    off_t	ds_End;		/* journal read up to			*/
+    int		ds_Entries;	/* entries read				*/
+    int		ds_Count;	/* distinct groups in ds_Hash[]		*/
+    hash_t	*ds_Hash;	/* sorted				*/
+} DirtyGroupSet;
+
+typedef struct OverColBuf {
+    char	*cb_Buf;	/* entries read so far			*/
+    int		cb_Len;
+    int		cb_Max;
+    off_t	cb_Pos;		/* file offset read up to		*/
+    int		cb_Flags;	/* from the file header			*/
+} OverColBuf;
+
 typedef struct HistHead {
     uint32	hmagic;		/* 0xA1B2C3D4			*/
     uint32	hashSize;	/* entries in hash table	*/
@@ -291,7 +387,8 @@ typedef struct HistHead {
 
 #define HMAGIC		((uint32)0xA1B2C3D4)
 #define HDEADMAGIC	((uint32)0xDEADF5E6)
-#define HVERSION	2
+#define HVERSION	3
+#define HHEADSIZE3	64	/* header padded to a cache line in V3 */
 
 /*
  * Dreaderd cache scoreboard
@@ -358,6 +455,27 @@ typedef struct History {
     int32	bsize;		/* size of article		*/
 } History;
 
+/*
+ * Version 3 history index.  The hash table is an array of hashSize
+ * buckets, one cache line each, probed linearly.  A slot holds a
+ * fingerprint of the message-id hash (never 0, 0 marks a free slot)
+ * and the index of the history entry.
+ */
+
+#define HBSLOTS		8
+
+typedef struct HistSlot {
+    uint32	hs_Fp;		/* fingerprint, 0 = free	*/
+    HistIndex	hs_Index;	/* history entry index		*/
+} HistSlot;
+
+typedef struct HistBucket {
+    HistSlot	hb_Slot[HBSLOTS];
+} HistBucket;
+
+#define HFP(hv)		((uint32)(hv).h1 ? (uint32)(hv).h1 : 1)
+#define HIDXSIZE(vers)	((vers) > 2 ? sizeof(HistBucket) : sizeof(HistIndex))
+
 #define EXPF_HEADONLY	0x8000	/* header-only flag (in exp field) */
 #define EXPF_EXPIRED	0x4000
 #define EXPF_FLAGS	0x0FFF
@@ -459,6 +577,7 @@ typedef struct NewslinkInfo {
     int			li_GenLines;
     int			li_Check;
     int			li_MaxStream;
+    int			li_AdaptiveStream;
     int			li_Priority;
     int			li_Compress;
     int			li_QueueSkip;
@@ -500,6 +619,7 @@ typedef struct ArtTypeList {
 #define HGF_MLOCK	0x03
 #define HGF_READONLY	0x04
 #define HGF_EXCHECK	0x08
+#define HGF_MMAP	0x10
 
 typedef struct Node {
     struct Node		*no_Next;
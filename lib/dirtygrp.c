@@ -0,0 +1,290 @@
+/*
+ * LIB/DIRTYGRP.C	- dirty group journal
+ *
+ * Refer to the COPYRIGHT file in the base directory of this
+ * distribution for specific rights granted.
+ *
+ * With 'readerdirtyjournal on' dreaderd appends the hhash() of a group
+ * name to the dexpover.dirty journal when it writes overview data for
+ * the group, and dexpireover -i only expires the groups in the journal
+ * plus a rotating slice of the others, rather than every over. file.
+ *
+ * The journal is a DirtyGroupHead followed by one hash_t per entry.
+ * Every time dexpireover has used it, it removes the entries it read and
+ * bumps dh_Gen.  A dreaderd fork only appends a group once per
+ * generation: it maps the header and keeps a table of the groups it
+ * has appended in the current generation, so a busy group costs a
+ * table lookup per article and the journal stays small.
+ *
+ * Appends are done holding a shared lock on the header, dexpireover
+ * takes it exclusively to read and to cut the journal, so no entry
+ * appended while dexpireover runs is lost.
+ */
+
+#include "defs.h"
+
+Prototype void DirtyGroupMark(const char *group);
+Prototype int DirtyGroupLoad(DirtyGroupSet *ds);
+Prototype int DirtyGroupTest(const DirtyGroupSet *ds, const char *group);
+Prototype int DirtyGroupConsume(DirtyGroupSet *ds);
+Prototype void DirtyGroupFree(DirtyGroupSet *ds);
+
+static int DGFd = -1;
+static const volatile DirtyGroupHead *DGHead;
+static int DGFailed;
+static hash_t *DGSeen;		/* open addressing, h1|h2 0 is empty	*/
+static int DGSeenSize;
+static int DGSeenCount;
+static uint32 DGSeenGen;
+
+static int dgcmp(const void *a, const void *b);
+
+/*
+ * dginit() - write a header.  The caller holds the exclusive lock.  The
+ *	      header is written in place and the file never made shorter
+ *	      than it, the dreaderd forks have it mapped.  An O_APPEND
+ *	      descriptor can only set up an empty file.
+ */
+
+static int
+dginit(int fd, uint32 gen, int append)
+{
+    DirtyGroupHead dh;
+
+    bzero(&dh, sizeof(dh));
+    dh.dh_Magic = DGMAGIC;
+    dh.dh_Version = DGVERSION;
+    dh.dh_Gen = gen;
+    if (append)
+	return((write(fd, &dh, sizeof(dh)) == sizeof(dh)) ? 0 : -1);
+    if (pwrite(fd, &dh, sizeof(dh), 0) != sizeof(dh) ||
+	ftruncate(fd, sizeof(dh)) < 0
+    ) {
+	return(-1);
+    }
+    return(0);
+}
+
+/*
+ * dgseen() - add hv to the table of groups appended in generation gen.
+ *	      Returns 1 if it was there already.
+ */
+
+static int
+dgseen(hash_t hv, uint32 gen)
+{
+    int i;
+
+    if (hv.h1 == 0 && hv.h2 == 0)
+	hv.h2 = 1;
+    if (gen != DGSeenGen && DGSeen) {
+	bzero(DGSeen, DGSeenSize * sizeof(hash_t));
+	DGSeenCount = 0;
+    }
+    DGSeenGen = gen;
+
+    if (DGSeenCount * 2 >= DGSeenSize) {
+	hash_t *old = DGSeen;
+	int oldSize = DGSeenSize;
+	hash_t *tab;
+
+	DGSeenSize = (oldSize) ? oldSize * 2 : 1024;
+	if ((tab = calloc(DGSeenSize, sizeof(hash_t))) == NULL) {
+	    DGSeenSize = oldSize;
+	    return(0);
+	}
+	DGSeen = tab;
+	DGSeenCount = 0;
+	for (i = 0; i < oldSize; ++i) {
+	    if (old[i].h1 || old[i].h2)
+		(void)dgseen(old[i], gen);
+	}
+	if (old)
+	    free(old);
+    }
+
+    for (i = (uint32)hv.h1 & (DGSeenSize - 1);
+	 DGSeen[i].h1 || DGSeen[i].h2;
+	 i = (i + 1) & (DGSeenSize - 1)
+    ) {
+	if (DGSeen[i].h1 == hv.h1 && DGSeen[i].h2 == hv.h2)
+	    return(1);
+    }
+    DGSeen[i] = hv;
+    ++DGSeenCount;
+    return(0);
+}
+
+/*
+ * DirtyGroupMark() - note that group has new articles
+ */
+
+void
+DirtyGroupMark(const char *group)
+{
+    hash_t hv;
+
+    if (DGHead == NULL) {
+	const char *path = PatDbExpand(DExpireOverDirtyPat);
+	struct stat st;
+
+	if (DGFailed)
+	    return;
+	DGFailed = 1;
+	if ((DGFd = open(path, O_RDWR|O_CREAT|O_APPEND, 0644)) < 0) {
+	    logit(LOG_ERR, "Unable to open dirty group journal %s: %s",
+						path, strerror(errno));
+	    return;
+	}
+	hflock(DGFd, 0, XLOCK_EX);
+	if (fstat(DGFd, &st) < 0 ||
+	    (st.st_size == 0 && dginit(DGFd, 0, 1) < 0) ||
+	    (DGHead = xmap(NULL, sizeof(DirtyGroupHead), PROT_READ, MAP_SHARED, DGFd, 0)) == NULL
+	) {
+	    logit(LOG_ERR, "Unable to set up dirty group journal %s: %s",
+						path, strerror(errno));
+	} else if (DGHead->dh_Magic != DGMAGIC || DGHead->dh_Version != DGVERSION) {
+	    logit(LOG_ERR, "Dirty group journal %s has a bad header", path);
+	    xunmap((void *)DGHead, sizeof(DirtyGroupHead));
+	    DGHead = NULL;
+	}
+	hflock(DGFd, 0, XLOCK_UN);
+	if (DGHead == NULL) {
+	    close(DGFd);
+	    DGFd = -1;
+	    return;
+	}
+    }
+
+    hv = hhash(group);
+    if (dgseen(hv, DGHead->dh_Gen))
+	return;
+
+    hflock(DGFd, 0, XLOCK_SH);
+    if (write(DGFd, &hv, sizeof(hv)) != sizeof(hv))
+	DGSeenGen = ~DGHead->dh_Gen;	/* try again next time */
+    hflock(DGFd, 0, XLOCK_UN);
+}
+
+/*
+ * DirtyGroupLoad() - read the journal into ds.  Returns -1 if there is
+ *		      no usable journal.  ds->ds_Fd is left open if the
+ *		      journal exists, so that DirtyGroupConsume() can
+ *		      reset a damaged one.
+ */
+
+int
+DirtyGroupLoad(DirtyGroupSet *ds)
+{
+    const char *path = PatDbExpand(DExpireOverDirtyPat);
+    DirtyGroupHead dh;
+    struct stat st;
+    int r = -1;
+
+    bzero(ds, sizeof(DirtyGroupSet));
+    if ((ds->ds_Fd = open(path, O_RDWR)) < 0)
+	return(-1);
+
+    hflock(ds->ds_Fd, 0, XLOCK_EX);
+    if (fstat(ds->ds_Fd, &st) == 0 &&
+	pread(ds->ds_Fd, &dh, sizeof(dh), 0) == sizeof(dh) &&
+	dh.dh_Magic == DGMAGIC &&
+	dh.dh_Version == DGVERSION
+    ) {
+	int n = (st.st_size - sizeof(dh)) / sizeof(hash_t);
+
+	ds->ds_Gen = dh.dh_Gen;
+	ds->ds_End = sizeof(dh) + (off_t)n * sizeof(hash_t);
+	if ((ds->ds_Hash = malloc((n + 1) * sizeof(hash_t))) != NULL &&
+	    pread(ds->ds_Fd, ds->ds_Hash, n * sizeof(hash_t), sizeof(dh)) == n * sizeof(hash_t)
+	) {
+	    int i;
+
+	    qsort(ds->ds_Hash, n, sizeof(hash_t), dgcmp);
+	    for (i = 0; i < n; ++i) {
+		if (ds->ds_Count == 0 ||
+		    dgcmp(&ds->ds_Hash[ds->ds_Count - 1], &ds->ds_Hash[i]) != 0
+		) {
+		    ds->ds_Hash[ds->ds_Count++] = ds->ds_Hash[i];
+		}
+	    }
+	    ds->ds_Entries = n;
+	    r = 0;
+	}
+    } else {
+	ds->ds_End = -1;	/* reset it */
+    }
+    hflock(ds->ds_Fd, 0, XLOCK_UN);
+    return(r);
+}
+
+int
+DirtyGroupTest(const DirtyGroupSet *ds, const char *group)
+{
+    hash_t hv = hhash(group);
+
+    return(ds->ds_Count &&
+	bsearch(&hv, ds->ds_Hash, ds->ds_Count, sizeof(hash_t), dgcmp) != NULL);
+}
+
+/*
+ * DirtyGroupConsume() - remove the entries DirtyGroupLoad() read from
+ *			 the journal, keeping any appended since, and
+ *			 start a new generation
+ */
+
+int
+DirtyGroupConsume(DirtyGroupSet *ds)
+{
+    struct stat st;
+    char *tail = NULL;
+    int tailLen = 0;
+    int r = -1;
+
+    if (ds->ds_Fd < 0)
+	return(-1);
+
+    hflock(ds->ds_Fd, 0, XLOCK_EX);
+    if (ds->ds_End > 0 && fstat(ds->ds_Fd, &st) == 0 && st.st_size > ds->ds_End) {
+	tailLen = (st.st_size - ds->ds_End) / sizeof(hash_t) * sizeof(hash_t);
+	if ((tail = malloc(tailLen)) == NULL ||
+	    pread(ds->ds_Fd, tail, tailLen, ds->ds_End) != tailLen
+	) {
+	    tailLen = -1;
+	}
+    }
+    if (tailLen >= 0 &&
+	dginit(ds->ds_Fd, ds->ds_Gen + 1, 0) == 0 &&
+	(tailLen == 0 || pwrite(ds->ds_Fd, tail, tailLen, sizeof(DirtyGroupHead)) == tailLen)
+    ) {
+	r = 0;
+    }
+    hflock(ds->ds_Fd, 0, XLOCK_UN);
+    if (tail)
+	free(tail);
+    return(r);
+}
+
+void
+DirtyGroupFree(DirtyGroupSet *ds)
+{
+    if (ds->ds_Fd >= 0)
+	close(ds->ds_Fd);
+    if (ds->ds_Hash)
+	free(ds->ds_Hash);
+    bzero(ds, sizeof(DirtyGroupSet));
+    ds->ds_Fd = -1;
+}
+
+static int
+dgcmp(const void *a, const void *b)
+{
+    const hash_t *h1 = a;
+    const hash_t *h2 = b;
+
+    if (h1->h1 != h2->h1)
+	return((h1->h1 < h2->h1) ? -1 : 1);
+    if (h1->h2 != h2->h2)
+	return((h1->h2 < h2->h2) ? -1 : 1);
+    return(0);
+}
@@ -0,0 +1,390 @@
+/*
+ * LIB/FEEDQUEUE.C	- shared memory queue of outgoing feed records
+ *
+ * Refer to the COPYRIGHT file in the base directory of this
+ * distribution for specific rights granted.
+ *
+ * A diablo child normally tells the master about every article it
+ * stores with a SOUT line down its pipe (see FeedAdd()), which costs
+ * a write() in the child and a read(), a line parse and a strtok()
+ * pass in the master.  With 'feederqueue' the master creates a ring
+ * of fixed size records in SysV shared memory before it forks, the
+ * children put their records in the ring and the master drains it in
+ * batches.
+ *
+ * The ring has many producers and one consumer and takes no locks.
+ * Every record carries a sequence number: a producer claims a
+ * position with a compare-and-swap on the head and publishes the
+ * record with a compare-and-swap of its sequence from position to
+ * position + 1, the master consumes records in order and hands the
+ * slot back for the next lap by setting its sequence to position +
+ * size.  A record that does not fit in a slot, or a full ring, falls
+ * back to the SOUT line.
+ *
+ * A record still unpublished after FQ_STUCK seconds is skipped by
+ * setting its sequence to position + FQ_SKIPPED.  If the producer was
+ * only slow its publish fails, it hands the slot back itself and
+ * sends a SOUT line.  If it died the slot stays skipped until the
+ * head comes round to it again and the master finds the producer
+ * (fr_Pid) gone.
+ *
+ * Before it sleeps in select() the master sets fq_Sleeping.  The
+ * first child to queue a record after that clears it and writes a
+ * newline down its pipe to wake the master up.
+ *
+ * The dqueue files are written by the master exactly as before.
+ */
+
+#include "defs.h"
+
+Prototype void InitFeedQueue(int slots);
+Prototype int FeedQueueAdd(const char *path, off_t off, int size, const char *msgid, const char *nglist, const char *dist, const char *npath, int headOnly, const char *artType, const char *cSize);
+Prototype int FeedQueueDrain(int max, void (*callback)(char *path, char *offsize, char *msgid, char *nglist, char *dist, char *npath, char *headOnly, char *artType, char *cSize));
+Prototype void FeedQueueSleep(struct timeval *tv);
+Prototype void FeedQueueWake(void);
+Prototype void DumpFeedQueue(FILE *fo, int raw);
+
+#define FQ_RECSIZE	2048
+#define FQ_NSTRINGS	7	/* path msgid nglist dist npath artType cSize */
+#define FQ_STUCK	10	/* secs before an unpublished record is skipped */
+#define FQ_SKIPPED	2	/* sequence offset of a skipped record	*/
+
+#if defined(__GNUC__)
+#define FQCAS(p, o, n)	__sync_bool_compare_and_swap(p, o, n)
+#define FQBARRIER()	__sync_synchronize()
+#define FQ_ATOMIC	1
+#else
+#define FQ_ATOMIC	0
+#endif
+
+typedef struct FeedQRec {
+    volatile uint32 fr_Seq;
+    int32	fr_Size;
+    off_t	fr_Off;
+    int16	fr_HeadOnly;
+    int16	fr_Len;			/* bytes used in fr_Data */
+    volatile pid_t fr_Pid;		/* producer, 0 when free */
+    char	fr_Data[FQ_RECSIZE - 24];	/* FQ_NSTRINGS \0 terminated */
+} FeedQRec;
+
+/*
+ * The head is written by every producer, keep it away from the fields
+ * only the master writes.  The counters are approximate.
+ */
+typedef struct FeedQueue {
+    volatile uint32 fq_Head;
+    char	fq_Pad1[60];
+    volatile uint32 fq_Tail;
+    volatile int fq_Sleeping;
+    uint32	fq_Mask;
+    double	fq_Records;		/* drained by the master	*/
+    double	fq_Batches;
+    double	fq_Wakeups;
+    double	fq_Full;		/* sent as a SOUT line instead	*/
+    double	fq_Skipped;
+    char	fq_Pad2[64];
+    FeedQRec	fq_Rec[1];
+} FeedQueue;
+
+FeedQueue	*FQ;
+
+static uint32	FQStuckPos;
+static time_t	FQStuckTime;
+static int	FQArmed;
+
+/*
+ * InitFeedQueue() is called by the master diablo before it forks, like
+ * InitPreCommit().  slots is rounded up to a power of 2, at least 4 so
+ * that a skipped sequence cannot be taken for a free or published one.
+ */
+
+void
+InitFeedQueue(int slots)
+{
+#if USE_PCOMMIT_SHM && FQ_ATOMIC
+    size_t bytes;
+    int sid;
+    struct shmid_ds ds;
+    int n;
+
+    for (n = 4; n < slots; n <<= 1)
+	;
+    bytes = sizeof(FeedQueue) + (n - 1) * sizeof(FeedQRec);
+    sid = shmget(IPC_PRIVATE, bytes, SHM_R|SHM_W);
+
+    if (sid < 0) {
+	logit(LOG_CRIT, "sysv shared memory alloc of %d failed, feed queue disabled",
+	    (int)bytes
+	);
+	return;
+    }
+    FQ = (FeedQueue *)shmat(sid, NULL, SHM_R|SHM_W);
+    if (shmctl(sid, IPC_STAT, &ds) < 0 || shmctl(sid, IPC_RMID, &ds) < 0)
+	logit(LOG_CRIT, "sysv shmctl stat/rmid failed");
+    if (FQ == (FeedQueue *)-1) {
+	FQ = NULL;
+	logit(LOG_CRIT, "sysv shared memory map failed, feed queue disabled");
+	return;
+    }
+    bzero(FQ, bytes);
+    FQ->fq_Mask = n - 1;
+    for (n = 0; n <= FQ->fq_Mask; ++n)
+	FQ->fq_Rec[n].fr_Seq = n;
+#else
+    logit(LOG_ERR, "feed queue needs USE_PCOMMIT_SHM and atomic ops, disabled");
+#endif
+}
+
+/*
+ * FeedQueueAdd() - queue a record from a child.  Returns -1 if the
+ *		    caller has to send a SOUT line instead, 0 if the
+ *		    record was queued and 1 if it was queued and the
+ *		    master has to be woken up.
+ */
+
+int
+FeedQueueAdd(const char *path, off_t off, int size, const char *msgid, const char *nglist, const char *dist, const char *npath, int headOnly, const char *artType, const char *cSize)
+{
+#if FQ_ATOMIC
+    const char *str[FQ_NSTRINGS];
+    int len[FQ_NSTRINGS];
+    FeedQRec *fr;
+    uint32 pos;
+    int total = 0;
+    int i;
+
+    if (FQ == NULL)
+	return(-1);
+
+    str[0] = path;
+    str[1] = msgid;
+    str[2] = nglist;
+    str[3] = dist;
+    str[4] = npath;
+    str[5] = artType;
+    str[6] = cSize;
+    for (i = 0; i < FQ_NSTRINGS; ++i) {
+	len[i] = strlen(str[i]) + 1;
+	total += len[i];
+    }
+    if (total > sizeof(fr->fr_Data))
+	return(-1);
+
+    for (;;) {
+	int32 dif;
+
+	pos = FQ->fq_Head;
+	fr = &FQ->fq_Rec[pos & FQ->fq_Mask];
+	dif = (int32)(fr->fr_Seq - pos);
+	if (dif == 0) {
+	    if (FQCAS(&FQ->fq_Head, pos, pos + 1))
+		break;
+	} else if (dif < 0) {
+	    ++FQ->fq_Full;
+	    return(-1);
+	}
+    }
+
+    fr->fr_Pid = getpid();
+    fr->fr_Off = off;
+    fr->fr_Size = size;
+    fr->fr_HeadOnly = headOnly;
+    fr->fr_Len = total;
+    for (i = total = 0; i < FQ_NSTRINGS; ++i) {
+	bcopy(str[i], fr->fr_Data + total, len[i]);
+	total += len[i];
+    }
+    if (FQCAS(&fr->fr_Seq, pos, pos + 1) == 0) {
+	/*
+	 * The master gave up on us and skipped the record, hand the
+	 * slot back and send a SOUT line instead.
+	 */
+	fr->fr_Pid = 0;
+	FQCAS(&fr->fr_Seq, pos + FQ_SKIPPED, pos + FQ->fq_Mask + 1);
+	return(-1);
+    }
+
+    if (FQ->fq_Sleeping && FQCAS(&FQ->fq_Sleeping, 1, 0))
+	return(1);
+    return(0);
+#else
+    return(-1);
+#endif
+}
+
+/*
+ * feedQueueReclaim() - master: the ring is empty up to pos.  If the
+ *			slot for pos was skipped last lap and its producer
+ *			has died since, hand it back, the head is stuck on
+ *			it and every child is sending SOUT lines.
+ */
+
+static void
+feedQueueReclaim(uint32 pos, FeedQRec *fr)
+{
+#if FQ_ATOMIC
+    uint32 skipped = pos - (FQ->fq_Mask + 1) + FQ_SKIPPED;
+    pid_t pid = fr->fr_Pid;
+
+    if (fr->fr_Seq != skipped)
+	return;
+    if (pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH))
+	return;
+    fr->fr_Pid = 0;
+    if (FQCAS(&fr->fr_Seq, skipped, pos))
+	logit(LOG_ERR, "feed queue record %u reclaimed from pid %d", pos, (int)pid);
+#endif
+}
+
+/*
+ * FeedQueueDrain() - master: hand up to max records to callback, in
+ *		      the same form as the fields of a SOUT line.
+ *		      Returns the number of records drained.
+ */
+
+int
+FeedQueueDrain(int max, void (*callback)(char *path, char *offsize, char *msgid, char *nglist, char *dist, char *npath, char *headOnly, char *artType, char *cSize))
+{
+#if FQ_ATOMIC
+    int n = 0;
+
+    if (FQ == NULL)
+	return(0);
+
+    while (n < max) {
+	uint32 pos = FQ->fq_Tail;
+	FeedQRec *fr = &FQ->fq_Rec[pos & FQ->fq_Mask];
+
+	if ((int32)(fr->fr_Seq - (pos + 1)) < 0) {
+	    /*
+	     * Not published yet.  A child killed between claiming and
+	     * publishing a record would block the queue, skip the
+	     * record if it stays that way.
+	     */
+	    if (pos == FQ->fq_Head) {
+		feedQueueReclaim(pos, fr);
+		break;
+	    }
+	    if (FQStuckPos != pos || FQStuckTime == 0) {
+		FQStuckPos = pos;
+		FQStuckTime = time(NULL);
+		break;
+	    }
+	    if (time(NULL) - FQStuckTime < FQ_STUCK)
+		break;
+	    FQStuckTime = 0;
+	    if (FQCAS(&fr->fr_Seq, pos, pos + FQ_SKIPPED)) {
+		logit(LOG_ERR, "feed queue record %u not published, skipped", pos);
+		++FQ->fq_Skipped;
+		FQ->fq_Tail = pos + 1;
+	    }
+	    continue;
+	} else {
+	    char *str[FQ_NSTRINGS];
+	    char offsize[64];
+	    char headOnly[16];
+	    char *p = fr->fr_Data;
+	    int i;
+
+	    FQBARRIER();
+	    for (i = 0; i < FQ_NSTRINGS; ++i) {
+		str[i] = p;
+		p += strlen(p) + 1;
+	    }
+	    snprintf(offsize, sizeof(offsize), "%lld,%ld",
+					(long long)fr->fr_Off, (long)fr->fr_Size);
+	    snprintf(headOnly, sizeof(headOnly), "%d", fr->fr_HeadOnly);
+	    callback(str[0], offsize, str[1], str[2], str[3], str[4],
+					headOnly, str[5], str[6]);
+	    ++n;
+	}
+	FQStuckTime = 0;
+	fr->fr_Pid = 0;
+	FQBARRIER();
+	fr->fr_Seq = pos + FQ->fq_Mask + 1;
+	FQ->fq_Tail = pos + 1;
+    }
+    if (n) {
+	FQ->fq_Records += n;
+	++FQ->fq_Batches;
+    }
+    return(n);
+#else
+    return(0);
+#endif
+}
+
+/*
+ * FeedQueueSleep() - master: about to sleep in select() for at most
+ *		      tv.  If records are waiting tv is cleared and the
+ *		      wakeup is not armed.  If the next record is stuck
+ *		      unpublished tv is cut to when it will be skipped,
+ *		      the records behind it have to wait for that.
+ *
+ * FeedQueueWake()  - master: back from select()
+ */
+
+void
+FeedQueueSleep(struct timeval *tv)
+{
+#if FQ_ATOMIC
+    uint32 pos;
+
+    if (FQ == NULL)
+	return;
+    FQ->fq_Sleeping = 1;
+    FQBARRIER();
+    pos = FQ->fq_Tail;
+    if (pos != FQ->fq_Head) {
+	FeedQRec *fr = &FQ->fq_Rec[pos & FQ->fq_Mask];
+
+	FQ->fq_Sleeping = 0;
+	if (FQStuckTime && FQStuckPos == pos &&
+	    (int32)(fr->fr_Seq - (pos + 1)) < 0
+	) {
+	    time_t left = FQStuckTime + FQ_STUCK - time(NULL);
+
+	    if (left < 0)
+		left = 0;
+	    if (tv->tv_sec > left)
+		tv->tv_sec = left;
+	} else {
+	    tv->tv_sec = 0;
+	}
+	tv->tv_usec = 0;
+	return;
+    }
+    FQArmed = 1;
+#endif
+}
+
+void
+FeedQueueWake(void)
+{
+    if (FQArmed == 0)
+	return;
+    FQArmed = 0;
+    if (FQ->fq_Sleeping)
+	FQ->fq_Sleeping = 0;
+    else
+	++FQ->fq_Wakeups;
+}
+
+void
+DumpFeedQueue(FILE *fo, int raw)
+{
+    double avg;
+
+    if (FQ == NULL)
+	return;
+    avg = (FQ->fq_Batches > 0) ? FQ->fq_Records / FQ->fq_Batches : 0.0;
+    if (raw)
+	xfprintf(fo, "211 FEEDQUEUE size=%u records=%.0f batches=%.0f perbatch=%.2f wakeups=%.0f full=%.0f skipped=%.0f\r\n",
+		FQ->fq_Mask + 1, FQ->fq_Records, FQ->fq_Batches, avg,
+		FQ->fq_Wakeups, FQ->fq_Full, FQ->fq_Skipped);
+    else
+	xfprintf(fo, "211 FEEDQUEUE size=%u records=%s batches=%s perbatch=%.2f wakeups=%s full=%s skipped=%s\r\n",
+		FQ->fq_Mask + 1, ftos(FQ->fq_Records), ftos(FQ->fq_Batches),
+		avg, ftos(FQ->fq_Wakeups), ftos(FQ->fq_Full),
+		ftos(FQ->fq_Skipped));
+}
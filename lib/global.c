@@ -42,11 +42,13 @@ Prototype const char *DistributionsPat;		/* lib relative	*/
 Prototype const char *ServerDActivePat;		/* db relative	*/
 Prototype const char *ReaderDActivePat;		/* db relative	*/
 Prototype const char *DHistoryPat;		/* db relative	*/
+Prototype const char *DHistoryLockPat;		/* db relative	*/
 Prototype const char *DumpHistPat;		/* db relative	*/
 Prototype const char *SpamBodyCachePat;		/* db relative	*/
 Prototype const char *SpamNphCachePat;		/* db relative	*/
 Prototype const char *PCommitCachePat;		/* db relative	*/
 Prototype const char *DExpireOverListPat;	/* db relative  */
+Prototype const char *DExpireOverDirtyPat;	/* db relative  */
 Prototype const char *DHostsCachePat;		/* db relative  */
 Prototype const char *DHostsLockPat;		/* db relative  */
 Prototype const char *DFeedStatsPat;		/* db relative  */
@@ -93,6 +95,7 @@ const char *DExpireCtlPat = "%s/dexpire.ctl";
 const char *DSpoolCtlPat = "%s/dspool.ctl";
 const char *DControlCtlPat = "%s/dcontrol.ctl";
 const char *DHistoryPat = "%s/dhistory";
+const char *DHistoryLockPat = "%s/.historylock";
 const char *DumpHistPat = "NONE";
 const char *DiabloHostsPat = "%s/diablo.hosts";
 const char *DReaderAccessPat = "%s/dreader.access";
@@ -103,6 +106,7 @@ const char *SpamBodyCachePat = "%s/spam.body.cache";
 const char *SpamNphCachePat = "%s/spam.nph.cache";
 const char *PCommitCachePat = "%s/pcommit.cache";
 const char *DExpireOverListPat = "%s/dexpover.dat";
+const char *DExpireOverDirtyPat = "%s/dexpover.dirty";
 const char *DHostsCachePat = "%s/dhosts.cache";
 const char *CacheHitsPat = "%s/cache.hits";
 const char *DHostsLockPat = "%s/.hostslock";
@@ -27,6 +27,10 @@ Prototype void bhash_init(void);
 Prototype void bhash_update(const char *p, int len);
 Prototype void bhash_final(md5hash_t *h);
 Prototype md5hash_t *md5hash(const char *st);
+Prototype md5hash_t *spamhash(const char *st);
+Prototype void mmhash_init(mmhash_ctx *ctx);
+Prototype void mmhash_update(mmhash_ctx *ctx, const char *p, int len);
+Prototype void mmhash_final(mmhash_ctx *ctx, md5hash_t *h);
 Prototype char *md5hashstr(md5hash_t *hash, char *buf);
 Prototype void bhash(hash_t *h, const char *p, int len);
 Prototype int GFIndex(char c);
@@ -56,6 +60,8 @@ int    DidCrcInit;
 
 struct diablo_MD5Context HMD5ctx;
 struct diablo_MD5Context BMD5ctx;	/* article body MD5 context */
+mmhash_ctx BMMctx;			/* article body murmur3 context */
+int BHashMethod;			/* method bhash_init() started */
 
 int
 quickhash(const char *st)
@@ -161,22 +167,184 @@ bhash(hash_t *h, const char *p, int len)
     }
 }
 
+/*
+ * bhash_*() - the article body fingerprint used by the internal spam
+ *	       filter, MD5 or murmur3 according to 'spamhash'.  The
+ *	       method is latched by bhash_init() so a config change
+ *	       cannot mix the two within an article.
+ */
+
 void 
 bhash_init(void)
 {
-    diablo_MD5Init(&BMD5ctx);
+    BHashMethod = DOpts.SpamHashMethod;
+    if (BHashMethod == SPAMHASH_MURMUR3)
+	mmhash_init(&BMMctx);
+    else
+	diablo_MD5Init(&BMD5ctx);
 }
 
 void 
 bhash_update(const char *p, int len)
 {
-    diablo_MD5Update(&BMD5ctx, p, len);
+    if (BHashMethod == SPAMHASH_MURMUR3)
+	mmhash_update(&BMMctx, p, len);
+    else
+	diablo_MD5Update(&BMD5ctx, p, len);
 }
 
 void 
 bhash_final(md5hash_t *h)
 {
-    diablo_MD5Final((unsigned char *)h, &BMD5ctx);
+    if (BHashMethod == SPAMHASH_MURMUR3)
+	mmhash_final(&BMMctx, h);
+    else
+	diablo_MD5Final((unsigned char *)h, &BMD5ctx);
+}
+
+/*
+ * MurmurHash3 x64_128 (Austin Appleby, public domain), made incremental
+ * so that it can be fed a line or a block at a time.  It is not a
+ * cryptographic hash, which the spam filter does not need, and runs
+ * several times faster than MD5.  Blocks are read in host byte order,
+ * the results are only ever compared on the host that made them.
+ */
+
+#define MMC1	0x87c37b91114253d5ULL
+#define MMC2	0x4cf5ad432745937fULL
+#define MMROTL(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t
+mmfmix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return(k);
+}
+
+static void
+mmblocks(mmhash_ctx *ctx, const unsigned char *p, int nblocks)
+{
+    uint64_t h1 = ctx->h1;
+    uint64_t h2 = ctx->h2;
+
+    while (nblocks-- > 0) {
+	uint64_t k1;
+	uint64_t k2;
+
+	memcpy(&k1, p, sizeof(k1));
+	memcpy(&k2, p + 8, sizeof(k2));
+	p += 16;
+
+	k1 *= MMC1;
+	k1 = MMROTL(k1, 31);
+	k1 *= MMC2;
+	h1 ^= k1;
+	h1 = MMROTL(h1, 27);
+	h1 += h2;
+	h1 = h1 * 5 + 0x52dce729;
+
+	k2 *= MMC2;
+	k2 = MMROTL(k2, 33);
+	k2 *= MMC1;
+	h2 ^= k2;
+	h2 = MMROTL(h2, 31);
+	h2 += h1;
+	h2 = h2 * 5 + 0x38495ab5;
+    }
+    ctx->h1 = h1;
+    ctx->h2 = h2;
+}
+
+void
+mmhash_init(mmhash_ctx *ctx)
+{
+    bzero(ctx, sizeof(mmhash_ctx));
+}
+
+void
+mmhash_update(mmhash_ctx *ctx, const char *p, int len)
+{
+    const unsigned char *up = (const unsigned char *)p;
+
+    if (len <= 0)
+	return;
+    ctx->len += len;
+
+    if (ctx->tlen) {
+	int n = 16 - ctx->tlen;
+
+	if (n > len)
+	    n = len;
+	memcpy(ctx->tail + ctx->tlen, up, n);
+	ctx->tlen += n;
+	up += n;
+	len -= n;
+	if (ctx->tlen < 16)
+	    return;
+	mmblocks(ctx, ctx->tail, 1);
+	ctx->tlen = 0;
+    }
+    if (len >= 16) {
+	mmblocks(ctx, up, len >> 4);
+	up += len & ~15;
+	len &= 15;
+    }
+    if (len) {
+	memcpy(ctx->tail, up, len);
+	ctx->tlen = len;
+    }
+}
+
+void
+mmhash_final(mmhash_ctx *ctx, md5hash_t *h)
+{
+    const unsigned char *tail = ctx->tail;
+    uint64_t h1 = ctx->h1;
+    uint64_t h2 = ctx->h2;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (ctx->tlen) {
+    case 15: k2 ^= (uint64_t)tail[14] << 48;
+    case 14: k2 ^= (uint64_t)tail[13] << 40;
+    case 13: k2 ^= (uint64_t)tail[12] << 32;
+    case 12: k2 ^= (uint64_t)tail[11] << 24;
+    case 11: k2 ^= (uint64_t)tail[10] << 16;
+    case 10: k2 ^= (uint64_t)tail[9] << 8;
+    case 9:  k2 ^= (uint64_t)tail[8];
+	     k2 *= MMC2;
+	     k2 = MMROTL(k2, 33);
+	     k2 *= MMC1;
+	     h2 ^= k2;
+    case 8:  k1 ^= (uint64_t)tail[7] << 56;
+    case 7:  k1 ^= (uint64_t)tail[6] << 48;
+    case 6:  k1 ^= (uint64_t)tail[5] << 40;
+    case 5:  k1 ^= (uint64_t)tail[4] << 32;
+    case 4:  k1 ^= (uint64_t)tail[3] << 24;
+    case 3:  k1 ^= (uint64_t)tail[2] << 16;
+    case 2:  k1 ^= (uint64_t)tail[1] << 8;
+    case 1:  k1 ^= (uint64_t)tail[0];
+	     k1 *= MMC1;
+	     k1 = MMROTL(k1, 31);
+	     k1 *= MMC2;
+	     h1 ^= k1;
+    }
+
+    h1 ^= ctx->len;
+    h2 ^= ctx->len;
+    h1 += h2;
+    h2 += h1;
+    h1 = mmfmix(h1);
+    h2 = mmfmix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    h->h1 = h1;
+    h->h2 = h2;
 }
 
 /*
@@ -195,6 +363,27 @@ md5hash(const char *st)
 }
 
 
+/*
+ * spamhash() - NNTP-Posting-Host fingerprint for the internal spam
+ *		filter, using the same method as the body fingerprint
+ */
+
+md5hash_t *
+spamhash(const char *st)
+{
+    static md5hash_t digest;
+
+    if (DOpts.SpamHashMethod == SPAMHASH_MURMUR3) {
+	mmhash_ctx ctx;
+
+	mmhash_init(&ctx);
+	mmhash_update(&ctx, st, strlen(st));
+	mmhash_final(&ctx, &digest);
+	return(&digest);
+    }
+    return(md5hash(st));
+}
+
 char *
 md5hashstr(md5hash_t *hash, char *buf)
 {
@@ -380,6 +569,9 @@ GFName(const char *group, int gftype, artno_t artBase, int wantdir, int iter, Gr
 		case GRPFTYPE_DATA:
 		    strcpy(ftype, "data");
 		    break;
+		default:
+		    snprintf(ftype, sizeof(ftype), "col%d", gftype - GRPFTYPE_COLUMN);
+		    break;
 	    }
 	    if (iter > 0)
 		snprintf(itbuf, sizeof(itbuf), ".%d", iter);
@@ -422,6 +614,9 @@ GFName(const char *group, int gftype, artno_t artBase, int wantdir, int iter, Gr
 		case GRPFTYPE_DATA:
 		    strcpy(ftype, "d");
 		    break;
+		default:
+		    snprintf(ftype, sizeof(ftype), "c%d", gftype - GRPFTYPE_COLUMN);
+		    break;
 	    }
 	    switch (method->gh_type) {
 		case HASHGRP_32MD5:
@@ -494,6 +689,9 @@ GFName(const char *group, int gftype, artno_t artBase, int wantdir, int iter, Gr
 		case GRPFTYPE_DATA:
 		    strcpy(ftype, "d");
 		    break;
+		default:
+		    snprintf(ftype, sizeof(ftype), "c%d", gftype - GRPFTYPE_COLUMN);
+		    break;
 	    }
 	    if (wantdir) {
 		FindGroupDir(group, groupPath);
@@ -627,6 +825,27 @@ ExtractGroupHashInfo(const char *name, char *Hash, artno_t *artBase, int *iter)
     if (sscanf(name, "d.%lld.%[^/]", artBase, Hash) == 2)
 	return(HASHGRP_HIER | HASHGRPTYPE_DATA);
     *iter = 0;
+
+    /*
+     * Column files (lib/overcol.c), column number in bits 4-7.  Last,
+     * since the MD5 pattern could match the other formats.
+     */
+    if (sscanf(name, "col%d.%lld.%17[0-9a-f.].%d", &b, artBase, Hash, iter) == 4 && b >= 0 && b < OVERCOL_COUNT)
+	return(HASHGRP_CRC | HASHGRPTYPE_COLUMN | (b << 4));
+    *iter = 0;
+    if (sscanf(name, "col%d.%lld.%17[0-9a-f.]", &b, artBase, Hash) == 3 && b >= 0 && b < OVERCOL_COUNT)
+	return(HASHGRP_CRC | HASHGRPTYPE_COLUMN | (b << 4));
+    *iter = 0;
+    if (sscanf(name, "c%d.%lld.%[^/]", &b, artBase, Hash) == 3 && b >= 0 && b < OVERCOL_COUNT)
+	return(HASHGRP_HIER | HASHGRPTYPE_COLUMN | (b << 4));
+    *iter = 0;
+    {
+	int c;
+
+	if (sscanf(name, "%[^.].%d.c%d.%d.%lld", Hash, iter, &c, &b, artBase) == 5 && c >= 0 && c < OVERCOL_COUNT)
+	    return(((b == 64) ? HASHGRP_64MD5 : HASHGRP_32MD5) | HASHGRPTYPE_COLUMN | (c << 4));
+    }
+    *iter = 0;
     return(HASHGRP_NONE);
 }
 
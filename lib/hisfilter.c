@@ -0,0 +1,448 @@
+/*
+ * LIB/HISFILTER.C	- Bloom filter in front of the history file
+ *
+ * Refer to the COPYRIGHT file in the base directory of this
+ * distribution for specific rights granted.
+ *
+ * The filter is a file (<dhistory>.filter) mapped shared by every
+ * process that has the history open.  It answers "this
+ * message-id is definitely not in the history" without touching the
+ * history file.  Each message-id hash sets HF_NHASH bits, all within
+ * one 64 byte block, so a test costs at most one cache line.
+ *
+ * The filter is built from the history file by the first process to
+ * open the history when the filter does not describe the file (it
+ * records the device, inode and size of the history it covers), so a
+ * new history installed by dhisexpire, or entries appended by a
+ * FAST mode writer, cause a rebuild on the next HistoryOpen().  The
+ * build and every addition happen under the history append lock, so
+ * bits are never lost and an entry is always in the filter before
+ * it can be found in the history.  The diablo master calls
+ * HistoryFilterReset() at startup so that a filter left over from a
+ * crash is never trusted.
+ *
+ * Filter bits are never cleared short of a rebuild: expired entries
+ * are only removed when dhisexpire writes a new history file.
+ */
+
+#include "defs.h"
+
+Prototype void HistoryFilterOpen(const char *hisName, int fd, off_t start, int build);
+Prototype void HistoryFilterClose(void);
+Prototype void HistoryFilterReset(void);
+Prototype int HistoryFilterTest(hash_t hv);
+Prototype void HistoryFilterAdd(hash_t hv, off_t end);
+Prototype void HistoryFilterMiss(void);
+Prototype void DumpHistoryFilter(FILE *fo, int raw);
+
+#define HFMAGIC		0x48464c31	/* 'HFL1' */
+#define HFHEADSIZE	128
+#define HFBLKSIZE	64
+#define HF_NHASH	6
+#define HF_STATSFLUSH	256	/* lookups counted before adding to the header */
+
+#define HFS_EMPTY	0
+#define HFS_BUILDING	1
+#define HFS_VALID	2
+
+/*
+ * Each process counts its lookups in HFStats and adds them to the
+ * header every HF_STATSFLUSH lookups, so the feeder forks do not all
+ * write the header's cache line on every CHECK.  The header counters
+ * are added to without locking and are approximate.
+ */
+typedef struct HisFilterHead {
+    uint32	hf_Magic;
+    uint32	hf_State;
+    uint32	hf_Blocks;	/* number of HFBLKSIZE blocks (power of 2) */
+    uint32	hf_Builds;	/* number of rebuilds		*/
+    uint64_t	hf_Dev;		/* history file we describe	*/
+    uint64_t	hf_Ino;
+    uint64_t	hf_EndOff;	/* history size as of last add	*/
+    uint32	hf_Entries;	/* history entries in the filter */
+    uint32	hf_BuildMs;	/* duration of last rebuild	*/
+    int32	hf_BuildTime;	/* time of last rebuild		*/
+    int32	hf_Unused01;
+    uint64_t	hf_Checks;	/* lookups tested		*/
+    uint64_t	hf_Absent;	/* answered 'not present'	*/
+    uint64_t	hf_FalsePos;	/* passed but not in history	*/
+} HisFilterHead;
+
+typedef struct HisFilterStats {
+    uint32	hs_Checks;
+    uint32	hs_Absent;
+    uint32	hs_FalsePos;
+} HisFilterStats;
+
+HisFilterHead	*HFHead;
+HisFilterStats	HFStats;
+uint32		*HFBits;
+size_t		HFMapSize;
+uint32		HFMask;
+uint64_t	HFDev;
+uint64_t	HFIno;
+int		HFLoggedSize;
+
+static void hfBuild(int fd, off_t start, struct stat *st);
+static void hfFlushStats(void);
+
+static const char *
+hfFileName(const char *hisName)
+{
+    static char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s.filter", hisName);
+    return(path);
+}
+
+/*
+ * Set or test the bits for hv.  hhash() values for similar message-ids
+ * can share most of their bits (h2 in particular), so the whole hash
+ * is mixed first.  The low bits select the block, the bit numbers
+ * within the block come from the top of a second multiply.
+ */
+
+static __inline uint32 *
+hfBlock(hash_t hv, uint64_t *mix)
+{
+    uint64_t v = ((uint64_t)hv.h1 << 32) | hv.h2;
+
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    v *= 0xc4ceb9fe1a85ec53ULL;
+    v ^= v >> 33;
+    *mix = v * 0x9E3779B97F4A7C15ULL;
+    return(HFBits + (size_t)((uint32)v & HFMask) * (HFBLKSIZE / sizeof(uint32)));
+}
+
+static __inline int
+hfActive(void)
+{
+    return(HFHead != NULL && HFHead->hf_State == HFS_VALID &&
+	HFHead->hf_Ino == HFIno && HFHead->hf_Dev == HFDev);
+}
+
+/*
+ * HistoryFilterOpen() - map the filter for the history open on fd
+ *			 and rebuild it if it does not describe the file.
+ *			 The caller holds the history append lock.  start
+ *			 is the offset of the first history entry.
+ *
+ *			 Read-only users pass build as 0, they use the
+ *			 filter only if it is already valid and never
+ *			 create or rebuild it.
+ */
+
+void
+HistoryFilterOpen(const char *hisName, int fd, off_t start, int build)
+{
+    const char *path = hfFileName(hisName);
+    struct stat st;
+    struct stat hst;
+    off_t want;
+    uint32 blocks;
+    int ffd;
+
+    HistoryFilterClose();
+
+    if (DOpts.HistoryFilterSize == 0 || fstat(fd, &hst) < 0)
+	return;
+
+    for (blocks = 1; (off_t)blocks * 2 * HFBLKSIZE <= DOpts.HistoryFilterSize; blocks <<= 1)
+	;
+    want = HFHEADSIZE + (off_t)blocks * HFBLKSIZE;
+
+    if ((ffd = open(path, O_RDWR | (build ? O_CREAT : 0), 0644)) < 0) {
+	if (build)
+	    logit(LOG_ERR, "open %s failed (%s)", path, strerror(errno));
+	return;
+    }
+    if (fstat(ffd, &st) < 0) {
+	close(ffd);
+	return;
+    }
+
+    /*
+     * Other processes may have the filter mapped, so it is never
+     * resized while in use.  A new size takes effect when the file
+     * is removed with diablo stopped.
+     */
+    if (st.st_size == 0 && build) {
+	if (ftruncate(ffd, want) < 0) {
+	    logit(LOG_ERR, "ftruncate %s failed (%s)", path, strerror(errno));
+	    close(ffd);
+	    return;
+	}
+	st.st_size = want;
+    } else if (st.st_size != want && HFLoggedSize == 0) {
+	HFLoggedSize = 1;
+	logit(LOG_NOTICE, "%s is %lld bytes, historyfilter wants %lld, remove it while diablo is stopped to resize",
+		path, (long long)st.st_size, (long long)want);
+    }
+    if (st.st_size < HFHEADSIZE + HFBLKSIZE) {
+	close(ffd);
+	return;
+    }
+    HFMapSize = st.st_size;
+    HFHead = xmap(NULL, HFMapSize, PROT_READ|PROT_WRITE, MAP_SHARED, ffd, 0);
+    close(ffd);
+    if (HFHead == NULL) {
+	logit(LOG_ERR, "%s mmap failed (%s)", path, strerror(errno));
+	return;
+    }
+    HFBits = (uint32 *)((char *)HFHead + HFHEADSIZE);
+    HFDev = (uint64_t)hst.st_dev;
+    HFIno = (uint64_t)hst.st_ino;
+
+    if (build == 0) {
+	if (!hfActive() || HFHead->hf_EndOff != (uint64_t)hst.st_size ||
+	    HFHEADSIZE + (off_t)HFHead->hf_Blocks * HFBLKSIZE > HFMapSize
+	) {
+	    HistoryFilterClose();
+	} else {
+	    HFMask = HFHead->hf_Blocks - 1;
+	}
+	return;
+    }
+
+    if (HFHead->hf_Magic != HFMAGIC || HFHead->hf_Blocks == 0 ||
+	(HFHead->hf_Blocks & (HFHead->hf_Blocks - 1)) != 0 ||
+	HFHEADSIZE + (off_t)HFHead->hf_Blocks * HFBLKSIZE > HFMapSize
+    ) {
+	blocks = (HFMapSize - HFHEADSIZE) / HFBLKSIZE;
+	while (blocks & (blocks - 1))
+	    blocks &= blocks - 1;
+	bzero(HFHead, HFHEADSIZE);
+	HFHead->hf_Blocks = blocks;
+	HFHead->hf_Magic = HFMAGIC;
+    }
+    HFMask = HFHead->hf_Blocks - 1;
+
+    if (!hfActive() || HFHead->hf_EndOff != (uint64_t)hst.st_size)
+	hfBuild(fd, start, &hst);
+}
+
+void
+HistoryFilterClose(void)
+{
+    hfFlushStats();
+    if (HFHead != NULL)
+	xunmap((void *)HFHead, HFMapSize);
+    HFHead = NULL;
+    HFBits = NULL;
+    HFMapSize = 0;
+}
+
+/*
+ * HistoryFilterReset() - called by the diablo master at startup.  Mark
+ *			  the filter for the default history as needing
+ *			  a rebuild.
+ */
+
+void
+HistoryFilterReset(void)
+{
+    HisFilterHead hf;
+    int fd;
+
+    if ((fd = open(hfFileName(PatDbExpand(DHistoryPat)), O_RDWR)) < 0)
+	return;
+    if (read(fd, &hf, sizeof(hf)) == sizeof(hf) && hf.hf_Magic == HFMAGIC) {
+	hf.hf_State = HFS_EMPTY;
+	lseek(fd, 0L, 0);
+	write(fd, &hf, sizeof(hf));
+    }
+    close(fd);
+}
+
+static void
+hfSet(hash_t hv)
+{
+    uint64_t mix;
+    uint32 *blk = hfBlock(hv, &mix);
+    int i;
+
+    for (i = 0; i < HF_NHASH; ++i) {
+	uint32 b = (uint32)(mix >> (55 - i * 9)) & 511;
+
+	blk[b >> 5] |= 1U << (b & 31);
+    }
+}
+
+/*
+ * HistoryFilterTest() - returns 0 if hv is definitely not in the
+ *			 history, non-zero if it may be (or if there is
+ *			 no usable filter).
+ */
+
+int
+HistoryFilterTest(hash_t hv)
+{
+    uint64_t mix;
+    uint32 *blk;
+    int i;
+
+    if (!hfActive())
+	return(1);
+    if (++HFStats.hs_Checks >= HF_STATSFLUSH)
+	hfFlushStats();
+    blk = hfBlock(hv, &mix);
+    for (i = 0; i < HF_NHASH; ++i) {
+	uint32 b = (uint32)(mix >> (55 - i * 9)) & 511;
+
+	if ((blk[b >> 5] & (1U << (b & 31))) == 0) {
+	    ++HFStats.hs_Absent;
+	    return(0);
+	}
+    }
+    return(1);
+}
+
+/*
+ * HistoryFilterAdd() - add hv to the filter.  The caller holds the
+ *			history append lock and has written the entry,
+ *			end is the new size of the history file.
+ */
+
+void
+HistoryFilterAdd(hash_t hv, off_t end)
+{
+    if (!hfActive())
+	return;
+    hfSet(hv);
+    ++HFHead->hf_Entries;
+    HFHead->hf_EndOff = (uint64_t)end;
+}
+
+/*
+ * HistoryFilterMiss() - a lookup the filter passed was not found
+ */
+
+void
+HistoryFilterMiss(void)
+{
+    if (hfActive())
+	++HFStats.hs_FalsePos;
+}
+
+/*
+ * hfFlushStats() - add this process's counts to the header
+ */
+
+static void
+hfFlushStats(void)
+{
+    if (hfActive()) {
+	HFHead->hf_Checks += HFStats.hs_Checks;
+	HFHead->hf_Absent += HFStats.hs_Absent;
+	HFHead->hf_FalsePos += HFStats.hs_FalsePos;
+    }
+    bzero(&HFStats, sizeof(HFStats));
+}
+
+static void
+hfBuild(int fd, off_t start, struct stat *st)
+{
+    History *buf;
+    struct timeval tv1;
+    struct timeval tv2;
+    uint32 count = 0;
+    int n;
+
+    gettimeofday(&tv1, NULL);
+
+    HFHead->hf_State = HFS_BUILDING;
+    bzero(HFBits, (size_t)HFHead->hf_Blocks * HFBLKSIZE);
+
+    buf = malloc(1024 * sizeof(History));
+    lseek(fd, start, 0);
+    while ((n = read(fd, buf, 1024 * sizeof(History))) >= (int)sizeof(History)) {
+	int i;
+
+	n /= sizeof(History);
+	for (i = 0; i < n; ++i) {
+	    if (buf[i].hv.h1 == 0 && buf[i].hv.h2 == 0)
+		continue;
+	    hfSet(buf[i].hv);
+	    ++count;
+	}
+    }
+    free(buf);
+
+    gettimeofday(&tv2, NULL);
+
+    HFHead->hf_Dev = (uint64_t)st->st_dev;
+    HFHead->hf_Ino = (uint64_t)st->st_ino;
+    HFHead->hf_EndOff = (uint64_t)st->st_size;
+    HFHead->hf_Entries = count;
+    HFHead->hf_Checks = 0;
+    HFHead->hf_Absent = 0;
+    HFHead->hf_FalsePos = 0;
+    bzero(&HFStats, sizeof(HFStats));
+    HFHead->hf_BuildTime = (int32)tv2.tv_sec;
+    HFHead->hf_BuildMs = (tv2.tv_sec - tv1.tv_sec) * 1000 +
+				(tv2.tv_usec - tv1.tv_usec) / 1000;
+    ++HFHead->hf_Builds;
+    HFHead->hf_State = HFS_VALID;
+
+    logit(LOG_INFO, "history filter rebuilt: %u entries, %u KB, %u ms",
+	count, (uint32)((size_t)HFHead->hf_Blocks * HFBLKSIZE / 1024),
+	HFHead->hf_BuildMs);
+}
+
+/*
+ * DumpHistoryFilter() - filter statistics for DoStats().  Only the
+ *			 filter for the default history is reported.
+ */
+
+void
+DumpHistoryFilter(FILE *fo, int raw)
+{
+    HisFilterHead hf;
+    int fd;
+    const char *state;
+
+    if ((fd = open(hfFileName(PatDbExpand(DHistoryPat)), O_RDONLY)) < 0)
+	return;
+    if (read(fd, &hf, sizeof(hf)) != sizeof(hf) || hf.hf_Magic != HFMAGIC) {
+	close(fd);
+	return;
+    }
+    close(fd);
+
+    switch(hf.hf_State) {
+    case HFS_VALID:
+	state = "valid";
+	break;
+    case HFS_BUILDING:
+	state = "building";
+	break;
+    default:
+	state = "empty";
+	break;
+    }
+    if (raw)
+	xfprintf(fo, "211 HISFILTER state=%s size=%u entries=%u checks=%.0f absent=%.0f falsepos=%.0f builds=%u built=%d buildms=%u\r\n",
+		state,
+		hf.hf_Blocks * HFBLKSIZE,
+		hf.hf_Entries,
+		(double)hf.hf_Checks,
+		(double)hf.hf_Absent,
+		(double)hf.hf_FalsePos,
+		hf.hf_Builds,
+		(int)hf.hf_BuildTime,
+		hf.hf_BuildMs
+	);
+    else
+	xfprintf(fo, "211 HISFILTER state=%s size=%s entries=%s checks=%s absent=%s falsepos=%s builds=%u buildms=%u\r\n",
+		state,
+		ftos((double)hf.hf_Blocks * HFBLKSIZE),
+		ftos((double)hf.hf_Entries),
+		ftos((double)hf.hf_Checks),
+		ftos((double)hf.hf_Absent),
+		ftos((double)hf.hf_FalsePos),
+		hf.hf_Builds,
+		hf.hf_BuildMs
+	);
+}
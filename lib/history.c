@@ -20,7 +20,19 @@
  * on heavily loaded systems, the exclusive lock is required).
  *
  * In a heavily loaded system, the exclusive lock and append may become a
- * bottleneck.
+ * bottleneck.  With 'historycommit' the diablo children instead queue
+ * their records in a shared memory commit queue, and whichever child
+ * holds the append lock appends every queued record with one writev()
+ * and fixes up the index for all of them (group commit).
+ *
+ * Version 3 history files replace the chain heads with an open addressed
+ * index of 64 byte buckets, each holding HBSLOTS (fingerprint, index)
+ * pairs.  A lookup hashes to a home bucket and probes forward until it
+ * finds the entry or a bucket with a free slot, so a message-id we do not
+ * have usually costs one cache line of the index and no entry reads at
+ * all.  The index cannot chain, so it must be sized for the number of
+ * entries kept (see HistoryHashSizeFor()).  Entries are stored exactly
+ * as in version 2, with next always 0.
  *
  * WARNING!  offsets stored in history records / hash table index are signed
  * 32 bits but cast to unsigned in any lseek() operations.  The history file
@@ -41,14 +53,25 @@ Prototype void HistoryStoreExp(History *h, HistIndex index);
 Prototype int HistoryExpire(const char *msgid, History *h, int unexp);
 Prototype void PrintHistory(History *h);
 
+Prototype uint32 HistoryHashSizeFor(uint32 entries);
+Prototype uint32 HistoryLoad(uint32 *slots);
+Prototype void InitHistoryCommit(int slots);
+Prototype void HistoryCommitSlot(int slot);
+Prototype void DumpHistoryCommit(FILE *fo, int raw);
+
 Prototype uint32 NewHSize;
+Prototype int NewHVersion;
 
 #define HBLKINCR	16
 #define HBLKSIZE	256
+#define HMAPGROW	(32 * 1024 * 1024)
+#define HBPROBE		64	/* V3 buckets probed before the overflow chain */
 
 HistHead	HHead;
 HistHead	*HHeadMap = NULL;
 HistIndex 	*HAry;
+HistBucket	*HBkt;			/* HAry as a version 3 bucket index */
+size_t		HIdxSize;		/* size of one hash table element */
 int		HFd = -1;
 int		LoggedDHistCorrupt;
 int		HFlags;
@@ -56,11 +79,71 @@ uint32		HSize;
 uint32		HMask;
 off_t		HEntryOff;		/* Start of actual history records */
 uint32		NewHSize = 0;
+int		NewHVersion = 0;
 int		HBlkIncr = HBLKINCR;
 int		HBlkGood;
 char		HistoryFileName[PATH_MAX];
 int		DoingReOpen = 0;
 
+/*
+ * HGF_MMAP: the entry region is mapped read-only so that chain walks
+ * don't need a lseek()/read() pair per hop.  The map begins at the page
+ * containing HEntryOff and is made HMAPGROW bytes larger than the file
+ * so that entries appended by other processes can usually be reached
+ * with nothing more than an fstat().  HEntValid is the file size we
+ * last saw - nothing at or beyond it is accessed through the map since
+ * that would fault.
+ */
+char		*HEntMap;
+off_t		HEntMapOff;
+off_t		HEntMapLen;
+off_t		HEntValid;
+
+/*
+ * Group commit queue, one slot per diablo child (indexed by the
+ * child's pipe descriptor).  A child fills in its slot, marks it
+ * pending and then takes the committer lock.  If its record has not
+ * been committed by the time it gets the lock, it commits every queued
+ * record itself.  The committer lock is a fixed lock file (HCLockFd)
+ * rather than the append lock, which is per history file and no
+ * longer shared once dhisexpire has replaced the history.
+ */
+#define HCS_FREE	0
+#define HCS_PENDING	1
+#define HCS_CLAIMED	2	/* being committed */
+#define HCS_DONE	3
+
+#define HCBATCH		64	/* max records per writev() */
+
+#if defined(__GNUC__)
+#define HCBARRIER()	__sync_synchronize()
+#else
+#define HCBARRIER()
+#endif
+
+typedef struct HistCommitSlot {
+    volatile int hc_State;
+    int		hc_Result;	/* HistoryAdd() return code */
+    History	hc_Hist;
+} HistCommitSlot;
+
+typedef struct HistCommit {
+    int		hq_Slots;
+    double	hq_Batches;
+    double	hq_Records;
+    HistCommitSlot hq_Slot[1];
+} HistCommit;
+
+HistCommit	*HCQ;
+int		HCSlot = -1;
+int		HCLockFd = -1;
+
+static int historyCommitAdd(History *h);
+static void historyMapEntries(void);
+static void historyUnmapEntries(void);
+static const History *historyEntry(HistIndex index, History *h, off_t *poff);
+static HistIndex historyFind(hash_t hv, History *h, const History **php, const char *msgid, int logbit);
+
 int
 HistoryOpen(const char *fileName, int hflags)
 {
@@ -74,9 +157,13 @@ HistoryOpen(const char *fileName, int hflags)
     strcpy(HistoryFileName, fileName);
 
     HFlags = hflags;
+    if (DOpts.HistoryMMap)
+	HFlags |= HGF_MMAP;
 
     if (NewHSize == 0)
 	NewHSize = DOpts.HashSize;	/* which may also be 0 */
+    if (NewHVersion == 0)
+	NewHVersion = DOpts.HistoryVersion;
 
     /*
      * open the history file
@@ -140,8 +227,8 @@ HistoryOpen(const char *fileName, int hflags)
 	    read(fd, &HHead, sizeof(HHead)) != sizeof(HHead) ||
 	    HHead.hmagic != HMAGIC
 	) {
-	    uint32 n;
-	    uint32 b;
+	    off_t n;
+	    off_t b;
 	    char *z = calloc(8192, 1);
 
 	    /*
@@ -171,21 +258,30 @@ HistoryOpen(const char *fileName, int hflags)
 	    ftruncate(fd, 0);
 	    bzero(&HHead, sizeof(HHead));
 
-	    HHead.hashSize = NewHSize;
-	    HHead.version  = HVERSION;
+	    HHead.version  = NewHVersion;
 	    HHead.henSize  = sizeof(History);
-	    HHead.headSize = sizeof(HHead);
+	    if (HHead.version > 2) {
+		/*
+		 * hsize is in entries, the index is in buckets.  The
+		 * header is padded so buckets are cache line aligned.
+		 */
+		HHead.hashSize = NewHSize / HBSLOTS;
+		HHead.headSize = HHEADSIZE3;
+	    } else {
+		HHead.hashSize = NewHSize;
+		HHead.headSize = sizeof(HHead);
+	    }
 
 	    write(fd, &HHead, sizeof(HHead));
+	    write(fd, z, HHead.headSize - sizeof(HHead));
 
 	    /*
 	     * write out the hash table
 	     */
 
 	    n = 0;
-	    b = HHead.hashSize * sizeof(HistIndex);
+	    b = (off_t)HHead.hashSize * HIDXSIZE(HHead.version);
 
-		printf("n=%u  b=%u HHead.hashSize=%u\n", n, b, HHead.hashSize);
 	    while (n < b) {
 		uint32 r = (b - n > 8192) ? 8192 : b - n;
 
@@ -258,6 +354,7 @@ HistoryOpen(const char *fileName, int hflags)
 
     HSize = HHead.hashSize;
     HMask = HSize - 1;
+    HIdxSize = HIDXSIZE(HHead.version);
 
     /*
      * In FAST mode we leave the history file locked in order to
@@ -281,13 +378,13 @@ HistoryOpen(const char *fileName, int hflags)
     }
 
     if (HFlags & HGF_FAST) {
-	HAry = calloc(HSize, sizeof(HistIndex));
+	HAry = calloc(HSize, HIdxSize);
 	if (HAry == NULL) {
 	    perror("calloc");
 	    exit(1);
 	}
 	lseek(fd, HHead.headSize, 0);
-	if (read(fd, HAry, (size_t)HSize * sizeof(HistIndex)) != (size_t)HSize * sizeof(HistIndex)) {
+	if (read(fd, HAry, (size_t)HSize * HIdxSize) != (size_t)HSize * HIdxSize) {
 	    perror("read");
 	    exit(1);
 	}
@@ -296,9 +393,9 @@ HistoryOpen(const char *fileName, int hflags)
 
 	if ((HFlags & HGF_READONLY) == 0)
 	    mapflags |= PROT_WRITE;
-	HAry = xmap(NULL, (size_t)HSize * sizeof(HistIndex), mapflags, MAP_SHARED, fd, HHead.headSize);
+	HAry = xmap(NULL, (size_t)HSize * HIdxSize, mapflags, MAP_SHARED, fd, HHead.headSize);
 	if (HFlags & HGF_MLOCK)
-	    mlock(HAry, HSize * sizeof(HistIndex));
+	    mlock(HAry, (size_t)HSize * HIdxSize);
     }
 
     if (HAry == NULL || HAry == (HistIndex *)-1) {
@@ -308,10 +405,109 @@ HistoryOpen(const char *fileName, int hflags)
 	exit(1);
     }
     HFd = fd;
-    HEntryOff = HHead.headSize + HHead.hashSize * sizeof(HistIndex);
+    HBkt = (HHead.version > 2) ? (HistBucket *)HAry : NULL;
+    HEntryOff = HHead.headSize + (off_t)HHead.hashSize * HIdxSize;
+    if (HFlags & HGF_MMAP) {
+	HEntMapOff = HEntryOff & ~(off_t)(getpagesize() - 1);
+	historyMapEntries();
+    }
+    if (DOpts.HistoryFilterSize != 0 && (HFlags & HGF_FAST) == 0) {
+	int build = (HFlags & HGF_READONLY) == 0;
+
+	if (build)
+	    hflock(fd, 4, XLOCK_EX);
+	HistoryFilterOpen(HistoryFileName, fd,
+		HEntryOff + ((HHead.version > 1) ? sizeof(History) : 0), build);
+	if (build)
+	    hflock(fd, 4, XLOCK_UN);
+    }
+    if (HBkt != NULL && (HFlags & HGF_READONLY) == 0) {
+	uint32 slots;
+	uint32 n = HistoryLoad(&slots);
+
+	if (n > slots / 10 * 9)
+	    logit(LOG_WARNING, "dhistory index is %u%% full, increase hsize",
+				(uint32)((uint64_t)n * 100 / slots));
+    }
     return(0);
 }
 
+/*
+ * (Re)map the history entry region.  If the file has not grown past
+ * the end of the current map we just note the new valid size.  If the
+ * map cannot be created we log it and drop back to lseek()/read().
+ */
+
+static void
+historyMapEntries(void)
+{
+    struct stat st;
+    off_t len;
+    int pgmask = getpagesize() - 1;
+
+    if (fstat(HFd, &st) < 0)
+	return;
+    if (HEntMap != NULL && st.st_size <= HEntMapOff + HEntMapLen) {
+	HEntValid = st.st_size;
+	return;
+    }
+    historyUnmapEntries();
+    len = st.st_size - HEntMapOff + HMAPGROW;
+    len = (len + pgmask) & ~(off_t)pgmask;
+    if ((off_t)(size_t)len != len ||
+	(HEntMap = mmap(NULL, (size_t)len, PROT_READ, MAP_SHARED,
+				HFd, HEntMapOff)) == MAP_FAILED) {
+	logit(LOG_ERR, "dhistory entry mmap of %lld bytes failed (%s), using read()",
+				(long long)len, strerror(errno));
+	HEntMap = NULL;
+	HFlags &= ~HGF_MMAP;
+	return;
+    }
+    HEntMapLen = len;
+    HEntValid = st.st_size;
+}
+
+static void
+historyUnmapEntries(void)
+{
+    if (HEntMap != NULL)
+	munmap(HEntMap, (size_t)HEntMapLen);
+    HEntMap = NULL;
+    HEntMapLen = 0;
+    HEntValid = 0;
+}
+
+/*
+ * Return a pointer to the history entry at index.  In HGF_MMAP mode
+ * this points into the map and no system call is made unless the
+ * entry lies beyond the last known end of file.  Otherwise the entry
+ * is read into *h.  Returns NULL if the entry cannot be read.
+ */
+
+static const History *
+historyEntry(HistIndex index, History *h, off_t *poff)
+{
+    off_t off;
+
+    if (HHead.version > 1)
+	off = (off_t)HEntryOff + (off_t)index * sizeof(History);
+    else 
+	off = index;
+    if (poff != NULL)
+	*poff = off;
+
+    if (HEntMap != NULL && off >= HEntMapOff) {
+	if (off + (off_t)sizeof(History) > HEntValid)
+	    historyMapEntries();
+	if (HEntMap != NULL && off + (off_t)sizeof(History) <= HEntValid)
+	    return((const History *)(HEntMap + (off - HEntMapOff)));
+    }
+    lseek(HFd, off, 0);
+    if (read(HFd, h, sizeof(*h)) != sizeof(*h))
+	return(NULL);
+    return(h);
+}
+
 /*
  * On close, we have to commit the hash table if we were in
  * FAST mode, otherwise we need only unmap the file before
@@ -323,10 +519,13 @@ HistoryClose(void)
 {
     int r = RCOK;
 
+    historyUnmapEntries();
+    HistoryFilterClose();
+
     if (HFd >= 0 && !(HFlags & HGF_READONLY)) {
 	if (HFlags & HGF_FAST) {
 	    lseek(HFd, HHead.headSize, 0);
-	    if (write(HFd, HAry, HSize * sizeof(HistIndex)) != HSize * sizeof(HistIndex)) {
+	    if (write(HFd, HAry, (size_t)HSize * HIdxSize) != (size_t)HSize * HIdxSize) {
 		r = RCTRYAGAIN;
 	    } else {
 		free(HAry);
@@ -335,8 +534,8 @@ HistoryClose(void)
 	} else {
 	    if (HAry && HAry != (HistIndex *)-1) {
 		if (HFlags & HGF_MLOCK)
-		    munlock(HAry, HSize * sizeof(HistIndex));
-		xunmap((void *)HAry, HSize * sizeof(HistIndex));
+		    munlock(HAry, (size_t)HSize * HIdxSize);
+		xunmap((void *)HAry, (size_t)HSize * HIdxSize);
 		HAry = NULL;
 	    }
 	}
@@ -344,8 +543,8 @@ HistoryClose(void)
     if (r == RCOK) {
 	if (HAry && HAry != (HistIndex *)-1) {
 	    if (HFlags & HGF_MLOCK)
-		munlock(HAry, HSize * sizeof(HistIndex));
-	    xunmap((void *)HAry, HSize * sizeof(HistIndex));
+		munlock(HAry, (size_t)HSize * HIdxSize);
+	    xunmap((void *)HAry, (size_t)HSize * HIdxSize);
 	    HAry = NULL;
 	}
 	if (HHeadMap != NULL) {
@@ -393,63 +592,136 @@ PrintHistory(History *h)
     );
 }
 
-int
-HistoryLookup(const char *msgid, History *nh)
+/*
+ * Locate the entry for hv, returning its index and a pointer to the
+ * entry in *php, or 0 if it is not in the history.  h is scratch space
+ * for historyEntry().  Version 3 files probe the bucket index, where a
+ * bucket with a free slot ends the search, older files walk the chain.
+ * Entries that found no free slot within HBPROBE buckets of their home
+ * bucket are chained from the dummy entry at index 0 (the overflow
+ * chain) instead.  The history filter is asked first and may answer
+ * for us.
+ */
+
+static HistIndex
+historyFind(hash_t hv, History *h, const History **php, const char *msgid, int logbit)
 {
-    hash_t hv;
     HistIndex hi;
     HistIndex pindex;
-    HistIndex index;
-    off_t off;
-    History h = { 0 };
-    static int HLAlt = 0;
-    int r = -1;
+    HistIndex index = 0;
+    const History *hp = NULL;
+    off_t off = 0;
     int counter = 0;
-    int statfailed = 0;
 
-    if (HHeadMap->hmagic != HMAGIC)
-	historyReOpen();
+    if (HistoryFilterTest(hv) == 0)
+	return(0);
 
-    hv = hhash(msgid);
     hi = (hv.h1 ^ hv.h2) & HMask;
+
+    if (HBkt != NULL) {
+	uint32 fp = HFP(hv);
+	uint32 n;
+
+	for (n = 0; n < HBPROBE && n < HSize; ++n) {
+	    const HistSlot *hs = HBkt[hi].hb_Slot;
+	    int i;
+
+	    for (i = 0; i < HBSLOTS; ++i, ++hs) {
+		if (hs->hs_Fp == 0) {
+		    HistoryFilterMiss();
+		    return(0);
+		}
+		if (hs->hs_Fp != fp || hs->hs_Index == 0)
+		    continue;
+		index = hs->hs_Index;
+		if ((hp = historyEntry(index, h, &off)) == NULL)
+		    goto corrupt;
+		if (hp->hv.h1 == hv.h1 && hp->hv.h2 == hv.h2) {
+		    *php = hp;
+		    return(index);
+		}
+	    }
+	    hi = (hi + 1) & HMask;
+	}
+
+	/*
+	 * The overflow chain runs from newer to older entries, anything
+	 * else is a loop.
+	 */
+	if ((hp = historyEntry(0, h, &off)) == NULL)
+	    goto corrupt;
+	for (index = hp->next; index != 0; index = hp->next) {
+	    if ((hp = historyEntry(index, h, &off)) == NULL)
+		goto corrupt;
+	    if (hp->hv.h1 == hv.h1 && hp->hv.h2 == hv.h2) {
+		*php = hp;
+		return(index);
+	    }
+	    if (hp->next >= index) {
+		logit(LOG_ERR, "dhistory overflow chain loop @ %u->%u",
+					index, hp->next);
+		break;
+	    }
+	}
+	HistoryFilterMiss();
+	return(0);
+    }
+
     pindex = HHead.headSize + hi * sizeof(HistIndex);
     index = HAry[hi];
 
     while (index) {
-	if (HHead.version > 1)
-	    off = (off_t)HEntryOff + (off_t)index * sizeof(History);
-	else 
-	    off = index;
-	lseek(HFd, off, 0);
-	if (read(HFd, &h, sizeof(h)) != sizeof(h)) {
-	    if ((LoggedDHistCorrupt & 1) == 0 || DebugOpt) {
-		LoggedDHistCorrupt |= 1;
-		logit(LOG_ERR, "dhistory file corrupted on lookup @ %d->%d chain %d  offset %ld  msgid %s  counter=%d",
-					pindex, index,
-					(int)((hv.h1 ^ hv.h2) & HMask),
-					off, msgid, counter);
-		sleep(1);
-	    }
-	    break;
+	if ((hp = historyEntry(index, h, &off)) == NULL)
+	    goto corrupt;
+	if (hp->hv.h1 == hv.h1 && hp->hv.h2 == hv.h2) {
+	    *php = hp;
+	    return(index);
 	}
-	if (h.hv.h1 == hv.h1 && h.hv.h2 == hv.h2)
-	    break;
 	pindex = index;
-	index = h.next;
+	index = hp->next;
 	if (counter++ > 5000) {
 	    logit(LOG_ERR, "dhistory file chain loop @ %d->%d chain %d (%s)",
 					(int)pindex, (int)index,
 					(int)((hv.h1 ^ hv.h2) & HMask),
-					msgid);
+					msgid ? msgid : "no message-id");
 	    index = 0;
 	}
     }
-    if (index != 0)
+    HistoryFilterMiss();
+    return(0);
+
+corrupt:
+    if ((LoggedDHistCorrupt & logbit) == 0 || DebugOpt) {
+	LoggedDHistCorrupt |= logbit;
+	logit(LOG_ERR, "dhistory file corrupted on lookup @ %u chain %d  offset %lld  msgid %s  counter=%d",
+				index, (int)((hv.h1 ^ hv.h2) & HMask),
+				(long long)off,
+				msgid ? msgid : "no message-id", counter);
+	sleep(1);
+    }
+    return(0);
+}
+
+int
+HistoryLookup(const char *msgid, History *nh)
+{
+    hash_t hv;
+    History h = { 0 };
+    const History *hp = NULL;
+    static int HLAlt = 0;
+    int r = -1;
+
+    if (HHeadMap->hmagic != HMAGIC)
+	historyReOpen();
+
+    hv = hhash(msgid);
+    if (historyFind(hv, &h, &hp, msgid, 1) != 0)
 	r = 0;
+
     /*
      * On failure, try alternate hash method (for lookup only)
      */
-    if (r < 0 && DOpts.CompatHashMethod >= 0 && HLAlt == 0 && !statfailed) {
+    if (r < 0 && DOpts.CompatHashMethod >= 0 && HLAlt == 0) {
 	int save = DOpts.HashMethod;
 
 	DOpts.HashMethod = DOpts.CompatHashMethod;
@@ -457,101 +729,105 @@ HistoryLookup(const char *msgid, History *nh)
 	r = HistoryLookup(msgid, nh);
 	DOpts.HashMethod = save;
 	HLAlt = 0;
+    } else if (r == 0 && nh != NULL) {
+	memcpy(nh, hp, sizeof(*nh));
     }
 
-    if (r == 0 && nh != NULL)
-	memcpy(nh, &h, sizeof(h));
-
     return(r);
 }
 
 int
 HistoryLookupByHash(hash_t hv, History *h)
 {
-    HistIndex hi;
-    HistIndex pindex;
-    HistIndex index;
-    off_t off;
-    int counter = 0;
-
     if (HHeadMap->hmagic != HMAGIC)
 	historyReOpen();
 
-    hi = (hv.h1 ^ hv.h2) & HMask;
-    pindex = HHead.headSize + hi * sizeof(HistIndex);
-    index = HAry[hi];
-
-    while (index) {
-	if (HHead.version > 1)
-	    off = (off_t)HEntryOff + (off_t)index * sizeof(History);
-	else 
-	    off = index;
-	lseek(HFd, off, 0);
-	if (read(HFd, h, sizeof(*h)) != sizeof(*h)) {
-	    if ((LoggedDHistCorrupt & 1) == 0 || DebugOpt) {
-		LoggedDHistCorrupt |= 1;
-		logit(LOG_ERR, "dhistory file corrupted on lookup");
-		sleep(1);
-	    }
-	    break;
-	}
-	if (h->hv.h1 == hv.h1 && h->hv.h2 == hv.h2)
-	    break;
-	pindex = index;
-	index = h->next;
-	if (counter++ > 5000) {
-	    logit(LOG_ERR, "dhistory file chain loop @ %d->%d chain %d",
-			(int)pindex, (int)index, (int)((hv.h1 ^ hv.h2) & HMask));
-	    index = 0;
-	}
-    }
-    if (index != 0) {
-	return(0);
-    }
-    return(-1);
+    return((HistoryPosLookupByHash(hv, h) == (HistIndex)-1) ? -1 : 0);
 }
 
 HistIndex
 HistoryPosLookupByHash(hash_t hv, History *h)
 {
-    HistIndex hi;
-    HistIndex pindex;
     HistIndex index;
+    History th;
+    const History *hp = NULL;
+
+    if ((index = historyFind(hv, &th, &hp, NULL, 1)) != 0) {
+	if (h != NULL)
+	    memcpy(h, hp, sizeof(*h));
+	return(index);
+    }
+    return(-1);
+}
+
+/*
+ * Claim a free slot for a new entry in a version 3 index, starting at
+ * the home bucket hi.  The caller holds the append lock so slots are
+ * never claimed twice.  If the HBPROBE buckets from hi are all taken
+ * the entry, already written, goes on the overflow chain so that a
+ * full index slows the history down rather than refusing articles.
+ * Returns -1 on a write error.
+ */
+
+static int
+historyBucketAdd(HistIndex hi, const History *h, HistIndex index)
+{
+    HistSlot ns;
+    HistIndex head;
     off_t off;
-    int counter = 0;
+    uint32 n;
 
-    hi = (hv.h1 ^ hv.h2) & HMask;
-    pindex = HHead.headSize + hi * sizeof(HistIndex);
-    index = HAry[hi];
+    ns.hs_Fp = HFP(h->hv);
+    ns.hs_Index = index;
 
-    while (index) {
-	if (HHead.version > 1)
-	    off = (off_t)HEntryOff + (off_t)index * sizeof(History);
-	else 
-	    off = index;
-	lseek(HFd, off, 0);
-	if (read(HFd, h, sizeof(*h)) != sizeof(*h)) {
-	    if ((LoggedDHistCorrupt & 1) == 0 || DebugOpt) {
-		LoggedDHistCorrupt |= 1;
-		logit(LOG_ERR, "dhistory file corrupted on lookup");
-		sleep(1);
+    for (n = 0; n < HBPROBE && n < HSize; ++n) {
+	HistSlot *hs = HBkt[hi].hb_Slot;
+	int i;
+
+	for (i = 0; i < HBSLOTS; ++i, ++hs) {
+	    if (hs->hs_Fp != 0)
+		continue;
+	    if (HFlags & HGF_FAST) {
+		*hs = ns;
+	    } else {
+		lseek(HFd, HHead.headSize + (off_t)hi * sizeof(HistBucket) +
+						i * sizeof(HistSlot), 0);
+		if (write(HFd, &ns, sizeof(ns)) != sizeof(ns)) {
+		    logit(LOG_ERR, "Error writing to history: %s", strerror(errno));
+		    return(-1);
+		}
 	    }
-	    break;
-	}
-	if (h->hv.h1 == hv.h1 && h->hv.h2 == hv.h2)
-	    break;
-	pindex = index;
-	index = h->next;
-	if (counter++ > 5000) {
-	    logit(LOG_ERR, "dhistory file chain loop @ %d->%d chain %d",
-			(int)pindex, (int)index, (int)((hv.h1 ^ hv.h2) & HMask));
-	    index = 0;
+	    return(0);
 	}
+	hi = (hi + 1) & HMask;
     }
-    if (index != 0) {
-	return(index);
+
+    /*
+     * Link the entry in at the head of the overflow chain, the next
+     * field of the dummy entry.  The entry's own link is written first
+     * so that a lookup never follows a half made chain.
+     */
+    if ((LoggedDHistCorrupt & 4) == 0) {
+	LoggedDHistCorrupt |= 4;
+	logit(LOG_CRIT, "dhistory index is full, using the overflow chain, increase hsize and rebuild with dhisexpire");
     }
-    return(-1);
+    off = HEntryOff + offsetof(History, next);
+    lseek(HFd, off, 0);
+    if (read(HFd, &head, sizeof(head)) != sizeof(head)) {
+	logit(LOG_ERR, "Error reading history: %s", strerror(errno));
+	return(-1);
+    }
+    lseek(HFd, off + (off_t)index * sizeof(History), 0);
+    if (write(HFd, &head, sizeof(head)) != sizeof(head)) {
+	logit(LOG_ERR, "Error writing to history: %s", strerror(errno));
+	return(-1);
+    }
+    lseek(HFd, off, 0);
+    if (write(HFd, &index, sizeof(index)) != sizeof(index)) {
+	logit(LOG_ERR, "Error writing to history: %s", strerror(errno));
+	return(-1);
+    }
+    return(0);
 }
 
 /*
@@ -559,14 +835,19 @@ HistoryPosLookupByHash(hash_t hv, History *h)
  * (pos 4) and just appends the single history record and unlocks.
  * It then updates the hash chain (already locked) by adding the
  * new history entry at the beginning as usual.
+ *
+ * For a version 3 index the home bucket is locked instead of the
+ * chain head and the new slot is claimed while the append lock is
+ * still held.
+ *
+ * Processes given a group commit slot (see InitHistoryCommit()) hand
+ * the record to the commit queue instead.
  */
 int
 HistoryAdd(const char *msgid, History *h)
 {
     HistIndex hi;
-    HistIndex pindex;
     HistIndex index;
-    off_t off;
     off_t chainlock;
     int r = RCOK;
 
@@ -580,14 +861,25 @@ HistoryAdd(const char *msgid, History *h)
 	logit(LOG_ERR, "Not adding history entry with gmt=0");
 	return(RCOK);
     }
+
+    if (HCQ != NULL && HCSlot >= 0 && (HFlags & (HGF_FAST|HGF_READONLY)) == 0) {
+	if (HCLockFd < 0 &&
+	    (HCLockFd = open(PatDbExpand(DHistoryLockPat), O_RDWR|O_CREAT, 0644)) < 0) {
+	    logit(LOG_ERR, "Unable to open %s (%s), history group commit disabled",
+				PatDbExpand(DHistoryLockPat), strerror(errno));
+	    HCSlot = -1;
+	} else {
+	    return(historyCommitAdd(h));
+	}
+    }
     /*
      * record lock, search for message id
      *
      */
 
+again:
     hi = (h->hv.h1 ^ h->hv.h2) & HMask;
-    pindex = HHead.headSize + hi * sizeof(HistIndex);
-    chainlock = (off_t)pindex;
+    chainlock = HHead.headSize + (off_t)hi * HIdxSize;
 
     if ((HFlags & HGF_FAST) == 0)	/* lock hash chain */
 	hflock(HFd, chainlock, XLOCK_EX);
@@ -596,52 +888,53 @@ HistoryAdd(const char *msgid, History *h)
      * make sure message-id is not already in hash table
      */
     if ((HFlags & HGF_NOSEARCH) == 0) {
-	int counter = 0;
-
-	index = HAry[hi];
-	while (index) {
-	    static History ht;
+	static History ht;
+	const History *hp;
 
-	    if (HHead.version > 1)
-		off = (off_t)HEntryOff + (off_t)index * sizeof(History);
-	    else 
-		off = index;
-	    lseek(HFd, off, 0);
-	    if (read(HFd, &ht, sizeof(ht)) != sizeof(ht)) {
-		if ((LoggedDHistCorrupt & 2) == 0 || DebugOpt) {
-		    LoggedDHistCorrupt |= 2;
-		    logit(LOG_ERR, "dhistory file corrupted @ %u (%s)",
-						index, strerror(errno));
-		    sleep(1);
-		}
-		break;
-	    }
-	    if (ht.hv.h1 == h->hv.h1 && ht.hv.h2 == h->hv.h2) {
-		r = RCALREADY;
-		break;
-	    }
-	    pindex = index;
-	    index = ht.next;
-	    if (counter++ > 5000) {
-		logit(LOG_ERR, "dhistory file chain loop @ %d->%d chain %d (%s)",
-					(int)pindex, (int)index,
-					(int)((ht.hv.h1 ^ ht.hv.h2) & HMask),
-					msgid ? msgid : "no message-id");
-		index = 0;
-	    }
-	}
+	if (historyFind(h->hv, &ht, &hp, msgid, 2) != 0)
+	    r = RCALREADY;
     }
 
     while (r == RCOK) {
 	off_t writePos;
 	int n = 0;
 
-	h->next = HAry[hi];
-
-	if ((HFlags & HGF_FAST) == 0)	/* append/scan lock */
+	if ((HFlags & HGF_FAST) == 0) {	/* append/scan lock */
 	    hflock(HFd, 4, XLOCK_EX);
 
+	    /*
+	     * dhisexpire marks a replaced history dead under the append
+	     * lock, start over on the new one.
+	     */
+	    if (HHeadMap->hmagic != HMAGIC) {
+		hflock(HFd, 4, XLOCK_UN);
+		hflock(HFd, chainlock, XLOCK_UN);
+		historyReOpen();
+		goto again;
+	    }
+
+	    /*
+	     * A group commit, which does not take chain locks, may have
+	     * added the message-id since we searched.  Look again now
+	     * that nobody else can append.
+	     */
+	    if ((HFlags & HGF_NOSEARCH) == 0) {
+		static History ht;
+		const History *hp;
+
+		if (historyFind(h->hv, &ht, &hp, msgid, 2) != 0) {
+		    hflock(HFd, 4, XLOCK_UN);
+		    r = RCALREADY;
+		    break;
+		}
+	    }
+	}
+
+	h->next = (HBkt != NULL) ? 0 : HAry[hi];
+
 	if ((writePos = lseek(HFd, 0L, 2)) == -1) {
+	    if ((HFlags & HGF_FAST) == 0)
+		hflock(HFd, 4, XLOCK_UN);
 	    r = RCTRYAGAIN;
 	    break;
 	}
@@ -652,15 +945,31 @@ HistoryAdd(const char *msgid, History *h)
 	    logit(LOG_ERR, "Error writing to history: %s", strerror(errno));
 	    lseek(HFd, writePos, 0);
 	    ftruncate(HFd, writePos);
+	    if (HEntValid > writePos)
+		HEntValid = writePos;
 	}
 
-	if ((HFlags & HGF_FAST) == 0)	/* append/scan lock */
-	    hflock(HFd, 4, XLOCK_UN);
+	/*
+	 * The filter must know about the entry before it can be found.
+	 */
+	if (n == sizeof(History))
+	    HistoryFilterAdd(h->hv, writePos + sizeof(History));
 
 	if (HHead.version > 1)
 	    index = (HistIndex)((writePos - HEntryOff) / sizeof(History));
 	else
 	    index = (HistIndex)writePos;
+
+	if (HBkt != NULL) {
+	    if (n == sizeof(History) && historyBucketAdd(hi, h, index) < 0)
+		n = 0;
+	    if ((HFlags & HGF_FAST) == 0)	/* append/scan lock */
+		hflock(HFd, 4, XLOCK_UN);
+	    if (n != sizeof(History))
+		r = RCTRYAGAIN;
+	    break;
+	}
+
 	if (n == sizeof(History)) {
 	    if ((HFlags & HGF_FAST) == 0) {
 		lseek(HFd, HHead.headSize + hi * sizeof(HistIndex), 0);
@@ -674,6 +983,14 @@ HistoryAdd(const char *msgid, History *h)
 	} else {
 	    r = RCTRYAGAIN;
 	}
+
+	/*
+	 * The chain head is updated before the append lock is released
+	 * so that it cannot race a group commit (which does not take
+	 * chain locks) on the same chain.
+	 */
+	if ((HFlags & HGF_FAST) == 0)	/* append/scan lock */
+	    hflock(HFd, 4, XLOCK_UN);
 	break;
     }
 
@@ -683,6 +1000,299 @@ HistoryAdd(const char *msgid, History *h)
     return(r);
 }
 
+/*
+ * InitHistoryCommit() is called by the master diablo before it forks,
+ *		       like InitPreCommit(), to create the group commit
+ *		       queue with one slot per possible child.
+ */
+
+void
+InitHistoryCommit(int slots)
+{
+#if USE_PCOMMIT_SHM
+    size_t bytes = sizeof(HistCommit) + (slots - 1) * sizeof(HistCommitSlot);
+    int sid = shmget(IPC_PRIVATE, bytes, SHM_R|SHM_W);
+    struct shmid_ds ds;
+
+    if (HCQ != NULL) {
+	shmdt((void *)HCQ);
+	HCQ = NULL;
+    }
+    if (sid < 0) {
+	logit(LOG_CRIT, "sysv shared memory alloc of %d failed, history group commit disabled",
+	    (int)bytes
+	);
+	return;
+    }
+    HCQ = (HistCommit *)shmat(sid, NULL, SHM_R|SHM_W);
+    if (shmctl(sid, IPC_STAT, &ds) < 0 || shmctl(sid, IPC_RMID, &ds) < 0)
+	logit(LOG_CRIT, "sysv shmctl stat/rmid failed");
+    if (HCQ == (HistCommit *)-1) {
+	HCQ = NULL;
+	logit(LOG_CRIT, "sysv shared memory map failed, history group commit disabled");
+	return;
+    }
+    bzero(HCQ, bytes);
+    HCQ->hq_Slots = slots;
+#else
+    logit(LOG_ERR, "history group commit needs USE_PCOMMIT_SHM, disabled");
+#endif
+}
+
+/*
+ * HistoryCommitSlot() - called by a child after the fork to select its
+ *			 queue slot, or -1 to add directly.
+ */
+
+void
+HistoryCommitSlot(int slot)
+{
+    if (HCQ != NULL && slot >= 0 && slot < HCQ->hq_Slots)
+	HCSlot = slot;
+    else
+	HCSlot = -1;
+}
+
+/*
+ * Commit up to HCBATCH queued records.  The caller holds the committer
+ * lock and the append lock on the live history.  Duplicates are
+ * checked against the history and against the batch itself, the
+ * accepted records are appended with a single writev(), then the
+ * filter and the index are updated and the slots are marked done.
+ * Slots left claimed by a committer that died are picked up again.
+ * Returns the number of records processed.
+ */
+
+static int
+historyCommitBatch(void)
+{
+    HistCommitSlot *batch[HCBATCH];
+    HistCommitSlot *ok[HCBATCH];
+    struct iovec iov[HCBATCH];
+    off_t writePos = 0;
+    int n = 0;
+    int nok = 0;
+    int i;
+    int j;
+
+    for (i = 0; i < HCQ->hq_Slots && n < HCBATCH; ++i) {
+	HistCommitSlot *hs = &HCQ->hq_Slot[i];
+
+	if (hs->hc_State == HCS_PENDING || hs->hc_State == HCS_CLAIMED) {
+	    hs->hc_State = HCS_CLAIMED;
+	    batch[n++] = hs;
+	}
+    }
+    if (n == 0)
+	return(0);
+    HCBARRIER();
+
+    for (i = 0; i < n; ++i) {
+	History *h = &batch[i]->hc_Hist;
+
+	batch[i]->hc_Result = RCOK;
+	if ((HFlags & HGF_NOSEARCH) == 0) {
+	    History ht;
+	    const History *hp;
+
+	    if (historyFind(h->hv, &ht, &hp, NULL, 2) != 0)
+		batch[i]->hc_Result = RCALREADY;
+	    for (j = 0; j < nok; ++j) {
+		if (ok[j]->hc_Hist.hv.h1 == h->hv.h1 &&
+		    ok[j]->hc_Hist.hv.h2 == h->hv.h2)
+		    batch[i]->hc_Result = RCALREADY;
+	    }
+	}
+	if (batch[i]->hc_Result == RCOK) {
+	    ok[nok] = batch[i];
+	    iov[nok].iov_base = (void *)h;
+	    iov[nok].iov_len = sizeof(History);
+	    ++nok;
+	}
+    }
+
+    if (nok && (writePos = lseek(HFd, 0L, 2)) == -1) {
+	for (i = 0; i < nok; ++i)
+	    ok[i]->hc_Result = RCTRYAGAIN;
+	nok = 0;
+    }
+
+    if (nok) {
+	HistIndex index0;
+
+	if (HHead.version > 1)
+	    index0 = (HistIndex)((writePos - HEntryOff) / sizeof(History));
+	else
+	    index0 = (HistIndex)writePos;
+
+	/*
+	 * Chain the records (version 2), including records in this
+	 * batch that share a chain.
+	 */
+	for (i = 0; i < nok; ++i) {
+	    History *h = &ok[i]->hc_Hist;
+	    HistIndex hi = (h->hv.h1 ^ h->hv.h2) & HMask;
+
+	    h->next = (HBkt != NULL) ? 0 : HAry[hi];
+	    for (j = 0; j < i && HBkt == NULL; ++j) {
+		const History *ph = &ok[j]->hc_Hist;
+
+		if (((ph->hv.h1 ^ ph->hv.h2) & HMask) == hi)
+		    h->next = (HHead.version > 1) ? index0 + j :
+				index0 + j * sizeof(History);
+	    }
+	}
+
+	if (writev(HFd, iov, nok) != nok * (ssize_t)sizeof(History)) {
+	    logit(LOG_ERR, "Error writing to history: %s", strerror(errno));
+	    lseek(HFd, writePos, 0);
+	    ftruncate(HFd, writePos);
+	    if (HEntValid > writePos)
+		HEntValid = writePos;
+	    for (i = 0; i < nok; ++i)
+		ok[i]->hc_Result = RCTRYAGAIN;
+	    nok = 0;
+	}
+
+	for (i = 0; i < nok; ++i) {
+	    History *h = &ok[i]->hc_Hist;
+	    HistIndex hi = (h->hv.h1 ^ h->hv.h2) & HMask;
+	    HistIndex index;
+
+	    if (HHead.version > 1)
+		index = index0 + i;
+	    else
+		index = index0 + i * sizeof(History);
+
+	    HistoryFilterAdd(h->hv, writePos + (off_t)(i + 1) * sizeof(History));
+	    if (HBkt != NULL) {
+		if (historyBucketAdd(hi, h, index) < 0)
+		    ok[i]->hc_Result = RCTRYAGAIN;
+	    } else {
+		lseek(HFd, HHead.headSize + hi * sizeof(HistIndex), 0);
+		if (write(HFd, &index, sizeof(index)) != sizeof(index)) {
+		    logit(LOG_ERR, "Error writing to history: %s", strerror(errno));
+		    ok[i]->hc_Result = RCTRYAGAIN;
+		}
+	    }
+	}
+    }
+
+    HCQ->hq_Batches += 1;
+    HCQ->hq_Records += n;
+    HCBARRIER();
+    for (i = 0; i < n; ++i)
+	batch[i]->hc_State = HCS_DONE;
+    return(n);
+}
+
+/*
+ * Wait for our record to be committed.  Whoever gets the committer
+ * lock while records are queued commits them, so records queued while
+ * one batch is being written go out together in the next.  The
+ * committer makes sure it has the live history before it drains the
+ * queue, and still takes the append lock to keep out direct adds.
+ */
+
+static void
+historyCommitWait(HistCommitSlot *hs)
+{
+    while (hs->hc_State == HCS_PENDING || hs->hc_State == HCS_CLAIMED) {
+	int loops = 0;
+
+	xflock(HCLockFd, XLOCK_EX);
+	if (HHeadMap->hmagic != HMAGIC)
+	    historyReOpen();
+	hflock(HFd, 4, XLOCK_EX);
+	if (HHeadMap->hmagic == HMAGIC) {
+	    while (historyCommitBatch() > 0 && ++loops < 16)
+		;
+	}
+	hflock(HFd, 4, XLOCK_UN);
+	xflock(HCLockFd, XLOCK_UN);
+    }
+}
+
+static int
+historyCommitAdd(History *h)
+{
+    HistCommitSlot *hs = &HCQ->hq_Slot[HCSlot];
+
+    /*
+     * A record queued by the previous owner of the slot, who may have
+     * been killed while waiting, is committed first.
+     */
+    historyCommitWait(hs);
+
+    hs->hc_Hist = *h;
+    hs->hc_Result = RCTRYAGAIN;
+    HCBARRIER();
+    hs->hc_State = HCS_PENDING;
+
+    historyCommitWait(hs);
+    HCBARRIER();
+    hs->hc_State = HCS_FREE;
+    return(hs->hc_Result);
+}
+
+/*
+ * DumpHistoryCommit() - group commit statistics for DoStats()
+ */
+
+void
+DumpHistoryCommit(FILE *fo, int raw)
+{
+    double avg;
+
+    if (HCQ == NULL)
+	return;
+    avg = (HCQ->hq_Batches > 0) ? HCQ->hq_Records / HCQ->hq_Batches : 0.0;
+    if (raw)
+	xfprintf(fo, "211 HISCOMMIT batches=%.0f records=%.0f perbatch=%.2f\r\n",
+		HCQ->hq_Batches, HCQ->hq_Records, avg);
+    else
+	xfprintf(fo, "211 HISCOMMIT batches=%s records=%s perbatch=%.2f\r\n",
+		ftos(HCQ->hq_Batches), ftos(HCQ->hq_Records), avg);
+}
+
+/*
+ * Return the number of entries in the history (including expired ones)
+ * and, in *slots, the number of index slots or, for version 2 and
+ * older files, the number of hash chains.
+ */
+
+uint32
+HistoryLoad(uint32 *slots)
+{
+    struct stat st;
+    off_t first = HEntryOff + ((HHead.version > 1) ? sizeof(History) : 0);
+
+    if (slots != NULL)
+	*slots = (HBkt != NULL) ? HSize * HBSLOTS : HSize;
+    if (fstat(HFd, &st) < 0 || st.st_size <= first)
+	return(0);
+    return((uint32)((st.st_size - first) / sizeof(History)));
+}
+
+/*
+ * Suggest a hash size (in entries) for a history that is about to be
+ * rebuilt with the given number of entries.  Version 3 indexes cannot
+ * chain, so leave room for the table to double before it fills.
+ */
+
+uint32
+HistoryHashSizeFor(uint32 entries)
+{
+    uint32 n = (NewHSize != 0) ? NewHSize : DOpts.HashSize;
+    uint64_t want = (uint64_t)entries * 2;
+
+    if (((NewHVersion != 0) ? NewHVersion : DOpts.HistoryVersion) < 3)
+	return(n);
+    while (n < want && n < (uint32)512 * 1024 * 1024)
+	n <<= 1;
+    return(n);
+}
+
 int
 HistoryStore(History *h)
 {
@@ -32,6 +32,14 @@
  *	does not match the file mtime (indicating a manual edit).  The m* field
  *	is updated on database close.
  *
+ *	Lookups do not normally use the sort.  Each open database keeps a
+ *	hash table of the offsets of the valid records it has mapped, built
+ *	on first lookup and extended with the records appended since
+ *	whenever the map grows.  Records never move, a rewritten record is
+ *	appended and replaces its key's entry, so a key that is not in the
+ *	table is not in the map.  KPDBHashIndex = 0 falls back to the
+ *	binary search (see dkpbench).
+ *
  *	The file starts with a fixed-format control line:
  *
  *	    $Vvv.vv aaaaaaaa mmmmmmmm cccccccc
@@ -81,11 +89,15 @@ Prototype void KPDBLock(KPDB *kpdb, const char *rec);
 Prototype void KPDBUnlock(KPDB *kpdb, const char *rec);
 Prototype int KPDBDelete(KPDB *kpdb, const char *key);
 Prototype int KPDBAppendCount(KPDB *kpdb);
+Prototype int KPDBHashIndex;
+Prototype void KPDBReSize(KPDB *kpdb);
 
-void KPDBReSize(KPDB *kpdb);
 int KPDBValidate(KPDB *kpdb);
 int KPDBSort(KPDB *kpdb);
 int KPDBLookup(KPDB *kpdb, const char *key, int lockMe, int forceCheck);
+void KPDBHashUpdate(KPDB *kpdb);
+void KPDBHashFree(KPDB *kpdb);
+int KPDBLookupHash(KPDB *kpdb, const char *key, int l);
 
 #define KEY_OFF		15
 #define V_OFF		1
@@ -97,6 +109,10 @@ int KPDBLookup(KPDB *kpdb, const char *key, int lockMe, int forceCheck);
 
 #define RESORT_LIMIT	128U
 
+#define KPHASH_MIN	1024
+
+int KPDBHashIndex = 1;
+
 /*
  * KPDBOpen() - open a KP database.  WARNING! If you fork() after calling
  *		KPDBOpen(), you must call KPDBReOpen() to re-open the
@@ -181,6 +197,7 @@ KPDBReOpen(KPDB *kpdb)
 	close(kpdb->kp_Fd);
 	kpdb->kp_Fd = -1;
 	dosort = 0;		/* do not resort */
+	KPDBHashFree(kpdb);	/* may not be the same file again */
     }
     if (kpdb->kp_MapBase) {
 	xunmap((char *)kpdb->kp_MapBase, kpdb->kp_MapSize);
@@ -190,6 +207,7 @@ KPDBReOpen(KPDB *kpdb)
 	kpdb->kp_CacheLen = 0;
     }
     if (kpdb->kp_CloseMe) {
+	KPDBHashFree(kpdb);
 	zfree(&SysMemPool, kpdb, sizeof(KPDB) + strlen(kpdb->kp_FileName) + 1);
 	return(NULL);
     }
@@ -704,7 +722,10 @@ KPDBWrite(KPDB *kpdb, const char *key, const char *tok, const char *data, int lo
 	    copyOld = 1;
 	}
 
-	if ((uint32)cval > kpdb->kp_ResortLimit) {
+	/*
+	 * The sort is only needed for the binary search
+	 */
+	if ((uint32)cval > kpdb->kp_ResortLimit && KPDBHashIndex == 0) {
 	    KPDBSort(kpdb);
 	    cval = 0;
 	}
@@ -862,11 +883,21 @@ KPDBLookup(KPDB *kpdb, const char *key, int lockMe, int forceCheck)
 	}
     }
 
+    /*
+     * Hash index, complete for the mapped records if we have one
+     */
+
+    if (found < 0 && KPDBHashIndex) {
+	KPDBHashUpdate(kpdb);
+	if (kpdb->kp_HashTab)
+	    found = KPDBLookupHash(kpdb, key, l);
+    }
+
     /*
      * Binary search
      */
 
-    if (found < 0) {
+    if (found < 0 && kpdb->kp_HashTab == NULL) {
 	found = KPDBLookupBinary(
 	    kpdb, 
 	    key,
@@ -880,7 +911,7 @@ KPDBLookup(KPDB *kpdb, const char *key, int lockMe, int forceCheck)
      * Sequential search from end (unsorted records only)
      */
 
-    if (found < 0) {
+    if (found < 0 && kpdb->kp_HashTab == NULL) {
 	const char *p = kpdb->kp_MapBase;
 	int i = kpdb->kp_MapSize;
 
@@ -939,6 +970,149 @@ KPDBLookup(KPDB *kpdb, const char *key, int lockMe, int forceCheck)
     return(found);
 }
 
+/*
+ * Hash index support.  Offset 0 is the control line, so 0 marks an
+ * empty slot.
+ */
+
+static uint32
+kphash(const char *p, int l)
+{
+    uint32 h = 0x811C9DC5;
+
+    while (l-- > 0) {
+	h ^= (uint8)*p++;
+	h *= 0x01000193;
+    }
+    return(h);
+}
+
+static int
+kpkeylen(const char *rec, int max)
+{
+    int i;
+
+    for (i = KEY_OFF; i < max && rec[i] != ' ' && rec[i] != '\t' && rec[i] != '\n'; ++i)
+	;
+    return(i - KEY_OFF);
+}
+
+static void
+kphashenter(KPDB *kpdb, int off, int recLen)
+{
+    const char *rec = kpdb->kp_MapBase + off;
+    int l = kpkeylen(rec, recLen);
+    int i;
+
+    if ((kpdb->kp_HashCount + 1) * 2 > kpdb->kp_HashSize) {
+	int32 *otab = kpdb->kp_HashTab;
+	int osize = kpdb->kp_HashSize;
+	int t;
+
+	kpdb->kp_HashSize = (osize) ? osize * 2 : KPHASH_MIN;
+	kpdb->kp_HashTab = pagealloc(&t, kpdb->kp_HashSize * sizeof(int32));
+	for (i = 0; i < osize; ++i) {
+	    const char *r;
+	    int rl;
+	    int h;
+
+	    if (otab[i] == 0)
+		continue;
+	    r = kpdb->kp_MapBase + otab[i];
+	    rl = kpkeylen(r, kpdb->kp_MapSize - otab[i]);
+	    h = kphash(r + KEY_OFF, rl) & (kpdb->kp_HashSize - 1);
+	    while (kpdb->kp_HashTab[h])
+		h = (h + 1) & (kpdb->kp_HashSize - 1);
+	    kpdb->kp_HashTab[h] = otab[i];
+	}
+	if (otab)
+	    pagefree(otab, osize * sizeof(int32));
+    }
+
+    /*
+     * A later record for the same key replaces the entry
+     */
+    for (i = kphash(rec + KEY_OFF, l) & (kpdb->kp_HashSize - 1);
+	 kpdb->kp_HashTab[i];
+	 i = (i + 1) & (kpdb->kp_HashSize - 1)
+    ) {
+	const char *r = kpdb->kp_MapBase + kpdb->kp_HashTab[i];
+
+	if (kpkeylen(r, kpdb->kp_MapSize - kpdb->kp_HashTab[i]) == l &&
+	    bcmp(r + KEY_OFF, rec + KEY_OFF, l) == 0
+	) {
+	    kpdb->kp_HashTab[i] = off;
+	    return;
+	}
+    }
+    kpdb->kp_HashTab[i] = off;
+    ++kpdb->kp_HashCount;
+}
+
+/*
+ * KPDBHashUpdate() - enter the complete records mapped since the last
+ *		      call.  Records are only ever appended.
+ */
+
+void
+KPDBHashUpdate(KPDB *kpdb)
+{
+    const char *p = kpdb->kp_MapBase;
+    const char *e;
+    int i;
+
+    if (kpdb->kp_HashEnd == kpdb->kp_MapSize)
+	return;
+    if (kpdb->kp_HashEnd < kpdb->kp_HeadLen || kpdb->kp_HashEnd > kpdb->kp_MapSize) {
+	KPDBHashFree(kpdb);
+	kpdb->kp_HashEnd = kpdb->kp_HeadLen;
+    }
+    for (i = kpdb->kp_HashEnd; i < kpdb->kp_MapSize; i = e - p + 1) {
+	if ((e = memchr(p + i, '\n', kpdb->kp_MapSize - i)) == NULL)
+	    break;		/* append in progress */
+	if (p[i] == '+' && e - (p + i) > KEY_OFF)
+	    kphashenter(kpdb, i, e - (p + i) + 1);
+    }
+    kpdb->kp_HashEnd = i;
+}
+
+void
+KPDBHashFree(KPDB *kpdb)
+{
+    if (kpdb->kp_HashTab)
+	pagefree(kpdb->kp_HashTab, kpdb->kp_HashSize * sizeof(int32));
+    kpdb->kp_HashTab = NULL;
+    kpdb->kp_HashSize = 0;
+    kpdb->kp_HashCount = 0;
+    kpdb->kp_HashEnd = 0;
+}
+
+int
+KPDBLookupHash(KPDB *kpdb, const char *key, int l)
+{
+    int mask = kpdb->kp_HashSize - 1;
+    int i;
+
+    for (i = kphash(key, l) & mask; kpdb->kp_HashTab[i]; i = (i + 1) & mask) {
+	int off = kpdb->kp_HashTab[i];
+	const char *r = kpdb->kp_MapBase + off;
+	int max = kpdb->kp_MapSize - off;
+
+	if (kpkeylen(r, max) == l && bcmp(r + KEY_OFF, key, l) == 0) {
+	    const char *e;
+
+	    if (r[0] != '+')
+		return(-1);
+	    if ((e = memchr(r, '\n', max)) == NULL)
+		return(-1);
+	    kpdb->kp_Cache = r;
+	    kpdb->kp_CacheLen = e - r + 1;
+	    return(0);
+	}
+    }
+    return(-1);
+}
+
 int
 KPDBLookupBinary(
     KPDB *kpdb,
@@ -18,6 +18,10 @@ typedef struct KPDB {
     int		kp_Lock4;
     int		kp_Modified;
     int		kp_ResortLimit;
+    int32	*kp_HashTab;	/* record offsets by key hash, 0 = empty */
+    int		kp_HashSize;	/* slots, power of 2		*/
+    int		kp_HashCount;
+    int		kp_HashEnd;	/* map indexed up to		*/
 } KPDB;
 
 #define KP_LOCK			1
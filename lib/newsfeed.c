@@ -16,6 +16,7 @@ Prototype int FeedWrite(int logIt, int (*callback)(const char *hlabel, const cha
 Prototype void FeedFlush(void);
 Prototype void LoadNewsFeed(time_t t, int force, const char *hlabel);
 Prototype void TouchNewsFeed(void);
+Prototype void ClearNewsFeedCache(void);
 Prototype int FeedValid(const char *hlabel, int *pcount);
 Prototype int IsFiltered(const char *hlabel, const char *nglist);
 Prototype int IsDelayed(const char *hlabel);
@@ -43,6 +44,7 @@ Prototype int OfferIsFiltered(const char *hlabel, const char *msgid);
 
 Prototype FILE *FeedFo;
 Prototype int FeedDebug;
+Prototype int FeedGroupCache;
 
 /*
  * NewsFeed - a newsfeeds label or group.
@@ -86,6 +88,7 @@ typedef struct NewsFeed {
     int			nf_WhereIs;
     int			nf_IncomingPriority;	/* nice() value of process */
     int			nf_PrecommitReject;	/* reject precommit hits */
+    int			nf_Index;		/* bit in the group cache */
     HashFeed_MatchList	*nf_HashFeed;		/* hashfeed */
     ArtTypeList		*nf_ArtTypes;		/* What type of articles */
     /*
@@ -96,6 +99,27 @@ typedef struct NewsFeed {
 
 #define MAXRECURSION	16
 
+/*
+ * FeedGroup - the group cache.  FeedWrite() looks each newsgroup of an
+ *	       article up here instead of matching it against the group
+ *	       lists of every label.  An entry holds the result of that
+ *	       match for each label in NFBase, as two bitmaps indexed by
+ *	       nf_Index: labels that feed the group and labels that
+ *	       delgroupany it.  The cache is thrown away when dnewsfeeds is
+ *	       reloaded and when it holds FGMAXENTS groups.
+ */
+
+typedef struct FeedGroup {
+    struct FeedGroup	*fg_Next;
+    uint32		fg_Hv;
+    uint32		*fg_Bits;		/* accept, then delgroupany */
+    char		*fg_Name;
+} FeedGroup;
+
+#define FGHSIZE		16384
+#define FGHMASK		(FGHSIZE - 1)
+#define FGMAXENTS	131072
+
 #define RTF_ENABLED	0x01			/* enable realtime feed  */
 #define RTF_NOBATCH	0x02			/* do not generate batch */
 
@@ -113,8 +137,17 @@ FILE	*FeedFo = NULL;
 MemPool	*NFMemPool = NULL;
 const char *SaveHLabel = NULL;
 int FeedDebug = 0;
+int FeedGroupCache = 1;
 int UseSpamAlias = 0;
 
+FeedGroup **FGHash;
+MemPool	*FGMemPool;
+int	FGCount;
+int	NFCount;			/* labels in NFBase */
+int	NFWords;			/* uint32's in a label bitmap */
+uint32	*FGArtBits;			/* bitmaps for the current article */
+int	FGArtWords;
+
 static int RecurCount = 0;
 static int RecurWarn = 0;
 
@@ -123,6 +156,11 @@ int feedHashFeedOK(HashFeed_MatchList *hashfeed, unsigned char *md5hash, const c
 int feedQueryPaths(NewsFeed *feed, const char *npath, int size, int artType);
 int feedQuerySpamPaths(NewsFeed *feed, const char *npath, int size, const char * msgid);
 int feedQueryGroups(NewsFeed *feed, const char *nglist);
+int feedQueryGroupBits(NewsFeed *feed, const char *nglist, int *pcount);
+int feedGroupLimits(NewsFeed *feed, const char *nglist, int r, int count);
+int feedGroupBits(const char *nglist);
+FeedGroup *feedGroupLookup(const char *group, int len);
+void feedGroupCacheClear(void);
 int feedQueryDists(NewsFeed *feed, const char *dist);
 int filterRequireGroups(Node *node, const char *nglist);
 int filterQueryGroups(NewsFeed *feed, const char *nglist);
@@ -171,10 +209,24 @@ FeedAdd(const char *msgid, time_t t, History *h, const char *nglist, const char
 
 	ArticleFileName(path, sizeof(path), h, ARTFILE_FILE_REL);
 
-	fprintf(FeedFo, "SOUT\t%s\t%lld,%ld\t%s\t%s\t%s\t%s\t%d\t%s\t%s\n",
-	    path, (long long)h->boffset, (long)h->bsize, msgid, nglist, dist, npath,
-	    headerOnly, artType, cSize
-	);
+	/*
+	 * With 'feederqueue' the record goes through shared memory and
+	 * the pipe is only used to wake up the master.
+	 */
+	switch(FeedQueueAdd(path, h->boffset, h->bsize, msgid, nglist, dist,
+						npath, headerOnly, artType, cSize)) {
+	case 0:
+	    return(0);
+	case 1:
+	    fputc('\n', FeedFo);
+	    break;
+	default:
+	    fprintf(FeedFo, "SOUT\t%s\t%lld,%ld\t%s\t%s\t%s\t%s\t%d\t%s\t%s\n",
+		path, (long long)h->boffset, (long)h->bsize, msgid, nglist, dist, npath,
+		headerOnly, artType, cSize
+	    );
+	    break;
+	}
 	fflush(FeedFo);	/* simplify the parent reader on the pipe */
 	if (ferror(FeedFo)) {
 	    logit(LOG_CRIT, "lost backchannel to master server");
@@ -210,6 +262,7 @@ FeedWrite(int logIt,
     int linesiz, siz;
     char *ptr;
     unsigned char md5hash[16];
+    int groupCount = -1;
 
     HM_MD5MessageID((mid_t)msgid, md5hash);
 
@@ -255,8 +308,12 @@ FeedWrite(int logIt,
 	    printf(">>SCAN:%s\n", nf->nf_Label);
 	if (UseSpamAlias && feedQuerySpamPaths(nf, npath, bytes, msgid))
 	    break;
-	if (feedQueryPaths(nf, npath, bytes, strtol(artType, NULL, 16)) == 0 && 
-	    feedQueryGroups(nf, nglist) == 0 &&
+	/*
+	 * The groups are tested first, with the group cache that is
+	 * a couple of bit tests and rules out most labels
+	 */
+	if (feedQueryGroupBits(nf, nglist, &groupCount) == 0 &&
+	    feedQueryPaths(nf, npath, bytes, strtol(artType, NULL, 16)) == 0 && 
 	    feedSpamFeedOK(nf->nf_SpamFeedOpt, spamArt) == 0 &&
 	    feedQueryDists(nf, dist) == 0 &&
 	    feedHashFeedOK(nf->nf_HashFeed, md5hash, msgid) == 0
@@ -535,6 +592,17 @@ feedQueryGroups(NewsFeed *feed, const char *nglist)
 	    r = nr;
 	}
     }
+    return(feedGroupLimits(feed, nglist, r, count));
+}
+
+/*
+ * feedGroupLimits() - apply the crosspost limits and requiregroup to the
+ *		       result of matching the groups
+ */
+
+int
+feedGroupLimits(NewsFeed *feed, const char *nglist, int r, int count)
+{
     if (r >= 0 && feed->nf_MaxCrossPost && count > feed->nf_MaxCrossPost)
 	r = -1;
     if (r >= 0 && feed->nf_MinCrossPost && count < feed->nf_MinCrossPost)
@@ -544,6 +612,147 @@ feedQueryGroups(NewsFeed *feed, const char *nglist)
     return(r);
 }
 
+/*
+ * feedQueryGroupBits() - feedQueryGroups() for a label in NFBase using the
+ *			  group cache.  *pcount is -1 for the first label
+ *			  asked about an article, the groups are looked up
+ *			  then and their bitmaps or'd together.
+ */
+
+int
+feedQueryGroupBits(NewsFeed *feed, const char *nglist, int *pcount)
+{
+    int w = feed->nf_Index >> 5;
+    uint32 m = 1 << (feed->nf_Index & 31);
+    int r = -1;
+
+    if (FeedGroupCache == 0 || FeedDebug || feed->nf_Index >= NFCount)
+	return(feedQueryGroups(feed, nglist));
+    if (*pcount < 0)
+	*pcount = feedGroupBits(nglist);
+
+    if (FGArtBits[NFWords + w] & m)
+	r = -2;
+    else if (FGArtBits[w] & m)
+	r = 0;
+    else
+	return(-1);
+    return(feedGroupLimits(feed, nglist, r, *pcount));
+}
+
+/*
+ * feedGroupBits() - or together the cached bitmaps of the groups in
+ *		     nglist into FGArtBits.  The list is split exactly as
+ *		     feedQueryGroups() splits it.  Returns the number of
+ *		     groups.
+ *
+ *		     feedQueryGroups() stops at the first delgroupany group
+ *		     and otherwise feeds if any group is fed, so a label's
+ *		     delgroupany bit wins over its accept bit.
+ */
+
+int
+feedGroupBits(const char *nglist)
+{
+    const char *p;
+    int count = 0;
+
+    if (FGArtWords < NFWords * 2) {
+	if (FGArtBits)
+	    free(FGArtBits);
+	FGArtWords = NFWords * 2;
+	FGArtBits = malloc(FGArtWords * sizeof(uint32));
+    }
+    bzero(FGArtBits, NFWords * 2 * sizeof(uint32));
+
+    while (*nglist == ' ' || *nglist == '\t')
+	++nglist;
+
+    for (p = nglist; p; p = strchr(p, ',')) {
+	FeedGroup *fg;
+	int l;
+	int i;
+
+	if (*p == ',')
+	    ++p;
+
+	for (l = 0; l < MAXGNAME - 1 && p[l] && p[l] != ',' && p[l] != ' ' && p[l] != '\t' && p[l] != '\n' && p[l] != '\r'; ++l)
+	    ;
+	++count;
+	fg = feedGroupLookup(p, l);
+	for (i = 0; i < NFWords * 2; ++i)
+	    FGArtBits[i] |= fg->fg_Bits[i];
+    }
+    return(count);
+}
+
+/*
+ * feedGroupLookup() - find the cache entry for a group, matching the group
+ *		       against the group lists of every label if it is not
+ *		       cached yet
+ */
+
+FeedGroup *
+feedGroupLookup(const char *group, int len)
+{
+    uint32 hv = 0xA4FC3244;
+    FeedGroup **pfg;
+    FeedGroup *fg;
+    NewsFeed *nf;
+    int i;
+
+    for (i = 0; i < len; ++i)
+	hv = (hv << 5) ^ (unsigned char)group[i] ^ (hv >> 23);
+
+    if (FGHash == NULL)
+	FGHash = calloc(FGHSIZE, sizeof(FeedGroup *));
+
+    for (pfg = &FGHash[(hv ^ (hv >> 16)) & FGHMASK];
+	 (fg = *pfg) != NULL;
+	 pfg = &fg->fg_Next
+    ) {
+	if (fg->fg_Hv == hv && strncmp(fg->fg_Name, group, len) == 0 &&
+	    fg->fg_Name[len] == 0
+	) {
+	    return(fg);
+	}
+    }
+
+    if (FGCount >= FGMAXENTS) {
+	feedGroupCacheClear();
+	pfg = &FGHash[(hv ^ (hv >> 16)) & FGHMASK];
+    }
+
+    fg = zalloc(&FGMemPool, sizeof(FeedGroup) +
+			NFWords * 2 * sizeof(uint32) + len + 1);
+    fg->fg_Bits = (uint32 *)(fg + 1);
+    fg->fg_Name = (char *)(fg->fg_Bits + NFWords * 2);
+    bcopy(group, fg->fg_Name, len);
+    fg->fg_Name[len] = 0;
+    fg->fg_Hv = hv;
+    *pfg = fg;
+    ++FGCount;
+
+    for (nf = NFBase; nf; nf = nf->nf_Next) {
+	int r = recursiveScan(nf, offsetof(NewsFeed, nf_GroupAcceptBase), fg->fg_Name, cbFeedGroupQuery, -1);
+
+	if (r == 0)
+	    fg->fg_Bits[nf->nf_Index >> 5] |= 1 << (nf->nf_Index & 31);
+	else if (r == -2)
+	    fg->fg_Bits[NFWords + (nf->nf_Index >> 5)] |= 1 << (nf->nf_Index & 31);
+    }
+    return(fg);
+}
+
+void
+feedGroupCacheClear(void)
+{
+    freePool(&FGMemPool);
+    if (FGHash)
+	bzero(FGHash, FGHSIZE * sizeof(FeedGroup *));
+    FGCount = 0;
+}
+
 /*
  * Check whether a distribution is valid.  Return 0 if so, -1 if we should
  * drop the article.
@@ -1163,6 +1372,19 @@ TouchNewsFeed(void)
     utime(PatLibExpand(DNewsfeedsPat), &ut);
 }
 
+/*
+ * ClearNewsFeedCache() - forget the most recently used label.  A
+ *			  pre-forked diablo child keeps the whole
+ *			  dnewsfeeds loaded and serves a different label
+ *			  in each session.
+ */
+
+void
+ClearNewsFeedCache(void)
+{
+    NFCache = NULL;
+}
+
 /*
  * LoadNewsFeed() - [re]load dnewsfeeds file
  */
@@ -1219,9 +1441,11 @@ LoadNewsFeed(time_t t, int force, const char *hlabel)
 	     */
 
 	    freePool(&NFMemPool);
+	    feedGroupCacheClear();
 	    NFCache = NULL;
 	    NFGlob = NULL;
 	    NFBase = NULL;
+	    NFCount = 0;
 	    IFBase = NULL;
 	    GRBase = NULL;
 	    ISBase = NULL;
@@ -1772,6 +1996,11 @@ LoadNewsFeed(time_t t, int force, const char *hlabel)
 			    nf->nf_LinkInfo.li_MaxStream = atoi(s2);
 			    err = 0;
 			}
+		    } else if (strcmp(s1, "adaptivestream") == 0) {
+			if (nf) {
+			    nf->nf_LinkInfo.li_AdaptiveStream = enabled(s2);
+			    err = 0;
+			}
 		    } else if (strcmp(s1, "queueskip") == 0) {
 			if (nf) {
 			    nf->nf_LinkInfo.li_QueueSkip = atoi(s2);
@@ -1964,6 +2193,10 @@ LoadNewsFeed(time_t t, int force, const char *hlabel)
 	{
 	    NewsFeed *nf;
 
+	    for (nf = NFBase; nf; nf = nf->nf_Next)
+		nf->nf_Index = NFCount++;
+	    NFWords = (NFCount + 31) / 32;
+
 	    for (nf = NFBase; nf; nf = nf->nf_Next) {
 		resolveGroupList(nf->nf_Label, nf->nf_PathAliasBase);
 		resolveGroupList(nf->nf_Label, nf->nf_SpamPathAliasBase);
@@ -2137,6 +2370,7 @@ setLinkGLOBAL(NewslinkInfo *nf)
     nf->li_ArticleStat = 0;
     nf->li_NoBatch = 0;
     nf->li_MaxStream = MAXSTREAM;
+    nf->li_AdaptiveStream = 0;
     nf->li_Priority = 0;
     nf->li_LogArts = NULL;
     nf->li_Hours = NULL;
@@ -2173,6 +2407,7 @@ setLinkStart(NewslinkInfo *nf)
     nf->li_ArticleStat = -1;
     nf->li_NoBatch = -1;
     nf->li_MaxStream = -1;
+    nf->li_AdaptiveStream = -1;
     nf->li_Priority = -1;
     nf->li_LogArts = NULL;
     nf->li_Hours = NULL;
@@ -2225,6 +2460,8 @@ setLinkDefaults(NewslinkInfo *nf, NewslinkInfo *gl)
 	nf->li_NoBatch = gl->li_NoBatch;
     if (nf->li_MaxStream < 0 && gl->li_MaxStream >= 0)
 	nf->li_MaxStream = gl->li_MaxStream;
+    if (nf->li_AdaptiveStream < 0 && gl->li_AdaptiveStream >= 0)
+	nf->li_AdaptiveStream = gl->li_AdaptiveStream;
     if (nf->li_Priority < 0 && gl->li_Priority >= 0)
 	nf->li_Priority = gl->li_Priority;
     if (!nf->li_LogArts && gl->li_LogArts)
@@ -2683,6 +2920,7 @@ DumpFeedInfo(FILE *fo, char *label)
     fprintf(fo, "  GenLines       : %d\n", nf->nf_LinkInfo.li_GenLines);
     fprintf(fo, "  Check          : %d\n", nf->nf_LinkInfo.li_Check);
     fprintf(fo, "  MaxStream      : %d\n", nf->nf_LinkInfo.li_MaxStream);
+    fprintf(fo, "  AdaptiveStream : %d\n", nf->nf_LinkInfo.li_AdaptiveStream);
     fprintf(fo, "  Priority       : %d\n", nf->nf_LinkInfo.li_Priority);
     fprintf(fo, "  Compress       : %d\n", nf->nf_LinkInfo.li_Compress);
     fprintf(fo, "  QueueSkip      : %d\n", nf->nf_LinkInfo.li_QueueSkip);
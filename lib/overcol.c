@@ -0,0 +1,316 @@
+/*
+ * LIB/OVERCOL.C	- overview column files
+ *
+ * Refer to the COPYRIGHT file in the base directory of this
+ * distribution for specific rights granted.
+ *
+ * With 'readercolumns on' dreaderd keeps, next to each overview data
+ * block, one file per column below holding just that header of every
+ * article in the block.  XHDR and XPAT on one of these headers read
+ * the column instead of every article's full header record.
+ *
+ * A column file is an OverColHead followed by one entry per article:
+ * an OverColEnt (article number, message-id hash, length) and the
+ * header line exactly as it is in the data. record, folds and \r\n
+ * included, or nothing if the article does not have the header.
+ * dreaderd appends to the files of the block it is writing to.
+ * Readers only trust an entry whose article number and message-id
+ * hash match the over. index and go to the data. record for anything
+ * else, so a missing, stale or damaged column costs speed, not
+ * correctness.
+ *
+ * dexpireover compresses the columns of complete blocks: the entries
+ * of the articles still in the index are deflated in one piece and the
+ * file is marked OCF_COMPRESSED.  Nothing is appended to it after that.
+ */
+
+#include "defs.h"
+
+Prototype int OverColFind(const char *name, int len);
+Prototype const char *OverColHeader(int col);
+Prototype int OverColOpen(int fd, int col);
+Prototype int OverColAppend(int fd, artno_t artNo, hash_t hv, const char *line, int len);
+Prototype int OverColRead(int fd, OverColBuf *cb);
+Prototype int OverColNext(const OverColBuf *cb, int off, OverColEnt *ce, const char **pline);
+Prototype void OverColFree(OverColBuf *cb);
+Prototype int OverColCompress(const char *path, const char *tmpPath, int (*keep)(const OverColEnt *ce, void *data), void *data);
+
+static const char *OverColNames[OVERCOL_COUNT] = {
+    "Subject", "From", "Date", "Message-ID", "References", "Bytes", "Lines"
+};
+
+/*
+ * OverColFind() - column number for header name (len bytes, not
+ *		   including any colon), or -1
+ */
+
+int
+OverColFind(const char *name, int len)
+{
+    int i;
+
+    for (i = 0; i < OVERCOL_COUNT; ++i) {
+	if (strlen(OverColNames[i]) == len &&
+	    strncasecmp(OverColNames[i], name, len) == 0
+	) {
+	    return(i);
+	}
+    }
+    return(-1);
+}
+
+const char *
+OverColHeader(int col)
+{
+    return(OverColNames[col]);
+}
+
+/*
+ * OverColOpen() - check a column file opened for appending, writing
+ *		   the header if it is new.  Returns -1 if it can not be
+ *		   appended to.
+ */
+
+int
+OverColOpen(int fd, int col)
+{
+    OverColHead ch;
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+	return(-1);
+    if (st.st_size == 0) {
+	bzero(&ch, sizeof(ch));
+	ch.ch_Magic = OCMAGIC;
+	ch.ch_Version = OCVERSION;
+	ch.ch_Column = col;
+	if (write(fd, &ch, sizeof(ch)) != sizeof(ch))
+	    return(-1);
+	return(0);
+    }
+    if (pread(fd, &ch, sizeof(ch), 0) != sizeof(ch) ||
+	ch.ch_Magic != OCMAGIC ||
+	ch.ch_Version != OCVERSION ||
+	ch.ch_Column != col ||
+	(ch.ch_Flags & OCF_COMPRESSED)
+    ) {
+	return(-1);
+    }
+    return(0);
+}
+
+/*
+ * OverColAppend() - append an entry, len may be 0.  The file must have
+ *		     been opened O_APPEND.
+ */
+
+int
+OverColAppend(int fd, artno_t artNo, hash_t hv, const char *line, int len)
+{
+    OverColEnt ce;
+    struct iovec iov[2];
+
+    bzero(&ce, sizeof(ce));
+    ce.ce_ArtNo = artNo;
+    ce.ce_MsgHash = hv;
+    ce.ce_Len = len;
+    iov[0].iov_base = (void *)&ce;
+    iov[0].iov_len = sizeof(ce);
+    iov[1].iov_base = (void *)line;
+    iov[1].iov_len = len;
+    if (writev(fd, iov, 2) != sizeof(ce) + len)
+	return(-1);
+    return(0);
+}
+
+static int
+ocgrow(OverColBuf *cb, int bytes)
+{
+    if (cb->cb_Len + bytes > cb->cb_Max) {
+	int max = cb->cb_Max ? cb->cb_Max : 16384;
+	char *buf;
+
+	while (max < cb->cb_Len + bytes)
+	    max *= 2;
+	if ((buf = realloc(cb->cb_Buf, max)) == NULL)
+	    return(-1);
+	cb->cb_Buf = buf;
+	cb->cb_Max = max;
+    }
+    return(0);
+}
+
+/*
+ * OverColRead() - read the entries of a column file into cb, starting
+ *		   where the last call stopped.  cb must be zeroed before
+ *		   the first call.  A compressed file is inflated whole
+ *		   by the first call.  Returns -1 if the file is unusable.
+ */
+
+int
+OverColRead(int fd, OverColBuf *cb)
+{
+    struct stat st;
+    int n;
+
+    if (fstat(fd, &st) < 0)
+	return(-1);
+
+    if (cb->cb_Pos == 0) {
+	OverColHead ch;
+
+	if (pread(fd, &ch, sizeof(ch), 0) != sizeof(ch) ||
+	    ch.ch_Magic != OCMAGIC ||
+	    ch.ch_Version != OCVERSION
+	) {
+	    return(-1);
+	}
+	cb->cb_Flags = ch.ch_Flags;
+	cb->cb_Pos = sizeof(ch);
+
+	if (ch.ch_Flags & OCF_COMPRESSED) {
+#ifdef USE_ZLIB
+	    uLongf dlen = ch.ch_RawBytes;
+	    int clen = st.st_size - sizeof(ch);
+	    char *cbuf;
+	    int r = -1;
+
+	    if (clen <= 0 || ch.ch_RawBytes <= 0 || ocgrow(cb, ch.ch_RawBytes) < 0)
+		return(-1);
+	    if ((cbuf = malloc(clen)) == NULL)
+		return(-1);
+	    if (pread(fd, cbuf, clen, sizeof(ch)) == clen &&
+		uncompress((Bytef *)cb->cb_Buf, &dlen, (Bytef *)cbuf, clen) == Z_OK &&
+		dlen == ch.ch_RawBytes
+	    ) {
+		cb->cb_Len = dlen;
+		cb->cb_Pos = st.st_size;
+		r = 0;
+	    }
+	    free(cbuf);
+	    return(r);
+#else
+	    return(-1);
+#endif
+	}
+    }
+    if (cb->cb_Flags & OCF_COMPRESSED)
+	return(0);
+
+    if ((n = st.st_size - cb->cb_Pos) <= 0)
+	return(0);
+    if (ocgrow(cb, n) < 0)
+	return(-1);
+    if ((n = pread(fd, cb->cb_Buf + cb->cb_Len, n, cb->cb_Pos)) < 0)
+	return(-1);
+    cb->cb_Len += n;
+    cb->cb_Pos += n;
+    return(0);
+}
+
+/*
+ * OverColNext() - decode the entry at offset off of cb.  Returns the
+ *		   offset of the next entry, or -1 if there is no
+ *		   complete entry at off (yet).
+ */
+
+int
+OverColNext(const OverColBuf *cb, int off, OverColEnt *ce, const char **pline)
+{
+    if (off < 0 || cb->cb_Len - off < (int)sizeof(OverColEnt))
+	return(-1);
+    bcopy(cb->cb_Buf + off, ce, sizeof(OverColEnt));
+    if (ce->ce_Len < 0 || ce->ce_Len > cb->cb_Len - off - (int)sizeof(OverColEnt))
+	return(-1);
+    *pline = cb->cb_Buf + off + sizeof(OverColEnt);
+    return(off + sizeof(OverColEnt) + ce->ce_Len);
+}
+
+void
+OverColFree(OverColBuf *cb)
+{
+    if (cb->cb_Buf)
+	free(cb->cb_Buf);
+    bzero(cb, sizeof(OverColBuf));
+}
+
+/*
+ * OverColCompress() - compress the column file path, keeping only the
+ *		       entries keep() returns non-zero for, and rename
+ *		       the result over it.  Returns 1 if the file was
+ *		       compressed, 0 if it already was, -1 on error.
+ */
+
+int
+OverColCompress(const char *path, const char *tmpPath, int (*keep)(const OverColEnt *ce, void *data), void *data)
+{
+#ifdef USE_ZLIB
+    OverColBuf cb = { 0 };
+    OverColBuf out = { 0 };
+    OverColHead ch;
+    OverColEnt ce;
+    const char *line;
+    uLongf zlen;
+    char *zbuf = NULL;
+    int off = 0;
+    int fd;
+    int r = -1;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return(-1);
+    if (pread(fd, &ch, sizeof(ch), 0) != sizeof(ch) || ch.ch_Magic != OCMAGIC) {
+	close(fd);
+	return(-1);
+    }
+    if (ch.ch_Flags & OCF_COMPRESSED) {
+	close(fd);
+	return(0);
+    }
+    if (OverColRead(fd, &cb) < 0) {
+	close(fd);
+	OverColFree(&cb);
+	return(-1);
+    }
+    close(fd);
+
+    while ((off = OverColNext(&cb, off, &ce, &line)) >= 0) {
+	int n = sizeof(ce) + ce.ce_Len;
+
+	if (keep && keep(&ce, data) == 0)
+	    continue;
+	if (ocgrow(&out, n) < 0)
+	    goto done;
+	bcopy(line - sizeof(ce), out.cb_Buf + out.cb_Len, n);
+	out.cb_Len += n;
+    }
+
+    zlen = compressBound(out.cb_Len);
+    if ((zbuf = malloc(zlen)) == NULL ||
+	compress2((Bytef *)zbuf, &zlen, (Bytef *)out.cb_Buf, out.cb_Len, Z_BEST_COMPRESSION) != Z_OK
+    ) {
+	goto done;
+    }
+    ch.ch_Flags |= OCF_COMPRESSED;
+    ch.ch_RawBytes = out.cb_Len;
+
+    if ((fd = open(tmpPath, O_RDWR|O_CREAT|O_TRUNC, 0644)) < 0)
+	goto done;
+    if (write(fd, &ch, sizeof(ch)) != sizeof(ch) ||
+	write(fd, zbuf, zlen) != zlen ||
+	close(fd) < 0 ||
+	rename(tmpPath, path) < 0
+    ) {
+	remove(tmpPath);
+	goto done;
+    }
+    r = 1;
+done:
+    if (zbuf)
+	free(zbuf);
+    OverColFree(&out);
+    OverColFree(&cb);
+    return(r);
+#else
+    return(0);
+#endif
+}
@@ -40,19 +40,43 @@ Prototype void SetSpamFilterTrip(int body, int nph);
 Prototype void SetSpamFilterOpt(void);
 Prototype void InitSpamFilter(void);
 Prototype void TermSpamFilter(void);
+Prototype void SpamFilterChild(void);
 Prototype int SpamFilter(time_t t, SpamInfo *spamInfo, int *phow);
 Prototype void ClearSpamFilterEntry(int which, int entry);
 Prototype void DumpSpamFilterCache(FILE *fo, int raw);
 Prototype int BodyFilterFd;
 Prototype int NphFilterFd;
 
+/*
+ * The table is set associative: a hash selects a bucket of F_WAYS
+ * entries and is stored in whichever of them is free, expired or has
+ * the fewest hits.  Buckets are locked in F_STRIPES stripes by lock
+ * words in the file, taken with a compare-and-swap rather than an
+ * fcntl() lock per lookup.  The lock word holds the pid of the owner
+ * (FilterPid).  A child killed holding a stripe cannot release it, so
+ * a waiter takes the stripe over once kill() says the owner is gone.
+ */
+
+#define F_WAYS		4
+#define F_STRIPES	1024
+#define F_LOCKSPIN	100
+#define F_STATSFLUSH	256
+
 #define F_B_HSIZE	65536
-#define F_B_HMASK	(F_B_HSIZE - 1)
+#define F_B_HMASK	(F_B_HSIZE / F_WAYS - 1)
 #define F_B_EXPIRE	(60 * 60)	/* one hour expire */
 #define F_P_HSIZE	65536
-#define F_P_HMASK	(F_B_HSIZE - 1)
+#define F_P_HMASK	(F_B_HSIZE / F_WAYS - 1)
 #define F_P_EXPIRE	(60 * 60)	/* one hour expire */
 
+#if defined(__GNUC__) && USE_SPAM_RW_MAP
+#define FCAS(p, o, n)	__sync_bool_compare_and_swap(p, o, n)
+#define FRELEASE(p)	__sync_lock_release(p)
+#define F_ATOMIC	1
+#else
+#define F_ATOMIC	0
+#endif
+
 typedef struct Filter {
     md5hash_t	f_Hash;		/* hash to check/store			*/
     hash_t	f_MHash;	/* message-id hash			*/
@@ -62,13 +86,55 @@ typedef struct Filter {
     int32	f_FilterCount;	/* filtered postings			*/
 } Filter;
 
+/*
+ * The cache files start with a header recording the layout and the
+ * fingerprint method ('spamhash') the entries were made with.  A file
+ * that does not match is rebuilt empty when it is opened.
+ */
+
+#define F_MAGIC		0x5346434bL	/* "SFCK" */
+#define F_VERSION	2
+
+typedef struct FilterStats {
+    double	fs_Lookups;
+    double	fs_Hits;	/* found in the bucket			*/
+    double	fs_Inserts;	/* into a free or expired entry		*/
+    double	fs_Evicts;	/* over an entry that was still live	*/
+    double	fs_Full;	/* every entry in the bucket locked	*/
+} FilterStats;
+
+/*
+ * Each process counts in its FilterInfo and adds the counts to the
+ * header every F_STATSFLUSH lookups, without a lock, so the header
+ * counters are approximate.
+ */
+typedef struct FilterHead {
+    int32	fh_Magic;
+    int32	fh_Version;
+    int32	fh_HashMethod;	/* SPAMHASH_*				*/
+    int32	fh_Entries;
+    int32	fh_EntrySize;	/* sizeof(Filter)			*/
+    int32	fh_Ways;
+    int32	fh_Stripes;
+    int32	fh_Unused;
+    FilterStats	fh_Stats;
+    char	fh_Reserved[56];
+} FilterHead;
+
+#define F_LOCKOFF(s)	(sizeof(FilterHead) + (s) * sizeof(int32))
+#define F_DATAOFF	F_LOCKOFF(F_STRIPES)
+#define F_MAPSIZE(fi)	(F_DATAOFF + (fi)->Hsize * sizeof(Filter))
+
 typedef struct FilterInfo {
     Filter	*HashAry;	/* Shared memory hash			*/
     int		Fd;		/* fd of the disk image of hash		*/
     int		Trip;		/* spam after this many hits		*/
     int		Hsize;		/* number of entries in the memory hash	*/
-    int		Hmask;		/* entry mask				*/
+    int		Hmask;		/* bucket mask				*/
     int		Expire;		/* how long (in seconds) entries last	*/
+    FilterHead	*Head;		/* start of the map			*/
+    volatile int32 *Locks;	/* F_STRIPES lock words, then HashAry	*/
+    FilterStats	Stats;		/* not yet added to Head->fh_Stats	*/
 } FilterInfo;
 
 FilterInfo	BodyFilter = { NULL, -1, 0, F_B_HSIZE, F_B_HMASK, F_P_EXPIRE };
@@ -77,12 +143,21 @@ int		BodyFilterFd = -1;
 int		NphFilterFd = -1;
 int		FilterLock = 4;
 int		FilterMax  = 100;
+pid_t		FilterPid;	/* stripe lock owner id, see SpamFilterChild() */
 
 void initSpamData(FilterInfo *f, const char *fname, int *fd);
 void termSpamData(FilterInfo *filter);
 int openFilterFile(FilterInfo *f, const char *fname);
+int checkFilterHead(FilterInfo *fi, const FilterHead *fh);
+int resetFilterFile(FilterInfo *fi);
+void setFilterMap(FilterInfo *fi, FilterHead *fh);
+int filterAge(FilterInfo *fi, Filter *f, time_t t, time_t *pt0, int *pdhits);
+void filterLock(FilterInfo *fi, int stripe);
+void filterUnlock(FilterInfo *fi, int stripe);
+void filterFlushStats(FilterInfo *fi);
 int spamFilterTable(time_t t, FilterInfo *f, hash_t mhv, md5hash_t *hv, int lines);
 void dumpSpamFilterMem(FILE *fo, FilterInfo *fi, char *stype, int raw);
+void dumpSpamFilterStats(FILE *fo, FilterInfo *fi, char *stype);
 
 void
 SetSpamFilterTrip(int body, int nph)
@@ -179,9 +254,18 @@ SetSpamFilterOpt(void)
 			return;
 		    }
 		    n = strtol(ptr, NULL, 0);
-		    if ((n ^ (n - 1)) != (n << 1) - 1) {
-			logit(LOG_ERR, "spam hash size option (%d) not a power of 2\n",
-							n);
+		    while (isdigit((int)*ptr))
+			++ptr;
+		    if (*ptr == 'k' && n < (1 << 20)) {
+			n <<= 10;
+			++ptr;
+		    } else if (*ptr == 'm' && n < (1 << 10)) {
+			n <<= 20;
+			++ptr;
+		    }
+		    if (n < F_WAYS || (n & (n - 1)) != 0) {
+			logit(LOG_ERR, "spam hash size option (%d) not a power of 2 of at least %d\n",
+							n, F_WAYS);
 			free(oldopts);
 			return;
 		    }
@@ -190,21 +274,19 @@ SetSpamFilterOpt(void)
 			    if (BodyFilter.HashAry != NULL)
 				break;
 			    BodyFilter.Hsize = n;
-			    BodyFilter.Hmask = n - 1;
+			    BodyFilter.Hmask = n / F_WAYS - 1;
 			    break;
 			case 2:
 			    if (NphFilter.HashAry != NULL)
 				break;
 			    NphFilter.Hsize = n;
-			    NphFilter.Hmask = n - 1;
+			    NphFilter.Hmask = n / F_WAYS - 1;
 			    break;
 			default:
 			    logit(LOG_ERR, "Invalid spam option: %s\n", oldopts);
 			    free(oldopts);
 			    return;
 		    }
-		    while (isdigit((int)*ptr))
-			++ptr;
 		    break;
 		default:
 		    logit(LOG_ERR, "Invalid spam option: %s\n", oldopts);
@@ -238,6 +320,61 @@ SetSpamFilterOpt(void)
  *		      spam cache into the shared memory segment.
  */
 
+int
+checkFilterHead(FilterInfo *fi, const FilterHead *fh)
+{
+    return(fh->fh_Magic == F_MAGIC &&
+	fh->fh_Version == F_VERSION &&
+	fh->fh_HashMethod == DOpts.SpamHashMethod &&
+	fh->fh_Entries == fi->Hsize &&
+	fh->fh_EntrySize == sizeof(Filter) &&
+	fh->fh_Ways == F_WAYS &&
+	fh->fh_Stripes == F_STRIPES);
+}
+
+/*
+ * resetFilterFile() - write an empty cache.  The entries are zeroed
+ *		       before the header is written, the file is never
+ *		       truncated below its new size.
+ */
+
+int
+resetFilterFile(FilterInfo *fi)
+{
+    static const char zero[65536];
+    FilterHead fh;
+    off_t size = F_MAPSIZE(fi);
+    off_t off;
+
+    if (ftruncate(fi->Fd, size) < 0)
+	return(-1);
+    for (off = 0; off < size; off += sizeof(zero)) {
+	size_t n = (size - off > sizeof(zero)) ? sizeof(zero) : size - off;
+
+	if (pwrite(fi->Fd, zero, n, off) != n)
+	    return(-1);
+    }
+    bzero(&fh, sizeof(fh));
+    fh.fh_Magic = F_MAGIC;
+    fh.fh_Version = F_VERSION;
+    fh.fh_HashMethod = DOpts.SpamHashMethod;
+    fh.fh_Entries = fi->Hsize;
+    fh.fh_EntrySize = sizeof(Filter);
+    fh.fh_Ways = F_WAYS;
+    fh.fh_Stripes = F_STRIPES;
+    if (pwrite(fi->Fd, &fh, sizeof(fh), 0) != sizeof(fh))
+	return(-1);
+    return(0);
+}
+
+void
+setFilterMap(FilterInfo *fi, FilterHead *fh)
+{
+    fi->Head = fh;
+    fi->Locks = (volatile int32 *)((char *)fh + F_LOCKOFF(0));
+    fi->HashAry = (Filter *)((char *)fh + F_DATAOFF);
+}
+
 int
 openFilterFile(FilterInfo *fi, const char *fname)
 {
@@ -248,22 +385,35 @@ openFilterFile(FilterInfo *fi, const char *fname)
 					PatDbExpand(fname), strerror(errno));
 
     if (fi->HashAry == NULL && fi->Fd >= 0 && fstat(fi->Fd, &st) == 0) {
-	if (st.st_size != fi->Hsize * sizeof(Filter)) {
-	    int i;
-	    Filter f = {{ 0 }};
-	    ftruncate(fi->Fd, 0);
-	    for (i = 0; i < fi->Hsize; i++)
-		write(fi->Fd, &f, sizeof(f));
-	    lseek(fi->Fd, 0, SEEK_SET);
+	FilterHead fh;
+	int ok = 1;
+
+	hflock(fi->Fd, 0, XLOCK_EX);
+	if (st.st_size != F_MAPSIZE(fi) ||
+	    pread(fi->Fd, &fh, sizeof(fh), 0) != sizeof(fh) ||
+	    !checkFilterHead(fi, &fh)
+	) {
+	    if (st.st_size != 0)
+		logit(LOG_INFO, "Rebuilding spam cache file %s", PatDbExpand(fname));
+	    if (resetFilterFile(fi) < 0) {
+		logit(LOG_ERR, "Unable to rebuild spam cache file: %s %s\n",
+					PatDbExpand(fname), strerror(errno));
+		ok = 0;
+	    }
+	}
+	if (ok) {
+	    fi->Head = xmap(
+		    NULL, 
+		    F_MAPSIZE(fi),
+		    PROT_READ | (USE_SPAM_RW_MAP * PROT_WRITE),
+		    MAP_SHARED,
+		    fi->Fd,
+		    0
+		);
 	}
-	fi->HashAry = xmap(
-		NULL, 
-		fi->Hsize * sizeof(Filter),
-		PROT_READ | (USE_SPAM_RW_MAP * PROT_WRITE),
-		MAP_SHARED,
-		fi->Fd,
-		0
-	    );
+	hflock(fi->Fd, 0, XLOCK_UN);
+	if (fi->Head != NULL)
+	    setFilterMap(fi, fi->Head);
     }
     if (fi->HashAry == NULL && fi->Fd >= 0) {
 	close(fi->Fd);
@@ -283,7 +433,7 @@ initSpamData(FilterInfo *f, const char *fname, int *fd)
     if (f->HashAry != NULL)
 	return;
 #if USE_SPAM_SHM
-    sid = shmget(IPC_PRIVATE, f->Hsize * sizeof(Filter), SHM_R|SHM_W);
+    sid = shmget(IPC_PRIVATE, F_MAPSIZE(f), SHM_R|SHM_W);
 
     if (sid < 0) {
         logit(LOG_ERR, "sysv shared memory alloc failed, is your machine configured with a high enough maximum segment size?");
@@ -292,26 +442,30 @@ initSpamData(FilterInfo *f, const char *fname, int *fd)
 	printf("Allocated spam shm segment\n");
     }
 
-    f->HashAry = (Filter *)shmat(sid, NULL, SHM_R|SHM_W);
+    f->Head = (FilterHead *)shmat(sid, NULL, SHM_R|SHM_W);
 
     if (shmctl(sid, IPC_STAT, &ds) < 0 || shmctl(sid, IPC_RMID, &ds) < 0) {
         logit(LOG_ERR, "sysv shmctl stat/rmid failed");
         exit(1);
     }
 
-    if (f->HashAry == (Filter *)-1) {
-        f->HashAry = NULL;
+    if (f->Head == (FilterHead *)-1) {
+        f->Head = NULL;
         logit(LOG_ERR, "sysv shared memory map failed");
         exit(1);
     }
-    bzero(f->HashAry, f->Hsize * sizeof(Filter));
+    setFilterMap(f, f->Head);
 
-    if ((f->Fd = open(PatDbExpand(fname), O_RDWR, 0644)) >= 0) {
+    if ((f->Fd = open(PatDbExpand(fname), O_RDWR|O_CREAT, 0644)) >= 0) {
 	struct stat sb;
-	if (fstat(f->Fd, &sb) == 0 && sb.st_size != f->Hsize * sizeof(Filter))
-	    ftruncate(f->Fd, 0);
-	else
-	    read(f->Fd, f->HashAry, f->Hsize * sizeof(Filter));
+
+	if (fstat(f->Fd, &sb) < 0 || sb.st_size != F_MAPSIZE(f) ||
+	    read(f->Fd, f->Head, F_MAPSIZE(f)) != F_MAPSIZE(f) ||
+	    !checkFilterHead(f, f->Head)
+	) {
+	    resetFilterFile(f);
+	    pread(f->Fd, f->Head, F_MAPSIZE(f), 0);
+	}
 	*fd = f->Fd;
     } else {
 	logit(LOG_ERR, "Unable to open %s (%s)", PatDbExpand(fname),
@@ -344,14 +498,18 @@ void
 termSpamData(FilterInfo *fi)
 {
 #if USE_SPAM_SHM
-    if (fi->Fd >= 0 && fi->HashAry != NULL) {
+    if (fi->Head != NULL)
+	filterFlushStats(fi);
+    if (fi->Fd >= 0 && fi->Head != NULL) {
 	lseek(fi->Fd, 0L, 0);
-	write(fi->Fd, fi->HashAry, fi->Hsize * sizeof(Filter));
-	ftruncate(fi->Fd, fi->Hsize * sizeof(Filter));
+	write(fi->Fd, fi->Head, F_MAPSIZE(fi));
+	ftruncate(fi->Fd, F_MAPSIZE(fi));
     }
-    if (fi->HashAry != NULL) {
-	if (shmdt((void *)fi->HashAry) != 0)
+    if (fi->Head != NULL) {
+	if (shmdt((void *)fi->Head) != 0)
 	    logit(LOG_ERR, "shmdt error: %s\n", strerror(errno));
+	fi->Head = NULL;
+	fi->Locks = NULL;
 	fi->HashAry = NULL;
     }
     if (fi->Fd >= 0) {
@@ -360,10 +518,14 @@ termSpamData(FilterInfo *fi)
     }
 #else
     if (fi->Fd >= 0) {
-	if (fi->HashAry != NULL)
-	    xunmap(fi->HashAry, fi->Hsize * sizeof(Filter));
+	if (fi->Head != NULL) {
+	    filterFlushStats(fi);
+	    xunmap(fi->Head, F_MAPSIZE(fi));
+	}
 	close(fi->Fd);
 	fi->Fd = -1;
+	fi->Head = NULL;
+	fi->Locks = NULL;
 	fi->HashAry = NULL;
     }
 #endif
@@ -382,10 +544,24 @@ TermSpamFilter(void)
 	termSpamData(&NphFilter);
 	done = 1;
     }
+    BodyFilterFd = -1;		/* so that InitSpamFilter() reopens */
+    NphFilterFd = -1;
     if (done)
 	logit(LOG_INFO, "Terminated internal spamfilter");
 }
 
+/*
+ * SpamFilterChild() - called by a child after the fork.  getpid() is a
+ *		       system call, so the id left in the stripe locks
+ *		       is looked up once per process rather than per lock.
+ */
+
+void
+SpamFilterChild(void)
+{
+    FilterPid = getpid();
+}
+
 /*
  * SpamFilter() - run spam filter on message-id hash, optional
  * nntpPostingHost.  If nntpPostingHost is not provided, it must
@@ -420,6 +596,91 @@ SpamFilter(time_t t, SpamInfo *spamInfo, int *phow)
     return(r);
 }
 
+/*
+ * filterLock() - lock the stripe a bucket is in
+ */
+
+void
+filterLock(FilterInfo *fi, int stripe)
+{
+#if F_ATOMIC
+    volatile int32 *lk = &fi->Locks[stripe];
+    int32 owner;
+    int n = 0;
+
+    if (FilterPid == 0)
+	FilterPid = getpid();
+    while ((owner = *lk) != 0 || !FCAS(lk, 0, FilterPid)) {
+	if (++n <= F_LOCKSPIN || owner == 0)
+	    continue;
+	if (kill(owner, 0) < 0 && errno == ESRCH) {
+	    if (FCAS(lk, owner, FilterPid)) {
+		logit(LOG_INFO, "SpamFilter, taking over lock on stripe %d from exited pid %d",
+							stripe, (int)owner);
+		break;
+	    }
+	    continue;
+	}
+	usleep(1000);
+    }
+#else
+    hflock(fi->Fd, F_LOCKOFF(stripe), XLOCK_EX);
+#endif
+}
+
+void
+filterUnlock(FilterInfo *fi, int stripe)
+{
+#if F_ATOMIC
+    FRELEASE(&fi->Locks[stripe]);
+#else
+    hflock(fi->Fd, F_LOCKOFF(stripe), XLOCK_UN);
+#endif
+}
+
+void
+filterFlushStats(FilterInfo *fi)
+{
+#if USE_SPAM_RW_MAP
+    FilterStats *fs = &fi->Head->fh_Stats;
+
+    fs->fs_Lookups += fi->Stats.fs_Lookups;
+    fs->fs_Hits += fi->Stats.fs_Hits;
+    fs->fs_Inserts += fi->Stats.fs_Inserts;
+    fs->fs_Evicts += fi->Stats.fs_Evicts;
+    fs->fs_Full += fi->Stats.fs_Full;
+#endif
+    bzero(&fi->Stats, sizeof(fi->Stats));
+}
+
+/*
+ * filterAge() - work out the hits an entry has left at time t, at one
+ *		 less per minute.  Returns 1 if the entry is empty,
+ *		 garbage or expired, *pdhits then cancels all its hits.
+ */
+
+int
+filterAge(FilterInfo *fi, Filter *f, time_t t, time_t *pt0, int *pdhits)
+{
+    int32 dt = (int)(t - f->f_Time);
+    time_t t0 = f->f_Time;
+    int dhits = 0;
+
+    if (t0 == 0 || dt < -10 || dt > fi->Expire) {
+	*pt0 = t;
+	*pdhits = -f->f_HitCount;
+	return(1);
+    }
+    while (dt >= 60 && f->f_HitCount + dhits > 0) {
+	--dhits;
+	t0 += 60;
+	dt -= 60;
+    }
+    *pt0 = t0;
+    *pdhits = dhits;
+    return(0);
+}
+
 /*
  * Execute spam filter on hash code
  */
@@ -428,67 +689,47 @@ int
 spamFilterTable(time_t t, FilterInfo *fi, hash_t mhv, md5hash_t *hv, int lines)
 {
     int r = 0;
-    int i = (hv->h1 ^ hv->h2) & fi->Hmask;	/* hash index */
-    int off = i * sizeof(Filter);	/* map offset */
-    Filter *f = &fi->HashAry[i];		/* structural pointer	*/
+    int b = (hv->h1 ^ hv->h2) & fi->Hmask;	/* bucket index */
+    int stripe = b & (F_STRIPES - 1);
+    Filter *f = &fi->HashAry[b * F_WAYS];	/* first entry in bucket */
+    Filter *victim = NULL;
     time_t t0;
     int dhits = 0;
-    int isdup = 1;
-
-    hflock(fi->Fd, off, XLOCK_EX);
-
-    t0 = f->f_Time;
-
-    /*
-     * calculate delta hits
-     */
-    {
-	int32 dt = (int)(t - t0);
-
-	if (t0 == 0 || dt < -10 || dt > fi->Expire) {
-	    /*
-	     * Slot is garbaged or long-expired, reset
-	     * it.  Set dhits to force override.  Reset
-	     * t0.
-	     */
-	    dhits = -f->f_HitCount;
-	    t0 = t;
-	    isdup = 0;
-	} else {
-	    /*
-	     * Slot ok (but may or may not match hash code).
-	     *
-	     * calculate per-minute rate, adjust dhits as if hash
-	     * code were ok.
-	     */
-	    while (dt >= 60 && f->f_HitCount + dhits > 0) {
-		--dhits;
-		t0 += 60;
-		dt -= 60;
-	    }
-	    /*
-	     * Check for duplicate message-id.  If not a duplicate,
-	     * enable write-back and bump dhits.
-	     */
-	    if (f->f_MHash.h1 != mhv.h1 || f->f_MHash.h2 != mhv.h2) {
-		++dhits;
-		isdup = 0;
-	    }
+    int vhits = 0;
+    int full = 0;
+    int w;
+
+    ++fi->Stats.fs_Lookups;
+
+    filterLock(fi, stripe);
+
+    for (w = 0; w < F_WAYS; ++w) {
+	if (f[w].f_Time != 0 &&
+	    f[w].f_Hash.h1 == hv->h1 &&
+	    f[w].f_Hash.h2 == hv->h2 &&
+	    (lines == 0 || f[w].f_Lines == lines)
+	) {
+	    break;
 	}
     }
 
-    /*
-     * cache hit / miss
-     */
-
-    if (f->f_Hash.h1 == hv->h1 &&
-	f->f_Hash.h2 == hv->h2 &&
-	(lines == 0 || (f->f_Lines == lines))
-    ) {
+    if (w < F_WAYS) {
 	/*
-	 * same-slot, valid.
+	 * cache hit.  Slot may be long expired, in which case it is
+	 * reset.  Otherwise check for a duplicate message-id.  If not
+	 * a duplicate, enable write-back and bump dhits.
 	 */
 	Filter copy;
+	int isdup = 1;
+
+	f += w;
+	if (filterAge(fi, f, t, &t0, &dhits)) {
+	    isdup = 0;
+	} else if (f->f_MHash.h1 != mhv.h1 || f->f_MHash.h2 != mhv.h2) {
+	    ++dhits;
+	    isdup = 0;
+	}
+	++fi->Stats.fs_Hits;
 
 	copy = *f;
 
@@ -514,39 +755,61 @@ spamFilterTable(time_t t, FilterInfo *fi, hash_t mhv, md5hash_t *hv, int lines)
 #if USE_SPAM_RW_MAP
 	    *f = copy;
 #else
-	    lseek(fd, off, 0);		/* seek & lock	*/
-	    write(fd, &copy, sizeof(Filter));
+	    pwrite(fi->Fd, &copy, sizeof(Filter),
+			F_DATAOFF + (f - fi->HashAry) * sizeof(Filter));
 #endif
 	}
-    } else if (f->f_HitCount + dhits < FilterLock) {
+    } else {
 	/*
-	 * reset slot
+	 * cache miss.  Replace the entry in the bucket with the
+	 * fewest hits left, unless even that one is locked.
 	 */
-	Filter copy = { { 0 } };
+	for (w = 0; w < F_WAYS; ++w) {
+	    int hits = 0;
+
+	    if (filterAge(fi, &f[w], t, &t0, &dhits) == 0)
+		hits = f[w].f_HitCount + dhits;
+	    if (victim == NULL || hits < vhits) {
+		victim = &f[w];
+		vhits = hits;
+	    }
+	}
+	if (vhits < FilterLock) {
+	    Filter copy = { { 0 } };
 
-	copy.f_Hash = *hv;
-	copy.f_MHash = mhv;
-	copy.f_Time = t;
-	copy.f_HitCount = 1;
-	copy.f_FilterCount = 0;
-	copy.f_Lines = lines;
+	    if (vhits > 0)
+		++fi->Stats.fs_Evicts;
+	    else
+		++fi->Stats.fs_Inserts;
+
+	    copy.f_Hash = *hv;
+	    copy.f_MHash = mhv;
+	    copy.f_Time = t;
+	    copy.f_HitCount = 1;
+	    copy.f_FilterCount = 0;
+	    copy.f_Lines = lines;
 
 #if USE_SPAM_RW_MAP
-	*f = copy;
+	    *victim = copy;
 #else
-	lseek(fd, off, 0);		/* seek & lock	*/
-	write(fd, &copy, sizeof(Filter));
+	    pwrite(fi->Fd, &copy, sizeof(Filter),
+			F_DATAOFF + (victim - fi->HashAry) * sizeof(Filter));
 #endif
-    } else {
-	logit(LOG_INFO, "SpamFilter, slot %d in use: dt=%d, %d + %d\n",
-	    i, 
-	    (int)(t - f->f_Time),
-	    f->f_HitCount, 
-	    dhits
+	} else {
+	    ++fi->Stats.fs_Full;
+	    full = 1;
+	}
+    }
+    filterUnlock(fi, stripe);
+
+    if (fi->Stats.fs_Lookups >= F_STATSFLUSH)
+	filterFlushStats(fi);
+    if (full) {
+	logit(LOG_INFO, "SpamFilter, bucket %d in use: %d hits or more\n",
+	    b,
+	    vhits
 	);
     }
-    hflock(fi->Fd, off, XLOCK_UN);
-
     return(r);
 }
 
@@ -632,6 +895,66 @@ dumpSpamFilterMem(FILE *fo, FilterInfo *fi, char *stype, int raw)
     }
 }
 
+/*
+ * dumpSpamFilterStats() - the lookup counters and a histogram of the
+ *			   number of live entries per bucket.  Many full
+ *			   buckets and evictions mean the table is too
+ *			   small for the feed ('s' option).
+ */
+
+void
+dumpSpamFilterStats(FILE *fo, FilterInfo *fi, char *stype)
+{
+    FilterStats *fs;
+    time_t t = time(NULL);
+    double hist[F_WAYS + 1];
+    double live = 0;
+    int nbuckets = fi->Hmask + 1;
+    int b;
+    int w;
+
+    if (fi->HashAry == NULL)
+	return;
+
+    filterFlushStats(fi);
+    fs = &fi->Head->fh_Stats;
+    bzero(hist, sizeof(hist));
+    for (b = 0; b < nbuckets; ++b) {
+	Filter *f = &fi->HashAry[b * F_WAYS];
+	int n = 0;
+
+	for (w = 0; w < F_WAYS; ++w) {
+	    int32 dt = t - f[w].f_Time;
+
+	    if (f[w].f_Time != 0 && dt >= -10 && dt <= fi->Expire)
+		++n;
+	}
+	++hist[n];
+	live += n;
+    }
+
+    fprintf(fo, "Internal spamfilter %s table: %d entries in %d buckets of %d, %.0f live (%.1f%%)\n",
+	stype,
+	fi->Hsize,
+	nbuckets,
+	F_WAYS,
+	live,
+	live * 100.0 / fi->Hsize
+    );
+    fprintf(fo, "    lookups %.0f hits %.0f inserts %.0f evictions %.0f full %.0f\n",
+	fs->fs_Lookups,
+	fs->fs_Hits,
+	fs->fs_Inserts,
+	fs->fs_Evicts,
+	fs->fs_Full
+    );
+    fprintf(fo, "    live entries per bucket:");
+    for (w = 0; w <= F_WAYS; ++w)
+	fprintf(fo, " %d:%.0f", w, hist[w]);
+    fprintf(fo, "\n");
+    fprintf(fo, "-------------------------------------------------\n");
+}
+
 void
 DumpSpamFilterCache(FILE *fo, int raw)
 {
@@ -640,6 +963,8 @@ DumpSpamFilterCache(FILE *fo, int raw)
     SpamFilter(time(NULL), NULL, &dummyHow);
 
     dumpSpamFilterMem(fo, &BodyFilter, "body", raw);
+    dumpSpamFilterStats(fo, &BodyFilter, "body");
     dumpSpamFilterMem(fo, &NphFilter, "nph", raw);
+    dumpSpamFilterStats(fo, &NphFilter, "nph");
 }
 
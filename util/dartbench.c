@@ -0,0 +1,391 @@
+
+/*
+ * DARTBENCH.C - article retrieval load generator
+ *
+ *	-g builds a synthetic spool: it offers count generated articles
+ *	to a diablo server with IHAVE and writes their message-ids to
+ *	the id file.  -r then fetches random message-ids from the id
+ *	file with ARTICLE from a (dreaderd) server over one or more
+ *	connections and reports the latency of each request.
+ */
+
+#include "defs.h"
+
+#define	ARTSIZE		4000
+#define	NEWSGROUP	"test.dartbench"
+
+void Usage(void);
+FILE *Connect(const char *host, const char *port);
+int Response(FILE *fp, char *buf, int len);
+void Generate(const char *host, const char *port, int count);
+void Fetch(const char *host, const char *port, int count);
+double *FetchLoop(const char *host, const char *port, int count, int *misses);
+int CmpDouble(const void *a, const void *b);
+double Elapsed(struct timeval *tv);
+
+char *IdFile = NULL;
+char *Group = NEWSGROUP;
+int ArtSize = ARTSIZE;
+int Conns = 1;
+int VerboseOpt = 0;
+char **MsgIds;
+int NumMsgIds;
+
+void
+Usage(void)
+{
+    fprintf(stderr, "An article retrieval load generator\n\n");
+    fprintf(stderr, "Usage: dartbench -g count [-n group] [-s size] -m idfile [-p port] host\n");
+    fprintf(stderr, "       dartbench -r count [-c conns] -m idfile [-p port] host\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-c\tnumber of parallel reader connections (default: 1)\n");
+    fprintf(stderr, "\t-g\toffer count synthetic articles with IHAVE\n");
+    fprintf(stderr, "\t-m\tfile of message-ids, written by -g, read by -r\n");
+    fprintf(stderr, "\t-n\tnewsgroup for -g (default: %s)\n", NEWSGROUP);
+    fprintf(stderr, "\t-p\tremote port (default: 119)\n");
+    fprintf(stderr, "\t-r\tfetch count random articles with ARTICLE\n");
+    fprintf(stderr, "\t-s\taverage article size for -g (default: %d)\n", ARTSIZE);
+    fprintf(stderr, "\t-v\tbe more verbose\n");
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char *host = NULL;
+    char *port = "119";
+    int gen = 0;
+    int fetch = 0;
+    int i;
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr == '-') {
+	    ptr += 2;
+	    switch(ptr[-1]) {
+	    case 'c':
+		Conns = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'g':
+		gen = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'm':
+		IdFile = (*ptr) ? ptr : av[++i];
+		break;
+	    case 'n':
+		Group = (*ptr) ? ptr : av[++i];
+		break;
+	    case 'p':
+		port = (*ptr) ? ptr : av[++i];
+		break;
+	    case 'r':
+		fetch = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 's':
+		ArtSize = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'v':
+		VerboseOpt = 1;
+		break;
+	    default:
+		Usage();
+	    }
+	} else {
+	    host = ptr;
+	}
+    }
+    if (host == NULL || IdFile == NULL || (gen <= 0) == (fetch <= 0) ||
+	Conns <= 0 || ArtSize <= 0
+    ) {
+	Usage();
+    }
+
+    srandom(getpid() ^ time(NULL));
+    if (gen > 0)
+	Generate(host, port, gen);
+    else
+	Fetch(host, port, fetch);
+    return(0);
+}
+
+FILE *
+Connect(const char *host, const char *port)
+{
+    struct hostent *hp;
+    struct sockaddr_in sin;
+    char buf[512];
+    FILE *fp;
+    int one = 1;
+    int fd;
+
+    bzero(&sin, sizeof(sin));
+    if ((hp = gethostbyname(host)) == NULL) {
+	fprintf(stderr, "dartbench: unknown host %s\n", host);
+	exit(1);
+    }
+    bcopy(hp->h_addr, &sin.sin_addr, hp->h_length);
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(atoi(port));
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+    ) {
+	perror("dartbench: connect");
+	exit(1);
+    }
+    /* stdio splits larger articles, don't let Nagle hold the tail */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if ((fp = fdopen(fd, "r+")) == NULL) {
+	perror("dartbench: fdopen");
+	exit(1);
+    }
+    if (Response(fp, buf, sizeof(buf)) / 100 != 2) {
+	fprintf(stderr, "dartbench: unexpected greeting: %s", buf);
+	exit(2);
+    }
+    return(fp);
+}
+
+/*
+ * Flush what we sent and read one response line, returning its code
+ */
+
+int
+Response(FILE *fp, char *buf, int len)
+{
+    fflush(fp);
+    if (fgets(buf, len, fp) == NULL) {
+	fprintf(stderr, "dartbench: connection closed by server\n");
+	exit(2);
+    }
+    return(atoi(buf));
+}
+
+/*
+ * Generate() - offer count articles of roughly ArtSize bytes.  Some body
+ *		lines start with a '.' so that the dot-escaping paths
+ *		get exercised too.
+ */
+
+void
+Generate(const char *host, const char *port, int count)
+{
+    FILE *fp = Connect(host, port);
+    FILE *ids;
+    struct timeval tv;
+    char buf[512];
+    long stamp = time(NULL);
+    int accepted = 0;
+    int rejected = 0;
+    int i;
+
+    if ((ids = fopen(IdFile, "a")) == NULL) {
+	perror(IdFile);
+	exit(1);
+    }
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < count; ++i) {
+	char msgid[128];
+	char date[64];
+	time_t t = time(NULL);
+	int size = ArtSize / 2 + random() % (ArtSize + 1);
+	int n;
+
+	snprintf(msgid, sizeof(msgid), "<%ld.%d.%d@dartbench.invalid>",
+						stamp, (int)getpid(), i);
+	fprintf(fp, "IHAVE %s\r\n", msgid);
+	if (Response(fp, buf, sizeof(buf)) != 335) {
+	    if (VerboseOpt)
+		printf("%s: %s", msgid, buf);
+	    ++rejected;
+	    continue;
+	}
+	fprintf(fp, "Path: dartbench!not-for-mail\r\n");
+	fprintf(fp, "From: dartbench <dartbench@dartbench.invalid>\r\n");
+	fprintf(fp, "Newsgroups: %s\r\n", Group);
+	fprintf(fp, "Subject: dartbench article %d\r\n", i);
+	strftime(date, sizeof(date), "%d %b %Y %H:%M:%S GMT", gmtime(&t));
+	fprintf(fp, "Date: %s\r\n", date);
+	fprintf(fp, "Message-ID: %s\r\n", msgid);
+	fprintf(fp, "\r\n");
+	for (n = 0; n < size; n += 74) {
+	    int j;
+
+	    if (random() % 16 == 0)
+		fputs("..", fp);
+	    for (j = 0; j < 72; ++j)
+		fputc('a' + (n + j) % 26, fp);
+	    fputs("\r\n", fp);
+	}
+	fprintf(fp, ".\r\n");
+	if (Response(fp, buf, sizeof(buf)) == 235) {
+	    fprintf(ids, "%s\n", msgid);
+	    ++accepted;
+	} else {
+	    if (VerboseOpt)
+		printf("%s: %s", msgid, buf);
+	    ++rejected;
+	}
+    }
+    fprintf(fp, "QUIT\r\n");
+    fflush(fp);
+    fclose(fp);
+    fclose(ids);
+    printf("Articles    : %d accepted, %d rejected in %.2fs\n",
+				accepted, rejected, Elapsed(&tv));
+}
+
+/*
+ * Fetch() - load the message-ids and run count ARTICLE requests, split
+ *	     over Conns forked connections.  Each child sends its
+ *	     latencies back over a pipe.
+ */
+
+void
+Fetch(const char *host, const char *port, int count)
+{
+    FILE *ids;
+    char buf[512];
+    int *pipes;
+    double *lat;
+    double total = 0.0;
+    struct timeval tv;
+    int nlat = 0;
+    int misses = 0;
+    int i;
+
+    if ((ids = fopen(IdFile, "r")) == NULL) {
+	perror(IdFile);
+	exit(1);
+    }
+    while (fgets(buf, sizeof(buf), ids) != NULL) {
+	char *ptr;
+
+	if ((ptr = strchr(buf, '\n')) != NULL)
+	    *ptr = 0;
+	if (buf[0] != '<')
+	    continue;
+	MsgIds = realloc(MsgIds, (NumMsgIds + 1) * sizeof(char *));
+	MsgIds[NumMsgIds++] = strdup(buf);
+    }
+    fclose(ids);
+    if (NumMsgIds == 0) {
+	fprintf(stderr, "dartbench: no message-ids in %s\n", IdFile);
+	exit(1);
+    }
+
+    pipes = malloc(Conns * sizeof(int));
+    lat = malloc(count * sizeof(double));
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < Conns; ++i) {
+	int fds[2];
+	int n = count / Conns + (i < count % Conns);
+
+	if (pipe(fds) < 0) {
+	    perror("dartbench: pipe");
+	    exit(1);
+	}
+	if (fork() == 0) {
+	    double *l;
+	    int m = 0;
+
+	    close(fds[0]);
+	    srandom(getpid() ^ time(NULL));
+	    l = FetchLoop(host, port, n, &m);
+	    write(fds[1], &m, sizeof(m));
+	    write(fds[1], l, n * sizeof(double));
+	    _exit(0);
+	}
+	close(fds[1]);
+	pipes[i] = fds[0];
+    }
+    for (i = 0; i < Conns; ++i) {
+	int n = count / Conns + (i < count % Conns);
+	int m = 0;
+	int r;
+
+	read(pipes[i], &m, sizeof(m));
+	misses += m;
+	while (n > 0 && (r = read(pipes[i], (char *)(lat + nlat), n * sizeof(double))) > 0) {
+	    nlat += r / sizeof(double);
+	    n -= r / sizeof(double);
+	}
+	close(pipes[i]);
+    }
+    while (wait(NULL) > 0)
+	;
+
+    if (nlat == 0) {
+	fprintf(stderr, "dartbench: no results\n");
+	exit(1);
+    }
+    for (i = 0; i < nlat; ++i)
+	total += lat[i];
+    qsort(lat, nlat, sizeof(double), CmpDouble);
+    printf("Requests    : %d over %d connection%s, %d not found, %.0f/s\n",
+	nlat, Conns, (Conns == 1) ? "" : "s", misses, nlat / Elapsed(&tv));
+    printf("ARTICLE     : avg %.3fms  p50 %.3fms  p99 %.3fms  max %.3fms\n",
+	total / nlat,
+	lat[nlat / 2],
+	lat[(int)(nlat * 0.99)],
+	lat[nlat - 1]
+    );
+}
+
+double *
+FetchLoop(const char *host, const char *port, int count, int *misses)
+{
+    FILE *fp = Connect(host, port);
+    double *lat = malloc(count * sizeof(double));
+    char buf[8192];
+    int i;
+
+    fprintf(fp, "MODE READER\r\n");
+    Response(fp, buf, sizeof(buf));
+
+    for (i = 0; i < count; ++i) {
+	struct timeval tv;
+	const char *msgid = MsgIds[random() % NumMsgIds];
+
+	gettimeofday(&tv, NULL);
+	fprintf(fp, "ARTICLE %s\r\n", msgid);
+	if (Response(fp, buf, sizeof(buf)) == 220) {
+	    int bol = 1;
+
+	    while (fgets(buf, sizeof(buf), fp) != NULL) {
+		int l = strlen(buf);
+
+		if (bol && strcmp(buf, ".\r\n") == 0)
+		    break;
+		bol = (l > 0 && buf[l-1] == '\n');
+	    }
+	} else {
+	    if (VerboseOpt)
+		printf("%s: %s", msgid, buf);
+	    ++*misses;
+	}
+	lat[i] = Elapsed(&tv) * 1000.0;
+    }
+    fprintf(fp, "QUIT\r\n");
+    fflush(fp);
+    fclose(fp);
+    return(lat);
+}
+
+int
+CmpDouble(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return((da < db) ? -1 : (da > db) ? 1 : 0);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
@@ -0,0 +1,228 @@
+/*
+ * DCHURNBENCH.C - incoming feed connection churn benchmark
+ *
+ *	Runs count short sessions against a diablo server: connect, wait
+ *	for the greeting, CHECK one message-id and QUIT.  The sessions
+ *	are split over one or more parallel clients.  Reports sessions
+ *	per second and the time from connect() to the greeting, which
+ *	is where diablo forks (or picks a pre-forked child), loads
+ *	dnewsfeeds and opens the history.  Run it against a diablo with
+ *	and without 'feederprefork' to compare.
+ */
+
+#include "defs.h"
+
+#define	COUNT	1000
+
+void Usage(void);
+double *SessionLoop(const char *host, const char *port, int count, int *fails);
+int Session(struct sockaddr_in *sin, int n, double *lat);
+int CmpDouble(const void *a, const void *b);
+double Elapsed(struct timeval *tv);
+
+int Conns = 1;
+int VerboseOpt = 0;
+
+void
+Usage(void)
+{
+    fprintf(stderr, "A diablo connection churn benchmark\n\n");
+    fprintf(stderr, "Usage: dchurnbench [-c conns] [-n count] [-p port] [-v] host\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-c\tnumber of parallel clients (default: 1)\n");
+    fprintf(stderr, "\t-n\tnumber of sessions (default: %d)\n", COUNT);
+    fprintf(stderr, "\t-p\tremote port (default: 119)\n");
+    fprintf(stderr, "\t-v\tbe more verbose\n");
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char *host = NULL;
+    char *port = "119";
+    int count = COUNT;
+    int *pipes;
+    double *lat;
+    double total = 0.0;
+    struct timeval tv;
+    int nlat = 0;
+    int fails = 0;
+    int i;
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr == '-') {
+	    ptr += 2;
+	    switch(ptr[-1]) {
+	    case 'c':
+		Conns = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'n':
+		count = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'p':
+		port = (*ptr) ? ptr : av[++i];
+		break;
+	    case 'v':
+		VerboseOpt = 1;
+		break;
+	    default:
+		Usage();
+	    }
+	} else {
+	    host = ptr;
+	}
+    }
+    if (host == NULL || count <= 0 || Conns <= 0 || Conns > count)
+	Usage();
+
+    /*
+     * Each client sends its failure count and latencies back over a pipe
+     */
+
+    pipes = malloc(Conns * sizeof(int));
+    lat = malloc(count * sizeof(double));
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < Conns; ++i) {
+	int fds[2];
+	int n = count / Conns + (i < count % Conns);
+
+	if (pipe(fds) < 0) {
+	    perror("dchurnbench: pipe");
+	    exit(1);
+	}
+	if (fork() == 0) {
+	    double *l;
+	    int f = 0;
+
+	    close(fds[0]);
+	    l = SessionLoop(host, port, n, &f);
+	    write(fds[1], &f, sizeof(f));
+	    write(fds[1], l, (n - f) * sizeof(double));
+	    _exit(0);
+	}
+	close(fds[1]);
+	pipes[i] = fds[0];
+    }
+    for (i = 0; i < Conns; ++i) {
+	int f = 0;
+	int r;
+
+	read(pipes[i], &f, sizeof(f));
+	fails += f;
+	while ((r = read(pipes[i], (char *)(lat + nlat), (count - nlat) * sizeof(double))) > 0)
+	    nlat += r / sizeof(double);
+	close(pipes[i]);
+    }
+    while (wait(NULL) > 0)
+	;
+
+    if (nlat == 0) {
+	fprintf(stderr, "dchurnbench: no sessions completed\n");
+	exit(1);
+    }
+    for (i = 0; i < nlat; ++i)
+	total += lat[i];
+    qsort(lat, nlat, sizeof(double), CmpDouble);
+    printf("Sessions    : %d over %d client%s, %d failed, %.0f/s\n",
+	nlat, Conns, (Conns == 1) ? "" : "s", fails, nlat / Elapsed(&tv));
+    printf("Greeting    : avg %.3fms  p50 %.3fms  p99 %.3fms  max %.3fms\n",
+	total / nlat,
+	lat[nlat / 2],
+	lat[(int)(nlat * 0.99)],
+	lat[nlat - 1]
+    );
+    return(0);
+}
+
+/*
+ * SessionLoop() - run count sessions one after the other, returning
+ *		   the greeting latencies of the ones that worked
+ */
+
+double *
+SessionLoop(const char *host, const char *port, int count, int *fails)
+{
+    struct hostent *hp;
+    struct sockaddr_in sin;
+    double *lat = malloc(count * sizeof(double));
+    int n = 0;
+    int i;
+
+    bzero(&sin, sizeof(sin));
+    if ((hp = gethostbyname(host)) == NULL) {
+	fprintf(stderr, "dchurnbench: unknown host %s\n", host);
+	_exit(1);
+    }
+    bcopy(hp->h_addr, &sin.sin_addr, hp->h_length);
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(atoi(port));
+
+    for (i = 0; i < count; ++i) {
+	if (Session(&sin, i, &lat[n]) == 0)
+	    ++n;
+	else
+	    ++*fails;
+    }
+    return(lat);
+}
+
+int
+Session(struct sockaddr_in *sin, int n, double *lat)
+{
+    struct timeval tv;
+    char buf[512];
+    FILE *fp;
+    int fd;
+
+    gettimeofday(&tv, NULL);
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	connect(fd, (struct sockaddr *)sin, sizeof(*sin)) < 0
+    ) {
+	if (VerboseOpt)
+	    perror("dchurnbench: connect");
+	if (fd >= 0)
+	    close(fd);
+	return(-1);
+    }
+    if ((fp = fdopen(fd, "r+")) == NULL) {
+	close(fd);
+	return(-1);
+    }
+    if (fgets(buf, sizeof(buf), fp) == NULL || buf[0] != '2') {
+	if (VerboseOpt)
+	    printf("greeting: %s", (feof(fp)) ? "connection closed\n" : buf);
+	fclose(fp);
+	return(-1);
+    }
+    *lat = Elapsed(&tv) * 1000.0;
+
+    fprintf(fp, "CHECK <%d.%d@dchurnbench.invalid>\r\n", (int)getpid(), n);
+    fflush(fp);
+    fgets(buf, sizeof(buf), fp);
+    fprintf(fp, "QUIT\r\n");
+    fflush(fp);
+    fgets(buf, sizeof(buf), fp);
+    fclose(fp);
+    return(0);
+}
+
+int
+CmpDouble(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return((da < db) ? -1 : (da > db) ? 1 : 0);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
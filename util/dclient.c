@@ -28,6 +28,10 @@
 /*
  * Program to connect to a news server and execute commands and optionally
  * report on the performance handling the commands
+ *
+ * With -i and -r it doubles as a connection scaling benchmark: hold N
+ * idle connections open, then time repeated round trips of a command on
+ * one active connection.
 */
 
 #include "defs.h"
@@ -49,12 +53,15 @@ int highmark;
 
 void
 usage(char *progname) {
-    printf("Usage: %s [-f filename] [-p port] [-v] hostname [command]\n\n", progname);
+    printf("Usage: %s [-f filename] [-i idle] [-p port] [-r repeat] [-v] hostname [command]\n\n", progname);
     printf(" Execute a command on an NNTP server and write output to stdout\n");
     printf(" If no command is specified then read commands from STDIN\n\n");
     printf("\t-f file = read NNTP commands from a file and send them to server\n");
+    printf("\t-i idle = hold idle connections open while running the command\n");
     printf("\t-v      = be more verbose in output\n");
     printf("\t-p port = specify the remote port (default: 119)\n");
+    printf("\t-r n    = time n round trips of command (default: DATE) and\n");
+    printf("\t          report the latency instead of the output\n");
     exit(1);
 }
 
@@ -167,6 +174,92 @@ newsquit(void) {
     }
 }
 
+/*
+ * Open idle connections to the server and leave them there.  Each one
+ * has been handed to a reader thread once its greeting arrives.
+ */
+
+void
+openidle(char *hostname, char *port, int idle)
+{
+    struct rlimit rlp;
+    int i;
+
+    if (getrlimit(RLIMIT_NOFILE, &rlp) == 0 &&
+	rlp.rlim_cur < (rlim_t)idle + 16 && rlp.rlim_cur < rlp.rlim_max) {
+	rlp.rlim_cur = ((rlim_t)idle + 16 < rlp.rlim_max) ? (rlim_t)idle + 16 : rlp.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rlp);
+    }
+    for (i = 0; i < idle; ++i)
+	connectnews(hostname, port);
+    if (verbose)
+	printf("Idle connections: %d\n", idle);
+}
+
+int
+cmpdouble(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return((da < db) ? -1 : (da > db) ? 1 : 0);
+}
+
+/*
+ * Time repeat round trips of a command.  Multi-line responses are read
+ * through to the terminating '.'.
+ */
+
+void
+benchcommand(char *command, int repeat)
+{
+    char line[MAXLINE];
+    double *lat;
+    double total = 0.0;
+    int i;
+
+    if ((lat = malloc(sizeof(double) * repeat)) == NULL) {
+	perror("malloc");
+	exit(1);
+    }
+    for (i = 0; i < repeat; ++i) {
+	struct timeval t1;
+	struct timeval t2;
+	int code;
+
+	gettimeofday(&t1, NULL);
+	fflush(fp);
+	fprintf(fp, "%s\r\n", command);
+	rewind(fp);
+	if (fgets(line, MAXLINE, fp) == NULL) {
+	    printf("Connection closed by server\n");
+	    exit(2);
+	}
+	code = atoi(line);
+	if (code == 100 || code == 101 || (code >= 215 && code <= 231) ||
+	    code == 282
+	) {
+	    while (fgets(line, MAXLINE, fp) != NULL) {
+		if (strncmp(line, ".\r\n", 3) == 0)
+		    break;
+	    }
+	}
+	gettimeofday(&t2, NULL);
+	lat[i] = ((t2.tv_sec - t1.tv_sec) * 1000000.0 +
+					(t2.tv_usec - t1.tv_usec)) / 1000.0;
+	total += lat[i];
+    }
+    qsort(lat, repeat, sizeof(double), cmpdouble);
+    printf("Requests: %d  avg: %.3fms  p50: %.3fms  p99: %.3fms  max: %.3fms\n",
+	repeat,
+	total / repeat,
+	lat[repeat / 2],
+	lat[(int)(repeat * 0.99)],
+	lat[repeat - 1]
+    );
+    free(lat);
+}
+
 int
 main(int argc, char **argv) {
     extern char *optarg;
@@ -176,15 +269,23 @@ main(int argc, char **argv) {
     char *port = "119";
     char *command;
     char *dumpfile = NULL;
+    int idle = 0;
+    int repeat = 0;
 
     progname = *argv;
 
     optind = 1;
-    while ((ch = getopt(argc, argv, "f:p:Vv")) != -1) {
+    while ((ch = getopt(argc, argv, "f:i:p:r:Vv")) != -1) {
 	switch(ch) {
 	    case 'f':
 		dumpfile = optarg;
 		break;
+	    case 'i':
+		idle = strtol(optarg, NULL, 0);
+		break;
+	    case 'r':
+		repeat = strtol(optarg, NULL, 0);
+		break;
 	    case 'p':
 		port  = optarg;
 		break;
@@ -208,11 +309,16 @@ main(int argc, char **argv) {
     else
 	command = NULL;
 
+    if (idle > 0)
+	openidle(hostname, port, idle);
+
     connectnews(hostname, port);
     gettimeofday(&connectend, NULL);
 
     gettimeofday(&commandstart, NULL);
-    if (dumpfile != NULL)
+    if (repeat > 0)
+	benchcommand((command != NULL) ? command : "DATE", repeat);
+    else if (dumpfile != NULL)
 	dodumpfile(dumpfile);
     else
 	newscommand(command);
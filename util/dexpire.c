@@ -14,6 +14,14 @@
  *
  * Modification by Nickolai Zeldovich to store msgid hashes when
  * expiring articles to allow for better overview expiration.
+ *
+ * Specifying the -pN option forks N processes to find the size of the
+ * spool directories (for dirsize and maxsize spools) and again to
+ * update the history file.  Each history process takes a contiguous
+ * range of entries, reads it HIST_CHUNK bytes at a time, marks the
+ * entries it expires in a bitmap of the chunk and writes each run of
+ * expired entries back with a single write, instead of seeking and
+ * writing the exp field of every entry.
  */
 
 #include "defs.h"
@@ -80,6 +88,7 @@ typedef struct Partition {
     long		keeptime; 	/* How long to keep articles */
     int			expmethod; 	/* Sync or dirsize expire method */
     struct FileSystem	*filesys;	/* Which filesys does this lie on */
+    struct Partition	*parent;	/* P.* containing this N.* */
     struct Partition	*next;
 } Partition;
 
@@ -97,6 +106,25 @@ typedef struct SpoolEnt {
     uint8		removed;	/* Has it been removed */
 } SpoolEnt;
 
+/*
+ * Per process history update counters, in memory shared with the
+ * -p forks
+ */
+
+typedef struct HistStats {
+    off_t		hs_Scanned;	/* entries looked at */
+    off_t		hs_Expired;	/* entries (un)expired */
+    off_t		hs_Writes;	/* history writes */
+    off_t		hs_TestSpool;	/* -t counters */
+    off_t		hs_TestHistory;
+    off_t		hs_TestExpired;
+    off_t		hs_TestValid;
+} HistStats;
+
+#define	MAX_PAR_COUNT	64
+#define	HIST_CHUNK	(4 * 1024 * 1024)	/* history read per pread() */
+#define	HASH_BUF	512			/* -o hashes per write() */
+
 struct FileSystem *FileSystems = NULL;
 struct Partition *Partitions = NULL;
 struct SpoolEnt **SpoolEntries;
@@ -126,6 +154,14 @@ int WriteHashesToFileOpt = 0;
 const char *HistoryFile = NULL;
 off_t HistoryEnd;
 int HistoryFd = -1;
+int ParallelCount = 0;
+int ParallelPid[MAX_PAR_COUNT];
+double *DirSizes;		/* shared, indexed like SpoolEntries */
+HistStats *HStats;		/* shared, one per process */
+off_t HistEntOff;		/* offset of the first history entry */
+off_t HistEntries;		/* number of entries to scan */
+off_t HistPerProc;		/* entries per process, a multiple of a chunk */
+int HistLastPerc;
 
 int CleanAllSpools(void);
 int spoolEntSort(const void *s1, const void *s2);
@@ -133,9 +169,16 @@ void addFreeSpaceTarget(char *which);
 int cleanupDirectories(void);
 long removeDirectory(char *partname, char *dirname, int *count, int *ccount, double *size);
 void scanDirectory(Partition *scanpart);
+int findSizes(void);
+void sizeWorker(int idx);
 double findSize(char *pathname, char *dirname);
 void printPartition(Partition *p);
 int updateHistory(void);
+void histWorker(int idx);
+void histProgress(void);
+int runWorkers(void (*func)(int idx), void (*progress)(void));
+void *sharedAlloc(size_t bytes);
+double phaseTime(const char *phase, struct timeval *tv);
 int findNode(const char *path, int createMe);
 void freeNodes(void);
 void dumpNodeTable(void);
@@ -148,7 +191,7 @@ void
 Usage(void)
 {
 	printf("This program performs an expire run on a diablo spool\n");
-	printf("dexpire -a|n [-c0] [-f historyfile] [-h0|1] [-k] [-O nn] [-o] [-q] [-R s:n] [-S nn] [-s[n[:i]]] [-u] [-v] [-z] [-C diablo.config] [-d[n]] [-V]\n");
+	printf("dexpire -a|n [-c0] [-f historyfile] [-h0|1] [-k] [-O nn] [-o] [-p nn] [-q] [-R s:n] [-S nn] [-s[n[:i]]] [-u] [-v] [-z] [-C diablo.config] [-d[n]] [-V]\n");
 	printf("\t-a\tactually make changes (nothing is done without this option)\n");
 	printf("\t-c0\tdon't perform file removal pass\n");
 	printf("\t-f\tspecify the history file to use\n");
@@ -158,6 +201,7 @@ Usage(void)
 	printf("\t-n\trun through process, but don't make any changes\n");
 	printf("\t-O\tset number of dexpire iterations before exit\n");
 	printf("\t-o\twrite ID hashes to a file\n");
+	printf("\t-p\tuse nn processes to size directories and update history\n");
 	printf("\t-q\tbe relatively quiet\n");
 	printf("\t-R\tset a freespacetarget for a spool (spoolnum:target)\n");
 	printf("\t-S\tonly expire the specified spool number\n");
@@ -218,6 +262,11 @@ main(int ac, char **av)
 	    case 'o':
 		WriteHashesToFileOpt = 1;
 		break;
+	    case 'p':
+		ParallelCount = strtol((*ptr ? ptr : av[++n]), NULL, 0);
+		if (ParallelCount > MAX_PAR_COUNT)
+		    ParallelCount = MAX_PAR_COUNT;
+		break;
 	    case 'q':
 		VerboseOpt = 0;
 		break;
@@ -303,6 +352,8 @@ main(int ac, char **av)
     count = 1;
     if (HistoryFile == NULL)
 	HistoryFile = strdup(PatDbExpand(DHistoryPat));
+    if (ParallelCount > 1)
+	setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
     TimeNow = time(NULL);
     while (!allOk) {
 	if (VerboseOpt)
@@ -321,6 +372,7 @@ CleanAllSpools(void)
 {
     int n;
     int allOk = 1;
+    struct timeval tv;
 
     UpdateHistory = (HistoryUpdateOpt > 0);
     FileSystems = NULL;
@@ -367,6 +419,7 @@ CleanAllSpools(void)
     /*
      * Scan through each of the spool objects
      */
+    gettimeofday(&tv, NULL);
     if (!UnexpireOpt) {
 	int i;
 	uint16 spoolnum;
@@ -402,6 +455,7 @@ CleanAllSpools(void)
 		    p->expmethod = expmethod;
 		p->spaceok = 0;
 		p->filesys = findFileSys(p->partname);
+		p->parent = NULL;
 		p->next = Partitions;
 		Partitions = p;
 		if (FreeSpaceTargetList[spoolnum] > 0.0)
@@ -409,6 +463,9 @@ CleanAllSpools(void)
 		scanDirectory(p);
 	    }
 	}
+	phaseTime("spool scan", &tv);
+	if (findSizes())
+	    phaseTime("directory sizes", &tv);
     }
 
     if (chdir(PatExpand(SpoolHomePat)) != 0) {
@@ -424,8 +481,10 @@ CleanAllSpools(void)
 
     if (entryIdx) {
 	qsort(SpoolEntries, entryIdx, sizeof(SpoolEnt *), spoolEntSort);
-	if (DoCleanup)
+	if (DoCleanup) {
 	    allOk = cleanupDirectories();
+	    phaseTime("directory removal", &tv);
+	}
     }
 
     /*
@@ -441,6 +500,7 @@ CleanAllSpools(void)
 	int n;
 	printf("DExpire updating history file\n");
 	n = updateHistory();
+	phaseTime("history update", &tv);
 	printf("DExpire history file update complete, %d articles %smarked %sexpired\n",
 					n,
 					NotForReal ? "would be " : "",
@@ -815,10 +875,10 @@ scanDirectory(Partition *scanpart)
 		    p->minfreefiles = scanpart->minfreefiles;
 		    p->filesys = findFileSys(p->partname);
 		    p->expmethod = scanpart->expmethod;
+		    p->parent = scanpart;
 		    p->next = scanpart->next;
 		    scanpart->next = p;
 		    scanDirectory(p);
-		    scanpart->partsize += p->partsize;
 		    if (p->age > scanpart->age)
 			scanpart->age = p->age;
 		    break;
@@ -850,11 +910,9 @@ scanDirectory(Partition *scanpart)
 		SpoolEntries[entryIdx]->dirsize = 0.0;
 		SpoolEntries[entryIdx]->dirname = strdup(den->d_name);
 
-		if (scanpart->expmethod == EXM_DIRSIZE || scanpart->maxsize) {
-		    SpoolEntries[entryIdx]->dirsize =
-				findSize(scanpart->partname, den->d_name);
-		    scanpart->partsize += SpoolEntries[entryIdx]->dirsize;
-		}
+		/*
+		 * The size of the directory is found later by findSizes()
+		 */
 		{
 		    time_t t;
 		    t = getAge(den->d_name);
@@ -862,12 +920,10 @@ scanDirectory(Partition *scanpart)
 			scanpart->age = TimeNow - t;
 		}
 		if (DebugOpt > 2)
-		    printf("ADD DIR %s%s dirsize=%s age=%u partsize=%s\n",
+		    printf("ADD DIR %s%s age=%u\n",
 				scanpart->partname,
 				den->d_name,
-				ftos(SpoolEntries[entryIdx]->dirsize),
-				(int)scanpart->age,
-				ftos(scanpart->partsize));
+				(int)scanpart->age);
 		++entryIdx;
 		break;
 	    case 'P':
@@ -883,6 +939,63 @@ scanDirectory(Partition *scanpart)
     closedir(dir);
 }
 
+/*
+ * findSizes() - find the size of the spool directories on dirsize and
+ *		 maxsize spools and add them to their partition and the
+ *		 partitions containing it.  With -p the directories are
+ *		 shared out between the forks.  Returns 0 if there was
+ *		 nothing to size.
+ */
+
+int
+findSizes(void)
+{
+    int i;
+
+    for (i = 0; i < entryIdx; ++i) {
+	Partition *p = SpoolEntries[i]->partn;
+
+	if (p->expmethod == EXM_DIRSIZE || p->maxsize)
+	    break;
+    }
+    if (i == entryIdx)
+	return(0);
+
+    DirSizes = sharedAlloc(entryIdx * sizeof(double));
+    if (runWorkers(sizeWorker, NULL) != 0)
+	fprintf(stderr, "dexpire: directory size scan failed, sizes may be low\n");
+
+    for (i = 0; i < entryIdx; ++i) {
+	Partition *p;
+
+	SpoolEntries[i]->dirsize = DirSizes[i];
+	for (p = SpoolEntries[i]->partn; p != NULL; p = p->parent)
+	    p->partsize += DirSizes[i];
+	if (DebugOpt > 2 && DirSizes[i] > 0.0)
+	    printf("DIR SIZE %s%s dirsize=%s partsize=%s\n",
+				SpoolEntries[i]->partn->partname,
+				SpoolEntries[i]->dirname,
+				ftos(DirSizes[i]),
+				ftos(SpoolEntries[i]->partn->partsize));
+    }
+    xunmap(DirSizes, entryIdx * sizeof(double));
+    DirSizes = NULL;
+    return(1);
+}
+
+void
+sizeWorker(int idx)
+{
+    int i;
+
+    for (i = idx; i < entryIdx; i += (ParallelCount > 1) ? ParallelCount : 1) {
+	Partition *p = SpoolEntries[i]->partn;
+
+	if (p->expmethod == EXM_DIRSIZE || p->maxsize)
+	    DirSizes[i] = findSize(p->partname, SpoolEntries[i]->dirname);
+    }
+}
+
 /*
  * Find the size of a spool directory (in MB)
  */
@@ -919,35 +1032,15 @@ findSize(char *pathname, char *dirname)
 int
 updateHistory(void)
 {
-    uint32 countExp = 0;
-    uint32 numEnt = 0;
-    off_t countEnt = 0;
-    off_t countTestSpool = 0;
-    off_t countTestHistory = 0;
-    off_t countTestExpired = 0;
-    off_t countTestValid = 0;
-    int lastPerc = 0;
-    FILE *DExpOverList = NULL;
+    HistHead hh;
+    HistStats tot;
     char path[PATH_MAX];
     int i;
+    int n;
     char spoolHome[512];
     int spoolHomeLen;
-    off_t npos = -1;
-    off_t bpos = -1;
-    History *h;
-
-    /*
-     * Write expired article msgid hashes to a file if requested.
-     */
-
-    if (WriteHashesToFileOpt == 1) {
-	const char *filename = PatDbExpand(DExpireOverListPat);
-
-	DExpOverList = fopen(filename, "a");
-	if (DExpOverList == NULL)
-	    fprintf(stderr, "Error opening %s: %s\n", filename,
-						      strerror(errno));
-    }
+    off_t perChunk = HIST_CHUNK / sizeof(History);
+    int nproc = (ParallelCount > 1) ? ParallelCount : 1;
 
     /*
      * scan all directories in the spool.   Expire history records by
@@ -1001,170 +1094,397 @@ updateHistory(void)
      * where the end of the file is before the spool entry hash is built
      */
 
-    {
-	int n;
-	HistHead hh;
-	History hist[65536];
+    if ((n = pread(HistoryFd, &hh, sizeof(hh), 0)) != sizeof(hh)) {
+	if (n == -1)
+	    fprintf(stderr, "Unable to read history header from %s (%s)\n",
+					HistoryFile, strerror(errno));
+	else 
+	    fprintf(stderr, "Read %d bytes from history %s, expected %d\n",
+				n, HistoryFile, (int)sizeof(hh));
 
-	if ((n = read(HistoryFd, &hh, sizeof(hh))) != sizeof(hh)) {
-	    if (n == -1)
-		fprintf(stderr, "Unable to read history header from %s (%s)\n",
-						HistoryFile, strerror(errno));
-	    else 
-		fprintf(stderr, "Read %d bytes from history %s, expected %d\n",
-					n, HistoryFile, (int)sizeof(hh));
+	exit(1);
+    }
+    if (hh.hmagic != HMAGIC) {
+	fprintf(stderr, "corrupted history file or old version of history file: %x : %x\n", hh.hmagic, HMAGIC);
+	exit(1);
+    }
+    if (hh.version > HVERSION) {
+	fprintf(stderr, "wrong dhistory file version (%d), expected %d\n",
+	    hh.version,
+	    HVERSION
+	);
+	exit(1);
+    }
 
-	    exit(1);
-	}
-	if (hh.hmagic != HMAGIC) {
-	    fprintf(stderr, "corrupted history file or old version of history file: %x : %x\n", hh.hmagic, HMAGIC);
-	    exit(1);
-	}
-	if (hh.version > HVERSION) {
-	    fprintf(stderr, "wrong dhistory file version (%d), expected %d\n",
-		hh.version,
-		HVERSION
-	    );
-	    exit(1);
-	}
+    HistEntOff = hh.headSize + HIDXSIZE(hh.version) * (off_t)hh.hashSize;
+    HistEntries = 0;
+    if (HistoryEnd > HistEntOff)
+	HistEntries = (HistoryEnd - HistEntOff) / sizeof(History);
+    if (VerboseOpt) {
+	printf("History contains %lld entries ....\n", (long long)HistEntries);
+	fflush(stdout);
+    }
 
-	lseek(HistoryFd, hh.headSize + sizeof(HistIndex) * hh.hashSize, 0);
+    /*
+     * Each process gets a contiguous range of whole chunks
+     */
+    HistPerProc = (HistEntries + nproc - 1) / nproc;
+    HistPerProc = (HistPerProc + perChunk - 1) / perChunk * perChunk;
+    HistLastPerc = 0;
+
+    HStats = sharedAlloc(nproc * sizeof(HistStats));
+    if (runWorkers(histWorker, histProgress) != 0)
+	fprintf(stderr, "dexpire: history update did not complete\n");
+
+    bzero(&tot, sizeof(tot));
+    for (i = 0; i < nproc; ++i) {
+	tot.hs_Scanned += HStats[i].hs_Scanned;
+	tot.hs_Expired += HStats[i].hs_Expired;
+	tot.hs_Writes += HStats[i].hs_Writes;
+	tot.hs_TestSpool += HStats[i].hs_TestSpool;
+	tot.hs_TestHistory += HStats[i].hs_TestHistory;
+	tot.hs_TestExpired += HStats[i].hs_TestExpired;
+	tot.hs_TestValid += HStats[i].hs_TestValid;
+    }
+    xunmap(HStats, nproc * sizeof(HistStats));
+    HStats = NULL;
 
-	numEnt = (HistoryEnd -
-			(hh.headSize + sizeof(HistIndex) * hh.hashSize)) /
-					sizeof(History);
-	if (VerboseOpt) {
-	    printf("History contains %d entries ....\n", numEnt);
-	    fflush(stdout);
+    if (VerboseOpt && tot.hs_Writes)
+	printf("History entries updated with %lld writes\n",
+					(long long)tot.hs_Writes);
+
+    if (TestOpt) {
+	printf("Total entries scanned      : %12lld\n",
+				(long long)tot.hs_Scanned);
+	printf("Total !expired + on spool  : %12lld\n",
+				(long long)tot.hs_TestValid);
+	printf("Total expired + ! on spool : %12lld\n",
+				(long long)tot.hs_TestExpired);
+	printf("Total expired + on spool   : %12lld\n",
+				(long long)tot.hs_TestSpool);
+	printf("Total !expired + ! on spool: %12lld\n",
+				(long long)tot.hs_TestHistory);
+    }
+    return((int)tot.hs_Expired);
+}
+
+/*
+ * histWorker() - scan process idx's range of the history entries.  The
+ *		  entries to be changed in a chunk are marked in a bitmap
+ *		  and each run of them is written back in one go.  Only
+ *		  the entries we change are written, diablo may have
+ *		  changed (expired) others since we read them.
+ */
+
+void
+histWorker(int idx)
+{
+    HistStats *hs = &HStats[idx];
+    off_t perChunk = HIST_CHUNK / sizeof(History);
+    off_t first = (off_t)idx * HistPerProc;
+    off_t last = first + HistPerProc;
+    History *hist;
+    uint8 *bmap;
+    hash_t hashBuf[HASH_BUF];
+    int hashCount = 0;
+    int hashFd = -1;
+    char path[PATH_MAX];
+
+    if (last > HistEntries)
+	last = HistEntries;
+    if (first >= last)
+	return;
+
+    hist = malloc(perChunk * sizeof(History));
+    bmap = malloc((perChunk + 7) / 8);
+    if (hist == NULL || bmap == NULL) {
+	fprintf(stderr, "unable to malloc in history update\n");
+	exit(1);
+    }
+
+    /*
+     * Write expired article msgid hashes to a file if requested.
+     */
+
+    if (WriteHashesToFileOpt == 1) {
+	const char *filename = PatDbExpand(DExpireOverListPat);
+
+	hashFd = open(filename, O_WRONLY|O_APPEND|O_CREAT, 0644);
+	if (hashFd < 0)
+	    fprintf(stderr, "Error opening %s: %s\n", filename,
+						      strerror(errno));
+    }
+
+    while (first < last) {
+	off_t bpos = HistEntOff + first * sizeof(History);
+	int n = (last - first < perChunk) ? (int)(last - first) : (int)perChunk;
+	int changed = 0;
+	int r;
+	int i;
+
+	r = pread(HistoryFd, hist, n * sizeof(History), bpos);
+	if (r < (int)sizeof(History)) {
+	    fprintf(stderr, "Unable to read history at %lld (%s)\n",
+			(long long)bpos, (r < 0) ? strerror(errno) : "short read");
+	    exit(1);
 	}
+	n = r / sizeof(History);
+	bzero(bmap, (n + 7) / 8);
 
-	npos = lseek(HistoryFd, 0L, 1);
-	while ((n = read(HistoryFd, hist, sizeof(hist))) > 0) {
-	    int i;
-	    int changed = 0;
+	for (i = 0; i < n; ++i) {
+	    History *h = &hist[i];
 
-	    bpos = npos;
-	    npos += n;
-	    n /= sizeof(History);
+	    hs->hs_Scanned++;
+	    path[0] = 0;
 
-	    for (i = 0; i < n; ++i) {
-		/*
-		 * Don't scan beyond the stored history position
-		 */
-		if (bpos + i * sizeof(History) >= HistoryEnd)
-		    break;
+	    if (TestOpt) {
+		int res;
 
-		countEnt++;
-		if (VerboseOpt && numEnt > 0 &&
-				countEnt * 100 / numEnt >= lastPerc + 10) {
-		    lastPerc = countEnt * 100 / numEnt;
-		    printf("\t%-10lld of %-10d (%d%%) complete  %lld  %u   \n",
-					(long long)countEnt, numEnt, lastPerc,
-					(long long)bpos, countExp);
-		    fflush(stdout);
-		}
+		ArticleFileName(path, sizeof(path), h, ARTFILE_DIR_REL);
+		res = findNode(path, 0);
 
-		h = &hist[i];
-		path[0] = 0;
-
-		if (TestOpt) {
-		    int res;
-
-		    ArticleFileName(path, sizeof(path), h, ARTFILE_DIR_REL);
-		    res = findNode(path, 0);
-
-		    if (res == 0) {
-			if (H_EXPIRED(h->exp)) {
-			    countTestSpool++;
-			    printf("%08x.%08x expired @%lld (index=%lld) but on spool (%s)\n",
-				h->hv.h1, h->hv.h2,
-				(long long)(npos + i * sizeof(History)),
-				(long long)countEnt, path);
-			    findNode(path, 0);
-			} else {
-			    countTestValid++;
-			}
+		if (res == 0) {
+		    if (H_EXPIRED(h->exp)) {
+			hs->hs_TestSpool++;
+			printf("%08x.%08x expired @%lld (index=%lld) but on spool (%s)\n",
+			    h->hv.h1, h->hv.h2,
+			    (long long)(bpos + i * sizeof(History)),
+			    (long long)(first + i), path);
 		    } else {
-			if (H_EXPIRED(h->exp)) {
-			    countTestExpired++;
-			} else {
-			    countTestHistory++;
-			    printf("%08x.%08x not expired @%lld (index=%llu) and not on spool (%s)\n",
-				h->hv.h1, h->hv.h2,
-				(long long)(npos + i * sizeof(History)),
-				(long long)countEnt, path);
-			}
+			hs->hs_TestValid++;
+		    }
+		} else {
+		    if (H_EXPIRED(h->exp)) {
+			hs->hs_TestExpired++;
+		    } else {
+			hs->hs_TestHistory++;
+			printf("%08x.%08x not expired @%lld (index=%lld) and not on spool (%s)\n",
+			    h->hv.h1, h->hv.h2,
+			    (long long)(bpos + i * sizeof(History)),
+			    (long long)(first + i), path);
 		    }
-		    continue;
 		}
+		continue;
+	    }
 
-		/*
-		 * skip if the article has already expired or if it
-		 * is a new article that we may not have scanned, or
-		 * if it is an expansion slot.
-		 */
+	    /*
+	     * skip if the article has already expired or if it
+	     * is a new article that we may not have scanned, or
+	     * if it is an expansion slot.
+	     */
 
-		if (SinglePart != NULL && *SinglePart != H_SPOOL(h->exp))
-		    continue;
-		if (!UnexpireOpt && H_EXPIRED(h->exp))
-		    continue;
-		if (UnexpireOpt && !H_EXPIRED(h->exp))
-		    continue;
-		if (h->hv.h1 == 0 && h->hv.h2 == 0)
-		    continue;
-
-		if (!UnexpireOpt)
-		    ArticleFileName(path, sizeof(path), h, ARTFILE_DIR_REL);
-
-		if (UnexpireOpt || findNode(path, 0) < 0) {
-		    if (!UnexpireOpt && VerboseOpt > 1) {
-			printf("Unable to find path %s (%08x.%08x), %s history record\n",
-			    path,
-			    h->hv.h1, h->hv.h2,
-			    ((HistoryUpdateOpt != 2) ? "expiring" : "would expire")
-			);
-		    }
-		    if (UnexpireOpt || HistoryUpdateOpt != 2) {
-			changed = 1;
-			if (UnexpireOpt)
-			    h->exp &= ~EXPF_EXPIRED;
-			else
-			    h->exp |= EXPF_EXPIRED;
-			lseek(
-			    HistoryFd,
-			    bpos + sizeof(History) * i + offsetof(History, exp),
-			    0
-			);
-			if (!NotForReal)
-			    write(HistoryFd, &h->exp, sizeof(h->exp));
-
-			if (WriteHashesToFileOpt == 1)
-			    fwrite(&h->hv, sizeof(hash_t), 1, DExpOverList);
+	    if (SinglePart != NULL && *SinglePart != H_SPOOL(h->exp))
+		continue;
+	    if (!UnexpireOpt && H_EXPIRED(h->exp))
+		continue;
+	    if (UnexpireOpt && !H_EXPIRED(h->exp))
+		continue;
+	    if (h->hv.h1 == 0 && h->hv.h2 == 0)
+		continue;
+
+	    if (!UnexpireOpt)
+		ArticleFileName(path, sizeof(path), h, ARTFILE_DIR_REL);
+
+	    if (UnexpireOpt || findNode(path, 0) < 0) {
+		if (!UnexpireOpt && VerboseOpt > 1) {
+		    printf("Unable to find path %s (%08x.%08x), %s history record\n",
+			path,
+			h->hv.h1, h->hv.h2,
+			((HistoryUpdateOpt != 2) ? "expiring" : "would expire")
+		    );
+		}
+		if (UnexpireOpt || HistoryUpdateOpt != 2) {
+		    if (UnexpireOpt)
+			h->exp &= ~EXPF_EXPIRED;
+		    else
+			h->exp |= EXPF_EXPIRED;
+		    bmap[i >> 3] |= 1 << (i & 7);
+		    changed = 1;
+
+		    if (hashFd >= 0) {
+			hashBuf[hashCount++] = h->hv;
+			if (hashCount == HASH_BUF) {
+			    write(hashFd, hashBuf, hashCount * sizeof(hash_t));
+			    hashCount = 0;
+			}
 		    }
-		    ++countExp;
 		}
+		hs->hs_Expired++;
+	    }
+	}
+
+	/*
+	 * Write back each run of changed entries
+	 */
+	for (i = 0; changed && !NotForReal && i < n; ) {
+	    int j;
+
+	    if ((bmap[i >> 3] & (1 << (i & 7))) == 0) {
+		if (bmap[i >> 3] == 0)
+		    i = (i | 7) + 1;
+		else
+		    ++i;
+		continue;
 	    }
-	    if (changed)
-		lseek(HistoryFd, npos, 0);
+	    for (j = i + 1; j < n && (bmap[j >> 3] & (1 << (j & 7))); ++j)
+		;
+	    if (pwrite(HistoryFd, &hist[i], (j - i) * sizeof(History),
+			bpos + i * sizeof(History)) != (j - i) * sizeof(History)
+	    ) {
+		fprintf(stderr, "Unable to write history at %lld (%s)\n",
+			(long long)(bpos + i * sizeof(History)), strerror(errno));
+		exit(1);
+	    }
+	    hs->hs_Writes++;
+	    i = j;
 	}
+	first += n;
+	if (ParallelCount <= 1)
+	    histProgress();
     }
 
-    if (WriteHashesToFileOpt == 1)
-	fclose(DExpOverList);
+    if (hashFd >= 0) {
+	if (hashCount)
+	    write(hashFd, hashBuf, hashCount * sizeof(hash_t));
+	close(hashFd);
+    }
+    free(bmap);
+    free(hist);
+}
 
-    if (TestOpt) {
-	printf("Total entries scanned      : %12lld\n",
-				(long long)countEnt);
-	printf("Total !expired + on spool  : %12lld\n",
-				(long long)countTestValid);
-	printf("Total expired + ! on spool : %12lld\n",
-				(long long)countTestExpired);
-	printf("Total expired + on spool   : %12lld\n",
-				(long long)countTestSpool);
-	printf("Total !expired + ! on spool: %12lld\n",
-				(long long)countTestHistory);
+/*
+ * histProgress() - report every 10% of the history scanned
+ */
+
+void
+histProgress(void)
+{
+    off_t scanned = 0;
+    off_t expired = 0;
+    int perc;
+    int i;
+
+    if (!VerboseOpt || HistEntries == 0)
+	return;
+    for (i = 0; i < ((ParallelCount > 1) ? ParallelCount : 1); ++i) {
+	scanned += HStats[i].hs_Scanned;
+	expired += HStats[i].hs_Expired;
+    }
+    perc = scanned * 100 / HistEntries;
+    if (perc >= HistLastPerc + 10) {
+	HistLastPerc = perc;
+	printf("\t%-10lld of %-10lld (%d%%) complete  %lld\n",
+			(long long)scanned, (long long)HistEntries,
+			perc, (long long)expired);
+	fflush(stdout);
+    }
+}
+
+/*
+ * runWorkers() - call func(idx) in each of the -p forks and wait for
+ *		  them, calling progress every 100ms.  Without -p func(0)
+ *		  is called directly.  Returns -1 if a fork failed.
+ */
+
+int
+runWorkers(void (*func)(int idx), void (*progress)(void))
+{
+    int remaining = 0;
+    int failed = 0;
+    int i;
+
+    if (ParallelCount <= 1) {
+	func(0);
+	return(0);
     }
-    return(countExp);
+
+    fflush(stdout);
+    for (i = 0; i < ParallelCount; ++i) {
+	pid_t pid = fork();
+
+	if (pid == 0) {
+	    func(i);
+	    fflush(stdout);
+	    _exit(0);
+	}
+	if (pid < 0) {
+	    fprintf(stderr, "dexpire: fork failed (%s), doing part %d here\n",
+						strerror(errno), i);
+	    func(i);
+	    pid = 0;
+	} else {
+	    ++remaining;
+	}
+	ParallelPid[i] = pid;
+    }
+
+    while (remaining) {
+	pid_t pid;
+	int status;
+
+	while (remaining && (pid = wait3(&status, WNOHANG, NULL)) > 0) {
+	    for (i = 0; i < ParallelCount; ++i) {
+		if (ParallelPid[i] == pid) {
+		    ParallelPid[i] = 0;
+		    --remaining;
+		    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed = -1;
+		}
+	    }
+	}
+	if (remaining) {
+	    usleep(100000);
+	    if (progress)
+		progress();
+	}
+    }
+    if (progress)
+	progress();
+    return(failed);
+}
+
+/*
+ * sharedAlloc() - zeroed memory shared with the -p forks
+ */
+
+void *
+sharedAlloc(size_t bytes)
+{
+    char tmpPath[PATH_MAX];
+    void *ptr;
+    int fd;
+
+    snprintf(tmpPath, sizeof(tmpPath), "%s/.dexpire.XXXXXX", PatExpand(DbHomePat));
+    if ((fd = mkstemp(tmpPath)) < 0 ||
+	remove(tmpPath) < 0 ||
+	ftruncate(fd, bytes) < 0 ||
+	(ptr = xmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == NULL
+    ) {
+	fprintf(stderr, "Unable to set up shared memory in %s: %s\n",
+						tmpPath, strerror(errno));
+	exit(1);
+    }
+    close(fd);
+    bzero(ptr, bytes);
+    return(ptr);
+}
+
+/*
+ * phaseTime() - report the time since tv and reset it
+ */
+
+double
+phaseTime(const char *phase, struct timeval *tv)
+{
+    struct timeval t2;
+    double secs;
+
+    gettimeofday(&t2, NULL);
+    secs = (t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6;
+    *tv = t2;
+    if (VerboseOpt)
+	printf("DExpire %s: %.2fs\n", phase, secs);
+    return(secs);
 }
 
 typedef struct ENode {
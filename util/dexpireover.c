@@ -23,7 +23,21 @@
  *
  *	Specifying the -pN option will fork N dexpireover processes and
  *	perform the expiration process in parallel. This is useful to speed
- *	up ExpireBySpool where dhistory lookups take a long time.
+ *	up ExpireBySpool where dhistory lookups take a long time.  The group
+ *	directories are put on a work queue shared by the forks, and each
+ *	fork takes the next directory nobody has started on when it is done
+ *	with its last one, so a few big directories do not leave the other
+ *	forks idle.  -PN limits the number of forks working on directories
+ *	on the same device at any one time.  The master reports progress.
+ *	Every directory is still processed the way a single dexpireover
+ *	does it, over. files first, with the same locking.
+ *
+ *	With the -i option only the groups dreaderd has written to since the
+ *	last run (lib/dirtygrp.c, 'readerdirtyjournal on'), and a rotating
+ *	slice of the others, are expired.  Their files are found by name
+ *	rather than by reading the group directories, so a run is cheap
+ *	enough to be done every few minutes.  Full runs are still needed
+ *	now and then to remove files of deleted groups and junk files.
  *
  *	LOCKING INFO
  *
@@ -58,6 +72,7 @@ typedef struct Group {
     char	*gr_GroupName;
     char	*gr_Flags;
     char	*gr_Hash;
+    char	*gr_Dir;	/* directory, relative, for -i		*/
     int		gr_UpdateFlag;
 } Group;
 
@@ -83,10 +98,42 @@ typedef struct FileCacheList {
 #define DEXPOVER_READ_BUFFER_SIZE	4096
 #define DEXPOVER_HASH_SIZE		32768
 
-/* Since we only look at the first char of the first-level directory,
- * we do not support more than 16 forks.
+#define	MAX_PAR_COUNT			64
+
+/*
+ * Work queue of group directories shared by the -p forks.  If there are
+ * only a few top level directories their subdirectories are queued
+ * separately, and the top level directory for just its files (wd_Flat).
  */
-#define	MAX_PAR_COUNT			16
+
+#define	WQ_MINDIRS			256
+#define	WQ_MAXDEVS			32
+#define	WQ_REPORT			60	/* progress report interval */
+#define	INC_SLICE			96	/* default -i slice		*/
+
+typedef struct WorkDir {
+    char	wd_Path[128];		/* relative to GroupHomePat	*/
+    int		wd_Flat;		/* files only			*/
+    int		wd_Dev;			/* index into wq_Dev[]		*/
+    int		wd_State;		/* WD_* below			*/
+    pid_t	wd_Pid;			/* fork running it		*/
+    int		wd_Requeued;		/* a fork died running it	*/
+} WorkDir;
+
+#define	WD_QUEUED	0
+#define	WD_RUNNING	1
+#define	WD_DONE		2
+
+typedef struct WorkQueue {
+    int		wq_Count;
+    int		wq_Done;
+    int		wq_Running;
+    time_t	wq_Start;
+    int		wq_NumDevs;
+    dev_t	wq_Dev[WQ_MAXDEVS];
+    int		wq_DevRunning[WQ_MAXDEVS];
+    WorkDir	wq_Dir[1];		/* extended			*/
+} WorkQueue;
 
 /*
  * These aren't really buckets, they're parts of a bucket
@@ -101,10 +148,28 @@ typedef struct bucket_t {
 KPDB  *KDBActive;
 Group *GHash[GHSIZE];
 
+void BuildWorkQueue(void);
+void BuildIncrementalQueue(void);
+void MapWorkQueue(WorkDir *dirs, int count);
+int IncrementalGroup(const char *groupName);
+const char *IncrementalDir(const char *groupName, int iter);
+void SelectIncrementalGroups(void);
+void ExpireDirGroups(const char *dirname);
+void ProcessGroup(Group *group);
+int ProcessGroupFile(Group *group, int gftype, artno_t artBase);
+int ProcessGroupColumns(Group *group, artno_t artBase);
+void ConsumeDirtyGroups(void);
+int ClaimWorkDir(void);
+void DoneWorkDir(int i);
+void RequeueWorkDirs(pid_t pid);
+void ReportProgress(void);
 void ScanDirectories(void);
 void scanDirectory(const char *dirpath, char *dirname, int *level);
 void DeleteJunkFile(const char *dirPath, const char *name);
 void ProcessOverviewFile(const char *dirPath, const char *name, int type);
+int isColumnFile(const char *name);
+void CompressColumn(Group *group, const char *path, artno_t artBase, int dataEntries);
+int keepColumnEntry(const OverColEnt *ce, void *data);
 int getFirstArtAge(Group *group, int fd, OverHead *oh);
 char *allocTmpCopy(const char *buf, int bufLen);
 Group *EnterGroup(const char *groupName, artno_t begNo, artno_t endNo, int lmts, int cts, int iter, const char *flags);
@@ -134,6 +199,7 @@ int BadGroups = 0;
 int ResizedGroups = 0;
 int NoResizedGroups = 0;
 int GoodGroups = 0;
+int CompressedColumns = 0;
 int ActiveUpdated = 0;
 int VerboseOpt = -1;
 int ResizeOpt = -1;
@@ -150,6 +216,14 @@ char *Wild;
 bucket_t *dexpover_msgid_hash;
 int ParallelIdx = 0;
 int ParallelPid[MAX_PAR_COUNT];
+int ParallelPerDev = 0;
+WorkQueue *WQ;
+int WQFd = -1;
+int IncrementalOpt = 0;
+DirtyGroupSet DirtyGroups = { -1 };
+Group **IncGroups;
+int IncCount;
+char *DBFile;
 
 void
 sigInt(int sigNo)
@@ -172,16 +246,18 @@ sigAlarm(int sigNo)
 void Usage(char *progname)
 {
     fprintf(stderr, "Expire the reader header database\n");
-    fprintf(stderr, "dexpireover [-a] [-e] [-f active] [-l#] [-NB] [-n] [-O#] [-o] [-p#] [-R[R]] [-s] [-U] [-v#] [-w wildmat] [-x] [-y] [-C diablo.config] [-d[n]] [-V]\n");
+    fprintf(stderr, "dexpireover [-a] [-e] [-f active] [-i[#]] [-l#] [-NB] [-n] [-O#] [-o] [-p#] [-P#] [-R[R]] [-s] [-U] [-v#] [-w wildmat] [-x] [-y] [-C diablo.config] [-d[n]] [-V]\n");
     fprintf(stderr, "\t-a\t\tDo a standard header expire run (-NB -U -s -y)\n");
     fprintf(stderr, "\t-e\t\tExpire by checking a local spool\n");
     fprintf(stderr, "\t-f file\t\tSpecify the name of the active file\n");
+    fprintf(stderr, "\t-i[#]\t\tOnly expire dirty groups and 1 in # others\n");
     fprintf(stderr, "\t-l#\t\tWait N seconds for lock files\n");
     fprintf(stderr, "\t-NB\t\tUpdate the begining article number (NB) in active\n");
     fprintf(stderr, "\t-n\t\tDon't actually make any changes (dry run)\n");
     fprintf(stderr, "\t-O#\t\tRemove groups not used within # days\n");
     fprintf(stderr, "\t-o\t\tExpire from file of msgid hashes\n");
     fprintf(stderr, "\t-p#\t\tRun # parallel expire runs (speed up)\n");
+    fprintf(stderr, "\t-P#\t\tAt most # of them on one device at a time\n");
     fprintf(stderr, "\t-R\t\tRewrite header data files\n\t\t\t(-RR to rewrite and remove corrupted entries)\n");
     fprintf(stderr, "\t-s\t\tResize group indexes\n");
     fprintf(stderr, "\t-U\t\tAdd CTS (group create time) in active if not present\n");
@@ -199,7 +275,6 @@ int
 main(int ac, char **av)
 {
     int i;
-    char *dbfile = NULL;
 
     LoadDiabloConfig(ac, av);
 
@@ -221,7 +296,12 @@ main(int ac, char **av)
 	    UseExpireBySpool = 1;
 	    break;
 	case 'f':
-	    dbfile = (*ptr) ? ptr : av[++i];
+	    DBFile = (*ptr) ? ptr : av[++i];
+	    break;
+	case 'i':
+	    IncrementalOpt = (*ptr) ? strtol(ptr, NULL, 0) : INC_SLICE;
+	    if (IncrementalOpt < 1)
+		IncrementalOpt = 1;
 	    break;
 	case 'l':
 	    LockWaitTime = strtol((*ptr) ? ptr : av[++i], NULL, 0);
@@ -261,6 +341,9 @@ main(int ac, char **av)
 		ParallelCount = MAX_PAR_COUNT;
 	    /* Note that a parcount of 1 doesn't do anything useful. */
 	    break;
+	case 'P':
+	    ParallelPerDev = strtol((*ptr) ? ptr : av[++i], NULL, 0);
+	    break;
 	case 'R':
 	    RewriteDataOpt = 1;
 	    if (*ptr == 'R') {
@@ -313,6 +396,20 @@ main(int ac, char **av)
     if (UseExpireFromFile)
 	ReadDExpOverList();
 
+    /*
+     * Read the dirty group journal.  A full run uses it up as well.
+     */
+
+    if (DirtyGroupLoad(&DirtyGroups) == 0) {
+	if (IncrementalOpt)
+	    printf("Dirty group journal generation %u: %d groups in %d entries\n",
+		DirtyGroups.ds_Gen, DirtyGroups.ds_Count, DirtyGroups.ds_Entries);
+    } else if (IncrementalOpt) {
+	printf("No usable dirty group journal %s, doing a full run\n",
+					PatDbExpand(DExpireOverDirtyPat));
+	IncrementalOpt = 0;
+    }
+
     /*
      * fork off parallel copies of dexpireover at this point
      */
@@ -320,6 +417,12 @@ main(int ac, char **av)
     if (ParallelCount) {
 	char *stdout_buffer;
 
+	if (IncrementalOpt)
+	    BuildIncrementalQueue();
+	else
+	    BuildWorkQueue();
+	fflush(stdout);
+
 	for (ParallelIdx=0; ParallelIdx < ParallelCount; ParallelIdx++) {
 	    int pid;
 
@@ -335,19 +438,30 @@ main(int ac, char **av)
 	if (ParallelIdx == ParallelCount) {
 	    pid_t pid;
 	    int remaining = ParallelCount;
+	    int failed = 0;
+	    int status;
 
 	    while (remaining) {
-		while (remaining && ((pid = wait3(NULL, 0, NULL)) > 0)) {
+		while (remaining && ((pid = wait3(&status, WNOHANG, NULL)) > 0)) {
 		    for (i=0; i<ParallelCount; i++)
 			if(ParallelPid[i] == pid) {
 			    ParallelPid[i] = 0;
 			    --remaining;
+			    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				failed = 1;
+			    RequeueWorkDirs(pid);
 			}
 		}
+		if (remaining) {
+		    sleep(1);
+		    ReportProgress();
+		}
 	    }
 
 	    printf("Parallelizing dexpireover (%d forks) finished.\n",
 	       ParallelCount);
+	    if (failed == 0)
+		ConsumeDirtyGroups();
 	    exit(0);
 	}
     }
@@ -358,8 +472,8 @@ main(int ac, char **av)
 
     if (VerboseOpt)
 	printf("Loading active file\n");
-    if (dbfile) {
-	KDBActive = KPDBOpen(dbfile, O_RDWR);
+    if (DBFile) {
+	KDBActive = KPDBOpen(DBFile, O_RDWR);
     } else {
 	KDBActive = KPDBOpen(PatDbExpand(ReaderDActivePat), O_RDWR);
     }
@@ -445,6 +559,9 @@ main(int ac, char **av)
     rsignal(SIGTERM, sigInt);
     rsignal(SIGALRM, SIG_IGN);
 
+    if (IncrementalOpt)
+	SelectIncrementalGroups();
+
     /*
      * Scan /news/spool/group/ and do the actual expire, over resize
      * and data rewrite
@@ -452,6 +569,8 @@ main(int ac, char **av)
      */
 
     ScanDirectories();
+    if (ParallelCount == 0)
+	ConsumeDirtyGroups();
 
     /*
      * Writeback active file
@@ -561,36 +680,38 @@ main(int ac, char **av)
  *		   then delete the file
  *
  * If a newsgroup for a file cannot be found, the file is removed
+ *
+ * The directories come off the work queue, shared with the other forks
+ * if -p was given.
  */
 
 void
 ScanDirectories(void)
 {
-    DIR *dir;
-    int level = 0;
+    int i;
 
     if (VerboseOpt)
 	printf("Scanning group directories\n");
 
+    if (WQ == NULL) {
+	if (IncrementalOpt)
+	    BuildIncrementalQueue();
+	else
+	    BuildWorkQueue();
+    }
     chdir(PatExpand(GroupHomePat));
-    if ((dir = opendir(".")) != NULL) {
-	den_t *den;
-	struct stat st;
 
-	while ((den = readdir(dir)) != NULL) {
-	    if (isalnum((int)den->d_name[0]) &&
-	    	stat(den->d_name, &st) == 0 && S_ISDIR(st.st_mode) &&
-		/*
-		 * We explicitly use the first char, because overview
-		 * sizes appear to be not evenly distributed wrt second
-		 * char.
-		 */
-		(ParallelCount ? ((GFIndex(den->d_name[0]) % ParallelCount) ==
-				      ParallelIdx) : 1)
-	    )
-		scanDirectory(PatExpand(GroupHomePat), den->d_name, &level);
-	}
-	closedir(dir);
+    while ((i = ClaimWorkDir()) >= 0) {
+	WorkDir *wd = &WQ->wq_Dir[i];
+	int level = (wd->wd_Flat) ? 3 : 0;	/* 3: no subdirectories */
+
+	if (IncrementalOpt)
+	    ExpireDirGroups(wd->wd_Path);
+	else
+	    scanDirectory(PatExpand(GroupHomePat), wd->wd_Path, &level);
+	DoneWorkDir(i);
+	if (ParallelCount == 0)
+	    ReportProgress();
     }
 
     printf("Scanned %d files, %d were bad, %d/%d indexes resized successfully\n",
@@ -599,7 +720,569 @@ ScanDirectories(void)
 	ResizedGroups, 
 	NoResizedGroups + ResizedGroups
     );
+    if (CompressedColumns)
+	printf("Compressed %d overview column files\n", CompressedColumns);
+
+}
+
+/*
+ * BuildWorkQueue() - list the group directories in a shared mapping
+ *		      locked with fcntl() locks, which the forks inherit
+ */
+
+void
+BuildWorkQueue(void)
+{
+    WorkDir *dirs = NULL;
+    int count = 0;
+    int max = 0;
+    int pass;
+
+    if (chdir(PatExpand(GroupHomePat)) != 0) {
+	printf("Unable to chdir(%s)\n", PatExpand(GroupHomePat));
+	exit(1);
+    }
+
+    /*
+     * pass 0 lists the top level directories, pass 1 their
+     * subdirectories if there are not enough to keep the forks busy
+     */
+    for (pass = 0; pass < 2; ++pass) {
+	int n = count;
+	int j;
+
+	if (pass == 1 && (ParallelCount <= 1 || count >= WQ_MINDIRS))
+	    break;
+	for (j = (pass == 0) ? -1 : 0; j < n; ++j) {
+	    DIR *dir;
+	    den_t *den;
+	    struct stat st;
+	    char path[sizeof(dirs->wd_Path)];
+	    int first = count;
+
+	    if ((dir = opendir((j < 0) ? "." : dirs[j].wd_Path)) == NULL)
+		continue;
+	    if (j >= 0)
+		dirs[j].wd_Flat = 1;
+	    while ((den = readdir(dir)) != NULL) {
+		if (pass == 0 && !isalnum((int)den->d_name[0]))
+		    continue;
+		if (strcmp(den->d_name, ".") == 0 || strcmp(den->d_name, "..") == 0)
+		    continue;
+		if (snprintf(path, sizeof(path), "%s%s%s",
+			(j < 0) ? "" : dirs[j].wd_Path,
+			(j < 0) ? "" : "/",
+			den->d_name) >= sizeof(path)
+		) {
+		    if (j < 0) {
+			printf("Skipping %s, name too long\n", den->d_name);
+			continue;
+		    }
+		    dirs[j].wd_Flat = 0;	/* do it all in one go */
+		    count = first;
+		    break;
+		}
+		if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+		    continue;
+		if (count == max) {
+		    max = (max) ? max * 2 : 256;
+		    dirs = realloc(dirs, max * sizeof(WorkDir));
+		}
+		bzero(&dirs[count], sizeof(WorkDir));
+		strcpy(dirs[count].wd_Path, path);
+		dirs[count].wd_Dev = (int)st.st_dev;
+		++count;
+	    }
+	    closedir(dir);
+	}
+    }
+    MapWorkQueue(dirs, count);
+    if (dirs)
+	free(dirs);
+}
+
+/*
+ * MapWorkQueue() - put the directories on the queue, noting their devices
+ */
+
+void
+MapWorkQueue(WorkDir *dirs, int count)
+{
+    char tmpPath[PATH_MAX];
+    size_t bytes;
+    int i;
+
+    bytes = offsetof(WorkQueue, wq_Dir[0]) + (count + 1) * sizeof(WorkDir);
+    snprintf(tmpPath, sizeof(tmpPath), "%s/.dexpireover.XXXXXX", PatExpand(GroupHomePat));
+    if ((WQFd = mkstemp(tmpPath)) < 0 ||
+	remove(tmpPath) < 0 ||
+	ftruncate(WQFd, bytes) < 0 ||
+	(WQ = xmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, WQFd, 0)) == NULL
+    ) {
+	printf("Unable to set up the work queue in %s: %s\n", tmpPath, strerror(errno));
+	exit(1);
+    }
+    bzero(WQ, bytes);
+    WQ->wq_Start = time(NULL);
+    for (i = 0; i < count; ++i) {
+	struct stat st;
+	int d;
+
+	WQ->wq_Dir[i] = dirs[i];
+	if (stat(dirs[i].wd_Path, &st) != 0)
+	    st.st_dev = 0;
+	for (d = 0; d < WQ->wq_NumDevs && WQ->wq_Dev[d] != st.st_dev; ++d)
+	    ;
+	if (d == WQ->wq_NumDevs) {
+	    if (d == WQ_MAXDEVS)
+		d = WQ_MAXDEVS - 1;	/* lump the rest together */
+	    else
+		WQ->wq_Dev[WQ->wq_NumDevs++] = st.st_dev;
+	}
+	WQ->wq_Dir[i].wd_Dev = d;
+    }
+    WQ->wq_Count = count;
+    if (VerboseOpt)
+	printf("Queued %d group directories on %d devices\n", count, WQ->wq_NumDevs);
+}
+
+/*
+ * ClaimWorkDir() - claim the next queued directory whose device is not
+ *		    busy (-P).  Returns -1 when there is nothing left.
+ */
+
+int
+ClaimWorkDir(void)
+{
+    for (;;) {
+	int queued = 0;
+	int i;
+
+	if (MustExit)
+	    exit(1);
+	xflock(WQFd, XLOCK_EX);
+	for (i = 0; i < WQ->wq_Count; ++i) {
+	    WorkDir *wd = &WQ->wq_Dir[i];
+
+	    if (wd->wd_State != WD_QUEUED)
+		continue;
+	    queued = 1;
+	    if (ParallelPerDev > 0 &&
+		WQ->wq_DevRunning[wd->wd_Dev] >= ParallelPerDev
+	    ) {
+		continue;
+	    }
+	    wd->wd_State = WD_RUNNING;
+	    wd->wd_Pid = getpid();
+	    ++WQ->wq_DevRunning[wd->wd_Dev];
+	    ++WQ->wq_Running;
+	    xflock(WQFd, XLOCK_UN);
+	    return(i);
+	}
+	xflock(WQFd, XLOCK_UN);
+	if (queued == 0)
+	    return(-1);
+	usleep(100000);
+    }
+}
+
+void
+DoneWorkDir(int i)
+{
+    WorkDir *wd = &WQ->wq_Dir[i];
+
+    xflock(WQFd, XLOCK_EX);
+    wd->wd_State = WD_DONE;
+    --WQ->wq_DevRunning[wd->wd_Dev];
+    --WQ->wq_Running;
+    ++WQ->wq_Done;
+    xflock(WQFd, XLOCK_UN);
+}
+
+/*
+ * RequeueWorkDirs() - master: a fork has exited, put back the
+ *		       directories it still held so the other forks
+ *		       pick them up and -P does not wait on it forever.
+ *		       A directory that takes down a second fork is
+ *		       given up rather than killing them all.
+ */
+
+void
+RequeueWorkDirs(pid_t pid)
+{
+    int i;
+
+    xflock(WQFd, XLOCK_EX);
+    for (i = 0; i < WQ->wq_Count; ++i) {
+	WorkDir *wd = &WQ->wq_Dir[i];
+
+	if (wd->wd_State != WD_RUNNING || wd->wd_Pid != pid)
+	    continue;
+	--WQ->wq_DevRunning[wd->wd_Dev];
+	--WQ->wq_Running;
+	wd->wd_Pid = 0;
+	if (wd->wd_Requeued) {
+	    printf("Fork %d exited holding %s, giving up on it\n",
+						(int)pid, wd->wd_Path);
+	    wd->wd_State = WD_DONE;
+	    ++WQ->wq_Done;
+	} else {
+	    printf("Fork %d exited holding %s, requeued\n",
+						(int)pid, wd->wd_Path);
+	    wd->wd_State = WD_QUEUED;
+	    wd->wd_Requeued = 1;
+	}
+    }
+    xflock(WQFd, XLOCK_UN);
+}
+
+/*
+ * ReportProgress() - print the progress and an estimate of the time
+ *		      left every WQ_REPORT seconds
+ */
+
+void
+ReportProgress(void)
+{
+    static time_t lastReport;
+    time_t t = time(NULL);
+    int elapsed;
+    int done;
+
+    if (WQ == NULL || t - lastReport < WQ_REPORT || t - WQ->wq_Start < WQ_REPORT)
+	return;
+    lastReport = t;
+    elapsed = t - WQ->wq_Start;
+    done = WQ->wq_Done;
+    printf("Progress: %d/%d directories done, %d running, %dm%02ds elapsed",
+	done, WQ->wq_Count, WQ->wq_Running, elapsed / 60, elapsed % 60);
+    if (done > 0) {
+	int eta = (int)((double)elapsed * (WQ->wq_Count - done) / done);
+
+	printf(", ETA %dm%02ds", eta / 60, eta % 60);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+/*
+ * IncrementalGroup() - whether an incremental run (-i#) expires a group:
+ *			1 if it is in the dirty group journal, 2 if it is
+ *			in this generation's 1 in # slice of the others, so
+ *			that every group is still expired every # runs.
+ */
 
+int
+IncrementalGroup(const char *groupName)
+{
+    hash_t hv;
+
+    if (DirtyGroupTest(&DirtyGroups, groupName))
+	return(1);
+    hv = hhash(groupName);
+    if ((uint32)hv.h1 % IncrementalOpt == DirtyGroups.ds_Gen % IncrementalOpt)
+	return(2);
+    return(0);
+}
+
+/*
+ * IncrementalDir() - the group's directory relative to GroupHomePat
+ */
+
+const char *
+IncrementalDir(const char *groupName, int iter)
+{
+    static char dir[sizeof(((WorkDir *)NULL)->wd_Path)];
+    const char *path = GFName(groupName, GRPFTYPE_OVER, 0, 1, iter,
+					&DOpts.ReaderGroupHashMethod);
+    const char *p = strrchr(path, '/');
+
+    if (p == NULL || p - path >= sizeof(dir))
+	return(NULL);
+    bcopy(path, dir, p - path);
+    dir[p - path] = 0;
+    return(dir);
+}
+
+static int
+wdcmp(const void *a, const void *b)
+{
+    return(strcmp(((const WorkDir *)a)->wd_Path, ((const WorkDir *)b)->wd_Path));
+}
+
+/*
+ * BuildIncrementalQueue() - queue the directories of the groups an
+ *			     incremental run expires.  The -p master has
+ *			     not loaded the active file, so read it here.
+ */
+
+void
+BuildIncrementalQueue(void)
+{
+    KPDB *kpdb = KDBActive;
+    WorkDir *dirs = NULL;
+    int count = 0;
+    int max = 0;
+    int dirty = 0;
+    int due = 0;
+    int groups = 0;
+    int recLen;
+    int recOff;
+    int i;
+
+    if (chdir(PatExpand(GroupHomePat)) != 0) {
+	printf("Unable to chdir(%s)\n", PatExpand(GroupHomePat));
+	exit(1);
+    }
+    if (kpdb == NULL &&
+	(kpdb = KPDBOpen((DBFile ? DBFile : PatDbExpand(ReaderDActivePat)), O_RDWR)) == NULL
+    ) {
+	fprintf(stderr, "Unable to open dactive.kp\n");
+	exit(1);
+    }
+
+    for (recOff = KPDBScanFirst(kpdb, 0, &recLen);
+	 recOff;
+	 recOff = KPDBScanNext(kpdb, recOff, 0, &recLen)
+    ) {
+	int groupLen;
+	const char *rec = KPDBReadRecordAt(kpdb, recOff, 0, NULL);
+	const char *group = KPDBGetField(rec, recLen, NULL, &groupLen, NULL);
+	int iter = (int)strtoul(KPDBGetField(rec, recLen, "ITER", NULL, "0"), NULL, 16);
+	const char *dir;
+	int r;
+
+	if (group == NULL)
+	    continue;
+	group = allocTmpCopy(group, groupLen);
+	if (Wild && WildCmp(Wild, group) != 0)
+	    continue;
+	++groups;
+	if ((r = IncrementalGroup(group)) == 0)
+	    continue;
+	if (r == 1)
+	    ++dirty;
+	else
+	    ++due;
+	if ((dir = IncrementalDir(group, iter)) == NULL) {
+	    printf("Skipping %s, directory name too long\n", group);
+	    continue;
+	}
+	if (count == max) {
+	    max = (max) ? max * 2 : 256;
+	    dirs = realloc(dirs, max * sizeof(WorkDir));
+	}
+	bzero(&dirs[count], sizeof(WorkDir));
+	strcpy(dirs[count].wd_Path, dir);
+	dirs[count].wd_Flat = 1;
+	++count;
+    }
+    if (kpdb != KDBActive)
+	KPDBClose(kpdb);
+
+    if (count)
+	qsort(dirs, count, sizeof(WorkDir), wdcmp);
+    for (i = 0, max = count, count = 0; i < max; ++i) {
+	if (count == 0 || strcmp(dirs[count - 1].wd_Path, dirs[i].wd_Path) != 0)
+	    dirs[count++] = dirs[i];
+    }
+    printf("Incremental run: %d dirty and %d due of %d groups, in %d directories\n",
+	dirty, due, groups, count);
+    MapWorkQueue(dirs, count);
+    if (dirs)
+	free(dirs);
+}
+
+static int
+grdircmp(const void *a, const void *b)
+{
+    const Group *g1 = *(const Group **)a;
+    const Group *g2 = *(const Group **)b;
+
+    return(strcmp(g1->gr_Dir, g2->gr_Dir));
+}
+
+/*
+ * SelectIncrementalGroups() - list the groups this run expires by
+ *			       directory, for ExpireDirGroups()
+ */
+
+void
+SelectIncrementalGroups(void)
+{
+    int max = 0;
+    int i;
+
+    for (i = 0; i < GHSIZE; ++i) {
+	Group *group;
+
+	for (group = GHash[i]; group; group = group->gr_Next) {
+	    const char *dir;
+
+	    if (IncrementalGroup(group->gr_GroupName) == 0 ||
+		(dir = IncrementalDir(group->gr_GroupName, group->gr_Iter)) == NULL
+	    ) {
+		continue;
+	    }
+	    group->gr_Dir = strdup(dir);
+	    if (IncCount == max) {
+		max = (max) ? max * 2 : 256;
+		IncGroups = realloc(IncGroups, max * sizeof(Group *));
+	    }
+	    IncGroups[IncCount++] = group;
+	}
+    }
+    if (IncCount)
+	qsort(IncGroups, IncCount, sizeof(Group *), grdircmp);
+}
+
+/*
+ * ExpireDirGroups() - expire the selected groups in a queued directory
+ */
+
+void
+ExpireDirGroups(const char *dirname)
+{
+    int lo = 0;
+    int hi = IncCount;
+
+    while (lo < hi) {
+	int i = (lo + hi) / 2;
+
+	if (strcmp(IncGroups[i]->gr_Dir, dirname) < 0)
+	    lo = i + 1;
+	else
+	    hi = i;
+    }
+    while (lo < IncCount && strcmp(IncGroups[lo]->gr_Dir, dirname) == 0) {
+	ProcessGroup(IncGroups[lo]);
+	++lo;
+	if (MustExit)
+	    exit(1);
+    }
+}
+
+/*
+ * ProcessGroup() - do for one group what scanDirectory() does for all
+ *		    files in a directory, looking for its files by name:
+ *		    the over. file, then data. and column files of the
+ *		    blocks that fell below NB, then the column files of
+ *		    the complete blocks back to the last one already
+ *		    compressed.
+ */
+
+void
+ProcessGroup(Group *group)
+{
+    artno_t startNo = group->gr_StartNo;
+    artno_t base;
+    int dataEntries;
+
+    if (ProcessGroupFile(group, GRPFTYPE_OVER, 0) < 0)
+	return;
+
+    dataEntries = getDataEntries(GFName(group->gr_GroupName,
+					GRPFTYPE_OVER, 0, 2,
+					group->gr_Iter,
+					&DOpts.ReaderGroupHashMethod));
+    if (dataEntries <= 0 ||
+	((dataEntries ^ (dataEntries - 1)) != (dataEntries << 1) - 1))
+	dataEntries = OD_HARTS;
+
+    if (startNo < 0)
+	startNo = 0;
+    for (base = startNo & ~(artno_t)(dataEntries - 1);
+	 base + dataEntries <= group->gr_StartNo;
+	 base += dataEntries
+    ) {
+	int col;
+
+	ProcessGroupFile(group, GRPFTYPE_DATA, base);
+	for (col = 0; col < OVERCOL_COUNT; ++col)
+	    ProcessGroupFile(group, GRPFTYPE_COLUMN + col, base);
+    }
+
+    if (group->gr_EndNo < dataEntries)
+	return;
+    for (base = (group->gr_EndNo - dataEntries) & ~(artno_t)(dataEntries - 1);
+	 base >= 0 && base + dataEntries > group->gr_StartNo;
+	 base -= dataEntries
+    ) {
+	if (ProcessGroupColumns(group, base) == 0)
+	    break;
+    }
+}
+
+/*
+ * ProcessGroupFile() - ProcessOverviewFile() a group file if it exists.
+ *			Returns -1 if it does not.
+ */
+
+int
+ProcessGroupFile(Group *group, int gftype, artno_t artBase)
+{
+    char path[PATH_MAX];
+    char *name;
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s", GFName(group->gr_GroupName,
+					gftype, artBase, 2,
+					group->gr_Iter,
+					&DOpts.ReaderGroupHashMethod));
+    if (stat(path, &st) != 0 || (name = strrchr(path, '/')) == NULL)
+	return(-1);
+    *name++ = 0;
+    ProcessOverviewFile(path, name, (gftype == GRPFTYPE_OVER) ? 1 : 2);
+    return(0);
+}
+
+/*
+ * ProcessGroupColumns() - compress the column files of a block.  Returns
+ *			   the number that were not compressed yet.
+ */
+
+int
+ProcessGroupColumns(Group *group, artno_t artBase)
+{
+    int count = 0;
+    int col;
+
+    for (col = 0; col < OVERCOL_COUNT; ++col) {
+	OverColHead ch;
+	int fd;
+
+	fd = open(GFName(group->gr_GroupName, GRPFTYPE_COLUMN + col, artBase, 2,
+			group->gr_Iter, &DOpts.ReaderGroupHashMethod), O_RDONLY);
+	if (fd < 0)
+	    continue;
+	if (pread(fd, &ch, sizeof(ch), 0) == sizeof(ch) &&
+	    ch.ch_Magic == OCMAGIC &&
+	    (ch.ch_Flags & OCF_COMPRESSED) == 0
+	) {
+	    ++count;
+	    ProcessGroupFile(group, GRPFTYPE_COLUMN + col, artBase);
+	}
+	close(fd);
+    }
+    return(count);
+}
+
+/*
+ * ConsumeDirtyGroups() - remove what this run read from the dirty group
+ *			  journal.  Not with -w, which only expired some of
+ *			  the groups, or -n.
+ */
+
+void
+ConsumeDirtyGroups(void)
+{
+    if (DirtyGroups.ds_Fd < 0 || Wild || ForReal == 0)
+	return;
+    if (DirtyGroupConsume(&DirtyGroups) < 0)
+	printf("Unable to update dirty group journal %s: %s\n",
+			PatDbExpand(DExpireOverDirtyPat), strerror(errno));
+    else if (VerboseOpt)
+	printf("Dirty group journal now at generation %u\n", DirtyGroups.ds_Gen + 1);
 }
 
 void
@@ -647,16 +1330,18 @@ scanDirectory(const char *dirpath, char *dirname, int *level)
 	     */
 	    if (strncmp(den2->d_name, ".data.", 6) == 0 ||
 		strncmp(den2->d_name, ".d.", 3) == 0 ||
-		sscanf(den2->d_name, ".%[^.]s.%d.d.", tbuf, &tint) == 2) {
+		sscanf(den2->d_name, ".%[^.]s.%d.d.", tbuf, &tint) == 2 ||
+		(den2->d_name[0] == '.' && isColumnFile(den2->d_name + 1))) {
 		DeleteJunkFile(path, den2->d_name);
 		continue;
 	    }
 
 	    /*
-	     * process data. files
+	     * process data. and column files
 	     */
 	    if (strncmp(den2->d_name, "data.", 5) == 0 ||
-		strstr(den2->d_name, ".d.") != NULL)
+		strstr(den2->d_name, ".d.") != NULL ||
+		isColumnFile(den2->d_name))
 		ProcessOverviewFile(path, den2->d_name, 2);
 	    if (MustExit)
 		exit(1);
@@ -702,6 +1387,7 @@ ProcessOverviewFile(const char *dirPath, const char *name, int type)
     char path[PATH_MAX];
     char Hash[PATH_MAX];
     int iter = 0;
+    int ftype;
     OverHead oh;
 
     snprintf(path, sizeof(path), "%s/%s", dirPath, name);
@@ -711,7 +1397,7 @@ ProcessOverviewFile(const char *dirPath, const char *name, int type)
 
     bzero(Hash, sizeof(Hash));
 
-    if (ExtractGroupHashInfo(name, Hash, &artBase, &iter) == HASHGRP_NONE)
+    if ((ftype = ExtractGroupHashInfo(name, Hash, &artBase, &iter)) == HASHGRP_NONE)
 	return;
 
     if (DebugOpt > 2)
@@ -952,8 +1638,91 @@ ProcessOverviewFile(const char *dirPath, const char *name, int type)
 		);
 	    if (ForReal)
 		remove(path);
-	} 
+	} else if (ftype & HASHGRPTYPE_COLUMN) {
+	    CompressColumn(group, path, artBase, oh.oh_DataEntries);
+	}
+    }
+}
+
+int
+isColumnFile(const char *name)
+{
+    char Hash[PATH_MAX];
+    artno_t artBase;
+    int iter = 0;
+
+    return((ExtractGroupHashInfo(name, Hash, &artBase, &iter) & HASHGRPTYPE_COLUMN) != 0);
+}
+
+/*
+ * CompressColumn() - compress an overview column file (lib/overcol.c)
+ *		      once its block is complete, dropping the entries of
+ *		      articles no longer in the over. index.  dreaderd
+ *		      does not append to a compressed column, and looks
+ *		      up anything it does not find there in the data.
+ *		      file, so no lock is needed.
+ */
+
+typedef struct ColumnIndex {
+    int		ci_Fd;
+    OverHead	ci_Head;
+} ColumnIndex;
+
+void
+CompressColumn(Group *group, const char *path, artno_t artBase, int dataEntries)
+{
+    ColumnIndex ci;
+    char tmpPath[PATH_MAX];
+    const char *name;
+    int r;
+
+    if (artBase + dataEntries > group->gr_EndNo || ForReal == 0)
+	return;
+
+    ci.ci_Fd = open(GFName(group->gr_GroupName, GRPFTYPE_OVER, 0, 2,
+				group->gr_Iter, &DOpts.ReaderGroupHashMethod),
+				O_RDONLY);
+    if (ci.ci_Fd < 0)
+	return;
+    if (read(ci.ci_Fd, &ci.ci_Head, sizeof(ci.ci_Head)) != sizeof(ci.ci_Head) ||
+	ci.ci_Head.oh_Version > OH_VERSION ||
+	ci.ci_Head.oh_ByteOrder != OH_BYTEORDER ||
+	ci.ci_Head.oh_MaxArts <= 0
+    ) {
+	close(ci.ci_Fd);
+	return;
     }
+
+    if ((name = strrchr(path, '/')) != NULL)
+	++name;
+    else
+	name = path;
+    snprintf(tmpPath, sizeof(tmpPath), "%.*s.%s", (int)(name - path), path, name);
+
+    r = OverColCompress(path, tmpPath, keepColumnEntry, &ci);
+    if (r > 0) {
+	++CompressedColumns;
+	if (VerboseOpt)
+	    printf("Compressed overview column %s\n", path);
+    } else if (r < 0) {
+	printf("Unable to compress overview column %s\n", path);
+    }
+    close(ci.ci_Fd);
+}
+
+int
+keepColumnEntry(const OverColEnt *ce, void *data)
+{
+    ColumnIndex *ci = data;
+    OverArt oa;
+    off_t pos = ci->ci_Head.oh_HeadSize +
+	((ce->ce_ArtNo & 0x7FFFFFFFFFFFFFFFLL) % ci->ci_Head.oh_MaxArts) * sizeof(OverArt);
+
+    if (pread(ci->ci_Fd, &oa, sizeof(oa), pos) != sizeof(oa))
+	return(0);
+    return(OA_ARTNOEQ(ce->ce_ArtNo, oa.oa_ArtNo) &&
+	oa.oa_MsgHash.h1 == ce->ce_MsgHash.h1 &&
+	oa.oa_MsgHash.h2 == ce->ce_MsgHash.h2);
 }
 
 int
@@ -0,0 +1,283 @@
+/*
+ * DFEEDBENCH.C - outgoing feed routing benchmark
+ *
+ *	Writes a dnewsfeeds file with a number of labels, each feeding a
+ *	few hierarchies and dropping a few, and routes a corpus of
+ *	Newsgroups: lines through FeedWrite() the way diablo does for
+ *	every accepted article.  The corpus is read from a file (one
+ *	Newsgroups: line per line) or made up, crossposting to 1 to 4 of
+ *	a set of groups with a skewed distribution.  The articles are
+ *	routed once matching every group against every label, then twice
+ *	with the group cache, and the labels fed are checked to be the
+ *	same.
+ */
+
+#include "defs.h"
+
+#define	LABELS		100
+#define	GROUPS		10000
+#define	ARTICLES	200000
+
+void Usage(void);
+void MakeFeeds(const char *path, int labels);
+char **MakeCorpus(int articles, int groups);
+char **ReadCorpus(const char *path, int *particles);
+void Route(const char *name, char **corpus, int articles, int *fed, int check);
+int fbCallBack(const char *hlabel, const char *msgid, const char *path, const char *offsize, int plfo, int headOnly, const char *artType, const char *cSize);
+double Elapsed(struct timeval *tv);
+
+const char *Hiers[] = {
+    "alt", "alt.binaries", "comp", "de", "fr", "misc", "news", "rec",
+    "sci", "soc", "talk", "uk", "control", "junk", "local", "it"
+};
+#define NHIERS	(sizeof(Hiers) / sizeof(Hiers[0]))
+
+int FedCount;
+uint32 FedHash;
+
+void
+Usage(void)
+{
+    fprintf(stderr, "An outgoing feed routing performance tester\n\n");
+    fprintf(stderr, "Usage: dfeedbench [-f corpus] [-g groups] [-l labels] [-n articles]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-f\tread the Newsgroups: lines from corpus\n");
+    fprintf(stderr, "\t-g\tnumber of groups to make up (default: %d)\n", GROUPS);
+    fprintf(stderr, "\t-l\tnumber of labels (default: %d)\n", LABELS);
+    fprintf(stderr, "\t-n\tnumber of articles to make up (default: %d)\n", ARTICLES);
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char tmp[] = "/tmp/dfeedbench.XXXXXX";
+    char *corpusFile = NULL;
+    char **corpus;
+    int labels = LABELS;
+    int groups = GROUPS;
+    int articles = ARTICLES;
+    int *fed;
+    int fd;
+    int i;
+
+    LoadDiabloConfig(ac, av);
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr != '-')
+	    Usage();
+	ptr += 2;
+	switch(ptr[-1]) {
+	case 'C':
+	    if (*ptr == 0)
+		++i;
+	    break;
+	case 'f':
+	    corpusFile = (*ptr) ? ptr : av[++i];
+	    break;
+	case 'g':
+	    groups = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'l':
+	    labels = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'n':
+	    articles = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	default:
+	    Usage();
+	}
+    }
+    if (labels <= 0 || groups <= 0 || articles <= 0)
+	Usage();
+
+    if ((fd = mkstemp(tmp)) < 0) {
+	perror("dfeedbench: mkstemp");
+	exit(1);
+    }
+    close(fd);
+    MakeFeeds(tmp, labels);
+    DNewsfeedsPat = tmp;
+    LoadNewsFeed(0, 1, NULL);
+    remove(tmp);
+
+    if (corpusFile)
+	corpus = ReadCorpus(corpusFile, &articles);
+    else
+	corpus = MakeCorpus(articles, groups);
+    printf("Labels      : %d\n", labels);
+    printf("Articles    : %d\n", articles);
+
+    fed = malloc(articles * sizeof(int));
+    FeedGroupCache = 0;
+    Route("Scan", corpus, articles, fed, 0);
+    FeedGroupCache = 1;
+    Route("Cache cold", corpus, articles, fed, 1);
+    Route("Cache warm", corpus, articles, fed, 1);
+    return(0);
+}
+
+/*
+ * MakeFeeds() - write a dnewsfeeds file.  Each label feeds between 2
+ *		 and 6 hierarchies, some of them only in part, and drops
+ *		 a few.  GLOBAL drops control and junk.
+ */
+
+void
+MakeFeeds(const char *path, int labels)
+{
+    FILE *fo;
+    int i;
+
+    if ((fo = fopen(path, "w")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    srandom(1);
+    fprintf(fo, "label GLOBAL\n    delgroup control.*\n    delgroup junk\nend\n\n");
+    for (i = 0; i < labels; ++i) {
+	int n = 2 + random() % 5;
+
+	fprintf(fo, "label feed%d\n    alias feed%d.example.com\n", i, i);
+	while (n-- > 0) {
+	    const char *h = Hiers[random() % NHIERS];
+
+	    if (random() % 4 == 0)
+		fprintf(fo, "    addgroup %s.sub%ld*\n", h, random() % 10);
+	    else
+		fprintf(fo, "    addgroup %s.*\n", h);
+	}
+	if (random() % 2)
+	    fprintf(fo, "    delgroup alt.binaries.*\n");
+	if (random() % 3 == 0)
+	    fprintf(fo, "    delgroup *.test\n");
+	if (random() % 8 == 0)
+	    fprintf(fo, "    delgroupany %s.*\n", Hiers[random() % NHIERS]);
+	fprintf(fo, "end\n\n");
+    }
+    if (fclose(fo) != 0) {
+	perror(path);
+	exit(1);
+    }
+}
+
+/*
+ * MakeCorpus() - make up Newsgroups: lines.  Low numbered groups are
+ *		  posted to more often.
+ */
+
+char **
+MakeCorpus(int articles, int groups)
+{
+    char **corpus = malloc(articles * sizeof(char *));
+    int i;
+
+    srandom(2);
+    for (i = 0; i < articles; ++i) {
+	char buf[1024];
+	int n = 1 + ((random() % 8 == 0) ? random() % 4 : 0);
+	int l = 0;
+
+	while (n-- > 0) {
+	    double r = (double)random() / RAND_MAX;
+	    int g = (int)(r * r * r * groups);
+
+	    l += snprintf(buf + l, sizeof(buf) - l, "%s%s.sub%d.group%d%s",
+		(l ? "," : ""), Hiers[g % NHIERS], (int)(g / NHIERS % 10), g,
+		((g % 50 == 0) ? ".test" : ""));
+	}
+	corpus[i] = strdup(buf);
+    }
+    return(corpus);
+}
+
+char **
+ReadCorpus(const char *path, int *particles)
+{
+    FILE *fi;
+    char **corpus = NULL;
+    char buf[8192];
+    int max = 0;
+    int n = 0;
+
+    if ((fi = fopen(path, "r")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    while (fgets(buf, sizeof(buf), fi) != NULL) {
+	char *p = buf;
+
+	p[strcspn(p, "\r\n")] = 0;
+	if (strncasecmp(p, "Newsgroups:", 11) == 0)
+	    p += 11;
+	while (*p == ' ' || *p == '\t')
+	    ++p;
+	if (*p == 0)
+	    continue;
+	if (n == max) {
+	    max = (max) ? max * 2 : 1024;
+	    corpus = realloc(corpus, max * sizeof(char *));
+	}
+	corpus[n++] = strdup(p);
+    }
+    fclose(fi);
+    if (n == 0) {
+	fprintf(stderr, "dfeedbench: no Newsgroups: lines in %s\n", path);
+	exit(1);
+    }
+    *particles = n;
+    return(corpus);
+}
+
+/*
+ * Route() - route every article, remembering (check 0) or checking
+ *	     (check 1) a hash of the labels it was fed to
+ */
+
+void
+Route(const char *name, char **corpus, int articles, int *fed, int check)
+{
+    struct timeval tv;
+    double secs;
+    long total = 0;
+    int i;
+
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < articles; ++i) {
+	FedCount = 0;
+	FedHash = 0;
+	FeedWrite(0, fbCallBack, "<bench@dfeedbench>", "", "0,1000",
+			corpus[i], "peer.example.com!poster", "",
+			"0", "000000", 0, NULL);
+	if (check && (int)FedHash != fed[i]) {
+	    fprintf(stderr, "dfeedbench: %s fed to different labels\n",
+								corpus[i]);
+	    exit(1);
+	}
+	fed[i] = (int)FedHash;
+	total += FedCount;
+    }
+    secs = Elapsed(&tv);
+    printf("%-12s: %d in %.3fs, %.0f/s, %ld feeds\n", name, articles,
+					secs, articles / secs, total);
+}
+
+int
+fbCallBack(const char *hlabel, const char *msgid, const char *path, const char *offsize, int plfo, int headOnly, const char *artType, const char *cSize)
+{
+    ++FedCount;
+    while (*hlabel)
+	FedHash = FedHash * 33 + (unsigned char)*hlabel++;
+    return(1);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
@@ -0,0 +1,277 @@
+/*
+ * DHASHBENCH.C - spam filter fingerprint benchmark
+ *
+ *	Times the fingerprints the internal spam filter can take of an
+ *	article body ('spamhash' in diablo.config): MD5 and murmur3, the
+ *	latter both in one call and fed a line at a time the way diablo
+ *	feeds it while an article comes in.  Inputs run from header line
+ *	to large binary article sizes, or are read from files holding one
+ *	article each.  The line at a time murmur3 digests are checked
+ *	against the one call ones.
+ */
+
+#include "defs.h"
+
+#define	MEGABYTES	256
+#define	LINELEN		74
+
+typedef struct Input {
+    char	*i_Buf;
+    int		i_Len;
+} Input;
+
+void Usage(void);
+int CheckVector(void);
+int CheckInput(Input *in);
+void Bench(Input *ins, int nins, int megabytes, const char *what);
+Input *ReadInputs(char **files, int nfiles);
+double Elapsed(struct timeval *tv);
+
+volatile uint64_t Sink;	/* keeps the digests from being optimised away */
+
+int Sizes[] = { 64, 512, 2048, 8192, 65536, 1048576 };
+#define NSIZES	(sizeof(Sizes) / sizeof(Sizes[0]))
+
+void
+Usage(void)
+{
+    fprintf(stderr, "A spam filter fingerprint performance tester\n\n");
+    fprintf(stderr, "Usage: dhashbench [-m megabytes] [article ...]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-m\tmegabytes hashed per input size and method (default: %d)\n", MEGABYTES);
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    int megabytes = MEGABYTES;
+    int errs = 0;
+    int i;
+
+    LoadDiabloConfig(ac, av);
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr != '-')
+	    break;
+	ptr += 2;
+	switch(ptr[-1]) {
+	case 'C':
+	    if (*ptr == 0)
+		++i;
+	    break;
+	case 'm':
+	    megabytes = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	default:
+	    Usage();
+	}
+    }
+    if (megabytes <= 0)
+	Usage();
+
+    errs += CheckVector();
+
+    if (i < ac) {
+	int nins = ac - i;
+	Input *ins = ReadInputs(av + i, nins);
+	int j;
+
+	for (j = 0; j < nins; ++j)
+	    errs += CheckInput(&ins[j]);
+	Bench(ins, nins, megabytes, "articles");
+    } else {
+	unsigned int n;
+
+	srandom(1);
+	for (n = 0; n < NSIZES; ++n) {
+	    Input in;
+	    char what[32];
+	    int j;
+
+	    in.i_Len = Sizes[n];
+	    in.i_Buf = malloc(in.i_Len);
+	    for (j = 0; j < in.i_Len; ++j) {
+		if (j % LINELEN == LINELEN - 2)
+		    in.i_Buf[j] = '\r';
+		else if (j % LINELEN == LINELEN - 1)
+		    in.i_Buf[j] = '\n';
+		else
+		    in.i_Buf[j] = ' ' + random() % 95;
+	    }
+	    errs += CheckInput(&in);
+	    snprintf(what, sizeof(what), "%d bytes", in.i_Len);
+	    Bench(&in, 1, megabytes, what);
+	    free(in.i_Buf);
+	}
+    }
+    if (errs) {
+	fprintf(stderr, "dhashbench: %d digest mismatches\n", errs);
+	exit(1);
+    }
+    return(0);
+}
+
+/*
+ * CheckVector() - compare against the MurmurHash3_x64_128 reference
+ *		   implementation with seed 0
+ */
+
+int
+CheckVector(void)
+{
+    static const char *text = "The quick brown fox jumps over the lazy dog";
+    mmhash_ctx ctx;
+    md5hash_t h;
+
+    mmhash_init(&ctx);
+    mmhash_update(&ctx, text, strlen(text));
+    mmhash_final(&ctx, &h);
+    if (h.h1 != 0xe34bbc7bbc071b6cULL || h.h2 != 0x7a433ca9c49a9347ULL) {
+	fprintf(stderr, "dhashbench: murmur3 test vector mismatch\n");
+	return(1);
+    }
+    return(0);
+}
+
+/*
+ * CheckInput() - the digest must not depend on how the input is split
+ */
+
+int
+CheckInput(Input *in)
+{
+    static const int splits[] = { 1, 3, 15, 16, 17, LINELEN, 4096 };
+    mmhash_ctx ctx;
+    md5hash_t h0;
+    md5hash_t h;
+    unsigned int n;
+    int errs = 0;
+
+    mmhash_init(&ctx);
+    mmhash_update(&ctx, in->i_Buf, in->i_Len);
+    mmhash_final(&ctx, &h0);
+
+    for (n = 0; n < sizeof(splits) / sizeof(splits[0]); ++n) {
+	int off;
+
+	mmhash_init(&ctx);
+	for (off = 0; off < in->i_Len; off += splits[n]) {
+	    int len = in->i_Len - off;
+
+	    if (len > splits[n])
+		len = splits[n];
+	    mmhash_update(&ctx, in->i_Buf + off, len);
+	}
+	mmhash_final(&ctx, &h);
+	if (h.h1 != h0.h1 || h.h2 != h0.h2) {
+	    fprintf(stderr, "dhashbench: murmur3 of %d bytes differs fed %d at a time\n",
+						in->i_Len, splits[n]);
+	    ++errs;
+	}
+    }
+    return(errs);
+}
+
+/*
+ * Bench() - hash the inputs over and over until megabytes have been
+ *	     hashed by each method
+ */
+
+void
+Bench(Input *ins, int nins, int megabytes, const char *what)
+{
+    struct diablo_MD5Context md5;
+    mmhash_ctx ctx;
+    md5hash_t h;
+    struct timeval tv;
+    double bytes = (double)megabytes * 1024 * 1024;
+    double done;
+    double secs;
+    int method;
+    int i;
+
+    for (method = 0; method < 3; ++method) {
+	long count = 0;
+
+	done = 0;
+	gettimeofday(&tv, NULL);
+	while (done < bytes) {
+	    for (i = 0; i < nins; ++i) {
+		Input *in = &ins[i];
+
+		switch (method) {
+		case 0:
+		    diablo_MD5Init(&md5);
+		    diablo_MD5Update(&md5, (unsigned char *)in->i_Buf, in->i_Len);
+		    diablo_MD5Final((unsigned char *)&h, &md5);
+		    break;
+		case 1:
+		    mmhash_init(&ctx);
+		    mmhash_update(&ctx, in->i_Buf, in->i_Len);
+		    mmhash_final(&ctx, &h);
+		    break;
+		case 2:
+		    {
+			char *p = in->i_Buf;
+			char *e = in->i_Buf + in->i_Len;
+
+			mmhash_init(&ctx);
+			while (p < e) {
+			    char *q = memchr(p, '\n', e - p);
+
+			    q = (q) ? q + 1 : e;
+			    mmhash_update(&ctx, p, q - p);
+			    p = q;
+			}
+			mmhash_final(&ctx, &h);
+		    }
+		    break;
+		}
+		Sink += h.h1;
+		done += in->i_Len;
+		++count;
+	    }
+	}
+	secs = Elapsed(&tv);
+	printf("%-12s: %-14s %ld in %.3fs, %.1f MB/s, %.0f/s\n",
+	    (method == 0) ? "md5" : ((method == 1) ? "murmur3" : "murmur3 line"),
+	    what, count, secs, done / secs / (1024 * 1024), count / secs);
+    }
+}
+
+Input *
+ReadInputs(char **files, int nfiles)
+{
+    Input *ins = calloc(nfiles, sizeof(Input));
+    int i;
+
+    for (i = 0; i < nfiles; ++i) {
+	struct stat st;
+	int fd;
+
+	if ((fd = open(files[i], O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	    perror(files[i]);
+	    exit(1);
+	}
+	ins[i].i_Len = st.st_size;
+	ins[i].i_Buf = malloc(st.st_size + 1);
+	if (read(fd, ins[i].i_Buf, st.st_size) != st.st_size) {
+	    perror(files[i]);
+	    exit(1);
+	}
+	close(fd);
+    }
+    return(ins);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
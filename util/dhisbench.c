@@ -12,6 +12,8 @@ typedef struct ForkMap {
 } ForkMap;
 
 void DoIt(int Action, int count, ForkMap *smap);
+double RunBench(void);
+void Prefill(int pct);
 
 ForkMap *StatsMap;
 int AddForks = 0;
@@ -19,13 +21,19 @@ int AddCount = COUNT;
 int LookupForks = 0;
 int LookupCount = COUNT;
 char StatsPath[PATH_MAX];
+int CompareMMap = 0;
+int PrefillPct = 0;
+int GroupCommit = 0;
+int AddScale = 0;
+double AddRate = 0.0;
 
 void
 Usage(void)
 {
     fprintf(stderr, "A simple history performance tester\n\n");
     fprintf(stderr, "Usage: dhisbench [-ac n] [-af n] [-F] [-f historyfile] [-l]\n");
-    fprintf(stderr, "                 [-lc n] [-lf n] [-m map_file]\n");
+    fprintf(stderr, "                 [-G] [-Gs] [-lc n] [-lf n] [-M] [-Mc] [-m map_file]\n");
+    fprintf(stderr, "                 [-P pct]\n");
     fprintf(stderr, "  where:\n");
     fprintf(stderr, "\t-ac\tspecify number if history additions (default:%d)\n",
 							AddCount);
@@ -36,13 +44,19 @@ Usage(void)
     fprintf(stderr, "\t-Fs\tdon't check for duplicates on history adds\n");
     fprintf(stderr, "\t-f FILE\tuse FILE has the history file (default: %s)\n",
 					PatDbExpand(DHistoryPat));
+    fprintf(stderr, "\t-G\tadd through the group commit queue (historycommit)\n");
+    fprintf(stderr, "\t-Gs\tmeasure adds with 1, 8 and 64 add forks, with and\n");
+    fprintf(stderr, "\t\twithout group commit\n");
     fprintf(stderr, "\t-h n\tspecify history hash size\n");
     fprintf(stderr, "\t-lc\tspecify number of history lookups (default: %d)\n",
 							LookupCount);
     fprintf(stderr, "\t-lf\tspecify number of lookup forks (default: %d)\n",
 							LookupForks);
+    fprintf(stderr, "\t-M\tmmap the history entries for lookups (historymmap)\n");
+    fprintf(stderr, "\t-Mc\trun the lookups with read() and then with mmap\n");
     fprintf(stderr, "\t-m FILE\tuse FILE for the temp stats mmap (default: %s)\n",
 					StatsPath);
+    fprintf(stderr, "\t-P pct\tfirst fill the history to pct%% of its hash slots\n");
     fprintf(stderr, "\nWARNING: This program writes garbage entries to the history file\n\n");
     exit(1);
 }
@@ -55,16 +69,6 @@ main(int ac, char **av)
 {
     int i;
     int n;
-    int rpid;
-    int mapfd;
-    int mapindex = 0;
-    struct timeval tstart;
-    struct timeval tend;
-    double elapsed;
-    int LookupTotal = 0;
-    double LookupTime = 0.0;
-    int AddTotal = 0;
-    double AddTime = 0.0;
 
     LoadDiabloConfig(ac, av);
  
@@ -98,6 +102,12 @@ main(int ac, char **av)
 		else
 		    HOFlags = HGF_FAST|HGF_NOSEARCH;
 		break;
+	    case 'G':
+		if (*ptr == 's')
+		    AddScale = 1;
+		else
+		    GroupCommit = 1;
+		break;
 	    case 'f':
 		HistoryFile = (*ptr) ? ptr : av[++i];
 		break;
@@ -121,6 +131,15 @@ main(int ac, char **av)
 		    LookupCount = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
 		}
 		break;
+	    case 'M':
+		if (*ptr == 'c')
+		    CompareMMap = 1;
+		else
+		    HOFlags |= HGF_MMAP;
+		break;
+	    case 'P':
+		PrefillPct = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
 	    case 'm':
 		if (!*ptr)
 		    ptr = av[++i];
@@ -135,6 +154,10 @@ main(int ac, char **av)
 	}
     }
 
+    if (AddScale) {
+	AddForks = 1;
+	LookupForks = 0;
+    }
     if (AddForks == 0 && LookupForks == 0)
 	Usage();
     if (AddForks == 0)
@@ -151,15 +174,81 @@ main(int ac, char **av)
 	printf("NOLOCK ");
     if (HOFlags & HGF_NOSEARCH)
 	printf("NOSEARCH ");
+    if ((HOFlags & HGF_MMAP) || DOpts.HistoryMMap)
+	printf("MMAP ");
     printf("\n");
     printf("Hash Size   : %d\n", DOpts.HashSize);
+    printf("Version     : %d\n", DOpts.HistoryVersion);
+    if (DOpts.HistoryFilterSize)
+	printf("Filter Size : %u\n", DOpts.HistoryFilterSize);
 
     /*
-     * Create history if it doesn't exist
+     * Create history if it doesn't exist.  This also (re)builds the
+     * history filter, which read-only lookups only use if it is valid.
      */
-    HistoryOpen(HistoryFile, HOFlags);
+    if (PrefillPct > 0)
+	Prefill(PrefillPct);
+    HistoryOpen(HistoryFile, HOFlags & ~HGF_READONLY);
     HistoryClose();
 
+    if (AddScale) {
+	static int writers[] = { 1, 8, 64 };
+	double rate[3][2];
+
+	for (i = 0; i < 3; ++i) {
+	    AddForks = writers[i];
+	    for (n = 0; n < 2; ++n) {
+		GroupCommit = n;
+		printf("\nAdds with %d forks%s:\n", AddForks,
+				(GroupCommit ? ", group commit" : ""));
+		RunBench();
+		rate[i][n] = AddRate;
+	    }
+	}
+	printf("\n  forks     adds/s  group adds/s  ratio\n");
+	for (i = 0; i < 3; ++i) {
+	    printf("%7d %10.0f %13.0f %6.2f\n", writers[i],
+			rate[i][0], rate[i][1], rate[i][1] / rate[i][0]);
+	}
+    } else if (CompareMMap) {
+	double rate;
+
+	if (AddForks != 0) {
+	    fprintf(stderr, "-Mc cannot be combined with -af\n");
+	    exit(1);
+	}
+	HOFlags &= ~HGF_MMAP;
+	DOpts.HistoryMMap = 0;
+	printf("\nLookups using read():\n");
+	rate = RunBench();
+	HOFlags |= HGF_MMAP;
+	printf("\nLookups using mmap:\n");
+	printf("mmap/read lookup ratio: %.2f\n", RunBench() / rate);
+    } else {
+	RunBench();
+    }
+    exit(0);
+}
+
+/*
+ * Run one pass of the add and lookup forks and print the results.
+ * Returns the lookup rate.
+ */
+double
+RunBench(void)
+{
+    int i;
+    int rpid;
+    int mapfd;
+    int mapindex = 0;
+    struct timeval tstart;
+    struct timeval tend;
+    double elapsed;
+    int LookupTotal = 0;
+    double LookupTime = 0.0;
+    int AddTotal = 0;
+    double AddTime = 0.0;
+
     remove(StatsPath);
     mapfd = open(StatsPath, O_RDWR|O_CREAT|O_EXCL, 0600);
     if (mapfd == -1) {
@@ -176,9 +265,13 @@ main(int ac, char **av)
 	perror("mmap");
 	exit(1);
     }
+    if (GroupCommit)
+	InitHistoryCommit(AddForks);
+    fflush(stdout);
     gettimeofday(&tstart, NULL);
     for (i = 0; i < AddForks; i++)
 	if (fork() == 0) {
+	    HistoryCommitSlot(GroupCommit ? i : -1);
 	    DoIt(2, AddCount, &StatsMap[mapindex]);
 	} else {
 	    mapindex++;
@@ -225,9 +318,11 @@ main(int ac, char **av)
 	AddTime = 1;
     printf("%.0f lookups per second\n", LookupTotal / LookupTime);
     printf("%.0f adds per second\n", AddTotal / AddTime);
+    AddRate = AddTotal / AddTime;
+    xunmap((void *)StatsMap, sizeof(ForkMap) * (AddForks + LookupForks));
     close(mapfd);
     remove(StatsPath);
-    exit(0);
+    return(LookupTotal / LookupTime);
 }
 
 void
@@ -251,7 +346,7 @@ DoIt(int Action, int count, ForkMap *smap)
 			random(), random(), random(), random(), random());
 	hv = hhash(msgid);
 	if (Action == 1) {
-	    HistoryLookupByHash(hv, NULL);
+	    HistoryLookupByHash(hv, &h);
 	} else if (Action == 2) {
 	    h.hv = hv;
 	    h.gmt = 1;
@@ -260,6 +355,43 @@ DoIt(int Action, int count, ForkMap *smap)
 	smap->count++;
     }
     gettimeofday(&smap->tend, NULL);
+    HistoryClose();
     exit(0);
 }
 
+
+/*
+ * Add random entries until the history holds pct% as many entries as
+ * it has hash slots (version 3) or hash chains (older versions).
+ */
+void
+Prefill(int pct)
+{
+    char msgid[512];
+    History h = { 0 };
+    uint32 slots;
+    uint32 n;
+    uint32 want;
+    int i = 0;
+
+    HistoryOpen(HistoryFile, HGF_FAST|HGF_NOSEARCH);
+    n = HistoryLoad(&slots);
+    want = (uint32)((uint64_t)slots * pct / 100);
+    printf("Prefill     : %u entries in %u slots, filling to %d%%\n",
+							n, slots, pct);
+    srandom(time(NULL) + getpid());
+    h.gmt = time(NULL) / 60;
+    for (; n < want; ++n) {
+	sprintf(msgid,"<p%d%08lx$%08lx@%08lx.%08lx>", i++,
+			random(), random(), random(), random());
+	h.hv = hhash(msgid);
+	if (HistoryAdd(msgid, &h) != RCOK) {
+	    fprintf(stderr, "Prefill stopped at %u entries\n", n);
+	    break;
+	}
+    }
+    if (HistoryClose() != RCOK) {
+	fprintf(stderr, "Unable to write history hash table\n");
+	exit(1);
+    }
+}
@@ -139,9 +139,14 @@ main(int ac, char **av)
     if (StructSizes) {
 	printf("History Header           : %2d bytes\n", (int)sizeof(HistHead));
 	printf("History Hash Entry       : %2d bytes\n", (int)sizeof(uint32));
+	printf("History V3 Index Bucket  : %2d bytes (%d slots)\n",
+					(int)sizeof(HistBucket), HBSLOTS);
 	printf("History Entry            : %2d bytes\n", (int)sizeof(History));
 	printf("Hash Table Entries       : %d\n", DOpts.HashSize);
-	printf("Expected hash table size : %d bytes\n", DOpts.HashSize * (int)sizeof(uint32));
+	printf("Expected hash table size : %.0f bytes\n",
+			(double)((DOpts.HistoryVersion > 2) ?
+			    DOpts.HashSize / HBSLOTS : DOpts.HashSize) *
+			HIDXSIZE(DOpts.HistoryVersion));
 	exit(0);
     }
 
@@ -186,13 +191,17 @@ DumpHeader(int fd)
 	    exit(0);
 	printf("Total Size      : %.0f Bytes (%s)\n", (double)sb.st_size,
 						ftos((double)sb.st_size));
-	printf("Hash Table Size : %d Bytes (%s)\n",
-				hh.hashSize * (int)sizeof(HistIndex),
-				ftos((double)hh.hashSize * sizeof(HistIndex)));
-	printf("Total Entries   : %.0f\n",
-	    ((double)sb.st_size - (double)hh.headSize -
-				(double)hh.hashSize * sizeof(HistIndex)) /
-								hh.henSize);
+	double entries = ((double)sb.st_size - (double)hh.headSize -
+			(double)hh.hashSize * HIDXSIZE(hh.version)) / hh.henSize;
+
+	printf("Hash Table Size : %.0f Bytes (%s)\n",
+				(double)hh.hashSize * HIDXSIZE(hh.version),
+				ftos((double)hh.hashSize * HIDXSIZE(hh.version)));
+	printf("Total Entries   : %.0f\n", entries);
+	if (hh.version > 2)
+	    printf("Index Load      : %.1f%% of %.0f slots\n",
+				entries * 100.0 / ((double)hh.hashSize * HBSLOTS),
+				(double)hh.hashSize * HBSLOTS);
     }
     exit(0);
 }
@@ -189,7 +189,7 @@ main(int ac, char **av)
 	    fprintf(stderr, "Corrupted history file - bad magic\n");
 	    exit(1);
 	}
-	if (hh.version != HVERSION) {
+	if (hh.version > HVERSION) {
 	    fprintf(stderr, "WARNING! Version mismatch file V%d, expecting V%d\n", hh.version, HVERSION);
 	    fprintf(stderr, "dump may be invalid\n");
 	}
@@ -232,7 +232,7 @@ DoUnDead(int fd)
 	fprintf(stderr, "History file not marked as dead\n");
 	return;
     }
-    if (hh.version != HVERSION) {
+    if (hh.version > HVERSION) {
 	 fprintf(stderr, "ERROR! Version mismatch file V%d, expecting V%d\n", hh.version, HVERSION);
 	return;
     }
@@ -279,9 +279,9 @@ DoExpire(int fd, int hsize, int rsize)
     }
 
     if (HistoryVersion > 1)
-	seekpos = lseek(fd, hsize * sizeof(HistIndex) + rsize, 1);
+	seekpos = lseek(fd, (off_t)hsize * HIDXSIZE(HistoryVersion) + rsize, 1);
     else
-	seekpos = lseek(fd, hsize * sizeof(HistIndex), 1);
+	seekpos = lseek(fd, (off_t)hsize * HIDXSIZE(HistoryVersion), 1);
 
     {
 	struct stat st;
@@ -296,6 +296,13 @@ DoExpire(int fd, int hsize, int rsize)
 				(long long)seekpos, totalentries);
     }
 
+    /*
+     * A version 3 index must be big enough to hold everything we keep
+     */
+    NewHSize = HistoryHashSizeFor(totalentries);
+    if (!QuietOpt)
+	printf("New history hash size %u\n", NewHSize);
+
     HistoryOpen(NewFileName, HGF_FAST|HGF_NOSEARCH|HGF_EXCHECK);
 
     gettimeofday(&tstart, NULL);
@@ -331,6 +338,12 @@ DoExpire(int fd, int hsize, int rsize)
 	    } else {
 		off_t seekpos = lseek(fd, 0, SEEK_CUR);
 		HistHead hh = { 0 };
+
+		/*
+		 * Mark the history dead under the append lock, anyone who
+		 * appends after this will see it and move to the new one.
+		 */
+		hflock(fd, 4, XLOCK_EX);
 		if (lseek(fd, 0, SEEK_SET) == -1)
 		    Fail(FileName, "Unable to seek to pos 0 in history");
 		if (read(fd, &hh, sizeof(hh)) == -1)
@@ -342,6 +355,7 @@ DoExpire(int fd, int hsize, int rsize)
 		    perror("historyheadwrite");
 		    Fail(FileName, "Unable to write history header");
 		}
+		hflock(fd, 4, XLOCK_UN);
 		if (lseek(fd, seekpos, SEEK_SET) == -1)
 		    Fail(FileName, "Unable to seek in history");
 		DonePause = 2;
@@ -58,8 +58,25 @@ typedef struct Retain {
 typedef struct Track {
     pid_t	tr_Pid;
     char	addr[64];
+    int		tr_Pool;	/* pre-forked child				*/
+    int		tr_Busy;	/* pre-forked child is running a session	*/
 } Track;
 
+/*
+ * Passed with the descriptor of an accepted connection to a pre-forked
+ * child (feederprefork)
+ */
+
+typedef struct PoolMsg {
+    int		pm_Count;
+    char	pm_Addr[NI_MAXHOST];
+#ifdef INET6
+    struct sockaddr_storage pm_Sa;
+#else
+    struct sockaddr_in pm_Sa;
+#endif
+} PoolMsg;
+
 #define RET_CLOSE	1
 #define RET_PAUSE	2
 #define RET_LOCK	3
@@ -67,9 +84,17 @@ typedef struct Track {
 #define REJMSGSIZE	1024
 
 #define MINARTSIZE      80   /* Reject articles smaller than this. This is a conservative estimate */
+#define FEEDERREADSIZE	(64 * 1024)	/* minimum incoming read buffer */
 
 void DiabloServer(int passedfd);
 void DoAccept(int lfd);
+void ChildInit(int slot, int pfd, int keepfd);
+void DoChild(int fd, int slot, struct sockaddr *sa, char *addrst, int count, time_t started);
+void PoolSpawn(void);
+int PoolDispatch(int fd, struct sockaddr *sa, char *addrst, int count);
+void PoolChild(int slot, int pfd);
+int PoolSend(int pfd, int fd, PoolMsg *pm);
+int PoolRecv(int pfd, PoolMsg *pm);
 void DoPipe(int fd);
 void DoSession(int fd, int count);
 void LogSession(void);
@@ -96,6 +121,7 @@ void writePath(time_t t, char *path);
 
 void writeFeedOut(const char *label, const char *file, const char *msgid, const char *offSize, int rt, int headOnly, const char *artType, const char *cSize);
 void flushFeeds(int justClose);
+void DoSOut(char *path, char *offsize, char *rawMsgId, char *nglist, char *dist, char *npath, char *headOnly, char *artType, char *cSize);
 void flushFeedOut(Feed *fe);
 
 void FeedRSet(FILE *fo);
@@ -159,6 +185,9 @@ int	ReadOnlyCxn = 0;		/* Read-only client connection */
 int	ReadOnlyMode = 0;		/* Server switched to RO mode */
 pid_t	HostCachePid = 0;
 time_t	SpoolAllocTime = 0;
+time_t	PoolSpawnTime = 0;
+int	PoolChildMode = 0;		/* we are a pre-forked child */
+int	PoolSessions = 0;		/* sessions run by a pre-forked child */
 
 FILE	*PathFd = NULL;
 time_t	PathFdT = 0;
@@ -843,12 +872,19 @@ DiabloServer(int lfd)
     }
 
     /*
-     * Call InitPreCommit() and InitSpamFilter() to setup any shared memory
+     * Call InitPreCommit(), InitHistoryCommit() and InitSpamFilter() to
+     * setup any shared memory
      * segments.  These need to be created and mapped prior to any forks that
-     * we do.
+     * we do.  HistoryFilterReset() invalidates any history filter left
+     * from a previous run, the first child to open the history rebuilds it.
      */
 
     InitPreCommit();
+    HistoryFilterReset();
+    if (DOpts.HistoryCommit)
+	InitHistoryCommit(MAXFDS);
+    if (DOpts.FeederQueue > 0)
+	InitFeedQueue(DOpts.FeederQueue);
     SetSpamFilterOpt();
     if (DOpts.SpamFilterOpt != NULL)
 	InitSpamFilter();
@@ -897,6 +933,22 @@ DiabloServer(int lfd)
 	if (HostCachePid == 0)
 	    HostCachePid = LoadHostAccess(t, 0, DOpts.HostCacheRebuildTime);
 
+	/*
+	 * Top up the pre-forked children, at most once a second so a
+	 * child that keeps dying can't make us fork in a loop.
+	 */
+	if (DOpts.FeederPrefork > 0 && t != PoolSpawnTime &&
+	    Exiting == 0 && PausedCount == 0 && ReadOnlyMode == 0
+	) {
+	    PoolSpawnTime = t;
+	    PoolSpawn();
+	}
+
+	/*
+	 * Don't sleep on records the children have queued already
+	 */
+	FeedQueueSleep(&tv);
+
 	n = select(MaxFds, &rfds, NULL, NULL, &tv);
 
 	if (lfd != -1 && FD_ISSET(lfd, &rfds))
@@ -919,6 +971,9 @@ DiabloServer(int lfd)
 	} while (n && i != fdrotor);
 	fdrotor = i;
 
+	FeedQueueWake();
+	FeedQueueDrain(1024, DoSOut);
+
 	{
 	    pid_t pid;
 
@@ -988,9 +1043,6 @@ void
 DoAccept(int lfd)
 {
     int fd;
-    int delaylen;
-    int curtime = (int)(time(NULL));
-    int dt = (int)(SessionMark);
     char addrst[NI_MAXHOST];
 #ifdef INET6
     struct sockaddr_storage res;
@@ -1011,6 +1063,11 @@ DoAccept(int lfd)
 	int fds[2] = { -1, -1 };
 	int ok = 0;
 	int count = 0;
+#ifdef INET6
+	struct sockaddr *sa = (struct sockaddr *)&res;
+#else
+	struct sockaddr *sa = (struct sockaddr *)&asin;
+#endif
 
 	fcntl(fd, F_SETFL, 0);
 
@@ -1078,6 +1135,15 @@ DoAccept(int lfd)
 	    ok = -1;
 	}
 
+	/*
+	 * Hand the connection to an idle pre-forked child if we have one
+	 */
+
+	if (ok == 0 && PoolDispatch(fd, sa, addrst, count) == 0) {
+	    close(fd);
+	    return;
+	}
+
 	if (ok == 0 && pipe(fds) == 0 && fds[0] < MAXFDS) {
 	    pid_t pid;
 
@@ -1095,165 +1161,8 @@ DoAccept(int lfd)
 	    fflush(stderr);
 
 	    if ((pid = fork()) == 0) {
-		int i;
-		time_t SessionCheck = SessionBeg = SessionMark = time(NULL);
-
-		flushFeeds(1);	/* close feed descriptors without flushing */
-		CloseIncomingLog();
-		ClosePathLog(0);
-		CloseArtLog(0);
-		DiabFilterClose(0);
-
-		if (HasStatusLine)
-		    stprintf("%s", addrst);
-
-		CloseLog(NULL, 1);
-
-		for (i = 0; i < MaxFds; ++i) {
-		    if (i > 2 && i != fds[1] && i != fd && i != ZoneFd && i != BodyFilterFd && i != NphFilterFd) {
-			if (PipeAry[fd] != NULL) {
-			    bclose(PipeAry[fd], 0);
-			    PipeAry[fd] = NULL;
-			}
-			close(i);
-		    }
-		}
-
-		OpenLog("diablo", (DebugOpt ? LOG_PERROR : 0)|LOG_PID|LOG_NDELAY);
-
-		if (HLabel[0] != 0)
-		    nice(FeedPriority(HLabel));
-
-		FeedFo = fdopen(fds[1], "w");
-#ifdef INET6
-		if ((HName = Authenticate(fd, (struct sockaddr *)&res, addrst, HLabel)) == NULL) {
-#else
-		if ((HName = Authenticate(fd, (struct sockaddr *)&asin,
-						addrst, HLabel)) == NULL) {
-#endif
-		    FILE *fo = fdopen(fd, "w");
-
-		    if (fo == NULL) {
-			logit(LOG_CRIT, "fdopen() of socket failed");
-			exit(1);
-		    }
-		    if (DOpts.DisplayAdminVersion && DOpts.NewsAdmin != NULL)
-			xfprintf(fo, "502 %s: Transfer permission denied to %s - %s (DIABLO %s-%s)\r\n",
-						DOpts.FeederHostName,
-						addrst,
-						DOpts.NewsAdmin,
-						VERS, SUBREV);
-		    else
-			xfprintf(fo, "502 %s: Transfer permission denied to %s\r\n",
-						DOpts.FeederHostName,
-						addrst);
-		    logit(LOG_INFO, "Connection %d from %s (no permission)",
-			fds[0],
-			addrst
-		    );
-		    exit(0);
-		}
-		if (HLabel[0] == 0) {
-		    FILE *fo = fdopen(fd, "w");
-
-		    if (fo == NULL) {
-			logit(LOG_CRIT, "fdopen() of socket failed");
-			exit(1);
-		    }
-		    if (DOpts.DisplayAdminVersion && DOpts.NewsAdmin != NULL)
-			xfprintf(fo, "502 %s DIABLO Misconfiguration, label missing in dnewsfeeds, contact %s\r\n",
-						DOpts.FeederHostName,
-						DOpts.NewsAdmin);
-		    else
-			xfprintf(fo, "502 %s DIABLO Misconfiguration, label missing in dnewsfeeds\r\n",
-						DOpts.FeederHostName);
-		    logit(LOG_CRIT, "Diablo misconfiguration, label for %s not found in dnewsfeeds", HName);
-		    exit(0);
-		}
-
-		if (strcmp(HLabel, "%STATS") == 0) {
-		    FILE *fo = fdopen(fd, "w");
-		    int dt = (int)(time(NULL) - SessionCheck);
-
-		    if (fo == NULL) {
-			logit(LOG_CRIT, "fdopen() of socket failed");
-			exit(1);
-		    }
-		    DoStats(fo, dt, 0);
-		    fflush(fo);
-		    exit(0);
-		}
-
-		DidFork = 1;
-
-		if (HasStatusLine)
-		    stprintf("%s", HName);
-
-		delaylen = FeedInDelay(HLabel);
-
-		if((curtime - dt) < delaylen) {
-			FILE *fo = fdopen(fd, "w");
-
-			if (DOpts.DisplayAdminVersion && DOpts.NewsAdmin != NULL)
-				xfprintf(fo, "400 %s: System starting up - Try again in a few minutes - %s (DIABLO %s-%s)\r\n",
-						DOpts.FeederHostName,
-						DOpts.NewsAdmin,
-						VERS, SUBREV);
-			else
-				xfprintf(fo, "400 %s: System starting up - Try again in a few minutes\r\n",
-						DOpts.FeederHostName);
-			logit(LOG_INFO, "System starting up: %s is delayed for %d seconds", DOpts.FeederHostName, delaylen);
-			exit(0);
-		}
-
-		logit(LOG_INFO, "Connection %d from %s %s",
-		    fds[0],
-		    HName,
-		    addrst
-		);
-
-		/*
-		 * Free the parent process memory pool, which the child does not
-		 * use (obviously!)
-		 */
-
-		freePool(&ParProcMemPool);
-
-		/*
-		 * Free memory used by DiabFilter as well, because it's only
-		 * used in the parent.
-		 */
-
-		DiabFilter_freeMem();
-
-		/*
-		 * Simple session debugging support
-		 */
-		if (DebugLabel && HLabel[0] && strcmp(DebugLabel, HLabel) == 0) {
-		    char path[256];
-		    int tfd;
-
-		    sprintf(path, "/tmp/diablo.debug.%d", (int)getpid());
-		    DebugOpt = 1;
-		    remove(path);
-		    if ((tfd = open(path, O_EXCL|O_CREAT|O_TRUNC|O_RDWR, 0600)) >= 0) {
-			close(tfd);
-			freopen(path, "a", stderr);
-			freopen(path, "a", stdout);
-			printf("Debug label %s pid %d\n", HLabel, (int)getpid());
-		    } else {
-			printf("Unable to create %s\n", path);
-		    }
-		}
-
-		DoSession(fd, count);
-		LogSession();
-		logit(LOG_INFO, "Disconnect %d from %s %s (%d elapsed)",
-		    fds[0],
-		    HName,
-		    addrst,
-		    (int)(time(NULL) - SessionBeg)
-		);
+		ChildInit(fds[0], fds[1], fd);
+		DoChild(fd, fds[0], sa, addrst, count, SessionMark);
 		exit(0);
 	    }
 	    if (pid < 0) {
@@ -1287,6 +1196,410 @@ DoAccept(int lfd)
     }
 }
 
+/*
+ * CHILDINIT()	- setup common to every child: drop the master's
+ *		  descriptors and state and send feed output over pfd
+ */
+
+void
+ChildInit(int slot, int pfd, int keepfd)
+{
+    int i;
+
+    flushFeeds(1);	/* close feed descriptors without flushing */
+    HistoryCommitSlot(slot);
+    SpamFilterChild();
+    CloseIncomingLog();
+    ClosePathLog(0);
+    CloseArtLog(0);
+    DiabFilterClose(0);
+
+    CloseLog(NULL, 1);
+
+    for (i = 0; i < MaxFds; ++i) {
+	if (i > 2 && i != pfd && i != keepfd && i != ZoneFd && i != BodyFilterFd && i != NphFilterFd) {
+	    if (PipeAry[i] != NULL) {
+		bclose(PipeAry[i], 0);
+		PipeAry[i] = NULL;
+	    }
+	    close(i);
+	}
+    }
+
+    OpenLog("diablo", (DebugOpt ? LOG_PERROR : 0)|LOG_PID|LOG_NDELAY);
+
+    FeedFo = fdopen(pfd, "w");
+
+    /*
+     * Free the parent process memory pool, which the child does not
+     * use (obviously!)
+     */
+
+    freePool(&ParProcMemPool);
+
+    /*
+     * Free memory used by DiabFilter as well, because it's only
+     * used in the parent.
+     */
+
+    DiabFilter_freeMem();
+}
+
+/*
+ * DOCHILD()	- authenticate and run one incoming session in a child.
+ *		  started is when the master started, for the feed
+ *		  startup delay.
+ */
+
+void
+DoChild(int fd, int slot, struct sockaddr *sa, char *addrst, int count, time_t started)
+{
+    time_t SessionCheck = SessionBeg = SessionMark = time(NULL);
+    int delaylen;
+
+    if (HasStatusLine)
+	stprintf("%s", addrst);
+
+    if (HLabel[0] != 0)
+	nice(FeedPriority(HLabel));
+
+    if ((HName = Authenticate(fd, sa, addrst, HLabel)) == NULL) {
+	FILE *fo = fdopen(fd, "w");
+
+	if (fo == NULL) {
+	    logit(LOG_CRIT, "fdopen() of socket failed");
+	    exit(1);
+	}
+	if (DOpts.DisplayAdminVersion && DOpts.NewsAdmin != NULL)
+	    xfprintf(fo, "502 %s: Transfer permission denied to %s - %s (DIABLO %s-%s)\r\n",
+				    DOpts.FeederHostName,
+				    addrst,
+				    DOpts.NewsAdmin,
+				    VERS, SUBREV);
+	else
+	    xfprintf(fo, "502 %s: Transfer permission denied to %s\r\n",
+				    DOpts.FeederHostName,
+				    addrst);
+	logit(LOG_INFO, "Connection %d from %s (no permission)",
+	    slot,
+	    addrst
+	);
+	exit(0);
+    }
+    if (HLabel[0] == 0) {
+	FILE *fo = fdopen(fd, "w");
+
+	if (fo == NULL) {
+	    logit(LOG_CRIT, "fdopen() of socket failed");
+	    exit(1);
+	}
+	if (DOpts.DisplayAdminVersion && DOpts.NewsAdmin != NULL)
+	    xfprintf(fo, "502 %s DIABLO Misconfiguration, label missing in dnewsfeeds, contact %s\r\n",
+				    DOpts.FeederHostName,
+				    DOpts.NewsAdmin);
+	else
+	    xfprintf(fo, "502 %s DIABLO Misconfiguration, label missing in dnewsfeeds\r\n",
+				    DOpts.FeederHostName);
+	logit(LOG_CRIT, "Diablo misconfiguration, label for %s not found in dnewsfeeds", HName);
+	exit(0);
+    }
+
+    if (strcmp(HLabel, "%STATS") == 0) {
+	FILE *fo = fdopen(fd, "w");
+	int dt = (int)(time(NULL) - SessionCheck);
+
+	if (fo == NULL) {
+	    logit(LOG_CRIT, "fdopen() of socket failed");
+	    exit(1);
+	}
+	DoStats(fo, dt, 0);
+	fflush(fo);
+	exit(0);
+    }
+
+    DidFork = 1;
+
+    if (HasStatusLine)
+	stprintf("%s", HName);
+
+    delaylen = FeedInDelay(HLabel);
+
+    if((time(NULL) - started) < delaylen) {
+	    FILE *fo = fdopen(fd, "w");
+
+	    if (DOpts.DisplayAdminVersion && DOpts.NewsAdmin != NULL)
+		    xfprintf(fo, "400 %s: System starting up - Try again in a few minutes - %s (DIABLO %s-%s)\r\n",
+				    DOpts.FeederHostName,
+				    DOpts.NewsAdmin,
+				    VERS, SUBREV);
+	    else
+		    xfprintf(fo, "400 %s: System starting up - Try again in a few minutes\r\n",
+				    DOpts.FeederHostName);
+	    logit(LOG_INFO, "System starting up: %s is delayed for %d seconds", DOpts.FeederHostName, delaylen);
+	    exit(0);
+    }
+
+    logit(LOG_INFO, "Connection %d from %s %s",
+	slot,
+	HName,
+	addrst
+    );
+
+    /*
+     * Simple session debugging support
+     */
+    if (DebugLabel && HLabel[0] && strcmp(DebugLabel, HLabel) == 0) {
+	char path[256];
+	int tfd;
+
+	sprintf(path, "/tmp/diablo.debug.%d", (int)getpid());
+	DebugOpt = 1;
+	remove(path);
+	if ((tfd = open(path, O_EXCL|O_CREAT|O_TRUNC|O_RDWR, 0600)) >= 0) {
+	    close(tfd);
+	    freopen(path, "a", stderr);
+	    freopen(path, "a", stdout);
+	    printf("Debug label %s pid %d\n", HLabel, (int)getpid());
+	} else {
+	    printf("Unable to create %s\n", path);
+	}
+    }
+
+    DoSession(fd, count);
+    LogSession();
+    logit(LOG_INFO, "Disconnect %d from %s %s (%d elapsed)",
+	slot,
+	HName,
+	addrst,
+	(int)(time(NULL) - SessionBeg)
+    );
+}
+
+/*
+ * POOLSPAWN()	- start pre-forked children until there are feederprefork
+ *		  of them.  Each child talks to the master over a
+ *		  socketpair: the master passes it connections with
+ *		  SCM_RIGHTS, the child returns the usual feed lines and
+ *		  an IDLE line after each session.
+ */
+
+void
+PoolSpawn(void)
+{
+    int n = 0;
+    int i;
+
+    for (i = 0; i < MaxFds; ++i) {
+	if (PidAry[i].tr_Pid && PidAry[i].tr_Pool)
+	    ++n;
+    }
+    while (n < DOpts.FeederPrefork && NumForks < MAXFORKS) {
+	int fds[2];
+	pid_t pid;
+
+	if (socketpair(PF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+	    logit(LOG_EMERG, "socketpair() failed: %s", strerror(errno));
+	    break;
+	}
+	if (fds[0] >= MAXFDS) {
+	    logit(LOG_WARNING, "Maximum file descriptors exceeded");
+	    close(fds[0]);
+	    close(fds[1]);
+	    break;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	if ((pid = fork()) == 0) {
+	    ChildInit(fds[0], fds[1], -1);
+	    PoolChild(fds[0], fds[1]);
+	    exit(0);
+	}
+	close(fds[1]);
+	if (pid < 0) {
+	    logit(LOG_EMERG, "fork failed: %s", strerror(errno));
+	    close(fds[0]);
+	    break;
+	}
+	++n;
+	++NumForks;
+	bzero(&PidAry[fds[0]], sizeof(PidAry[0]));
+	PidAry[fds[0]].tr_Pid = pid;
+	PidAry[fds[0]].tr_Pool = 1;
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	FD_SET(fds[0], &RFds);
+	if (MaxFds <= fds[0])
+	    MaxFds = fds[0] + 1;
+    }
+}
+
+/*
+ * POOLDISPATCH() - pass an accepted connection to an idle pre-forked
+ *		    child.  Returns 0 if a child took it, -1 if the
+ *		    caller has to fork.
+ */
+
+int
+PoolDispatch(int fd, struct sockaddr *sa, char *addrst, int count)
+{
+    PoolMsg pm;
+    int i;
+
+    if (DOpts.FeederPrefork <= 0)
+	return(-1);
+
+    for (i = 0; i < MaxFds; ++i) {
+	Track *tr = &PidAry[i];
+
+	if (tr->tr_Pid == 0 || tr->tr_Pool == 0 || tr->tr_Busy)
+	    continue;
+	if (!FD_ISSET(i, &RFds))	/* child went away */
+	    continue;
+
+	bzero(&pm, sizeof(pm));
+	pm.pm_Count = count;
+	snprintf(pm.pm_Addr, sizeof(pm.pm_Addr), "%s", addrst);
+	bcopy(sa, &pm.pm_Sa, sizeof(pm.pm_Sa));
+	if (PoolSend(i, fd, &pm) < 0) {
+	    logit(LOG_ERR, "passing connection to pid %d failed: %s",
+					(int)tr->tr_Pid, strerror(errno));
+	    continue;
+	}
+	tr->tr_Busy = 1;
+	strncpy(tr->addr, addrst, sizeof(tr->addr) - 1);
+	tr->addr[sizeof(tr->addr) - 1] = '\0';
+	return(0);
+    }
+    return(-1);
+}
+
+/*
+ * POOLCHILD()	- main loop of a pre-forked child.  dnewsfeeds, the
+ *		  spool configuration and the history stay loaded
+ *		  between sessions, they are only rechecked for changes.
+ *		  Sessions refused before DoSession() returns still exit
+ *		  the child, the master starts a replacement.
+ */
+
+void
+PoolChild(int slot, int pfd)
+{
+    time_t started = SessionMark;
+    PoolMsg pm;
+    int fd;
+
+    DidFork = 1;
+    PoolChildMode = 1;
+
+    while (PoolSessions < DOpts.FeederPreforkSessions) {
+	time_t t;
+
+	if (HasStatusLine)
+	    stprintf("idle");
+	if ((fd = PoolRecv(pfd, &pm)) < 0)
+	    break;
+
+	t = time(NULL);
+	LoadSpoolCtl(t, 0);
+	LoadNewsFeed(t, 0, NULL);
+	ClearNewsFeedCache();
+	SpoolAllocTime = t;
+	AllocateSpools(SpoolAllocTime);
+
+	HLabel[0] = 0;
+	ReadOnlyCxn = 0;
+	if (pm.pm_Addr[0]) {
+	    strncpy(PeerIpName, pm.pm_Addr, sizeof(PeerIpName) - 1);
+	    PeerIpName[sizeof(PeerIpName) - 1] = '\0';
+	    bhash(&PeerIpHash, PeerIpName, strlen(PeerIpName));
+	}
+
+	DoChild(fd, slot, (struct sockaddr *)&pm.pm_Sa, pm.pm_Addr,
+							pm.pm_Count, started);
+	++PoolSessions;
+	if (HName != NULL)
+	    zfreeStr(&SysMemPool, &HName);
+
+	/*
+	 * Only ask for more work if we are going to take it, the master
+	 * would otherwise pass a connection to a child that is exiting.
+	 */
+	if (PoolSessions < DOpts.FeederPreforkSessions)
+	    fprintf(FeedFo, "IDLE\n");
+	fflush(FeedFo);
+    }
+}
+
+/*
+ * POOLSEND()/POOLRECV() - pass a descriptor and its PoolMsg over the
+ *			   child's socketpair
+ */
+
+int
+PoolSend(int pfd, int fd, PoolMsg *pm)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    char tbuf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg;
+
+    bzero(&msg, sizeof(msg));
+    iov.iov_base = (void *)pm;
+    iov.iov_len = sizeof(PoolMsg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = tbuf;
+    msg.msg_controllen = sizeof(tbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    msg.msg_controllen = cmsg->cmsg_len;
+
+    if (sendmsg(pfd, &msg, 0) != sizeof(PoolMsg))
+	return(-1);
+    return(0);
+}
+
+int
+PoolRecv(int pfd, PoolMsg *pm)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    char tbuf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr *cmsg;
+    int fd = -1;
+    int r;
+
+    bzero(&msg, sizeof(msg));
+    iov.iov_base = (void *)pm;
+    iov.iov_len = sizeof(PoolMsg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = tbuf;
+    msg.msg_controllen = sizeof(tbuf);
+
+    do {
+	r = recvmsg(pfd, &msg, MSG_WAITALL);
+    } while (r < 0 && errno == EINTR);
+
+    if ((cmsg = CMSG_FIRSTHDR(&msg)) != NULL &&
+	cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+    ) {
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (r != sizeof(PoolMsg)) {
+	if (r < 0)
+	    logit(LOG_ERR, "recvmsg from master failed: %s", strerror(errno));
+	if (fd >= 0)
+	    close(fd);
+	return(-1);
+    }
+    return(fd);
+}
+
 /*
  * DOPIPE()	- handle data returned from our children over a pipe
  */
@@ -1299,6 +1612,65 @@ fwCallBack(const char *hlabel, const char *msgid, const char *path, const char *
     return(0);
 }
 
+/*
+ * DOSOUT()	- an article stored by a child: a SOUT line from its pipe
+ *		  or a record from the feed queue.
+ */
+
+void
+DoSOut(char *path, char *offsize, char *rawMsgId, char *nglist, char *dist, char *npath, char *headOnly, char *artType, char *cSize)
+{
+    const char *msgid = MsgId(rawMsgId, NULL);
+    int bytes;
+
+    if (DebugOpt > 2) {
+	ddprintf(
+	    "%d SOUTLINE: %s %s %s %s %s HO=%s AT=%s %s\n",
+	    (int)getpid(), 
+	    path, 
+	    offsize,
+	    msgid,
+	    nglist,
+	    npath, 
+	    headOnly != NULL ? headOnly : "",
+	    artType != NULL ? artType : "",
+	    cSize != NULL? cSize : ""
+	);
+    }
+
+    if (path && offsize && msgid && nglist && npath && headOnly) {
+	int spamArt = 0;
+
+	bytes = 0;
+	{
+	    char *p;
+	    if ((p = strchr(offsize, ',')) != NULL)
+		bytes = strtol(p + 1, NULL, 0);
+	}
+
+	if (DOpts.FeederFilter != NULL && 
+		FeedSpam(2, nglist, npath, dist, artType, bytes))
+	{
+	    static char loc[PATH_MAX];
+
+	    snprintf(loc, sizeof(loc), "%s:%s", path, offsize);
+	    spamArt = DiabFilter(DOpts.FeederFilter, loc, DOpts.WireFormat);
+	}
+	FeedWrite(1, fwCallBack, msgid, path, offsize, nglist,
+			npath, dist, headOnly, artType, spamArt, cSize);
+	{
+	    TtlStats.ArtsBytes += (double)bytes;
+	}
+	TtlStats.ArtsReceived += 1.0;
+	if (++LogCount == 1024) {
+	    LogCount = 0;
+	    LogSession2();
+	}
+	WritePath(npath);
+	WriteArtLog(npath, bytes, artType, nglist);
+    }
+}
+
 void
 DoPipe(int fd)
 {
@@ -1325,7 +1697,7 @@ DoPipe(int fd)
 	if (strncmp(s1, "SOUT", 4) == 0) {
 	    char *path = strtok(NULL, "\t\n");
 	    char *offsize = strtok(NULL, "\t\n");
-	    const char *msgid = MsgId(strtok(NULL, "\t\n"), NULL);
+	    char *msgid = strtok(NULL, "\t\n");
 	    char *nglist = strtok(NULL, "\t\n");
 	    char *dist = strtok(NULL, "\t\n");
 	    char *npath = strtok(NULL, "\t\n");
@@ -1333,54 +1705,16 @@ DoPipe(int fd)
 	    char *artType = strtok(NULL, "\t\n");
 	    char *cSize = strtok(NULL, "\t\n");
 
-	    if (DebugOpt > 2) {
-		ddprintf(
-		    "%d SOUTLINE: %s %s %s %s %s HO=%s AT=%s %s\n",
-		    (int)getpid(), 
-		    path, 
-		    offsize,
-		    msgid,
-		    nglist,
-		    npath, 
-		    headOnly != NULL ? headOnly : "",
-		    artType != NULL ? artType : "",
-		    cSize != NULL? cSize : ""
-		);
-	    }
-
-	    if (path && offsize && msgid && nglist && npath && headOnly) {
-		int spamArt = 0;
-
-		bytes = 0;
-		{
-		    char *p;
-		    if ((p = strchr(offsize, ',')) != NULL)
-			bytes = strtol(p + 1, NULL, 0);
-		}
-
-		if (DOpts.FeederFilter != NULL && 
-			FeedSpam(2, nglist, npath, dist, artType, bytes))
-		{
-		    static char loc[PATH_MAX];
-
-		    snprintf(loc, sizeof(loc), "%s:%s", path, offsize);
-		    spamArt = DiabFilter(DOpts.FeederFilter, loc, DOpts.WireFormat);
-		}
-		FeedWrite(1, fwCallBack, msgid, path, offsize, nglist,
-				npath, dist, headOnly, artType, spamArt, cSize);
-		{
-		    TtlStats.ArtsBytes += (double)bytes;
-		}
-		TtlStats.ArtsReceived += 1.0;
-		if (++LogCount == 1024) {
-		    LogCount = 0;
-		    LogSession2();
-		}
-		WritePath(npath);
-		WriteArtLog(npath, bytes, artType, nglist);
-	    }
+	    DoSOut(path, offsize, msgid, nglist, dist, npath, headOnly,
+							artType, cSize);
 	} else if (strncmp(s1, "FLUSH", 5) == 0) {
 	    flushFeeds(0);
+	} else if (strncmp(s1, "IDLE", 4) == 0) {
+	    /*
+	     * pre-forked child finished its session
+	     */
+	    PidAry[fd].tr_Busy = 0;
+	    PidAry[fd].addr[0] = 0;
 	}
 
 	if (--maxCount == 0)
@@ -1396,6 +1730,8 @@ DoPipe(int fd)
 	}
 	close(fd);
 	FD_CLR(fd, &RFds);
+	PidAry[fd].tr_Pool = 0;
+	PidAry[fd].tr_Busy = 0;
 	--NumForks;
     }
 }
@@ -1533,6 +1869,10 @@ flushFeeds(int justClose)
 {
     Feed *fe;
 
+    if (justClose == 0) {
+	while (FeedQueueDrain(1024, DoSOut) > 0)
+	    ;
+    }
     while ((fe = FeBase) != NULL) {
 	if (justClose == 0)
 	    flushFeedOut(fe);
@@ -1611,7 +1951,8 @@ DoSession(int fd, int count)
 	    logit(LOG_CRIT, "DoSession: dup()");
 	    exit(1);
 	}
-	bi = bopen(nfd, DOpts.FeederBufferSize);
+	bi = bopen(nfd, (DOpts.FeederBufferSize < FEEDERREADSIZE) ?
+					FEEDERREADSIZE : DOpts.FeederBufferSize);
 	fo = fdopen(fd, "w");
 
 	if (bi == NULL || fo == NULL) {
@@ -1632,7 +1973,8 @@ DoSession(int fd, int count)
 	exit(0);
     }
 
-    LoadNewsFeed(0, 1, HLabel);	/* free old memory and load only our label */
+    if (PoolChildMode == 0)
+	LoadNewsFeed(0, 1, HLabel); /* free old memory and load only our label */
 
     ConfigNewsFeedSockOpts(HLabel, nfd, fd);
 
@@ -1643,7 +1985,8 @@ DoSession(int fd, int count)
 	exit(0);
     }
 
-    HistoryOpen(NULL, 0);
+    if (PoolSessions == 0)
+	HistoryOpen(NULL, 0);
 
     switch(FeedValid(HLabel, &count)) {
     case FEED_VALID:
@@ -1678,7 +2021,7 @@ DoSession(int fd, int count)
     ReadOnlyCxn = FeedReadOnly(HLabel);
 				/* force read-only?			   */
 
-    if ((DOpts.FeederActiveEnabled && (DOpts.FeederXRefSync || DOpts.FeederXRefSlave == 0)) || DOpts.FeederActiveDrop)
+    if (PoolSessions == 0 && ((DOpts.FeederActiveEnabled && (DOpts.FeederXRefSync || DOpts.FeederXRefSlave == 0)) || DOpts.FeederActiveDrop))
 	InitDActive(ServerDActivePat); /* initialize dactive.kp if enabled   */
 
     bzero(&Stats, sizeof(Stats));
@@ -2640,6 +2983,7 @@ LoadArticle(Buffer *bi, const char *msgid, int noWrite, int headerOnly, char *re
 	int responded = 0;
 	int headerEndLine;
 	int bodyLines = 0;
+	int lineMode = 0;
 	int addRejectToHistory = 0;
 	int arttype = ARTTYPE_DEFAULT;
 	char nglist[MAXLINE];
@@ -2695,7 +3039,138 @@ LoadArticle(Buffer *bi, const char *msgid, int noWrite, int headerOnly, char *re
 	    arttype = ARTTYPE_DEFAULT;
 	    InitArticleType();
 	}
-	while ((p = bgets(bi, &bytes)) != NULL && p != (char *)-1) {
+	while ((p = (inHeader || lineMode) ? bgets(bi, &bytes) :
+					bgetlines(bi, &bytes)) != NULL &&
+						p != (char *)-1) {
+
+	    /*
+	     * The body is taken in blocks: bgetlines() returns every
+	     * complete line in the input buffer.  Find the end of the
+	     * article, account for, classify and hash the block in one
+	     * go and copy it to the article buffer with one bwrite(),
+	     * or skip it if the article is already rejected.  Anything
+	     * that would make the line by line code below do something
+	     * else (a new error, a partial line) hands the block back and
+	     * the rest of the article is read a line at a time.
+	     */
+	    if (!inHeader && !lineMode) {
+		char *end = p + bytes;
+		char *q = p;
+		char *term = NULL;
+		int termLen = 0;
+		int lines = 0;
+		int blen;
+
+		if (!thisNl || p[bytes-1] != '\n') {
+		    bunget(bi, bytes);
+		    lineMode = 1;
+		    continue;
+		}
+		while (q < end) {
+		    char *nl = memchr(q, '\n', end - q);
+		    int n = nl + 1 - q;
+
+		    if (*q == '.' && ((n == 3 && q[1] == '\r') ||
+					(n == 2 && !DOpts.WireFormat))) {
+			term = q;
+			termLen = n;
+			break;
+		    }
+		    ++lines;
+		    q = nl + 1;
+		}
+		blen = q - p;
+
+		if (artError == 0 && DOpts.FeederMaxArtSize > 0 &&
+				size + blen + termLen > DOpts.FeederMaxArtSize) {
+		    bunget(bi, bytes);
+		    lineMode = 1;
+		    continue;
+		}
+		if (artError == 0 &&
+			(DOpts.RejectArtsWithNul || DOpts.RejectArtsWithBareCR)) {
+		    int i;
+
+		    for (i = 0; i < blen; ++i) {
+			if ((DOpts.RejectArtsWithNul && p[i] == 0) ||
+			    (DOpts.RejectArtsWithBareCR && i > 0 &&
+					p[i-1] == '\r' && p[i] != '\n')) {
+			    break;
+			}
+		    }
+		    if (i < blen) {
+			bunget(bi, bytes);
+			lineMode = 1;
+			continue;
+		    }
+		}
+
+		if (delay_counter_max) {
+		    delay_counter += lines + (term != NULL);
+		    while (delay_counter >= delay_counter_max) {
+			delay_counter -= delay_counter_max;
+			if (delay.tv_nsec)
+			    nanosleep(&delay, NULL);
+		    }
+		}
+		size += blen + termLen;
+		if (DOpts.FeederMaxArtSize > 0 && size > DOpts.FeederMaxArtSize)
+		    artError |= LAERR_TOOBIG;
+
+		if (artError) {
+		    blen = 0;
+		} else if (DOpts.FeederArtTypes && artType != NULL && blen > 0) {
+		    arttype = ArticleTypeBody(p, blen, DOpts.WireFormat);
+		}
+
+		/*
+		 * Without wireformat, replace CRLF's with LF's and undo
+		 * the dot escapes, in place.
+		 */
+		if (!DOpts.WireFormat) {
+		    char *d = p;
+
+		    for (q = p; q < p + blen; ) {
+			char *nl = memchr(q, '\n', p + blen - q);
+			char *s = q;
+			int n = nl + 1 - q;
+
+			if (n > 1 && s[n-2] == '\r')
+			    --n;
+			if (*s == '.') {
+			    ++s;
+			    --n;
+			}
+			memmove(d, s, n - 1);
+			d[n-1] = '\n';
+			d += n;
+			q = nl + 1;
+		    }
+		    blen = d - p;
+		}
+
+		if (buffer != NULL && !skipHeader && blen > 0) {
+		    if (BodyFilterFd != -1) {
+			bhash_update(p, blen);
+			bodyLines += lines;
+		    }
+		    bwrite(buffer, p, blen);
+		}
+
+		if (term == NULL)
+		    continue;
+
+		/*
+		 * End of article, give back what follows it
+		 */
+		bunget(bi, end - term - termLen);
+		if (DOpts.WireFormat && buffer != NULL &&
+						!skipHeader && !artError)
+		    bwrite(buffer, term, termLen);
+		if (retcode == RCERROR)
+		    retcode = RCOK;
+		break;
+	    }
 
 	    if (delay_counter_max) {
 		delay_counter++;
@@ -3242,7 +3717,7 @@ LoadArticle(Buffer *bi, const char *msgid, int noWrite, int headerOnly, char *re
 		bhash_final(&spamInfo.BodyHash);
 		if (nntpPostingHost[0]) {
 		    spamInfo.PostingHost = nntpPostingHost;
-		    memcpy(&spamInfo.PostingHostHash, md5hash(nntpPostingHost),
+		    memcpy(&spamInfo.PostingHostHash, spamhash(nntpPostingHost),
 					sizeof(spamInfo.PostingHostHash));
 		}
 		spamInfo.Lines = bodyLines;
@@ -3834,6 +4309,10 @@ DoStats(FILE *fo, int dt, int raw)
 		ftos(TtlStats.ArtsBytes),
 		ftos(TtlStats.ArtsFed)
     );
+    if (DOpts.HistoryFilterSize != 0)
+	DumpHistoryFilter(fo, raw);
+    DumpHistoryCommit(fo, raw);
+    DumpFeedQueue(fo, raw);
 }
 
 /*
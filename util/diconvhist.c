@@ -5,6 +5,10 @@
  *			switchover from INN to diablo.  Priming MAY
  *			run in parallel to diablo operation.
  *
+ *			With -c, convert a dhistory file to the current
+ *			history version (historyversion in diablo.config).
+ *			Conversion must NOT run in parallel to diablo.
+ *
  * (c)Copyright 1997, Matthew Dillon, All Rights Reserved.  Refer to
  *    the COPYRIGHT file in the base directory of this distribution 
  *    for specific rights granted.
@@ -12,6 +16,8 @@
 
 #include "defs.h"
 
+int ConvertHistory(const char *fileName);
+
 int
 main(int ac, char **av)
 {
@@ -25,6 +31,7 @@ main(int ac, char **av)
     int lskip = 0;
     int i;
     int fastOpt = 0;
+    int convOpt = 0;
     const char *innhName = NULL;
     uint32 gmt = time(NULL) / 60;
     FILE *fi;
@@ -44,6 +51,9 @@ main(int ac, char **av)
 	    if (*ptr == 0)
 		++i;
 	    break;
+	case 'c':
+	    convOpt = 1;
+	    break;
 	case 'f':
 	    fastOpt = 1;
 	    break;
@@ -55,8 +65,12 @@ main(int ac, char **av)
 	}
     }
 
+    if (convOpt)
+	exit(ConvertHistory(innhName));
+
     if (innhName == NULL) {
 	puts("diconvhistory [-f] innhistoryfile");
+	puts("diconvhistory -c [dhistory]");
 	exit(0);
     }
 
@@ -120,3 +134,102 @@ main(int ac, char **av)
     return(0);
 }
 
+
+/*
+ * Rewrite an existing dhistory in the history version selected in
+ * diablo.config.  The entries are copied to <file>.conv, which is then
+ * renamed over the original.  The original is kept as <file>.bak.
+ */
+
+int
+ConvertHistory(const char *fileName)
+{
+    char newName[PATH_MAX];
+    char bakName[PATH_MAX];
+    HistHead hh;
+    History hbuf[4096];
+    struct stat st;
+    off_t seekpos;
+    uint32 entries;
+    uint32 count = 0;
+    int fd;
+    int n;
+
+    if (fileName == NULL)
+	fileName = PatDbExpand(DHistoryPat);
+    snprintf(newName, sizeof(newName), "%s.conv", fileName);
+    snprintf(bakName, sizeof(bakName), "%s.bak", fileName);
+
+    if ((fd = open(fileName, O_RDWR)) < 0 || fstat(fd, &st) < 0) {
+	fprintf(stderr, "Unable to open %s: %s\n", fileName, strerror(errno));
+	return(1);
+    }
+    if (read(fd, &hh, sizeof(hh)) != sizeof(hh) || hh.hmagic != HMAGIC) {
+	fprintf(stderr, "%s: corrupted history file - bad magic\n", fileName);
+	return(1);
+    }
+    if (hh.version > HVERSION || hh.henSize != sizeof(History)) {
+	fprintf(stderr, "%s: unknown history version %d\n", fileName,
+							hh.version);
+	return(1);
+    }
+    if (hh.version == DOpts.HistoryVersion) {
+	printf("%s is already version %d\n", fileName, hh.version);
+	return(0);
+    }
+    if (hflock(fd, 0, XLOCK_EX|XLOCK_NB) < 0) {
+	fprintf(stderr, "%s is locked, is dhisexpire or diload running?\n",
+							fileName);
+	return(1);
+    }
+
+    seekpos = hh.headSize + (off_t)hh.hashSize * HIDXSIZE(hh.version);
+    if (hh.version > 1)
+	seekpos += sizeof(History);
+    entries = (uint32)((st.st_size - seekpos) / sizeof(History));
+
+    NewHVersion = DOpts.HistoryVersion;
+    NewHSize = HistoryHashSizeFor(entries);
+    printf("Converting %s V%d to V%d, %u entries, hash size %u\n",
+			fileName, hh.version, NewHVersion, entries, NewHSize);
+
+    remove(newName);
+    HistoryOpen(newName, HGF_FAST|HGF_NOSEARCH|HGF_EXCHECK);
+
+    lseek(fd, seekpos, 0);
+    while ((n = read(fd, hbuf, sizeof(hbuf))) >= (int)sizeof(History)) {
+	int i;
+
+	n /= sizeof(History);
+	for (i = 0; i < n; ++i) {
+	    if (hbuf[i].gmt == 0)
+		continue;
+	    if (HistoryAdd(NULL, &hbuf[i]) != RCOK) {
+		fprintf(stderr, "HistoryAdd failed, %s left unchanged\n",
+							fileName);
+		HistoryClose();
+		remove(newName);
+		return(1);
+	    }
+	    if ((++count % 1000000) == 0)
+		printf(" %u/%u\n", count, entries);
+	}
+    }
+    if (HistoryClose() != RCOK) {
+	fprintf(stderr, "Unable to write %s, %s left unchanged\n", newName,
+							fileName);
+	remove(newName);
+	return(1);
+    }
+
+    remove(bakName);
+    if (link(fileName, bakName) < 0)
+	fprintf(stderr, "Unable to link %s: %s\n", bakName, strerror(errno));
+    if (rename(newName, fileName) < 0) {
+	fprintf(stderr, "Unable to rename %s: %s\n", newName, strerror(errno));
+	return(1);
+    }
+    printf("Converted %u entries, old history saved as %s\n", count, bakName);
+    close(fd);
+    return(0);
+}
@@ -40,7 +40,7 @@ int DumpHashOnly = 0;
 char *FindHash = NULL;
 time_t MaxAge = -1;
 int HistoryVersion = 0;
-uint32 HOffset = 0;
+off_t HOffset = 0;
 
 uint32 ExpireDropCount = 0;
 uint32 ExpireKeepCount = 0;
@@ -52,6 +52,7 @@ uint32 DumpedCount = 0;
 void DumpTrace(int fd, int hsize, int rsize);
 void DumpQuick(int fd, int hsize, int rsize);
 void DumpChain(int fd, int hsize, int rsize, hash_t *hv);
+void DumpBuckets(int fd, int hsize, int rsize, hash_t *hv);
 
 void
 Usage(void)
@@ -258,7 +259,7 @@ main(int ac, char **av)
 	    HistoryVersion = hh.version;
 	    rsize = hh.henSize;
 	    hsize = hh.hashSize;
-	    HOffset = hh.headSize + hsize * sizeof(HistIndex);
+	    HOffset = hh.headSize + (off_t)hsize * HIDXSIZE(hh.version);
 
 	    lseek(fd, hh.headSize, 0);
 	}
@@ -345,11 +346,52 @@ PrintTrace(int fd, HistIndex index, int rsize)
     printf("\n");
 }
 
+/*
+ * Version 3 histories have no chains, dump the index buckets instead
+ */
+void
+DumpBuckets(int fd, int hsize, int rsize, hash_t *hv)
+{
+    HistBucket *Bkt = calloc(hsize, sizeof(HistBucket));
+    int b = 0;
+    int n;
+    int i;
+
+    if (read(fd, Bkt, hsize * sizeof(HistBucket)) != hsize * sizeof(HistBucket)) {
+	fprintf(stderr, "Unable to read hash table array\n");
+	exit(1);
+    }
+    if (hv != NULL)
+	b = (hv->h1 ^ hv->h2) & (hsize - 1);
+
+    for (n = 0; n < hsize; ++n, b = (b + 1) & (hsize - 1)) {
+	HistSlot *hs = Bkt[b].hb_Slot;
+
+	for (i = 0; i < HBSLOTS; ++i, ++hs) {
+	    if (hs->hs_Fp == 0)
+		break;
+	    if (hv != NULL && hs->hs_Fp != HFP(*hv))
+		continue;
+	    printf("Bucket %d.%d fp=%08x: ", b, i, hs->hs_Fp);
+	    PrintTrace(fd, hs->hs_Index, rsize);
+	}
+	if (hv != NULL && i < HBSLOTS)
+	    break;
+    }
+    free(Bkt);
+}
+
 void
 DumpTrace(int fd, int hsize, int rsize)
 {
     int i;
-    HistIndex *Ary = calloc(hsize, sizeof(HistIndex));
+    HistIndex *Ary;
+
+    if (HistoryVersion > 2) {
+	DumpBuckets(fd, hsize, rsize, NULL);
+	return;
+    }
+    Ary = calloc(hsize, sizeof(HistIndex));
 
     if (read(fd, Ary, hsize * sizeof(HistIndex)) != hsize * sizeof(HistIndex)) {
 	fprintf(stderr, "Unable to read hash table array\n");
@@ -367,9 +409,15 @@ DumpTrace(int fd, int hsize, int rsize)
 void
 DumpChain(int fd, int hsize, int rsize, hash_t *hv)
 {
-    uint32 *Ary = calloc(hsize, sizeof(uint32));
+    uint32 *Ary;
     uint32 off;
 
+    if (HistoryVersion > 2) {
+	DumpBuckets(fd, hsize, rsize, hv);
+	return;
+    }
+    Ary = calloc(hsize, sizeof(uint32));
+
     if (read(fd, Ary, hsize * sizeof(uint32)) != hsize * sizeof(uint32)) {
 	fprintf(stderr, "Unable to read hash table array\n");
 	exit(1);
@@ -407,9 +455,9 @@ DumpQuick(int fd, int hsize, int rsize)
 	seekpos = lseek(fd, -FCount * rsize, 2);
     else
 	if (HistoryVersion > 1)
-	    seekpos = lseek(fd, (off_t)hsize * sizeof(HistIndex) + (off_t)rsize, 1);
+	    seekpos = lseek(fd, (off_t)hsize * HIDXSIZE(HistoryVersion) + (off_t)rsize, 1);
 	else
-	    seekpos = lseek(fd, (off_t)hsize * sizeof(HistIndex), 1);
+	    seekpos = lseek(fd, (off_t)hsize * HIDXSIZE(HistoryVersion), 1);
 
     {
 	struct stat st;
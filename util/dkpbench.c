@@ -0,0 +1,222 @@
+/*
+ * DKPBENCH.C - key-pair database (dactive.kp) lookup benchmark
+ *
+ *	Writes a dactive.kp style database of count groups, sorts it, and
+ *	times random lookups the way GROUP does (KPDBReadRecord() plus
+ *	the NB and NE fields), in-place NE updates the way article number
+ *	assignment does, and rewrites that append a replacement record
+ *	and so leave unsorted records behind.  Every lookup is checked.
+ *	-b uses the binary search instead of the hash index.
+ */
+
+#include "defs.h"
+
+#define	COUNT	100000
+#define	LOOKUPS	1000000
+
+void Usage(void);
+void MakeDB(const char *path, int count);
+const char *GroupName(int n);
+void Lookups(KPDB *kpdb, const char *name, int count, int lookups, int update);
+double Elapsed(struct timeval *tv);
+
+void
+Usage(void)
+{
+    fprintf(stderr, "A key-pair database lookup performance tester\n\n");
+    fprintf(stderr, "Usage: dkpbench [-b] [-f file] [-l lookups] [-n count]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-b\tuse the binary search instead of the hash index\n");
+    fprintf(stderr, "\t-f\tkeep the database in file (default: a temporary file)\n");
+    fprintf(stderr, "\t-l\tnumber of lookups (default: %d)\n", LOOKUPS);
+    fprintf(stderr, "\t-n\tnumber of groups (default: %d)\n", COUNT);
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char tmp[] = "/tmp/dkpbench.XXXXXX";
+    char *path = NULL;
+    int count = COUNT;
+    int lookups = LOOKUPS;
+    struct timeval tv;
+    KPDB *kpdb;
+    int len;
+    int i;
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr != '-')
+	    Usage();
+	ptr += 2;
+	switch(ptr[-1]) {
+	case 'b':
+	    KPDBHashIndex = 0;
+	    break;
+	case 'f':
+	    path = (*ptr) ? ptr : av[++i];
+	    break;
+	case 'l':
+	    lookups = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'n':
+	    count = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	default:
+	    Usage();
+	}
+    }
+    if (count <= 0 || lookups <= 0)
+	Usage();
+
+    if (path == NULL) {
+	int fd;
+
+	if ((fd = mkstemp(tmp)) < 0) {
+	    perror("dkpbench: mkstemp");
+	    exit(1);
+	}
+	close(fd);
+	path = tmp;
+    }
+    MakeDB(path, count);
+
+    gettimeofday(&tv, NULL);
+    if ((kpdb = KPDBOpen(path, O_RDWR)) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    KPDBReSort(kpdb);
+    printf("Groups      : %d, %s, sorted in %.3fs\n", count,
+		(KPDBHashIndex ? "hash index" : "binary search"), Elapsed(&tv));
+
+    gettimeofday(&tv, NULL);
+    if (KPDBReadRecord(kpdb, GroupName(0), 0, &len) == NULL) {
+	fprintf(stderr, "dkpbench: %s not found\n", GroupName(0));
+	exit(1);
+    }
+    printf("First lookup: %.3fs\n", Elapsed(&tv));
+
+    Lookups(kpdb, "GROUP", count, lookups, 0);
+    Lookups(kpdb, "NE update", count, lookups, 1);
+    Lookups(kpdb, "rewrite", count, lookups / 100, 2);
+    Lookups(kpdb, "GROUP", count, lookups, 0);
+
+    KPDBClose(kpdb);
+    if (path == tmp)
+	remove(path);
+    return(0);
+}
+
+const char *
+GroupName(int n)
+{
+    static char buf[64];
+
+    snprintf(buf, sizeof(buf), "alt.test.%c%c.group%d",
+	'a' + n % 26, 'a' + n / 26 % 26, n);
+    return(buf);
+}
+
+/*
+ * MakeDB() - write count dactive.kp records in a random order
+ */
+
+void
+MakeDB(const char *path, int count)
+{
+    FILE *fo;
+    int *order = malloc(count * sizeof(int));
+    int i;
+
+    for (i = 0; i < count; ++i)
+	order[i] = i;
+    srandom(1);
+    for (i = count - 1; i > 0; --i) {
+	int j = random() % (i + 1);
+	int t = order[i];
+
+	order[i] = order[j];
+	order[j] = t;
+    }
+
+    if ((fo = fopen(path, "w")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    fprintf(fo, "$V00.00 00000000 00000000 0FFFFFFF\n");
+    for (i = 0; i < count; ++i) {
+	fprintf(fo, "+00000000.0000:%s NB=%010d NE=%010d S=y CTS=6ad413d0 LMTS=6ad4161f GD=Test%%20group%%20%d\n",
+	    GroupName(order[i]), 1, order[i] % 5000, order[i]);
+    }
+    if (fclose(fo) != 0) {
+	perror(path);
+	exit(1);
+    }
+    free(order);
+}
+
+/*
+ * Lookups() - look up random groups.  update 1 writes NE back in
+ *	       place, update 2 rewrites the record with a longer field
+ *	       so it is appended.
+ */
+
+void
+Lookups(KPDB *kpdb, const char *name, int count, int lookups, int update)
+{
+    struct timeval tv;
+    double secs;
+    int i;
+
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < lookups; ++i) {
+	const char *group = GroupName(random() % count);
+	const char *rec;
+	const char *key;
+	int recLen;
+	int keyLen;
+	artno_t nb;
+	artno_t ne;
+
+	if ((rec = KPDBReadRecord(kpdb, group, (update ? KP_LOCK : 0), &recLen)) == NULL) {
+	    fprintf(stderr, "dkpbench: %s not found\n", group);
+	    exit(1);
+	}
+	key = KPDBGetField(rec, recLen, NULL, &keyLen, NULL);
+	if (keyLen != strlen(group) || strncmp(key, group, keyLen) != 0) {
+	    fprintf(stderr, "dkpbench: looked up %s, got %.*s\n", group, keyLen, key);
+	    exit(1);
+	}
+	nb = strtoll(KPDBGetField(rec, recLen, "NB", NULL, "-1"), NULL, 10);
+	ne = strtoll(KPDBGetField(rec, recLen, "NE", NULL, "-1"), NULL, 10);
+	if (nb < 0 || ne < 0) {
+	    fprintf(stderr, "dkpbench: %s has no NB/NE\n", group);
+	    exit(1);
+	}
+	if (update == 1) {
+	    char buf[32];
+
+	    snprintf(buf, sizeof(buf), "%010lld", ne + 1);
+	    KPDBWrite(kpdb, group, "NE", buf, KP_UNLOCK);
+	} else if (update == 2) {
+	    char buf[32];
+
+	    snprintf(buf, sizeof(buf), "%lld", ne + (random() % 1000));
+	    KPDBWrite(kpdb, group, "X", buf, KP_UNLOCK);
+	}
+    }
+    secs = Elapsed(&tv);
+    printf("%-12s: %d in %.3fs, %.0f/s\n", name, lookups, secs, lookups / secs);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
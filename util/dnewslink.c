@@ -149,6 +149,14 @@
 #define MAXREASON       100     /* maximal length of a peer response logged */
 
 #define CMDBUFFSIZE	32768	/* Output buffer for NNTP traffic */
+#define RESPBUFSIZE	65536	/* Input buffer for NNTP responses */
+#define MAXOUTVEC	64	/* iovecs gathered for one writev() */
+#define ARTVECSIZE	4096	/* wire format articles this size and up are
+				 * written straight from the spool mapping */
+
+#define MAXSTREAMWIN	1024	/* slot limit for the adaptive window (-a) */
+#define DEFSTREAMWIN	256	/* default slot limit for -a		*/
+#define RTTWINDOW	10	/* secs a minimum slot hold time is kept */
 
 typedef struct Stream {
     int	st_State;		/* state	*/
@@ -158,15 +166,26 @@ typedef struct Stream {
     off_t st_Off;		/* file offset	*/
     int32 st_Size;		/* file size	*/
     int32 st_CompSize;		/* compressed file size	*/
+    int st_IdLen;		/* strlen(st_MsgId)	*/
+    struct timeval st_Sent;	/* check queued (-a)	*/
 } Stream;
 
+typedef struct ArtMap {
+    char *am_Base;		/* cdmap() result	*/
+    int am_Size;
+    int am_MultiArtFile;
+    int am_Compressed;
+} ArtMap;
+
 int connectTo(const char *hostName, const char *serviceName, int defPort);
 int Transact(int cfd, const char *relPath, char *msgId, off_t off, int size, int cSize, int defers, char *stage, char *reason, char *buf, int *sentSize);
 int DumpArticle(int cfd, const char *relPath, off_t off, int size, int cSize);
-int writeLarge(int cfd, char *buffer, size_t size);
+int commandWriteMap(int cfd, char *ptr, int bytes, ArtMap *am);
 int StreamTransact(int cfd, const char *relPath, char *msgId, off_t off, int size, int cSize, int defers, char *stage, char *reason, char *buf, int *sentSize);
 void StreamReload(int cfd);
 Stream *LocateStream(const char *msgId, int state);
+void StreamAdapt(Stream *s);
+int responseReady(void);
 int RefilePendingStreams(FILE *fo);
 int commandResponse(int cfd, char **rptr, const char *ctl, ...);
 int commandWrite(int cfd, const void *buf, int bytes, int artdata);
@@ -218,14 +237,20 @@ char ArtLog[100]; /* auto-initialised to "" */
 FILE *Logfd = NULL;
 struct stat CurSt;
 
-Stream StreamAry[MAXSTREAM];
+Stream *StreamAry;
 int MaxStream = MAXSTREAM;	/* Maximum number of streaming slots */
 int NumStream = MAXSTREAM;	/* Current number of streaming slots */
+int AdaptiveWin = 0;		/* size NumStream from the link (-a)	*/
+int MaxPendBytes = MAXPENDBYTES;
+int TxFlushSize = CMDBUFFSIZE;	/* socket send buffer size		*/
 int HiWaterMark =  0;
 int StreamMode = 0;		/* set by stream negotiation	*/
 int StreamPend = 0;		/* pending streaming requests	*/
 int StreamRetry = 0;		/* retry after connection failure */
 double AveragePend = 0.0;	/* sliding average of pending requests */
+double XCacheHits;		/* articles served from a cached mapping */
+double XCacheMisses;		/* articles that needed an open() or mmap() */
+double XCacheMapped;		/* bytes in cached mappings */
 int TryStreaming = 1;
 int BytesPend = 0;
 int PipeOpt = 0;
@@ -304,6 +329,8 @@ Usage(char *progname)
 	    "-A[levels]      - turn on article logging, default all\n"
 	    "                  levels is either all or comma-separated list\n"
 	    "                  of accept,reject,defer,refuse,error\n"
+	    "-a              - adaptive streaming window, -M is the limit\n"
+	    "                  (default 256 with -a)\n"
 	    "-B ip           - set source ip address for outbound connections\n"
 	    "-b batchfile    - specify batchfile\n"
 	    "-b template%d   - template containing %[xx]d\n"
@@ -342,6 +369,7 @@ main(int ac, char **av)
 {
     int i;
     int eNoBat = 0;
+    int maxStreamOpt = 0;
 
     TimeNow = time(NULL);
     OpenLog("newslink", (DebugOpt > 0? LOG_PERROR: 0) | LOG_NDELAY | LOG_PID);
@@ -355,6 +383,9 @@ main(int ac, char **av)
 	case 'A':
             StrnCpyNull(ArtLog, ((*ptr) ? ptr: "all"), sizeof(ArtLog));
             break;
+	case 'a':
+	    AdaptiveWin = 1;
+	    break;
 	case 'B':
 	    if (*ptr == 0)
 		ptr = av[++i];
@@ -401,9 +432,7 @@ main(int ac, char **av)
 	    break;
 	case 'M':
 	    MaxStream = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
-	    if (MaxStream > MAXSTREAM)
-		MaxStream = MAXSTREAM;
-	    NumStream = MaxStream;
+	    maxStreamOpt = 1;
 	    break;
 	case 'N':
 	    NumBatches = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
@@ -479,6 +508,30 @@ main(int ac, char **av)
 	Usage(av[0]);
     }
 
+    /*
+     * The adaptive window never drops below the fixed default and may
+     * grow to MaxStream.  It keeps a lot more check message-ids pending, the
+     * limit is set so that their responses always fit in our response
+     * buffer.
+     */
+    if (AdaptiveWin) {
+	if (maxStreamOpt == 0)
+	    MaxStream = DEFSTREAMWIN;
+	if (MaxStream > MAXSTREAMWIN)
+	    MaxStream = MAXSTREAMWIN;
+	if (MaxStream < MAXSTREAM)
+	    MaxStream = MAXSTREAM;
+	NumStream = MAXSTREAM;
+	MaxPendBytes = RESPBUFSIZE / 2;
+    } else {
+	if (MaxStream > MAXSTREAM)
+	    MaxStream = MAXSTREAM;
+	if (MaxStream < 2)
+	    MaxStream = 2;
+	NumStream = MaxStream;
+    }
+    StreamAry = calloc(MaxStream, sizeof(Stream));
+
     rsignal(SIGPIPE, SIG_IGN);
     rsignal(SIGHUP, sigTerm);
     rsignal(SIGINT, sigTerm);
@@ -696,7 +749,7 @@ main(int ac, char **av)
 		 */
 		if (bufInval && 
 		    StreamPend < NumStream - HiWaterMark && 
-		    BytesPend < MAXPENDBYTES
+		    BytesPend < MaxPendBytes
 		) {
 		    if (DebugOpt > 1)
 			printf("clear watermark\n");
@@ -1568,6 +1621,15 @@ connectTo(const char *hostName, const char *serviceName, int defPort)
 
     setSocketOptions(fd);
 
+    if (fd >= 0) {
+	int sz = 0;
+	socklen_t szLen = sizeof(sz);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, (void *)&sz, &szLen) == 0 &&
+							sz > CMDBUFFSIZE)
+	    TxFlushSize = sz;
+    }
+
 #ifdef TCP_NODELAY
     /*
      * Turn on TCP_NODELAY
@@ -1901,16 +1963,16 @@ DumpArticle(int cfd, const char *relPath, off_t off, int size, int cSize)
 #ifdef USE_ZLIB
 			!CompressOn &&
 #endif
-			artSize > CMDBUFFSIZE ) { 
-	    if (writeLarge(cfd, ptr, artSize) < 0) {
-		if (base != NULL)
-		    cdunmap(base, size, multiArtFile, cSize > 0);
+			artSize >= ARTVECSIZE ) { 
+	    ArtMap am;
+
+	    am.am_Base = base;
+	    am.am_Size = size;
+	    am.am_MultiArtFile = multiArtFile;
+	    am.am_Compressed = (cSize > 0);
+	    if (commandWriteMap(cfd, ptr, artSize, &am) < 0)
 		return(T_FAILED);
-	    } else {
-		if (base != NULL)
-		    cdunmap(base, size, multiArtFile, cSize > 0);
-		return(0);
-	    }
+	    return(0);
 	}
 	    
 	for (i = b = 0; i < artSize; b = i) {
@@ -2081,6 +2143,9 @@ StreamTransact(int cfd, const char *relPath, char *msgId, off_t off, int size, i
 	s->st_Size = size;
 	s->st_CompSize = cSize;
 	s->st_DumpRCode = 0;
+	s->st_IdLen = strlen(s->st_MsgId);
+	if (AdaptiveWin)
+	    gettimeofday(&s->st_Sent, NULL);
 	if (NoCheckOpt) {
 	    int r;
 
@@ -2097,7 +2162,7 @@ StreamTransact(int cfd, const char *relPath, char *msgId, off_t off, int size, i
 	    commandResponse(cfd, NULL, "check %s\r\n", s->st_MsgId);
 	    s->st_State = STATE_CHECK;
 	}
-	BytesPend += strlen(s->st_MsgId);
+	BytesPend += s->st_IdLen;
 	++StreamPend;
 	AveragePend = StreamPend * (1 - 0.98) + AveragePend * 0.98;
 	if (StreamPend == NumStream) {
@@ -2108,7 +2173,9 @@ StreamTransact(int cfd, const char *relPath, char *msgId, off_t off, int size, i
     }
 
     /*
-     * Should we wait for a response ?
+     * Should we wait for a response ?  A response that has already
+     * been read (see flushCommandBuffer()) is handled right away, even
+     * if the window isn't full, so its takethis goes out sooner.
      *
      * note: code has been written to allow for non-blocking reads in the 
      * future.  For now, we simply enforce the pipeline by ensuring the
@@ -2120,7 +2187,8 @@ StreamTransact(int cfd, const char *relPath, char *msgId, off_t off, int size, i
      */
 
     if ((relPath == NULL && StreamPend > 0) || 
-	StreamPend >= NumStream - HiWaterMark
+	StreamPend >= NumStream - HiWaterMark ||
+	(StreamPend > 0 && responseReady())
     ){
 	char *ptr = NULL;
 	Stream *s = NULL;
@@ -2277,8 +2345,10 @@ StreamTransact(int cfd, const char *relPath, char *msgId, off_t off, int size, i
 	    break;
 	}
 	if (delMe) {
+	    if (AdaptiveWin)
+		StreamAdapt(s);
 	    --StreamPend;
-	    BytesPend -= strlen(s->st_MsgId);
+	    BytesPend -= s->st_IdLen;
 	    zfreeStr(&SysMemPool, &s->st_RelPath);
 	    zfreeStr(&SysMemPool, &s->st_MsgId);
 	    if (s != &StreamAry[StreamPend]) {
@@ -2325,7 +2395,7 @@ LocateStream(const char *msgId, int state)
 
 	if ((state == 0 || s->st_State == state) && 
 	    s->st_State &&
-	    strlen(s->st_MsgId) == idLen &&
+	    s->st_IdLen == idLen &&
 	    strncmp(msgId, s->st_MsgId, idLen) == 0
 	) {
 	    if (DebugOpt > 1)
@@ -2338,6 +2408,73 @@ LocateStream(const char *msgId, int state)
     return(NULL);
 }
 
+/*
+ * StreamAdapt() - adaptive window (-a), called when a stream slot is
+ *		   done with.
+ *
+ * The window is set to twice the bandwidth-delay product of the link:
+ * the rate slots are completed at times the shortest time a slot was
+ * held (check and takethis, so two round trips) in the last RTTWINDOW
+ * to 2 x RTTWINDOW seconds.  The minimum leaves out the time commands
+ * spend queued behind our own articles or in the peer's backlog.
+ * While the window limits us the measured rate is window / hold time
+ * and the window doubles, once the peer or the link is the limit it
+ * settles.  The rate is taken over a window's worth of slots.
+ */
+
+void
+StreamAdapt(Stream *s)
+{
+    static struct timeval rateTv;
+    static int rateCnt;
+    static double heldMin[2];
+    static time_t heldTime;
+    struct timeval tv;
+    double held;
+    double minHeld;
+    double dt;
+    int win;
+
+    gettimeofday(&tv, NULL);
+    held = (tv.tv_sec - s->st_Sent.tv_sec) + 
+			(tv.tv_usec - s->st_Sent.tv_usec) / 1000000.0;
+    if (tv.tv_sec - heldTime >= RTTWINDOW) {
+	heldMin[1] = heldMin[0];
+	heldMin[0] = 0.0;
+	heldTime = tv.tv_sec;
+    }
+    if (heldMin[0] == 0.0 || held < heldMin[0])
+	heldMin[0] = held;
+
+    if (rateCnt++ == 0) {
+	rateTv = tv;
+	return;
+    }
+    if (rateCnt <= NumStream)
+	return;
+    dt = (tv.tv_sec - rateTv.tv_sec) + (tv.tv_usec - rateTv.tv_usec) / 1000000.0;
+    if (dt <= 0.0)
+	return;
+
+    minHeld = heldMin[0];
+    if (heldMin[1] > 0.0 && heldMin[1] < minHeld)
+	minHeld = heldMin[1];
+    win = (int)(2.0 * (rateCnt - 1) / dt * minHeld) + 1;
+    if (win > NumStream * 2)
+	win = NumStream * 2;
+    if (win < NumStream / 2)
+	win = NumStream / 2;
+    if (win > MaxStream)
+	win = MaxStream;
+    if (win < MAXSTREAM)
+	win = MAXSTREAM;
+    if (DebugOpt && win != NumStream)
+	printf("%s window %d -> %d (%.0f/s, held %.2fms)\n", dtstamp(),
+		NumStream, win, (rateCnt - 1) / dt, minHeld * 1000.0);
+    NumStream = win;
+    rateCnt = 0;
+}
+
 /*
  * Refile pending streams.  If we have an output file, the
  * pending streams are refiled to the file.  If we do not,
@@ -2473,6 +2610,17 @@ logStats(const char *description)
 	    Stats->SentStats.DeferredCnt,
 	    Stats->SentStats.DeferredFailCnt
 	);
+    if (XCacheHits + XCacheMisses > 0) {
+	dl_logit("%s mapcache hits=%.0f misses=%.0f (%.1f%%) mapped=%.0f",
+	    description,
+	    XCacheHits,
+	    XCacheMisses,
+	    XCacheHits * 100.0 / (XCacheHits + XCacheMisses),
+	    XCacheMapped
+	);
+	XCacheHits = 0.0;
+	XCacheMisses = 0.0;
+    }
 #ifdef	USE_ZLIB
     if (CompressOn > 0)
 	dl_logit("%s compbytes=%ld decompbytes=%ld (%.2f%% compression)\n",
@@ -2513,12 +2661,25 @@ logStats(const char *description)
  * commandResponse() optionally send command, optionally read a response
  */
 
-static char Buf[16384];
+static char Buf[RESPBUFSIZE];
 static int Bufb;
 static int Bufe;
 static char Cmd[CMDBUFFSIZE];
 static int Cmde;
 
+/*
+ * Output waiting for the next flushCommandBuffer(): the Cmd buffer
+ * plus large wire format articles that are written straight from their
+ * spool mapping.  OutVec[] holds what comes before Cmd[CmdSeg], the
+ * mappings are released once the lot has been written.
+ */
+static struct iovec OutVec[MAXOUTVEC];
+static int OutVecCnt;
+static int CmdSeg;
+static int OutBytes;
+static ArtMap OutMap[MAXOUTVEC];
+static int OutMapCnt;
+
 void
 clearResponseBuf(void)
 {
@@ -2528,9 +2689,57 @@ clearResponseBuf(void)
 void
 clearCommandBuffer(void)
 {
+    int i;
+
+    for (i = 0; i < OutMapCnt; ++i) {
+	ArtMap *am = &OutMap[i];
+	cdunmap(am->am_Base, am->am_Size, am->am_MultiArtFile, am->am_Compressed);
+    }
+    OutMapCnt = 0;
+    OutVecCnt = 0;
+    OutBytes = 0;
+    CmdSeg = 0;
     Cmde = 0;
 }
 
+/*
+ * responseReady() - a complete response line has already been read
+ */
+
+int
+responseReady(void)
+{
+    return(Bufe > Bufb && memchr(Buf + Bufb, '\n', Bufe - Bufb) != NULL);
+}
+
+/*
+ * readAhead() - read whatever responses have arrived without blocking,
+ *		 while we wait to be able to write.  Returns -1 on EOF or
+ *		 error or if the response buffer is full.
+ */
+
+static int
+readAhead(int cfd)
+{
+    int n;
+
+    if (Bufb > 0 && Bufe == sizeof(Buf) - 1) {
+	memmove(Buf, Buf + Bufb, Bufe - Bufb);
+	Bufe -= Bufb;
+	Bufb = 0;
+    }
+    if (Bufe == sizeof(Buf) - 1)
+	return(-1);
+    n = read(cfd, Buf + Bufe, sizeof(Buf) - Bufe - 1);
+    if (n > 0) {
+	Bufe += n;
+	return(0);
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	return(0);
+    return(-1);
+}
+
 #ifdef NOTDEF
 
 void
@@ -2566,40 +2775,68 @@ flushCompressBuffer(int cfd)
 #endif
 }
 
+/*
+ * flushCommandBuffer() - write out everything queued with one writev()
+ *			  where possible.  While the socket is full we
+ *			  read the responses that come in, so a peer
+ *			  that stops reading until it can send its
+ *			  responses doesn't lock us up.
+ */
+
 int
 flushCommandBuffer(int cfd)
 {
-    int b = 0;
+    struct iovec *iov = OutVec;
+    int iovcnt;
+    int readOk = 1;
+    int r = 0;
 
     if (WritesLosing) {
-	Cmde = 0;
+	clearCommandBuffer();
 	return(-1);
     }
 
-    while (b != Cmde) {
-	int r = 0;
+    if (Cmde > CmdSeg) {
+	OutVec[OutVecCnt].iov_base = Cmd + CmdSeg;
+	OutVec[OutVecCnt].iov_len = Cmde - CmdSeg;
+	++OutVecCnt;
+    }
+    iovcnt = OutVecCnt;
+
+    while (iovcnt > 0) {
+	ssize_t n;
 
 	credtime(OUR_DELAY);
 
 	errno = 0;
-	r = write(cfd, Cmd + b, Cmde - b);
-	if (r < 0) {
+	n = writev(cfd, iov, iovcnt);
+	if (n < 0) {
 	    if (errno != EAGAIN && errno != EINTR &&
 		errno != EWOULDBLOCK && errno != EINPROGRESS) {
-		    Cmde = 0;
-		    return(-1);
+		    r = -1;
+		    break;
 	    }
-	    r = 0;
+	    n = 0;
+	}
+
+	/* Skip what has been written */
+	while (iovcnt > 0 && n >= (ssize_t)iov->iov_len) {
+	    n -= iov->iov_len;
+	    ++iov;
+	    --iovcnt;
+	}
+	if (n > 0) {
+	    iov->iov_base = (char *)iov->iov_base + n;
+	    iov->iov_len -= n;
 	}
-	b += r;
 
 #if USE_POLL
-	if (b != Cmde) {
+	if (iovcnt > 0) {
 	    struct pollfd pfd = { 0 };
 	    struct linger l;
 
 	    pfd.fd = cfd;
-	    pfd.events = POLLOUT;
+	    pfd.events = POLLOUT | (readOk ? POLLIN : 0);
 	    if (poll(&pfd, 1, Timeout * 1000) == 0) {
 		dl_logit("write timeout");
 		WritesLosing = 1;
@@ -2609,95 +2846,57 @@ flushCommandBuffer(int cfd)
 		TimeCounter = 100000;
 		break;
 	    }
+	    if (pfd.revents & POLLIN) {
+		if (readAhead(cfd) < 0)
+		    readOk = 0;
+	    }
 	}
 #endif
 
 	credtime(THEIR_DELAY);
     }
 
-    Cmde = 0;
+    if (r < 0 || WritesLosing) {
+	clearCommandBuffer();
+	return(-1);
+    }
+    clearCommandBuffer();
     return(0);
 }
 
+/*
+ * commandWriteMap() - queue article data straight from its spool
+ *		       mapping.  The mapping is handed over and released
+ *		       once it has been written.
+ */
+
 int
-writeLarge(int cfd, char *buffer, size_t size)
+commandWriteMap(int cfd, char *ptr, int bytes, ArtMap *am)
 {
-    struct iovec tmpvec[3]; /* structures to store writev info */
-
-    int status;	
-    size_t offset, bytes=0;
-    int iovleft=0,	/* iov's to handle */
-	i;		/* first iov in buffer that has data left */
-
-    if (WritesLosing) {
-	Cmde = 0;
-	return(-1);
+    if (OutVecCnt + 3 > MAXOUTVEC || OutMapCnt == MAXOUTVEC) {
+	if (flushCommandBuffer(cfd) < 0) {
+	    cdunmap(am->am_Base, am->am_Size, am->am_MultiArtFile, am->am_Compressed);
+	    return(-1);
+	}
     }
-
-    if (Cmde > 0) { /* if there is something to write out in Cmd buffer */ 
-        tmpvec[iovleft].iov_base=Cmd;
-        tmpvec[iovleft].iov_len=Cmde;
-        iovleft++;
-        bytes += Cmde;
-	Cmde=0;
+    if (Cmde > CmdSeg) {
+	OutVec[OutVecCnt].iov_base = Cmd + CmdSeg;
+	OutVec[OutVecCnt].iov_len = Cmde - CmdSeg;
+	++OutVecCnt;
+	CmdSeg = Cmde;
     }
-    tmpvec[iovleft].iov_base=buffer;
-    tmpvec[iovleft].iov_len=size;
-    iovleft++;
-
-    bytes += size;
-
-    i = 0;
-    do {
-        /* Write out what's left and return success if it's all written. */
-	credtime(OUR_DELAY);
-	errno = 0;
-	status = writev(cfd, tmpvec + i, iovleft);
-	if (status < 0) {
-	    if (errno != EAGAIN && errno != EINTR &&
-		errno != EWOULDBLOCK && errno != EINPROGRESS) {
-		    return(-1);
-	    }
-	    status = 0; offset=0;
-	} else {
-            offset = status;
-            bytes -= offset;
-        }
-#if USE_POLL
-	if (bytes > 0) {
-	    struct pollfd pfd = { 0 };
-	    struct linger l;
-
-	    pfd.fd = cfd;
-	    pfd.events = POLLOUT;
-	    if (poll(&pfd, 1, Timeout * 1000) == 0) {
-		dl_logit("write timeout");
-		WritesLosing = 1;
-		l.l_onoff = 1;
-		l.l_linger = 0;
-		setsockopt(cfd, SOL_SOCKET, SO_LINGER, (void*)&l, sizeof(l));
-		TimeCounter = 100000;
-		break;
-	    }
-	}
-#endif
-	credtime(THEIR_DELAY);
-
-        /* Skip full iovecs */
-        for (; offset >= (size_t) tmpvec[i].iov_len && iovleft > 0; i++) {
-            offset -= tmpvec[i].iov_len;
-            iovleft--;
-        }
-	if (offset > 0) {
-	    tmpvec[i].iov_base = (char *) tmpvec[i].iov_base + offset;
-	    tmpvec[i].iov_len -= offset;
-	}
+    OutVec[OutVecCnt].iov_base = ptr;
+    OutVec[OutVecCnt].iov_len = bytes;
+    ++OutVecCnt;
+    OutMap[OutMapCnt++] = *am;
+    OutBytes += bytes;
 
-    } while (iovleft > 0 && (status >= 0 || errno == EINTR));
-
-    assert(bytes == 0);
-
-    return status;
+    /*
+     * Write once a socket buffer's worth has built up
+     */
+    if (OutBytes + Cmde >= TxFlushSize)
+	return(flushCommandBuffer(cfd));
+    return(0);
 }
 
 int
@@ -2775,10 +2974,14 @@ commandResponse(int cfd, char **rptr, const char *ctl, ...)
 	/*
 	 * flush output that has built up.  It's important to try to
 	 * do this in one write() because TCP_NODELAY has been set.
+	 * Don't bother if a response is waiting already, the output
+	 * keeps building up until we really have to wait.
 	 */
 
-	flushCompressBuffer(cfd);
-	flushCommandBuffer(cfd);
+	if (!responseReady()) {
+	    flushCompressBuffer(cfd);
+	    flushCommandBuffer(cfd);
+	}
 
 	*rptr = NULL;
 
@@ -3249,18 +3452,32 @@ AttemptRemoveRenamedFile(struct stat *st, const char *spoolFile)
 /*
  * CDMAP() - map part of a file.  If off & *psize are 0, we map the whole
  *	     file.
+ *
+ * Spool files are kept open and mapped whole in a small cache, articles
+ * are handed out as pointers into the mapping and counted in mc_Refs
+ * until cdunmap() releases them (DumpArticle() may hold several while
+ * their writev() is pending).  Entries are replaced least recently used
+ * first, never while referenced.  An article that can not be served
+ * from a cached mapping, because the file grew past a mapping still in
+ * use or every entry is busy, is mapped on its own as before.
  */
 
 #define MAXMCACHE	32
+#define MAXMCACHEMAP	(1024 * 1024 * 1024)	/* total bytes mapped */
 
 typedef struct XCache {
     char	*mc_Path;
     int		mc_Fd;
     int		mc_Size;	/* only if off/psize are not known */
     time_t	mc_OpenTime;
+    char	*mc_Map;	/* whole file, or NULL */
+    off_t	mc_MapSize;
+    int		mc_Refs;	/* articles handed out of mc_Map */
+    uint32	mc_LastUse;
 } XCache;
 
 XCache	XCacheAry[MAXMCACHE];
+uint32	XCacheTick;
 
 void
 cdinit(void)
@@ -3273,11 +3490,113 @@ cdinit(void)
     }
 }
 
+static void
+cdrelease(XCache *mc)
+{
+    if (mc->mc_Map) {
+	xunmap(mc->mc_Map, mc->mc_MapSize);
+	XCacheMapped -= mc->mc_MapSize;
+	mc->mc_Map = NULL;
+	mc->mc_MapSize = 0;
+    }
+}
+
+static void
+cdclose(XCache *mc)
+{
+    cdrelease(mc);
+    if (mc->mc_Fd >= 0)
+	close(mc->mc_Fd);
+    if (mc->mc_Path)
+	zfreeStr(&SysMemPool, &mc->mc_Path);
+    mc->mc_Fd = -1;
+    mc->mc_Size = 0;
+    mc->mc_OpenTime = 0;
+}
+
+/*
+ * cdlookup() - find the entry for path, or a free or least recently used
+ *		one to open it in.  NULL if every entry is referenced.
+ */
+
+static XCache *
+cdlookup(const char *path)
+{
+    XCache *lru = NULL;
+    int i;
+
+    for (i = 0; i < MAXMCACHE; ++i) {
+	XCache *mc = &XCacheAry[i];
+
+	if (mc->mc_Path == NULL) {
+	    if (lru == NULL || lru->mc_Path != NULL)
+		lru = mc;
+	    continue;
+	}
+	if (strcmp(path, mc->mc_Path) == 0)
+	    return(mc);
+	if (mc->mc_Refs == 0 && (lru == NULL ||
+	    (lru->mc_Path != NULL && (int32)(mc->mc_LastUse - lru->mc_LastUse) < 0))
+	) {
+	    lru = mc;
+	}
+    }
+    if (lru && lru->mc_Path)
+	cdclose(lru);
+    return(lru);
+}
+
+/*
+ * cdmapcache() - return off in the whole file mapping of mc, mapping or
+ *		  remapping the file if it does not cover bytes yet.
+ *		  NULL if the range can not be served from the mapping.
+ */
+
+static char *
+cdmapcache(XCache *mc, off_t off, int bytes)
+{
+    struct stat st;
+    int i;
+
+    if (mc->mc_Map && off + bytes <= mc->mc_MapSize) {
+	++XCacheHits;
+	return(mc->mc_Map + off);
+    }
+    ++XCacheMisses;
+    if (mc->mc_Refs || fstat(mc->mc_Fd, &st) < 0 || off + bytes > st.st_size)
+	return(NULL);
+    cdrelease(mc);
+
+    /*
+     * Keep the total mapped within bounds, dropping idle mappings
+     */
+    for (i = 0; XCacheMapped + st.st_size > MAXMCACHEMAP && i < MAXMCACHE; ++i) {
+	if (XCacheAry[i].mc_Refs == 0)
+	    cdrelease(&XCacheAry[i]);
+    }
+    if (XCacheMapped + st.st_size > MAXMCACHEMAP)
+	return(NULL);
+
+    mc->mc_Map = xmap(NULL, st.st_size, PROT_READ, MAP_SHARED, mc->mc_Fd, 0);
+    if (mc->mc_Map == NULL)
+	return(NULL);
+    mc->mc_MapSize = st.st_size;
+    XCacheMapped += st.st_size;
+
+    /*
+     * Advise the whole mapping once, advising each article's range
+     * would split the mapping into many
+     */
+    if (HeaderOnlyFeed == 0 && DOpts.FeederPreloadArt == 0)
+	xadvise(mc->mc_Map, mc->mc_MapSize, XADV_SEQUENTIAL);
+    return(mc->mc_Map + off);
+}
+
 char *
 cdmap(const char *path, off_t off, int *psize, int cSize, int *multiArtFile)
 {
-    int i;
     XCache *mc;
+    XCache tmp;
     char *ptr = NULL;
 
     *multiArtFile = 0;
@@ -3285,32 +3604,22 @@ cdmap(const char *path, off_t off, int *psize, int cSize, int *multiArtFile)
 	*multiArtFile = 1;
     }
 
-    for (i = 0; i < MAXMCACHE; ++i) {
-	if (XCacheAry[i].mc_Path == NULL)
-	    break;
-	if (strcmp(path, XCacheAry[i].mc_Path) == 0)
-	    break;
-    }
-    if (i == MAXMCACHE) {
-	i = random() % MAXMCACHE;
-
-	mc = &XCacheAry[i];
-	close(mc->mc_Fd);
-	zfreeStr(&SysMemPool, &mc->mc_Path);
-	mc->mc_Fd = -1;
-	mc->mc_Size = 0;
-	mc->mc_OpenTime = 0;
+    if ((mc = cdlookup(path)) == NULL) {
+	bzero(&tmp, sizeof(tmp));
+	tmp.mc_Fd = -1;
+	mc = &tmp;
     }
-    mc = &XCacheAry[i];
+    mc->mc_LastUse = ++XCacheTick;
 
-    if (mc->mc_Path == NULL) {
+    if (mc->mc_Fd < 0) {
 	if ((mc->mc_Fd = cdopen(path, O_RDONLY, 0)) >= 0) {
 	    struct stat st;
 
 	    st.st_size = 0;
 	    fstat(mc->mc_Fd, &st);
 	    mc->mc_Size = st.st_size;
-	    mc->mc_Path = zallocStr(&SysMemPool, path);
+	    if (mc != &tmp)
+		mc->mc_Path = zallocStr(&SysMemPool, path);
 	    mc->mc_OpenTime = time(NULL);
 	}
     }
@@ -3332,7 +3641,7 @@ cdmap(const char *path, off_t off, int *psize, int cSize, int *multiArtFile)
 
 	    lseek(mc->mc_Fd, off, 0);
 	    if (read(mc->mc_Fd, &tah, sizeof(tah)) != sizeof(tah))
-		return(NULL);
+		goto done;
 	    if ((uint8)tah.Magic1 != (uint8)STORE_MAGIC1 &&
 				(uint8)tah.Magic2 != (uint8)STORE_MAGIC2) {
 		lseek(mc->mc_Fd, off, 0);
@@ -3347,21 +3656,23 @@ cdmap(const char *path, off_t off, int *psize, int cSize, int *multiArtFile)
 	    }
 	    gzf = gzdopen(dup(mc->mc_Fd), "r");
 	    if (gzf == NULL)
-		return(NULL);
+		goto done;
 
 	    ptr = (char *)malloc(tah.ArtLen + tah.HeadLen + 2);
 	    if (ptr == NULL) {
 		logit(LOG_CRIT, "Unable to malloc %d bytes for article (%s)\n",
 				tah.ArtLen + tah.HeadLen + 2, strerror(errno));
 		gzclose(gzf);
-		return(NULL);
+		goto done;
 	    }
 	    p = ptr;
 	    bcopy(&tah, p, tah.HeadLen);
 	    p += tah.HeadLen;
 	    if (gzread(gzf, p, tah.ArtLen) != tah.ArtLen) {
 		free(ptr);
-		return(NULL);
+		ptr = NULL;
+		gzclose(gzf);
+		goto done;
 	    }
 	    p[tah.ArtLen] = 0;
 	    *psize = tah.ArtLen + tah.HeadLen;
@@ -3370,32 +3681,54 @@ cdmap(const char *path, off_t off, int *psize, int cSize, int *multiArtFile)
 	    logit(LOG_CRIT, "Queue batch file indicates compressed file and compression not enabled");
 #endif
 	} else {
-	    ptr = xmap(NULL, *psize + *multiArtFile, PROT_READ, MAP_SHARED, mc->mc_Fd, off);
+	    int cached = 0;
+
+	    if (mc != &tmp && (ptr = cdmapcache(mc, off, *psize + *multiArtFile)) != NULL)
+		cached = 1;
+	    else
+		ptr = xmap(NULL, *psize + *multiArtFile, PROT_READ, MAP_SHARED, mc->mc_Fd, off);
 	    if (ptr == NULL)
-		return(ptr);
-	    if (ptr && HeaderOnlyFeed==0) {
+		goto done;
+	    if (HeaderOnlyFeed == 0) {
 		if (DOpts.FeederPreloadArt)
 		    xadvise(ptr, *psize, XADV_WILLNEED);
-		else
+		else if (!cached)
 		    xadvise(ptr, *psize, XADV_SEQUENTIAL);
 	    }
-	    if (*multiArtFile && ptr && ptr[*psize] != 0) {
+	    if (*multiArtFile && ptr[*psize] != 0) {
 		logit(LOG_CRIT, "article batch corrupted: %s @ %lld,%ld", path, off, *psize);
-		xunmap(ptr, *psize + *multiArtFile);
+		if (!cached)
+		    xunmap(ptr, *psize + *multiArtFile);
 		ptr = NULL;
+	    } else if (cached) {
+		++mc->mc_Refs;
 	    }
 	}
     }
+done:
+    if (mc == &tmp && tmp.mc_Fd >= 0)
+	close(tmp.mc_Fd);
     return(ptr);
 }
 
 void
 cdunmap(char *ptr, int bytes, int multiArtFile, int compressed)
 {
-    if (compressed)
+    int i;
+
+    if (compressed) {
 	free(ptr);
-    else
-	xunmap((caddr_t)ptr, bytes + multiArtFile);
+	return;
+    }
+    for (i = 0; i < MAXMCACHE; ++i) {
+	XCache *mc = &XCacheAry[i];
+
+	if (mc->mc_Map && ptr >= mc->mc_Map && ptr < mc->mc_Map + mc->mc_MapSize) {
+	    --mc->mc_Refs;
+	    return;
+	}
+    }
+    xunmap((caddr_t)ptr, bytes + multiArtFile);
 }
 
 /*
@@ -3408,13 +3741,9 @@ cdflush(void)
     int i;
     time_t t = time(NULL);
     for (i = 0; i < MAXMCACHE; ++i) {
-	if (XCacheAry[i].mc_Fd >= 0 &&
+	if (XCacheAry[i].mc_Fd >= 0 && XCacheAry[i].mc_Refs == 0 &&
 			(t - XCacheAry[i].mc_OpenTime) > CACHEFLUSHTIME) {
-	close(XCacheAry[i].mc_Fd);
-	zfreeStr(&SysMemPool, &XCacheAry[i].mc_Path);
-	XCacheAry[i].mc_Fd = -1;
-	XCacheAry[i].mc_Size = 0;
-	XCacheAry[i].mc_OpenTime = 0;
+	    cdclose(&XCacheAry[i]);
 	}
     }
 }
@@ -0,0 +1,419 @@
+/*
+ * DOVERBENCH.C - dreaderd overview output micro-benchmark
+ *
+ *	Writes a synthetic overview data file, records of typical article
+ *	headers (folded References, long Subjects, the usual clutter)
+ *	each \0 terminated like the over.* data files, maps it and feeds
+ *	every record through OutputOverview() the way XOVER, XHDR and
+ *	XPAT do.  Reports records/sec and output MB/sec for each.  -s
+ *	uses the scalar scanner instead of SSE2/AVX2, for comparison.
+ *
+ *	Then writes the Subject: column files (lib/overcol.c) for the
+ *	records, a file per data block, plain and compressed the way
+ *	dexpireover leaves them, and compares XHDR subject from the
+ *	records with XHDR subject from the columns, including what has to
+ *	be read for each.
+ */
+
+#include "dreaderd/defs.h"
+
+#define	COUNT	100000
+#define	PASSES	5
+#define	BLOCK	512	/* records per data block, like OD_HARTS	*/
+
+void Usage(void);
+void MakeData(const char *path, int count);
+void Bench(const char *name, int mode, const char *hdrs, const char *pat);
+void AddWord(char *buf, int *len, int max);
+double Elapsed(struct timeval *tv);
+void MakeColumns(const char *dir);
+void BenchColumns(const char *name, const char *dir, int compressed);
+
+int Count = COUNT;
+int Passes = PASSES;
+const char *Map;
+int *RecOff;
+int *RecLen;
+int NumRecs;
+
+/*
+ * what the dreaderd objects expect from dreaderd/main.c
+ */
+char *RTStatus = NULL;
+char *MyGroupHome;
+int ThisReaderFork = -1;
+int FeedOnlyServer = -1;
+int CoreDebugOpt = 0;
+int FastCopyOpt = 1;
+
+void
+ValidateTcpBufferSize(int *psize)
+{
+}
+
+void
+Usage(void)
+{
+    fprintf(stderr, "A dreaderd overview output performance tester\n\n");
+    fprintf(stderr, "Usage: doverbench [-f file] [-n count] [-p passes] [-s]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-f\tkeep the data file in file (default: a temporary file)\n");
+    fprintf(stderr, "\t-n\tnumber of records (default: %d)\n", COUNT);
+    fprintf(stderr, "\t-p\tpasses over the records (default: %d)\n", PASSES);
+    fprintf(stderr, "\t-s\tuse the scalar scanner\n");
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char tmp[] = "/tmp/doverbench.XXXXXX";
+    char *path = NULL;
+    struct stat st;
+    int fd;
+    int i;
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr != '-')
+	    Usage();
+	ptr += 2;
+	switch(ptr[-1]) {
+	case 'f':
+	    path = (*ptr) ? ptr : av[++i];
+	    break;
+	case 'n':
+	    Count = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'p':
+	    Passes = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 's':
+	    OverScanScalar = 1;
+	    break;
+	default:
+	    Usage();
+	}
+    }
+    if (Count <= 0 || Passes <= 0)
+	Usage();
+
+    if (path == NULL) {
+	if ((fd = mkstemp(tmp)) < 0) {
+	    perror("doverbench: mkstemp");
+	    exit(1);
+	}
+	close(fd);
+	path = tmp;
+    }
+    MakeData(path, Count);
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	perror(path);
+	exit(1);
+    }
+    Map = xmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (Map == NULL) {
+	perror("doverbench: mmap");
+	exit(1);
+    }
+    close(fd);
+    if (path == tmp)
+	remove(path);
+
+    /*
+     * index the records
+     */
+    RecOff = malloc(Count * sizeof(int));
+    RecLen = malloc(Count * sizeof(int));
+    for (i = 0; i < st.st_size && NumRecs < Count; ++NumRecs) {
+	RecOff[NumRecs] = i;
+	RecLen[NumRecs] = strlen(Map + i);
+	i += RecLen[NumRecs] + 1;
+    }
+
+    printf("Records     : %d, %.1f MB, %s scanner, %d passes\n",
+	NumRecs, st.st_size / (1024.0 * 1024.0), OverScanType(), Passes);
+    Bench("XOVER", COM_XOVER, OverViewFmt, NULL);
+    Bench("XHDR subject", COM_XHDR, "subject", NULL);
+    Bench("XHDR xref", COM_XHDR, "xref", NULL);
+    Bench("XPAT subject", COM_XPAT, "subject", "*fast*");
+
+    {
+	char dir[] = "/tmp/doverbench.XXXXXX";
+	char cmd[64];
+
+	if (mkdtemp(dir) == NULL) {
+	    perror("doverbench: mkdtemp");
+	    exit(1);
+	}
+	MakeColumns(dir);
+	printf("XHDR rows   : read %.1f MB\n", st.st_size / (1024.0 * 1024.0));
+	BenchColumns("XHDR column", dir, 0);
+	BenchColumns("XHDR zcolumn", dir, 1);
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	system(cmd);
+    }
+    xunmap((void *)Map, st.st_size);
+    return(0);
+}
+
+/*
+ * MakeData() - write count synthetic overview records to path
+ */
+
+static const char *Words[] = {
+    "Re:", "amiga", "question", "about", "the", "new", "disk", "drive",
+    "fast", "ram", "problem", "with", "kickstart", "WTB:", "FS:", "help",
+    "needed", "workbench", "upgrade", "monitor", "(was:", "old", "thread)",
+    "graphics", "card", "driver", "network", "stack", "for", "sale"
+};
+
+void
+AddWord(char *buf, int *len, int max)
+{
+    const char *w = Words[random() % arysize(Words)];
+    int l = strlen(w);
+
+    if (*len + l + 1 < max) {
+	if (*len)
+	    buf[(*len)++] = ' ';
+	bcopy(w, buf + *len, l);
+	*len += l;
+    }
+}
+
+void
+MakeData(const char *path, int count)
+{
+    FILE *fo;
+    int i;
+
+    if ((fo = fopen(path, "w")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    srandom(1);
+    for (i = 0; i < count; ++i) {
+	char subj[256];
+	int slen = 0;
+	int nrefs = random() % 12;
+	int words = 3 + random() % 12;
+	int r;
+
+	while (words--)
+	    AddWord(subj, &slen, sizeof(subj));
+	subj[slen] = 0;
+
+	fprintf(fo, "Path: news.example.net!feeder.example.org!not-for-mail\r\n");
+	fprintf(fo, "From: User %d <user%d@example.com>\r\n", i % 977, i % 977);
+	fprintf(fo, "Newsgroups: comp.sys.amiga.misc,comp.sys.amiga.hardware\r\n");
+	if (slen > 60) {
+	    char *p = strchr(subj + 40, ' ');
+
+	    if (p) {
+		*p = 0;
+		fprintf(fo, "Subject: %s\r\n\t%s\r\n", subj, p + 1);
+	    } else {
+		fprintf(fo, "Subject: %s\r\n", subj);
+	    }
+	} else {
+	    fprintf(fo, "Subject:  %s\r\n", subj);
+	}
+	fprintf(fo, "Date: Sat, 17 Oct 2026 %02d:%02d:%02d +0000\r\n",
+	    i / 3600 % 24, i / 60 % 60, i % 60);
+	fprintf(fo, "Organization: Example Networks\r\n");
+	fprintf(fo, "Lines: %d\r\n", 5 + (int)(random() % 200));
+	fprintf(fo, "Message-ID: <%d.%ld@example.com>\r\n", i, random());
+	if (nrefs) {
+	    fprintf(fo, "References:");
+	    for (r = 0; r < nrefs; ++r) {
+		if (r && r % 3 == 0)
+		    fprintf(fo, "\r\n");
+		fprintf(fo, " <%d.%d@example.com>", i - nrefs + r, r);
+	    }
+	    fprintf(fo, "\r\n");
+	}
+	fprintf(fo, "NNTP-Posting-Host: 192.0.2.%d\r\n", i % 254 + 1);
+	fprintf(fo, "X-Trace: news.example.net 1792195200 %d 192.0.2.%d (17 Oct 2026)\r\n", i, i % 254 + 1);
+	fprintf(fo, "X-Complaints-To: abuse@example.net\r\n");
+	fprintf(fo, "User-Agent: Thor/2.6 (AmigaOS)\r\n");
+	fprintf(fo, "Xref: news.example.net comp.sys.amiga.misc:%d comp.sys.amiga.hardware:%d\r\n", i + 1, i / 2 + 1);
+	fputc(0, fo);
+    }
+    if (fclose(fo) != 0) {
+	perror(path);
+	exit(1);
+    }
+}
+
+/*
+ * Bench() - run every record through OutputOverview() Passes times.
+ *	     The output is thrown away whenever 64K has been queued.
+ */
+
+void
+Bench(const char *name, int mode, const char *hdrs, const char *pat)
+{
+    Connection conn;
+    struct timeval tv;
+    double bytes = 0.0;
+    double secs;
+    int recs = 0;
+    int pass;
+    int i;
+
+    bzero(&conn, sizeof(conn));
+    conn.co_ArtMode = mode;
+    conn.co_ListHdrs = (char *)hdrs;
+    conn.co_ListPat = (char *)pat;
+    conn.co_Numbering = CON_RFC977;
+    MBInit(&conn.co_TMBuf, -1, &conn.co_MemPool, &conn.co_BufPool);
+
+    gettimeofday(&tv, NULL);
+    for (pass = 0; pass < Passes; ++pass) {
+	for (i = 0; i < NumRecs; ++i) {
+	    conn.co_ListBegNo = i + 1;
+	    if (OutputOverview(&conn, Map + RecOff[i], RecLen[i], RecLen[i] * 3) == 0)
+		++recs;
+	    if (conn.co_TMBuf.mh_Bytes > 65536) {
+		bytes += conn.co_TMBuf.mh_Bytes;
+		MBFree(&conn.co_TMBuf);
+	    }
+	}
+    }
+    bytes += conn.co_TMBuf.mh_Bytes;
+    MBFree(&conn.co_TMBuf);
+    secs = Elapsed(&tv);
+
+    printf("%-12s: %.0f records/s, %.1f MB/s out, %d lines\n",
+	name, NumRecs * Passes / secs, bytes / (1024.0 * 1024.0) / secs, recs);
+}
+
+/*
+ * MakeColumns() - write the Subject: column of every BLOCK records to
+ *		   dir/u.<block>, and a compressed copy to dir/z.<block>
+ */
+
+void
+MakeColumns(const char *dir)
+{
+    int col = OverColFind("Subject", 7);
+    char path[PATH_MAX];
+    char zpath[PATH_MAX];
+    char tmp[PATH_MAX];
+    int ufd = -1;
+    int zfd = -1;
+    int i;
+
+    for (i = 0; i <= NumRecs; ++i) {
+	OverLine ol;
+	int b = 0;
+
+	if (i % BLOCK == 0 || i == NumRecs) {
+	    if (ufd >= 0) {
+		close(ufd);
+		close(zfd);
+		snprintf(tmp, sizeof(tmp), "%s/tmp", dir);
+		if (OverColCompress(zpath, tmp, NULL, NULL) < 0) {
+		    fprintf(stderr, "doverbench: unable to compress %s\n", zpath);
+		    exit(1);
+		}
+	    }
+	    if (i == NumRecs)
+		break;
+	    snprintf(path, sizeof(path), "%s/u.%d", dir, i / BLOCK);
+	    snprintf(zpath, sizeof(zpath), "%s/z.%d", dir, i / BLOCK);
+	    if ((ufd = open(path, O_RDWR|O_CREAT|O_APPEND, 0644)) < 0 ||
+		(zfd = open(zpath, O_RDWR|O_CREAT|O_APPEND, 0644)) < 0 ||
+		OverColOpen(ufd, col) < 0 ||
+		OverColOpen(zfd, col) < 0
+	    ) {
+		perror(path);
+		exit(1);
+	    }
+	}
+	ol.ol_Line = NULL;
+	ol.ol_Len = 0;
+	while ((b = OverScanLine(Map + RecOff[i], RecLen[i], b, &ol)) >= 0) {
+	    if (OverColFind(ol.ol_Line, ol.ol_NameLen) == col)
+		break;
+	}
+	if (b < 0)
+	    ol.ol_Len = 0;
+	OverColAppend(ufd, i + 1, hhash(""), ol.ol_Line, ol.ol_Len);
+	OverColAppend(zfd, i + 1, hhash(""), ol.ol_Line, ol.ol_Len);
+    }
+}
+
+/*
+ * BenchColumns() - XHDR subject from the column files, reading each
+ *		    block's file the way GetOverColumn() does
+ */
+
+void
+BenchColumns(const char *name, const char *dir, int compressed)
+{
+    Connection conn;
+    struct timeval tv;
+    double bytes = 0.0;
+    double readBytes = 0.0;
+    double secs;
+    int recs = 0;
+    int pass;
+    int blk;
+
+    bzero(&conn, sizeof(conn));
+    conn.co_ArtMode = COM_XHDR;
+    conn.co_ListHdrs = "subject";
+    conn.co_Numbering = CON_RFC977;
+    MBInit(&conn.co_TMBuf, -1, &conn.co_MemPool, &conn.co_BufPool);
+
+    gettimeofday(&tv, NULL);
+    for (pass = 0; pass < Passes; ++pass) {
+	for (blk = 0; blk * BLOCK < NumRecs; ++blk) {
+	    OverColBuf cb = { 0 };
+	    OverColEnt ce;
+	    const char *line;
+	    struct stat st;
+	    int off = 0;
+	    int fd;
+
+	    fd = xopen(O_RDONLY, 0, "%s/%c.%d", dir, (compressed ? 'z' : 'u'), blk);
+	    if (fd < 0 || OverColRead(fd, &cb) < 0) {
+		fprintf(stderr, "doverbench: bad column file %d\n", blk);
+		exit(1);
+	    }
+	    if (fstat(fd, &st) == 0)
+		readBytes += st.st_size;
+	    close(fd);
+	    while ((off = OverColNext(&cb, off, &ce, &line)) >= 0) {
+		conn.co_ListBegNo = ce.ce_ArtNo;
+		if (OutputOverview(&conn, line, ce.ce_Len, 0) == 0)
+		    ++recs;
+		if (conn.co_TMBuf.mh_Bytes > 65536) {
+		    bytes += conn.co_TMBuf.mh_Bytes;
+		    MBFree(&conn.co_TMBuf);
+		}
+	    }
+	    OverColFree(&cb);
+	}
+    }
+    bytes += conn.co_TMBuf.mh_Bytes;
+    MBFree(&conn.co_TMBuf);
+    secs = Elapsed(&tv);
+
+    printf("%-12s: %.0f records/s, %.1f MB/s out, %d lines, read %.1f MB\n",
+	name, NumRecs * Passes / secs, bytes / (1024.0 * 1024.0) / secs, recs,
+	readBytes / Passes / (1024.0 * 1024.0));
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
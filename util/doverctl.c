@@ -268,6 +268,7 @@ ConvertHash(const char *group, GroupHashType *srcHash, GroupHashType *dstHash, i
     artno_t artBase;
     artno_t prevArtBase;
     int dataEntriesMask;
+    int col;
 
     if (chdir(PatExpand(GroupHomePat)) != 0) {
 	printf("Unable to chdir %s (%s)\n", PatExpand(GroupHomePat), strerror(errno));
@@ -324,6 +325,24 @@ ConvertHash(const char *group, GroupHashType *srcHash, GroupHashType *dstHash, i
 		}
 	    }
 	}
+	/*
+	 * and the block's column files, if any (lib/overcol.c)
+	 */
+	for (col = 0; col < OVERCOL_COUNT; ++col) {
+	    strcpy(path1, GFName(group, GRPFTYPE_COLUMN + col, artBase, 1, iter, srcHash));
+	    strcpy(path2, GFName(group, GRPFTYPE_COLUMN + col, artBase, 1, iter, dstHash));
+	    if (stat(path1, &st) != 0)
+		continue;
+	    if (DebugOpt > 1)
+		printf("Converting %s -> %s\n", path1, path2);
+	    if (ForReal) {
+		if (FileCopy)
+		    MoveFile(path1, path2);
+		else if (rename(path1, path2) != 0)
+		    printf("Cannot rename %s -> %s (%s)\n", path1, path2,
+							strerror(errno));
+	    }
+	}
     }
     if (VerboseOpt)
 	printf("Converted %s\n", group);
@@ -602,9 +621,9 @@ ProcessFile(const char *dirPath, const char *name)
 	    }
 	    close(fd);
 	}
-    } else if (type & HASHGRPTYPE_DATA) {
+    } else if (type & (HASHGRPTYPE_DATA|HASHGRPTYPE_COLUMN)) {
 	/*
-	 * data. file, modulo OD_HARTS.  OD_HARTS constant in second
+	 * data. or column file, modulo OD_HARTS.  OD_HARTS constant in second
 	 * part of conditional is a fudge to make 100% sure we do not
 	 * delete a brand new data file.
 	 */
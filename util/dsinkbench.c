@@ -0,0 +1,381 @@
+/*
+ * DSINKBENCH.C - NNTP streaming sink with a configurable latency
+ *
+ *	Takes a streaming feed (mode stream, check, takethis, ihave) and
+ *	throws the articles away.  Every response is held back until
+ *	latency ms after its command arrived, as from a peer that far
+ *	away.  When a connection closes it reports articles/sec and how
+ *	many commands the sender kept in flight.  Point dnewslink at it
+ *	with different -M values, or with -a, to see what the window is
+ *	worth on a long link.
+ */
+
+#include "defs.h"
+
+#define	LATENCY		50
+#define	PORT		"11190"
+#define	MAXRESP		8192		/* responses held back, power of 2 */
+#define	RESPLEN		(MAXMSGIDLEN + 16)
+#define	INBUFSIZE	(256 * 1024)
+
+typedef struct Resp {
+    double	r_Due;
+    int		r_Len;
+    int		r_InFlight;		/* answers a check/takethis/ihave */
+    char	r_Text[RESPLEN];
+} Resp;
+
+void Usage(void);
+void Sink(int fd, int n);
+void Queue(double t, int inFlight, const char *ctl, ...);
+int Command(char *line, double t);
+void SetInFlight(int n, double t);
+double Now(void);
+
+int Latency = LATENCY;
+int VerboseOpt = 0;
+
+Resp	RespAry[MAXRESP];
+int	RespHead;
+int	RespTail;
+
+int	InFlight;
+int	PeakInFlight;
+double	InFlightSum;			/* in flight x secs */
+double	InFlightLast;
+int	Arts;
+double	ArtBytes;
+double	FirstCmd;
+int	InArticle;			/* 0, 1 takethis, 2 ihave */
+int	Quit;
+char	ArtMsgId[MAXMSGIDLEN];
+
+void
+Usage(void)
+{
+    fprintf(stderr, "An NNTP streaming sink with a configurable latency\n\n");
+    fprintf(stderr, "Usage: dsinkbench [-l latency] [-n conns] [-p port] [-v]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-l\tresponse delay in ms (default: %d)\n", LATENCY);
+    fprintf(stderr, "\t-n\texit after conns connections (default: never)\n");
+    fprintf(stderr, "\t-p\tlisten port (default: %s)\n", PORT);
+    fprintf(stderr, "\t-v\tbe more verbose\n");
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char *port = PORT;
+    int count = 0;
+    struct sockaddr_in sin;
+    int lfd;
+    int on = 1;
+    int n;
+    int i;
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr != '-')
+	    Usage();
+	ptr += 2;
+	switch(ptr[-1]) {
+	case 'l':
+	    Latency = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'n':
+	    count = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'p':
+	    port = (*ptr) ? ptr : av[++i];
+	    break;
+	case 'v':
+	    VerboseOpt = 1;
+	    break;
+	default:
+	    Usage();
+	}
+    }
+
+    rsignal(SIGPIPE, SIG_IGN);
+
+    bzero(&sin, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(atoi(port));
+    if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+	perror("dsinkbench: socket");
+	exit(1);
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, (void *)&on, sizeof(on));
+    if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+	listen(lfd, 5) < 0
+    ) {
+	perror("dsinkbench: bind");
+	exit(1);
+    }
+    printf("Listening on port %s, latency %dms\n", port, Latency);
+    fflush(stdout);
+
+    for (n = 1; count == 0 || n <= count; ++n) {
+	int fd;
+
+	if ((fd = accept(lfd, NULL, NULL)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    perror("dsinkbench: accept");
+	    exit(1);
+	}
+#ifdef TCP_NODELAY
+	/*
+	 * Responses are small writes, do not let Nagle hold them up
+	 * behind the peer's delayed ack
+	 */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof(on));
+#endif
+	Sink(fd, n);
+	close(fd);
+    }
+    return(0);
+}
+
+/*
+ * Sink() - one connection.  Commands are parsed as they come in,
+ *	    their responses are queued with the time they are due and
+ *	    written when that time has come.
+ */
+
+void
+Sink(int fd, int n)
+{
+    static char in[INBUFSIZE];
+    static char out[64 * 1024];
+    int inb = 0;
+    int ine = 0;
+    int outb = 0;
+    int oute = 0;
+    int midLine = 0;
+    int eof = 0;
+    double start = Now();
+    double t;
+
+    RespHead = RespTail = 0;
+    InFlight = PeakInFlight = 0;
+    InFlightSum = 0.0;
+    InFlightLast = start;
+    Arts = 0;
+    ArtBytes = 0.0;
+    FirstCmd = 0.0;
+    InArticle = 0;
+    Quit = 0;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    Queue(0.0, 0, "200 dsinkbench ready\r\n");
+
+    for (;;) {
+	struct pollfd pfd = { 0 };
+	int timeout = -1;
+
+	t = Now();
+
+	/*
+	 * Handle complete lines, as long as there is room to queue
+	 * their responses.  Article lines only need to be looked at
+	 * for the terminating '.'
+	 */
+	while (((RespHead + 1) & (MAXRESP - 1)) != RespTail) {
+	    char *p = memchr(in + inb, '\n', ine - inb);
+	    int len;
+
+	    if (p == NULL)
+		break;
+	    len = p - (in + inb) + 1;
+	    if (InArticle) {
+		if (!midLine && (len == 2 || (len == 3 && in[inb + 1] == '\r')) &&
+		    in[inb] == '.'
+		) {
+		    ++Arts;
+		    if (InArticle == 1)
+			Queue(t, 1, "239 %s\r\n", ArtMsgId);
+		    else
+			Queue(t, 1, "235\r\n");
+		    InArticle = 0;
+		} else {
+		    ArtBytes += len;
+		}
+	    } else if (!midLine) {
+		*p = 0;
+		if (p > in + inb && p[-1] == '\r')
+		    p[-1] = 0;
+		if (VerboseOpt)
+		    printf("<< %s\n", in + inb);
+		Command(in + inb, t);
+	    }
+	    midLine = 0;
+	    inb += len;
+	}
+	if (inb == ine) {
+	    inb = ine = 0;
+	} else if (ine == sizeof(in)) {
+	    if (inb == 0) {
+		/* line longer than the buffer, skip it */
+		ArtBytes += ine;
+		ine = 0;
+		midLine = 1;
+	    } else {
+		memmove(in, in + inb, ine - inb);
+		ine -= inb;
+		inb = 0;
+	    }
+	}
+
+	/*
+	 * Move due responses to the output buffer and write them
+	 */
+	while (RespHead != RespTail) {
+	    Resp *r = &RespAry[RespTail];
+
+	    if (r->r_Due > t || oute + r->r_Len > sizeof(out))
+		break;
+	    bcopy(r->r_Text, out + oute, r->r_Len);
+	    oute += r->r_Len;
+	    if (r->r_InFlight)
+		SetInFlight(InFlight - 1, t);
+	    RespTail = (RespTail + 1) & (MAXRESP - 1);
+	}
+	if (outb != oute) {
+	    int w = write(fd, out + outb, oute - outb);
+
+	    if (w > 0)
+		outb += w;
+	    else if (w < 0 && errno != EAGAIN && errno != EINTR)
+		break;
+	    if (outb == oute)
+		outb = oute = 0;
+	}
+	if ((eof || Quit) && RespHead == RespTail && outb == oute)
+	    break;
+
+	/*
+	 * Wait for input (unless the response queue is full), for the
+	 * socket to take more output or for the next response to fall due
+	 */
+	pfd.fd = fd;
+	if (!eof && !Quit && ine < sizeof(in) &&
+	    ((RespHead + 1) & (MAXRESP - 1)) != RespTail
+	) {
+	    pfd.events |= POLLIN;
+	}
+	if (outb != oute)
+	    pfd.events |= POLLOUT;
+	if (RespHead != RespTail) {
+	    timeout = (int)((RespAry[RespTail].r_Due - t) * 1000.0) + 1;
+	    if (timeout < 0)
+		timeout = 0;
+	}
+	if (pfd.events == 0 && timeout < 0)
+	    break;
+	if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+	    break;
+	if ((pfd.events & POLLIN) && (pfd.revents & (POLLIN|POLLHUP|POLLERR))) {
+	    int r = read(fd, in + ine, sizeof(in) - ine);
+
+	    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR))
+		eof = 1;
+	    else if (r > 0)
+		ine += r;
+	}
+    }
+
+    t = Now();
+    SetInFlight(InFlight, t);
+    if (FirstCmd == 0.0)
+	FirstCmd = start;
+    printf("Conn %d: %d articles, %.1f MB in %.2fs, %.0f articles/s\n",
+	n, Arts, ArtBytes / (1024.0 * 1024.0), t - FirstCmd,
+	(t > FirstCmd) ? Arts / (t - FirstCmd) : 0.0);
+    printf("Conn %d: in flight peak %d, average %.1f\n",
+	n, PeakInFlight, (t > start) ? InFlightSum / (t - start) : 0.0);
+    fflush(stdout);
+}
+
+/*
+ * Command() - queue the response to one command line
+ */
+
+int
+Command(char *line, double t)
+{
+    char *cmd = strtok(line, " \t");
+    char *arg = strtok(NULL, " \t");
+
+    if (cmd == NULL)
+	return(0);
+    if (FirstCmd == 0.0 && strcasecmp(cmd, "mode") != 0)
+	FirstCmd = t;
+
+    if (strcasecmp(cmd, "mode") == 0 && arg && strcasecmp(arg, "stream") == 0) {
+	Queue(t, 0, "203 StreamOK.\r\n");
+    } else if (strcasecmp(cmd, "mode") == 0 && arg && strcasecmp(arg, "headfeed") == 0) {
+	Queue(t, 0, "250 Mode Command OK.\r\n");
+    } else if (strcasecmp(cmd, "check") == 0 && arg) {
+	Queue(t, 1, "238 %s\r\n", arg);
+    } else if (strcasecmp(cmd, "takethis") == 0 && arg) {
+	StrnCpyNull(ArtMsgId, arg, sizeof(ArtMsgId));
+	InArticle = 1;
+    } else if (strcasecmp(cmd, "ihave") == 0 && arg) {
+	Queue(t, 0, "335 %s\r\n", arg);
+	InArticle = 2;
+    } else if (strcasecmp(cmd, "quit") == 0) {
+	Queue(t, 0, "205 Goodbye\r\n");
+	Quit = 1;
+    } else {
+	Queue(t, 0, "500 What?\r\n");
+    }
+    return(0);
+}
+
+/*
+ * Queue() - queue a response due latency ms after t
+ */
+
+void
+Queue(double t, int inFlight, const char *ctl, ...)
+{
+    Resp *r = &RespAry[RespHead];
+    va_list va;
+
+    va_start(va, ctl);
+    vsnprintf(r->r_Text, sizeof(r->r_Text), ctl, va);
+    va_end(va);
+    r->r_Len = strlen(r->r_Text);
+    r->r_Due = t + Latency / 1000.0;
+    r->r_InFlight = inFlight;
+    if (inFlight)
+	SetInFlight(InFlight + 1, t);
+    RespHead = (RespHead + 1) & (MAXRESP - 1);
+}
+
+/*
+ * SetInFlight() - change the number of commands in flight, keeping the
+ *		   time integral for the average
+ */
+
+void
+SetInFlight(int n, double t)
+{
+    InFlightSum += InFlight * (t - InFlightLast);
+    InFlightLast = t;
+    InFlight = n;
+    if (InFlight > PeakInFlight)
+	PeakInFlight = InFlight;
+}
+
+double
+Now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return(tv.tv_sec + tv.tv_usec / 1000000.0);
+}
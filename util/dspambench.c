@@ -0,0 +1,164 @@
+/*
+ * DSPAMBENCH.C - internal spam filter table benchmark
+ *
+ *	Forks a number of processes that all run SpamFilter() against
+ *	the same body and NNTP-Posting-Host: cache files, the way the
+ *	incoming feeds do, and reports the aggregate lookup rate.  The
+ *	fingerprints are drawn from a fixed set of keys so that the
+ *	table sees hits, inserts and evictions.  Scratch cache files in
+ *	the db directory are used, not the live ones.
+ */
+
+#include "defs.h"
+#include <sys/wait.h>
+
+#define	LOOKUPS		1000000
+#define	KEYS		100000
+#define	PROCS		"1,4,16"
+#define	FILTEROPT	"B6s1m N16s1m"
+
+void Usage(void);
+void Bench(int procs, int lookups, int keys);
+double Elapsed(struct timeval *tv);
+
+void
+Usage(void)
+{
+    fprintf(stderr, "An internal spam filter performance tester\n\n");
+    fprintf(stderr, "Usage: dspambench [-f filteropt] [-k keys] [-n lookups] [-p procs[,procs...]]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-f\t'internalfilter' options (default: %s)\n", FILTEROPT);
+    fprintf(stderr, "\t-k\tnumber of distinct body fingerprints (default: %d)\n", KEYS);
+    fprintf(stderr, "\t-n\tlookups per process (default: %d)\n", LOOKUPS);
+    fprintf(stderr, "\t-p\tprocess counts to run (default: %s)\n", PROCS);
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char *filterOpt = FILTEROPT;
+    char *procs = PROCS;
+    int lookups = LOOKUPS;
+    int keys = KEYS;
+    int i;
+
+    LoadDiabloConfig(ac, av);
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr != '-')
+	    Usage();
+	ptr += 2;
+	switch(ptr[-1]) {
+	case 'C':
+	    if (*ptr == 0)
+		++i;
+	    break;
+	case 'f':
+	    filterOpt = (*ptr) ? ptr : av[++i];
+	    break;
+	case 'k':
+	    keys = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'n':
+	    lookups = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'p':
+	    procs = (*ptr) ? ptr : av[++i];
+	    break;
+	default:
+	    Usage();
+	}
+    }
+    if (keys <= 0 || lookups <= 0 || procs == NULL)
+	Usage();
+
+    SpamBodyCachePat = "%s/dspambench.body.cache";
+    SpamNphCachePat = "%s/dspambench.nph.cache";
+    strdupfree(&DOpts.SpamFilterOpt, filterOpt, NULL);
+    SetSpamFilterOpt();
+    if (DOpts.SpamFilterOpt == NULL) {
+	fprintf(stderr, "dspambench: bad filter options: %s\n", filterOpt);
+	exit(1);
+    }
+
+    procs = strdup(procs);
+    for (procs = strtok(procs, ","); procs != NULL; procs = strtok(NULL, ",")) {
+	int n = strtol(procs, NULL, 0);
+
+	if (n <= 0)
+	    Usage();
+	InitSpamFilter();
+	Bench(n, lookups, keys);
+	TermSpamFilter();
+	remove(PatDbExpand(SpamBodyCachePat));
+	remove(PatDbExpand(SpamNphCachePat));
+    }
+    return(0);
+}
+
+/*
+ * Bench() - run procs processes doing lookups each.  The posting host
+ *	     takes one of a thousand values, so the NNTP-Posting-Host:
+ *	     table is mostly hits and trips, the body table mostly
+ *	     misses and inserts unless keys is small.
+ */
+
+void
+Bench(int procs, int lookups, int keys)
+{
+    struct timeval tv;
+    double secs;
+    long spam = 0;
+    int status;
+    int i;
+
+    fflush(stdout);
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < procs; ++i) {
+	if (fork() == 0) {
+	    int nspam = 0;
+	    int j;
+
+	    SpamFilterChild();
+	    srandom(i + 1);
+	    for (j = 0; j < lookups; ++j) {
+		SpamInfo si;
+		long k = random() % keys;
+		int how;
+
+		bzero(&si, sizeof(si));
+		si.BodyHash.h1 = k * 0x9E3779B97F4A7C15ULL;
+		si.BodyHash.h2 = k;
+		si.PostingHost = "bench.invalid";
+		si.PostingHostHash.h1 = (k % 1000) * 0x9E3779B97F4A7C15ULL;
+		si.PostingHostHash.h2 = k % 1000;
+		si.Lines = 10;
+		si.MsgIdHash.h1 = j;
+		si.MsgIdHash.h2 = i;
+		if (SpamFilter(time(NULL), &si, &how) < 0)
+		    ++nspam;
+	    }
+	    _exit(nspam * 100L / lookups);
+	}
+    }
+    while (wait(&status) > 0) {
+	if (WIFEXITED(status))
+	    spam += WEXITSTATUS(status);
+    }
+    secs = Elapsed(&tv);
+    printf("%-12s: %d procs, %d lookups in %.3fs, %.0f/s, %ld%% spam\n",
+	"spamfilter", procs, procs * lookups, secs,
+	procs * (double)lookups / secs, spam / procs);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
@@ -22,6 +22,7 @@
 #define SF_PRESBYTES	0x0040
 #define SF_ARTSTAT	0x0080
 #define SF_NOTIFY	0x0100
+#define SF_ADAPTIVE	0x0200
 
 #define MAXLOGARTS      80   /* maximal length of the logarts string */
 
@@ -239,6 +240,7 @@ processDnewsfeeds(const char *qFile)
 	    flags = flags | (li->li_PreserveBytes ? SF_PRESBYTES : 0);
 	    flags = flags | (li->li_ArticleStat ? SF_ARTSTAT : 0);
 	    flags = flags | (li->li_NoBatch ? SF_NOBATCH : 0);
+	    flags = flags | (li->li_AdaptiveStream > 0 ? SF_ADAPTIVE : 0);
 
 	    if (flags & SF_NOTIFY && !(flags & SF_REALTIME))
 		flags &= ~SF_NOTIFY;
@@ -361,6 +363,8 @@ processDspoolout(const char *fname, char *qFile)
 				flags |= SF_GENLINES;
 			    } else if (strcmp(maxqStr, "notify") == 0) {
 				flags |= SF_NOTIFY;
+			    } else if (strcmp(maxqStr, "adaptive") == 0) {
+				flags |= SF_ADAPTIVE;
 			    } else if (strcmp(maxqStr, "compress") == 0) {
 				compress = 1;
 			    } else if (strcmp(maxqStr, "logarts") == 0) {
@@ -543,7 +547,12 @@ spool_file(char *spoolFile, int pass, NewslinkInfo *li, int flags)
 	sprintf(rxBufSizeStr, "-R%d", li->li_ReceiveBuf);
     if (li->li_TOS > 0 && li->li_TOS <= 0xff )
 	sprintf(TOSStr, "-Q%d", li->li_TOS);
-    if (li->li_MaxStream > 0)
+    /*
+     * An adaptive window only takes a maxstream above the fixed default
+     * as its limit, dnewslink picks its own otherwise
+     */
+    if (li->li_MaxStream > 0 &&
+	(!(flags & SF_ADAPTIVE) || li->li_MaxStream > MAXSTREAM))
 	sprintf(maxStreamStr, "-M%d", li->li_MaxStream);
     if (li->li_Compress > 0)
 	sprintf(compressStr, "-Z%d", li->li_Compress);
@@ -756,7 +765,7 @@ spool_file(char *spoolFile, int pass, NewslinkInfo *li, int flags)
 		    sprintf(templateFile, "%s.S%%05d", spoolFile);
 		    sprintf(seqName, "%d", use);
 		    if (VerboseOpt)
-			    printf("%s %s%s %s%s %s%s %s%s %s%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
+			    printf("%s %s%s %s%s %s%s %s%s %s%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
 				"dnewslink",
 				"-h", li->li_HostName,
 				"-b", templateFile,
@@ -770,6 +779,7 @@ spool_file(char *spoolFile, int pass, NewslinkInfo *li, int flags)
 				    "-nop"),
 				((flags & SF_NOCHECK) ? "-I" : "-nop"),
 				((flags & SF_GENLINES) ? "-L" : "-nop"),
+				((flags & SF_ADAPTIVE) ? "-a" : "-nop"),
 				((flags & SF_ARTSTAT) ? "-x" : "-nop"),
 				compressStr,
 				logartsStr,
@@ -812,6 +822,7 @@ spool_file(char *spoolFile, int pass, NewslinkInfo *li, int flags)
 				    "-nop"),
 				((flags & SF_NOCHECK) ? "-I" : "-nop"),
 				((flags & SF_GENLINES) ? "-L" : "-nop"),
+				((flags & SF_ADAPTIVE) ? "-a" : "-nop"),
 				((flags & SF_ARTSTAT) ? "-x" : "-nop"),
 				compressStr,
 				logartsStr,
@@ -853,7 +864,7 @@ spool_file(char *spoolFile, int pass, NewslinkInfo *li, int flags)
 			printf("dspoolout: run realtime %s\n", spoolFile);
 
 		    if (VerboseOpt)
-			printf("%s %s%s %s%s %s%s %s%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
+			printf("%s %s%s %s%s %s%s %s%s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s %s\n",
 				"dnewslink",
 				"-h", li->li_HostName,
 				"-b", spoolFile,
@@ -868,6 +879,7 @@ spool_file(char *spoolFile, int pass, NewslinkInfo *li, int flags)
 				    "-nop"),
 				(((flags & SF_NOCHECK)||(li->li_Check==2)) ? "-I" : "-nop"),
 				((flags & SF_GENLINES) ? "-L" : "-nop"),
+				((flags & SF_ADAPTIVE) ? "-a" : "-nop"),
 				((flags & SF_ARTSTAT) ? "-x" : "-nop"),
 				compressStr,
 				logartsStr,
@@ -907,6 +919,7 @@ spool_file(char *spoolFile, int pass, NewslinkInfo *li, int flags)
 				    "-nop"),
 				(((flags & SF_NOCHECK)||(li->li_Check==2)) ? "-I" : "-nop"),
 				((flags & SF_GENLINES) ? "-L" : "-nop"),
+				((flags & SF_ADAPTIVE) ? "-a" : "-nop"),
 				((flags & SF_ARTSTAT) ? "-x" : "-nop"),
 				compressStr,
 				logartsStr,
@@ -0,0 +1,515 @@
+/*
+ * DTAKEBENCH.C - incoming article throughput benchmark
+ *
+ *	Replays a captured streaming feed (the bytes a peer sent: TAKETHIS
+ *	commands each followed by its article) to a diablo server over one
+ *	or more connections and reports the rate at which the articles
+ *	were taken, in articles/sec and MB/s per connection.  Each diablo
+ *	connection is one process, so the per connection rate is the
+ *	ingest rate of one core.  Other commands in the capture are
+ *	ignored.  Unless -k is given the message-ids are made unique for
+ *	the run, in the TAKETHIS and the Message-ID: header, so that the
+ *	same capture can be replayed again.  -g writes a made up capture
+ *	of text and base64 binary articles to the file instead.
+ */
+
+#include "defs.h"
+
+#define	SIZE		4000
+#define	NEWSGROUP	"test.dtakebench"
+
+typedef struct Article {
+    char	*a_Buf;		/* dot stuffed article and terminator	*/
+    int		a_Len;
+    char	*a_MsgId;
+    int		a_IdOff;	/* of the message-id in a_Buf, or -1	*/
+} Article;
+
+typedef struct Result {
+    double	r_Bytes;
+    double	r_Secs;
+    int		r_Accepted;
+    int		r_Rejected;
+    int		r_Errors;
+} Result;
+
+void Usage(void);
+void Generate(const char *path, int count, int size);
+Article *ReadCapture(const char *path, int *pcount);
+void Replay(const char *host, const char *port, Article *arts, int count, int conn, int conns, const char *suffix, Result *res);
+int ReadLine(int fd, char *buf, int len);
+double Elapsed(struct timeval *tv);
+
+void
+Usage(void)
+{
+    fprintf(stderr, "A diablo incoming article throughput benchmark\n\n");
+    fprintf(stderr, "Usage: dtakebench [-c conns] [-k] [-p port] host capture\n");
+    fprintf(stderr, "       dtakebench -g count [-s size] capture\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-c\tnumber of parallel connections (default: 1)\n");
+    fprintf(stderr, "\t-g\twrite a capture of count made up articles\n");
+    fprintf(stderr, "\t-k\tkeep the message-ids of the capture\n");
+    fprintf(stderr, "\t-p\tremote port (default: 119)\n");
+    fprintf(stderr, "\t-s\taverage article body size (default: %d)\n", SIZE);
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    char *args[2] = { NULL, NULL };
+    char *port = "119";
+    char suffix[64];
+    Article *arts;
+    Result *res;
+    Result tot;
+    int *pipes;
+    double secs;
+    int nargs = 0;
+    int conns = 1;
+    int generate = 0;
+    int size = SIZE;
+    int keep = 0;
+    int count;
+    int i;
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr == '-') {
+	    ptr += 2;
+	    switch(ptr[-1]) {
+	    case 'c':
+		conns = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'g':
+		generate = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'k':
+		keep = 1;
+		break;
+	    case 'p':
+		port = (*ptr) ? ptr : av[++i];
+		break;
+	    case 's':
+		size = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    default:
+		Usage();
+	    }
+	} else if (nargs < 2) {
+	    args[nargs++] = ptr;
+	} else {
+	    Usage();
+	}
+    }
+
+    if (generate) {
+	if (nargs != 1 || size <= 0)
+	    Usage();
+	Generate(args[0], generate, size);
+	return(0);
+    }
+    if (nargs != 2 || conns <= 0)
+	Usage();
+
+    arts = ReadCapture(args[1], &count);
+    if (conns > count)
+	conns = count;
+    suffix[0] = 0;
+    if (keep == 0)
+	snprintf(suffix, sizeof(suffix), ".%lx.%d", (long)time(NULL), (int)getpid());
+
+    /*
+     * Each connection sends its result back over a pipe
+     */
+
+    res = calloc(conns, sizeof(Result));
+    pipes = malloc(conns * sizeof(int));
+    for (i = 0; i < conns; ++i) {
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+	    perror("dtakebench: pipe");
+	    exit(1);
+	}
+	if (fork() == 0) {
+	    close(fds[0]);
+	    Replay(args[0], port, arts, count, i, conns, suffix, &res[i]);
+	    write(fds[1], &res[i], sizeof(Result));
+	    _exit(0);
+	}
+	close(fds[1]);
+	pipes[i] = fds[0];
+    }
+    for (i = 0; i < conns; ++i) {
+	if (read(pipes[i], &res[i], sizeof(Result)) != sizeof(Result))
+	    res[i].r_Errors = (count - i + conns - 1) / conns;
+	close(pipes[i]);
+    }
+    while (wait(NULL) > 0)
+	;
+
+    /*
+     * The total rate is over the time the slowest connection took
+     */
+    secs = 0.0;
+    bzero(&tot, sizeof(tot));
+    for (i = 0; i < conns; ++i) {
+	Result *r = &res[i];
+
+	printf("Conn %-7d: %d taken, %d rejected, %d errors, %.1fMB in %.3fs, %.0f/s, %.1f MB/s\n",
+	    i, r->r_Accepted, r->r_Rejected, r->r_Errors,
+	    r->r_Bytes / (1024.0 * 1024.0), r->r_Secs,
+	    (r->r_Secs > 0) ? (r->r_Accepted + r->r_Rejected) / r->r_Secs : 0.0,
+	    (r->r_Secs > 0) ? r->r_Bytes / r->r_Secs / (1024.0 * 1024.0) : 0.0);
+	tot.r_Bytes += r->r_Bytes;
+	tot.r_Accepted += r->r_Accepted;
+	tot.r_Rejected += r->r_Rejected;
+	tot.r_Errors += r->r_Errors;
+	if (r->r_Secs > secs)
+	    secs = r->r_Secs;
+    }
+    if (secs <= 0.0)
+	secs = 1e-6;
+    printf("Total       : %d taken, %d rejected, %d errors, %.1fMB in %.3fs, %.0f/s, %.1f MB/s, %.1f MB/s per connection\n",
+	tot.r_Accepted, tot.r_Rejected, tot.r_Errors,
+	tot.r_Bytes / (1024.0 * 1024.0), secs,
+	(tot.r_Accepted + tot.r_Rejected) / secs,
+	tot.r_Bytes / secs / (1024.0 * 1024.0),
+	tot.r_Bytes / secs / (1024.0 * 1024.0) / conns);
+    return((tot.r_Errors) ? 1 : 0);
+}
+
+/*
+ * Generate() - write a capture of count articles.  Three in four are
+ *		text, the rest base64 binaries, with bodies of 1/2 to
+ *		3/2 of size bytes.
+ */
+
+static const char *Words[] = {
+    "the", "of", "news", "spool", "feed", "article", "peer", "history",
+    "a", "server", "group", "header", "body", "diablo", "expire", "with"
+};
+#define NWORDS	(sizeof(Words) / sizeof(Words[0]))
+
+static const char B64Chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void
+Generate(const char *path, int count, int size)
+{
+    FILE *fo;
+    char date[64];
+    time_t t = time(NULL);
+    int i;
+
+    if ((fo = fopen(path, "w")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&t));
+    srandom(1);
+    fprintf(fo, "MODE STREAM\r\n");
+    for (i = 0; i < count; ++i) {
+	int binary = (random() % 4 == 0);
+	int body = size / 2 + random() % (size + 1);
+	int n = 0;
+
+	fprintf(fo, "TAKETHIS <%d.%lx@dtakebench.invalid>\r\n", i, (long)t);
+	fprintf(fo, "Path: dtakebench.invalid!not-for-mail\r\n");
+	fprintf(fo, "From: bench@dtakebench.invalid\r\n");
+	fprintf(fo, "Newsgroups: %s%s\r\n", NEWSGROUP, (binary) ? ".binaries" : "");
+	fprintf(fo, "Subject: dtakebench article %d\r\n", i);
+	fprintf(fo, "Date: %s\r\n", date);
+	fprintf(fo, "Message-ID: <%d.%lx@dtakebench.invalid>\r\n", i, (long)t);
+	if (binary) {
+	    fprintf(fo, "Mime-Version: 1.0\r\n");
+	    fprintf(fo, "Content-Type: image/jpeg\r\n");
+	}
+	fprintf(fo, "\r\n");
+	while (n < body) {
+	    char line[128];
+	    int l = 0;
+
+	    if (binary) {
+		for (l = 0; l < 76; ++l)
+		    line[l] = B64Chars[random() % 64];
+	    } else {
+		int want = 20 + random() % 56;
+
+		if (random() % 40 == 0)
+		    line[l++] = '.';
+		while (l < want) {
+		    l += sprintf(line + l, "%s%s", (l ? " " : ""),
+						Words[random() % NWORDS]);
+		}
+	    }
+	    if (line[0] == '.')
+		fputc('.', fo);
+	    fwrite(line, l, 1, fo);
+	    fprintf(fo, "\r\n");
+	    n += l + 2;
+	}
+	fprintf(fo, ".\r\n");
+    }
+    fprintf(fo, "QUIT\r\n");
+    if (fclose(fo) != 0) {
+	perror(path);
+	exit(1);
+    }
+}
+
+/*
+ * ReadCapture() - find the TAKETHIS commands and their articles
+ */
+
+Article *
+ReadCapture(const char *path, int *pcount)
+{
+    Article *arts = NULL;
+    struct stat st;
+    char *base;
+    char *p;
+    char *end;
+    int max = 0;
+    int n = 0;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	perror(path);
+	exit(1);
+    }
+    base = xmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == NULL) {
+	perror(path);
+	exit(1);
+    }
+    close(fd);
+    end = base + st.st_size;
+
+    for (p = base; p < end; ) {
+	char *nl = memchr(p, '\n', end - p);
+	char *next = (nl) ? nl + 1 : end;
+
+	if (next - p > 9 && strncasecmp(p, "TAKETHIS ", 9) == 0) {
+	    Article *a;
+	    char *id = p + 9;
+	    char *ide = id;
+	    char *q;
+	    int inHead = 1;
+
+	    while (ide < next && *ide != '\r' && *ide != '\n' &&
+							*ide != ' ')
+		++ide;
+	    if (n == max) {
+		max = (max) ? max * 2 : 1024;
+		arts = realloc(arts, max * sizeof(Article));
+	    }
+	    a = &arts[n];
+	    a->a_MsgId = malloc(ide - id + 1);
+	    memcpy(a->a_MsgId, id, ide - id);
+	    a->a_MsgId[ide - id] = 0;
+	    a->a_Buf = next;
+	    a->a_IdOff = -1;
+
+	    /*
+	     * The article runs to the .CRLF line, the message-id we want
+	     * is the first one in the headers
+	     */
+	    for (q = next; q < end; ) {
+		char *qn = memchr(q, '\n', end - q);
+
+		qn = (qn) ? qn + 1 : end;
+		if (qn - q == 3 && strncmp(q, ".\r\n", 3) == 0) {
+		    q = qn;
+		    break;
+		}
+		if (qn - q <= 2)
+		    inHead = 0;
+		if (inHead && a->a_IdOff < 0 && qn - q > 11 &&
+				strncasecmp(q, "Message-ID:", 11) == 0) {
+		    char *m;
+
+		    for (m = q + 11; m + (ide - id) <= qn; ++m) {
+			if (memcmp(m, id, ide - id) == 0) {
+			    a->a_IdOff = m - next;
+			    break;
+			}
+		    }
+		}
+		q = qn;
+	    }
+	    a->a_Len = q - next;
+	    next = q;
+	    ++n;
+	}
+	p = next;
+    }
+    if (n == 0) {
+	fprintf(stderr, "dtakebench: no TAKETHIS commands in %s\n", path);
+	exit(1);
+    }
+    *pcount = n;
+    return(arts);
+}
+
+/*
+ * Replay() - send every conns'th article, from conn on, as fast as the
+ *	      server takes them and count the responses
+ */
+
+void
+Replay(const char *host, const char *port, Article *arts, int count, int conn, int conns, const char *suffix, Result *res)
+{
+    struct hostent *hp;
+    struct sockaddr_in sin;
+    struct timeval tv;
+    char *out;
+    int outLen = 0;
+    int outMax = 0;
+    int off = 0;
+    char in[8192];
+    int inLen = 0;
+    int want = 0;
+    int sl = strlen(suffix);
+    int fd;
+    int i;
+
+    /*
+     * Build what we send first, so that only the server is measured
+     */
+    for (i = conn; i < count; i += conns)
+	outMax += arts[i].a_Len + strlen(arts[i].a_MsgId) + 2 * sl + 16;
+    out = malloc(outMax);
+    for (i = conn; i < count; i += conns) {
+	Article *a = &arts[i];
+	char *id = a->a_MsgId;
+	int il = strlen(id);
+	int at;
+
+	for (at = il - 1; at > 0 && id[at] != '@'; --at)
+	    ;
+	if (at == 0)
+	    at = il - 1;
+	if (sl == 0 || a->a_IdOff < 0) {
+	    outLen += sprintf(out + outLen, "TAKETHIS %s\r\n", id);
+	    memcpy(out + outLen, a->a_Buf, a->a_Len);
+	    outLen += a->a_Len;
+	} else {
+	    outLen += sprintf(out + outLen, "TAKETHIS %.*s%s%s\r\n",
+						at, id, suffix, id + at);
+	    memcpy(out + outLen, a->a_Buf, a->a_IdOff + at);
+	    outLen += a->a_IdOff + at;
+	    memcpy(out + outLen, suffix, sl);
+	    outLen += sl;
+	    memcpy(out + outLen, a->a_Buf + a->a_IdOff + at,
+						a->a_Len - a->a_IdOff - at);
+	    outLen += a->a_Len - a->a_IdOff - at;
+	}
+	++want;
+    }
+
+    bzero(&sin, sizeof(sin));
+    if ((hp = gethostbyname(host)) == NULL) {
+	fprintf(stderr, "dtakebench: unknown host %s\n", host);
+	res->r_Errors = want;
+	return;
+    }
+    bcopy(hp->h_addr, &sin.sin_addr, hp->h_length);
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(atoi(port));
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+    ) {
+	perror("dtakebench: connect");
+	res->r_Errors = want;
+	return;
+    }
+    if (ReadLine(fd, in, sizeof(in)) < 0 || in[0] != '2') {
+	fprintf(stderr, "dtakebench: greeting: %s\n", in);
+	res->r_Errors = want;
+	return;
+    }
+    write(fd, "MODE STREAM\r\n", 13);
+    if (ReadLine(fd, in, sizeof(in)) < 0 || strncmp(in, "203", 3) != 0) {
+	fprintf(stderr, "dtakebench: mode stream: %s\n", in);
+	res->r_Errors = want;
+	return;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    gettimeofday(&tv, NULL);
+    while (res->r_Accepted + res->r_Rejected + res->r_Errors < want) {
+	fd_set rfds;
+	fd_set wfds;
+	int n;
+
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_SET(fd, &rfds);
+	if (off < outLen)
+	    FD_SET(fd, &wfds);
+	if (select(fd + 1, &rfds, &wfds, NULL, NULL) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	if (FD_ISSET(fd, &wfds)) {
+	    if ((n = write(fd, out + off, outLen - off)) > 0)
+		off += n;
+	}
+	if (FD_ISSET(fd, &rfds)) {
+	    char *p;
+	    char *nl;
+
+	    if ((n = read(fd, in + inLen, sizeof(in) - inLen)) <= 0) {
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		    continue;
+		break;
+	    }
+	    inLen += n;
+	    for (p = in; (nl = memchr(p, '\n', in + inLen - p)) != NULL; p = nl + 1) {
+		if (strncmp(p, "239", 3) == 0)
+		    ++res->r_Accepted;
+		else if (strncmp(p, "439", 3) == 0)
+		    ++res->r_Rejected;
+		else
+		    ++res->r_Errors;
+	    }
+	    inLen -= p - in;
+	    memmove(in, p, inLen);
+	}
+    }
+    res->r_Secs = Elapsed(&tv);
+    res->r_Bytes = off;
+    if (res->r_Accepted + res->r_Rejected + res->r_Errors < want)
+	res->r_Errors = want - res->r_Accepted - res->r_Rejected;
+    fcntl(fd, F_SETFL, 0);
+    write(fd, "QUIT\r\n", 6);
+    close(fd);
+    free(out);
+}
+
+int
+ReadLine(int fd, char *buf, int len)
+{
+    int i = 0;
+
+    while (i < len - 1 && read(fd, buf + i, 1) == 1) {
+	if (buf[i++] == '\n')
+	    break;
+    }
+    buf[i] = 0;
+    return((i && buf[i-1] == '\n') ? i : -1);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
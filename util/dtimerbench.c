@@ -0,0 +1,220 @@
+
+/*
+ * DTIMERBENCH.C - dreaderd timer micro-benchmark
+ *
+ *	Drives the dreaderd timer code (AddTimer(), DelTimer(),
+ *	ScanTimers()) with a large number of timers on fake descriptors
+ *	and reports the cost per operation.  -l runs the same inserts
+ *	through a sorted list, the way dreaderd kept its timers before
+ *	the timing wheel, for comparison.
+ */
+
+#include "dreaderd/defs.h"
+
+#define	COUNT	100000
+#define	RANGE	60000
+
+void Usage(void);
+double Elapsed(struct timeval *tv);
+void Advance(int ms);
+void ListBench(int *ms);
+
+int Count = COUNT;
+int Range = RANGE;
+int CompareList = 0;
+int Verify = 0;
+
+void
+Usage(void)
+{
+    fprintf(stderr, "A dreaderd timer performance tester\n\n");
+    fprintf(stderr, "Usage: dtimerbench [-l] [-n count] [-r ms] [-v]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-l\talso time the inserts on a sorted timer list\n");
+    fprintf(stderr, "\t-n\tnumber of timers (default: %d)\n", COUNT);
+    fprintf(stderr, "\t-r\ttimeouts are spread over 1..ms (default: %d)\n", RANGE);
+    fprintf(stderr, "\t-v\tcheck that every timer fires on time\n");
+    exit(1);
+}
+
+int
+main(int ac, char **av)
+{
+    ForkDesc *descs;
+    int *ms;
+    struct timeval tv;
+    struct timeval start;
+    int passes = 0;
+    int fired = 0;
+    int early = 0;
+    int late = 0;
+    int i;
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr == '-') {
+	    ptr += 2;
+	    switch(ptr[-1]) {
+	    case 'l':
+		CompareList = 1;
+		break;
+	    case 'n':
+		Count = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'r':
+		Range = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+		break;
+	    case 'v':
+		Verify = 1;
+		break;
+	    default:
+		Usage();
+	    }
+	} else {
+	    Usage();
+	}
+    }
+    if (Count <= 0 || Range <= 0)
+	Usage();
+
+    descs = calloc(Count, sizeof(ForkDesc));
+    ms = malloc(Count * sizeof(int));
+    if (descs == NULL || ms == NULL) {
+	fprintf(stderr, "dtimerbench: out of memory\n");
+	exit(1);
+    }
+    srandom(1);
+    for (i = 0; i < Count; ++i) {
+	descs[i].d_Fd = (Verify) ? i : -1;
+	ms[i] = random() % Range + 1;
+    }
+
+    printf("Timers      : %d\n", Count);
+    printf("Range       : 1..%dms\n", Range);
+
+    gettimeofday(&CurTime, NULL);
+    start = CurTime;
+
+    /*
+     * insert, then reschedule every timer (cancel + insert), then
+     * cancel half of them
+     */
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < Count; ++i)
+	AddTimer(&descs[i], ms[i], TIF_READ);
+    printf("Add         : %.1f ns/timer\n", Elapsed(&tv) * 1e9 / Count);
+
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < Count; ++i)
+	AddTimer(&descs[i], ms[i], TIF_READ);
+    printf("Reschedule  : %.1f ns/timer\n", Elapsed(&tv) * 1e9 / Count);
+
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < Count; i += 2)
+	DelTimer(descs[i].d_Timer);
+    printf("Cancel      : %.1f ns/timer\n", Elapsed(&tv) * 2e9 / Count);
+
+    /*
+     * Run the clock forward until every remaining timer has fired,
+     * sleeping (advancing) as long as ScanTimers() asks us to.
+     */
+    gettimeofday(&tv, NULL);
+    for (;;) {
+	int now = (CurTime.tv_sec - start.tv_sec) * 1000 +
+			(CurTime.tv_usec - start.tv_usec) / 1000;
+	int dt = ScanTimers(1, 1000);
+
+	++passes;
+	if (Verify) {
+	    int j;
+
+	    for (j = 0; j < Count; ++j) {
+		if (FDS_ISSET(j, &RFds)) {
+		    FDS_CLR(j, &RFds);
+		    ++fired;
+		    if (now < ms[j])
+			++early;
+		    else if (now > ms[j] + 1)
+			++late;
+		}
+	    }
+	}
+	if (now > Range + 1)
+	    break;
+	Advance((dt > 0) ? dt : 1);
+    }
+    printf("Expire      : %.1f ns/timer (%d passes)\n",
+	Elapsed(&tv) * 2e9 / Count, passes);
+
+    if (Verify) {
+	printf("Fired       : %d of %d, %d early, %d late\n",
+	    fired, Count - Count / 2, early, late);
+    }
+    if (CompareList)
+	ListBench(ms);
+    return(0);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}
+
+void
+Advance(int ms)
+{
+    CurTime.tv_usec += ms * 1000;
+    while (CurTime.tv_usec >= 1000000) {
+	CurTime.tv_usec -= 1000000;
+	++CurTime.tv_sec;
+    }
+}
+
+/*
+ * ListBench() - the sorted insert dreaderd used before the wheel
+ */
+
+void
+ListBench(int *ms)
+{
+    Timer base = { &base, &base };
+    Timer *timers = calloc(Count, sizeof(Timer));
+    struct timeval tv;
+    int i;
+
+    if (timers == NULL) {
+	fprintf(stderr, "dtimerbench: out of memory\n");
+	exit(1);
+    }
+    gettimeofday(&tv, NULL);
+    for (i = 0; i < Count; ++i) {
+	Timer *ti = &timers[i];
+	Timer *scan;
+
+	ti->ti_Tv.tv_sec = CurTime.tv_sec + ms[i] / 1000;
+	ti->ti_Tv.tv_usec = CurTime.tv_usec + ms[i] % 1000 * 1000;
+	if (ti->ti_Tv.tv_usec >= 1000000) {
+	    ti->ti_Tv.tv_usec -= 1000000;
+	    ++ti->ti_Tv.tv_sec;
+	}
+	for (scan = base.ti_Next; scan != &base; scan = scan->ti_Next) {
+	    if (ti->ti_Tv.tv_sec < scan->ti_Tv.tv_sec ||
+		(ti->ti_Tv.tv_sec == scan->ti_Tv.tv_sec &&
+		ti->ti_Tv.tv_usec < scan->ti_Tv.tv_usec)
+	    ) {
+		break;
+	    }
+	}
+	ti->ti_Next = scan;
+	ti->ti_Prev = scan->ti_Prev;
+	ti->ti_Prev->ti_Next = ti;
+	ti->ti_Next->ti_Prev = ti;
+    }
+    printf("List Add    : %.1f ns/timer\n", Elapsed(&tv) * 1e9 / Count);
+    free(timers);
+}
@@ -0,0 +1,433 @@
+/*
+ * DTYPEBENCH.C - article type classifier benchmark
+ *
+ *	Classifies a corpus of articles the way diablo does when feeder
+ *	article types are in use, once passing every line to ArticleType()
+ *	and once passing the headers a line at a time and the body in one
+ *	block to ArticleTypeBody(), both with and without wireformat, and
+ *	checks that the two give the same type for every article.  The
+ *	corpus is read from files holding one article each, or made up
+ *	from plain text, quoted text, uuencode, base64, binhex, yEnc, PGP
+ *	and MIME articles.
+ */
+
+#include "defs.h"
+
+#define	ARTICLES	2000
+#define	LOOPS		20
+
+typedef struct Article {
+    char	*a_Buf;		/* CRLF terminated, dot stuffed	*/
+    int		a_Len;
+} Article;
+
+void Usage(void);
+Article *MakeCorpus(int articles);
+Article *ReadCorpus(char **files, int nfiles);
+void WireArticle(Article *art, const char *text, int len);
+int ClassifyLines(Article *art, char *scratch, int wire);
+int ClassifyBlock(Article *art, char *scratch, int wire);
+double Elapsed(struct timeval *tv);
+
+int
+main(int ac, char **av)
+{
+    Article *corpus;
+    char *scratch;
+    int articles = ARTICLES;
+    int loops = LOOPS;
+    int maxLen = 0;
+    int errs = 0;
+    int wire;
+    int i;
+
+    LoadDiabloConfig(ac, av);
+
+    for (i = 1; i < ac; ++i) {
+	char *ptr = av[i];
+
+	if (*ptr != '-')
+	    break;
+	ptr += 2;
+	switch(ptr[-1]) {
+	case 'C':
+	    if (*ptr == 0)
+		++i;
+	    break;
+	case 'l':
+	    loops = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	case 'n':
+	    articles = strtol(((*ptr) ? ptr : av[++i]), NULL, 0);
+	    break;
+	default:
+	    Usage();
+	}
+    }
+    if (loops <= 0 || articles <= 0)
+	Usage();
+
+    if (i < ac) {
+	articles = ac - i;
+	corpus = ReadCorpus(av + i, articles);
+    } else {
+	corpus = MakeCorpus(articles);
+    }
+    for (i = 0; i < articles; ++i) {
+	if (corpus[i].a_Len > maxLen)
+	    maxLen = corpus[i].a_Len;
+    }
+    scratch = calloc(1, maxLen + 1);
+    printf("Articles    : %d\n", articles);
+
+    for (wire = 0; wire <= 1; ++wire) {
+	int (*classify[2])(Article *, char *, int) = { ClassifyLines, ClassifyBlock };
+	const char *name[2] = { "Lines", "Block" };
+	int *types = malloc(articles * sizeof(int));
+	int counts[2] = { 0, 0 };
+	int m;
+
+	for (m = 0; m < 2; ++m) {
+	    struct timeval tv;
+	    double bytes = 0;
+	    double secs;
+	    int l;
+
+	    gettimeofday(&tv, NULL);
+	    for (l = 0; l < loops; ++l) {
+		for (i = 0; i < articles; ++i) {
+		    int t = classify[m](&corpus[i], scratch, wire);
+
+		    if (l == 0 && m == 0) {
+			types[i] = t;
+		    } else if (l == 0 && t != types[i]) {
+			fprintf(stderr, "dtypebench: article %d is %06x by line, %06x by block (wire %d)\n", i, types[i], t, wire);
+			++errs;
+		    }
+		    if (l == 0 && (t & ARTTYPE_BINARY))
+			++counts[m];
+		    bytes += corpus[i].a_Len;
+		}
+	    }
+	    secs = Elapsed(&tv);
+	    printf("%s %-6s: %d in %.3fs, %.0f/s, %.1f MB/s, %d binaries\n",
+		name[m], (wire ? "wire" : "nowire"), articles * loops, secs,
+		articles * loops / secs, bytes / secs / (1024.0 * 1024.0),
+		counts[m]);
+	}
+	free(types);
+    }
+    if (errs) {
+	fprintf(stderr, "dtypebench: %d articles classified differently\n", errs);
+	exit(1);
+    }
+    return(0);
+}
+
+void
+Usage(void)
+{
+    fprintf(stderr, "An article type classifier performance tester\n\n");
+    fprintf(stderr, "Usage: dtypebench [-l loops] [-n articles] [article files]\n");
+    fprintf(stderr, "  where:\n");
+    fprintf(stderr, "\t-l\tnumber of passes over the corpus (default: %d)\n", LOOPS);
+    fprintf(stderr, "\t-n\tnumber of articles to make up (default: %d)\n", ARTICLES);
+    exit(1);
+}
+
+/*
+ * ClassifyLines() - the diablo LoadArticle() loop, one ArticleType() call
+ *		     per line
+ */
+
+int
+ClassifyLines(Article *art, char *scratch, int wire)
+{
+    char *p = scratch;
+    char *end = scratch + art->a_Len;
+    int arttype = ARTTYPE_DEFAULT;
+    int inHeader = 1;
+
+    memcpy(scratch, art->a_Buf, art->a_Len);
+    InitArticleType();
+    while (p < end) {
+	char *nl = memchr(p, '\n', end - p);
+	char *next = (nl) ? nl + 1 : end;
+	int bytes = next - p;
+	int aflen;
+
+	if (!wire) {
+	    if (bytes > 1 && p[bytes-1] == '\n' && p[bytes-2] == '\r') {
+		p[bytes-2] = '\n';
+		--bytes;
+	    }
+	    aflen = 1;
+	    if (*p == '.') {
+		++p;
+		--bytes;
+	    }
+	} else {
+	    aflen = 2;
+	}
+	arttype = ArticleType(p, bytes - aflen, inHeader);
+	if (inHeader && bytes <= 2 &&
+			(p[0] == '\n' || (p[0] == '\r' && p[1] == '\n'))) {
+	    inHeader = 0;
+	}
+	p = next;
+    }
+    return(arttype);
+}
+
+/*
+ * ClassifyBlock() - headers a line at a time, then the body in one go
+ */
+
+int
+ClassifyBlock(Article *art, char *scratch, int wire)
+{
+    char *p = scratch;
+    char *end = scratch + art->a_Len;
+    int arttype = ARTTYPE_DEFAULT;
+
+    memcpy(scratch, art->a_Buf, art->a_Len);
+    InitArticleType();
+    while (p < end) {
+	char *nl = memchr(p, '\n', end - p);
+	char *next = (nl) ? nl + 1 : end;
+	int bytes = next - p;
+	int aflen;
+
+	if (!wire) {
+	    if (bytes > 1 && p[bytes-1] == '\n' && p[bytes-2] == '\r') {
+		p[bytes-2] = '\n';
+		--bytes;
+	    }
+	    aflen = 1;
+	    if (*p == '.') {
+		++p;
+		--bytes;
+	    }
+	} else {
+	    aflen = 2;
+	}
+	arttype = ArticleType(p, bytes - aflen, 1);
+	if (bytes <= 2 && (p[0] == '\n' || (p[0] == '\r' && p[1] == '\n'))) {
+	    p = next;
+	    break;
+	}
+	p = next;
+    }
+    if (p < end)
+	arttype = ArticleTypeBody(p, end - p, wire);
+    return(arttype);
+}
+
+/*
+ * WireArticle() - store an LF terminated article CRLF terminated and
+ *		   dot stuffed
+ */
+
+void
+WireArticle(Article *art, const char *text, int len)
+{
+    char *d = malloc(len * 2 + 3);
+    int i;
+    int bol = 1;
+
+    art->a_Buf = d;
+    for (i = 0; i < len; ++i) {
+	if (bol && text[i] == '.')
+	    *d++ = '.';
+	bol = 0;
+	if (text[i] == '\r' && i + 1 < len && text[i+1] == '\n')
+	    continue;
+	if (text[i] == '\n') {
+	    *d++ = '\r';
+	    bol = 1;
+	}
+	*d++ = text[i];
+    }
+    if (!bol) {
+	*d++ = '\r';
+	*d++ = '\n';
+    }
+    art->a_Len = d - art->a_Buf;
+}
+
+Article *
+ReadCorpus(char **files, int nfiles)
+{
+    Article *corpus = calloc(nfiles, sizeof(Article));
+    int i;
+
+    for (i = 0; i < nfiles; ++i) {
+	struct stat st;
+	char *text;
+	int fd;
+
+	if ((fd = open(files[i], O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	    perror(files[i]);
+	    exit(1);
+	}
+	text = malloc(st.st_size + 1);
+	if (read(fd, text, st.st_size) != st.st_size) {
+	    perror(files[i]);
+	    exit(1);
+	}
+	close(fd);
+	WireArticle(&corpus[i], text, st.st_size);
+	free(text);
+    }
+    return(corpus);
+}
+
+/*
+ * MakeCorpus() - make up articles.  Most are text, with lines of all
+ *		  lengths, some of them quoted or dot stuffed, and some
+ *		  carry a short run of encoded lines that is not long
+ *		  enough to make a binary.
+ */
+
+static const char *Words[] = {
+    "the", "of", "could", "Content-Type:", "come", "over", "=ybegin",
+    "news", "spool", "(This", "-----BEGIN", "MMMM", "feed", "article",
+    "HAVE", "base64", "x", "all", "BODY", "control"
+};
+#define NWORDS	(sizeof(Words) / sizeof(Words[0]))
+
+static const char B64Chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char BhxChars[] =
+    "!\"#$%&'()*+,-012345689@ABCDEFGHIJKLMNPQRSTUVXYZ[`abcdefhijklmpqr";
+
+static int
+encLines(char *b, int l, const char *prefix, int lines, int kind)
+{
+    while (lines-- > 0) {
+	int n;
+
+	l += sprintf(b + l, "%s", prefix);
+	switch(kind) {
+	case 0:
+	    b[l++] = 'M';
+	    for (n = 0; n < 60; ++n)
+		b[l++] = 32 + random() % 65;
+	    break;
+	case 1:
+	    for (n = 0; n < 76; ++n)
+		b[l++] = B64Chars[random() % 64];
+	    break;
+	case 2:
+	    for (n = 0; n < 64; ++n)
+		b[l++] = BhxChars[random() % 64];
+	    break;
+	default:
+	    for (n = 0; n < 128; ++n) {
+		char c = random() % 256;
+
+		b[l++] = (c == '\n' || c == '\r' || c == 0) ? 'y' : c;
+	    }
+	    break;
+	}
+	b[l++] = '\n';
+    }
+    return(l);
+}
+
+static int
+textLines(char *b, int l, int lines)
+{
+    while (lines-- > 0) {
+	int want = random() % 90;
+	int start = l;
+
+	if (random() % 8 == 0)
+	    l += sprintf(b + l, "> ");
+	if (random() % 40 == 0)
+	    b[l++] = '.';
+	while (l - start < want) {
+	    l += sprintf(b + l, "%s%s", ((l == start) ? "" : " "),
+						Words[random() % NWORDS]);
+	}
+	b[l++] = '\n';
+    }
+    return(l);
+}
+
+Article *
+MakeCorpus(int articles)
+{
+    Article *corpus = calloc(articles, sizeof(Article));
+    char *b = malloc(1024 * 1024);
+    int i;
+
+    srandom(1);
+    for (i = 0; i < articles; ++i) {
+	int kind = random() % 16;
+	int l = 0;
+
+	l += sprintf(b + l, "Path: news.example.com!not-for-mail\n");
+	l += sprintf(b + l, "From: poster%d@example.com\n", i);
+	l += sprintf(b + l, "Newsgroups: alt.test\n");
+	l += sprintf(b + l, "Message-ID: <%d@dtypebench>\n", i);
+	if (kind == 9)
+	    l += sprintf(b + l, "Control: cancel <%d@dtypebench>\n", i - 1);
+	if (kind >= 10 && kind <= 12) {
+	    l += sprintf(b + l, "Mime-Version: 1.0\n");
+	    l += sprintf(b + l, "Content-Type: %s\n", (kind == 10) ?
+		"text/html" : (kind == 11) ?
+		"multipart/mixed; boundary=\"xx\"" : "message/partial");
+	}
+	l += sprintf(b + l, "Subject: article %d\n\n", i);
+	l = textLines(b, l, 5 + random() % 40);
+
+	switch(kind) {
+	case 1:
+	case 2:
+	    l += sprintf(b + l, "begin 644 file%d.bin\n", i);
+	    l = encLines(b, l, ((kind == 2) ? "> " : ""), 10 + random() % 2000, 0);
+	    l += sprintf(b + l, "`\nend\n");
+	    break;
+	case 3:
+	    l = encLines(b, l, "", 10 + random() % 2000, 1);
+	    break;
+	case 4:
+	    l += sprintf(b + l, "(This file must be converted with BinHex 4.0)\n:");
+	    l = encLines(b, l, "", 10 + random() % 2000, 2);
+	    break;
+	case 5:
+	    l += sprintf(b + l, "=ybegin line=128 size=100000 name=f%d.bin\n", i);
+	    l = encLines(b, l, "", 10 + random() % 2000, 3);
+	    l += sprintf(b + l, "=yend size=100000\n");
+	    break;
+	case 6:
+	    l += sprintf(b + l, "-----BEGIN PGP MESSAGE-----\n");
+	    l = encLines(b, l, "", 8, 1);
+	    l += sprintf(b + l, "-----END PGP MESSAGE-----\n");
+	    break;
+	case 7:
+	    l = encLines(b, l, "", 1 + random() % 8, random() % 3);
+	    break;
+	case 11:
+	    l += sprintf(b + l, "--xx\nContent-Type: image/jpeg\n"
+			"Content-Transfer-Encoding: base64\n\n");
+	    l = encLines(b, l, "", 10 + random() % 2000, 1);
+	    l += sprintf(b + l, "--xx--\n");
+	    break;
+	}
+	l = textLines(b, l, random() % 20);
+	WireArticle(&corpus[i], b, l);
+    }
+    free(b);
+    return(corpus);
+}
+
+double
+Elapsed(struct timeval *tv)
+{
+    struct timeval t2;
+
+    gettimeofday(&t2, NULL);
+    return((t2.tv_sec - tv->tv_sec) + (t2.tv_usec - tv->tv_usec) / 1e6);
+}